@@ -35,7 +35,9 @@
   <modulefile>mod_buffer.xml</modulefile>
   <modulefile>mod_cache.xml</modulefile>
   <modulefile>mod_cache_disk.xml</modulefile>
+  <modulefile>mod_cache_slab.xml</modulefile>
   <modulefile>mod_cache_socache.xml</modulefile>
+  <modulefile>mod_cache_tiered.xml</modulefile>
   <modulefile>mod_cern_meta.xml</modulefile>
   <modulefile>mod_cgi.xml</modulefile>
   <modulefile>mod_cgid.xml</modulefile>
@@ -50,6 +52,7 @@
   <modulefile>mod_dialup.xml</modulefile>
   <modulefile>mod_dir.xml</modulefile>
   <modulefile>mod_dumpio.xml</modulefile>
+  <modulefile>mod_early_hints.xml</modulefile>
   <modulefile>mod_echo.xml</modulefile>
   <modulefile>mod_env.xml</modulefile>
   <modulefile>mod_example_hooks.xml</modulefile>
@@ -69,6 +72,8 @@
   <modulefile>mod_isapi.xml</modulefile>
   <modulefile>mod_journald.xml</modulefile>
   <modulefile>mod_lbmethod_bybusyness.xml</modulefile>
+  <modulefile>mod_lbmethod_byhash.xml</modulefile>
+  <modulefile>mod_lbmethod_bylatency.xml</modulefile>
   <modulefile>mod_lbmethod_byrequests.xml</modulefile>
   <modulefile>mod_lbmethod_bytraffic.xml</modulefile>
   <modulefile>mod_lbmethod_heartbeat.xml</modulefile>
@@ -89,6 +94,7 @@
   <modulefile>mod_proxy.xml</modulefile>
   <modulefile>mod_proxy_ajp.xml</modulefile>
   <modulefile>mod_proxy_balancer.xml</modulefile>
+  <modulefile>mod_proxy_broker.xml</modulefile>
   <modulefile>mod_proxy_connect.xml</modulefile>
   <modulefile>mod_proxy_express.xml</modulefile>
   <modulefile>mod_proxy_fcgi.xml</modulefile>
@@ -723,6 +723,24 @@
  * 20211221.17 (2.5.1-dev) Add ap_proxy_worker_get_name()
  * 20211221.18 (2.5.1-dev) Add ap_regexec_ex()
  * 20211221.19 (2.5.1-dev) Add AP_REG_NOTEMPTY_ATSTART
+ * 20211221.20 (2.5.1-dev) Add connects, reused and brokered to
+ *                         proxy_worker_shared, and optional hooks
+ *                         proxy_fetch_connection and proxy_park_connection
+ * 20211221.21 (2.5.1-dev) Add latency and latency_updated to
+ *                         proxy_worker_shared
+ * 20211221.22 (2.5.1-dev) Add ap_proxy_refresh_worker_address()
+ * 20211221.23 (2.5.1-dev) Add ap_proxy_can_splice_input() and
+ *                         ap_proxy_splice_input()
+ * 20211221.24 (2.5.1-dev) Add ofails and ocount to proxy_worker_shared
+ * 20211221.25 (2.5.1-dev) Add response_buffer, response_buffer_mem and
+ *                         response_buffer_set to proxy_dir_conf
+ * 20211221.26 (2.5.1-dev) Add FastCGI end request protocol status and
+ *                         GET_VALUES names to util_fcgi.h
+ * 20211221.27 (2.5.1-dev) Add lockless to proxy_balancer_method,
+ *                         ap_proxy_add_lbstatus() and
+ *                         ap_proxy_increment_elected_count()
+ * 20211221.28 (2.5.1-dev) Add ap_proxy_suspend_post_request() and
+ *                         ap_proxy_resume_post_request()
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -730,7 +748,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20211221
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 19             /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 28             /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
@@ -143,6 +143,28 @@ typedef struct {
 #define AP_FCGI_BRB_RESERVED3_OFFSET    6
 #define AP_FCGI_BRB_RESERVED4_OFFSET    7
 
+/*
+ * Values for protocolStatus component of the body of an
+ * AP_FCGI_END_REQUEST record
+ */
+#define AP_FCGI_REQUEST_COMPLETE  0
+#define AP_FCGI_CANT_MPX_CONN     1
+#define AP_FCGI_OVERLOADED        2
+#define AP_FCGI_UNKNOWN_ROLE      3
+
+/**
+ * Offsets of the fields of the body of an AP_FCGI_END_REQUEST record
+ */
+#define AP_FCGI_ERB_APP_STATUS_OFFSET       0
+#define AP_FCGI_ERB_PROTOCOL_STATUS_OFFSET  4
+
+/**
+ * Names of the variables queried by an AP_FCGI_GET_VALUES record
+ */
+#define AP_FCGI_MAX_CONNS_STR   "FCGI_MAX_CONNS"
+#define AP_FCGI_MAX_REQS_STR    "FCGI_MAX_REQS"
+#define AP_FCGI_MPXS_CONNS_STR  "FCGI_MPXS_CONNS"
+
 /**
  * Pack ap_fcgi_header
  * @param h The header to read from
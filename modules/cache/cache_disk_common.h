@@ -33,6 +33,8 @@
 #define CACHE_DATA_SUFFIX   ".data"
 #define CACHE_VDIR_SUFFIX   ".vary"
 
+#define CACHE_JOURNAL_FILE  "cache.journal"
+
 #define AP_TEMPFILE_PREFIX "/"
 #define AP_TEMPFILE_BASE   "aptmp"
 #define AP_TEMPFILE_SUFFIX "XXXXXX"
@@ -64,5 +66,32 @@ typedef struct {
     cache_control_t control;
 } disk_cache_info_t;
 
+#define JOURNAL_FORMAT_VERSION 1
+
+#define JOURNAL_STORE  1
+#define JOURNAL_REMOVE 2
+
+/*
+ * A record appended to CACHE_JOURNAL_FILE by mod_cache_disk, so that
+ * htcacheclean can maintain its index without walking the cache.
+ */
+typedef struct {
+    /* Indicates the format of the record. */
+    apr_uint32_t format;
+    /* JOURNAL_STORE or JOURNAL_REMOVE */
+    apr_uint32_t type;
+    /* When the entity was stored or removed */
+    apr_time_t time;
+    /* The expiry and response times of a stored entity */
+    apr_time_t expire;
+    apr_time_t response_time;
+    /* The sizes of the headers and data files of a stored entity */
+    apr_off_t hsize;
+    apr_off_t dsize;
+    /* The size of the name that follows: the file set relative to the
+     * cache root, without suffix */
+    apr_size_t name_len;
+} disk_cache_journal_t;
+
 #endif /* CACHE_DIST_COMMON_H */
 /** @} */
@@ -216,6 +216,7 @@ int cache_select(cache_request_rec *cache, request_rec *r)
     cache_provider_list *list;
     apr_status_t rv;
     cache_handle_t *h;
+    cache_server_conf *conf;
 
     if (!cache) {
         /* This should never happen */
@@ -225,6 +226,15 @@ int cache_select(cache_request_rec *cache, request_rec *r)
         return DECLINED;
     }
 
+    /* canonicalize the request headers the variants are keyed by, before
+     * the lookup and before the request goes to the backend on a miss.
+     */
+    conf = (cache_server_conf *) ap_get_module_config(r->server->module_config,
+                                                      &cache_module);
+    if (conf->vary_normalize->nelts) {
+        cache_vary_normalize(conf, r);
+    }
+
     /* if no-cache, we can't serve from the cache, but we may store to the
      * cache.
      */
@@ -257,6 +257,44 @@ CACHE_DECLARE(apr_int64_t) ap_cache_current_age(cache_info *info,
     return apr_time_sec(current_age);
 }
 
+/**
+ * Is this the background revalidation of a stale entity served by the
+ * main request? If so the main request holds the lock for us.
+ */
+static int cache_is_revalidation(request_rec *r)
+{
+    void *dummy = NULL;
+
+    if (r->main) {
+        apr_pool_userdata_get(&dummy, CACHE_REVALIDATE_KEY, r->main->pool);
+    }
+    return dummy != NULL;
+}
+
+/**
+ * Extract the stale-while-revalidate of a cached response (RFC5861),
+ * or -1 if absent.
+ */
+static apr_int64_t cache_stale_while_revalidate(request_rec *r,
+        apr_table_t *headers)
+{
+    const char *cc = cache_table_getm(r->pool, headers, "Cache-Control");
+    const char *token;
+    apr_off_t offt;
+    char *endp;
+
+    while (cc) {
+        token = ap_cache_tokstr(r->pool, cc, &cc);
+        if (!ap_cstr_casecmpn(token, "stale-while-revalidate=", 23)
+                && !apr_strtoff(&offt, token + 23, &endp, 10)
+                && endp > token + 23 && !*endp && offt >= 0) {
+            return offt;
+        }
+    }
+
+    return -1;
+}
+
 /**
  * Try obtain a cache wide lock on the given cache key.
  *
@@ -299,7 +337,7 @@ apr_status_t cache_try_lock(cache_server_conf *conf, cache_request_rec *cache,
 
     /* lock already obtained earlier? if so, success */
     apr_pool_userdata_get(&dummy, CACHE_LOCKFILE_KEY, r->pool);
-    if (dummy) {
+    if (dummy || cache_is_revalidation(r)) {
         return APR_SUCCESS;
     }
 
@@ -449,6 +487,73 @@ apr_status_t cache_remove_lock(cache_server_conf *conf,
     return apr_file_remove(lockname, r->pool);
 }
 
+/**
+ * Wait for the cache lock held by another request to be released.
+ *
+ * The lock is polled with an increasing interval, a stat() being cheap
+ * compared to the backend request we save. A lock older than its
+ * max-age ends the wait, the next cache_try_lock() removing it.
+ */
+apr_status_t cache_wait_lock(cache_server_conf *conf,
+        cache_request_rec *cache, request_rec *r)
+{
+    apr_status_t status;
+    apr_interval_time_t step = apr_time_from_msec(1);
+    apr_time_t start, now, deadline;
+    apr_finfo_t finfo;
+    const char *lockname;
+    void *dummy;
+
+    if (!conf || !conf->lock || !conf->lockpath || !conf->lockwait
+            || cache->stale_handle) {
+        /* no waiting configured, or stale content to serve, leave */
+        return APR_NOTFOUND;
+    }
+
+    status = cache_try_lock(conf, cache, r);
+    if (APR_SUCCESS == status) {
+        /* we are the first */
+        return APR_NOTFOUND;
+    }
+    if (!APR_STATUS_IS_EEXIST(status)) {
+        return status;
+    }
+
+    apr_pool_userdata_get(&dummy, CACHE_LOCKNAME_KEY, r->pool);
+    lockname = (const char *)dummy;
+
+    now = start = apr_time_now();
+    deadline = start + conf->lockwait;
+    for (;;) {
+        status = apr_stat(&finfo, lockname, APR_FINFO_MTIME, r->pool);
+        if (APR_STATUS_IS_ENOENT(status)) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10584)
+                    "Cache lock released after %" APR_TIME_T_FMT "ms, "
+                    "looking up the cache again: %s",
+                    apr_time_as_msec(apr_time_now() - start), r->uri);
+            return APR_SUCCESS;
+        }
+        if (APR_SUCCESS != status) {
+            return status;
+        }
+        if ((now - finfo.mtime) > conf->lockmaxage || now < finfo.mtime) {
+            return APR_SUCCESS;
+        }
+        if (now >= deadline) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10585)
+                    "Timed out waiting for the cache lock, not caching "
+                    "response: %s", r->uri);
+            return APR_TIMEUP;
+        }
+
+        apr_sleep(step < deadline - now ? step : deadline - now);
+        if (step < apr_time_from_msec(100)) {
+            step *= 2;
+        }
+        now = apr_time_now();
+    }
+}
+
 int ap_cache_check_no_cache(cache_request_rec *cache, request_rec *r)
 {
 
@@ -547,6 +652,9 @@ int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
     cache_server_conf *conf =
       (cache_server_conf *)ap_get_module_config(r->server->module_config,
                                                 &cache_module);
+    cache_dir_conf *dconf =
+      (cache_dir_conf *)ap_get_module_config(r->per_dir_config,
+                                             &cache_module);
 
     /*
      * We now want to check if our cached data is still fresh. This depends
@@ -740,6 +848,60 @@ int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
         return 1;    /* Cache object is fresh (enough) */
     }
 
+    /*
+     * RFC5861 stale-while-revalidate: within this window past its freshness
+     * lifetime, the stale object is served as if fresh, and the request
+     * obtaining the lock revalidates it in the background once its own
+     * response is sent. Nobody waits for the backend.
+     */
+    if (dconf->stale_while_revalidate >= 0 && maxage_req == -1
+            && !cache_is_revalidation(r)
+            && !h->cache_obj->info.control.must_revalidate
+            && !h->cache_obj->info.control.proxy_revalidate
+            && smaxage == -1) {
+        apr_int64_t swr = cache_stale_while_revalidate(r, h->resp_hdrs);
+        apr_int64_t lifetime = -1;
+
+        if (swr == -1) {
+            swr = dconf->stale_while_revalidate;
+        }
+        if (maxage_cresp != -1) {
+            lifetime = maxage_cresp;
+        }
+        else if (info->expire != APR_DATE_BAD) {
+            lifetime = apr_time_sec(info->expire - info->date);
+        }
+
+        if (swr > 0 && lifetime != -1 && age < lifetime + swr) {
+            void *lockfile = NULL;
+
+            /* Without a lock file (CacheLock off) nothing would revalidate
+             * the entity in the background, revalidate it now then.
+             */
+            status = cache_try_lock(conf, cache, r);
+            if (APR_SUCCESS == status) {
+                apr_pool_userdata_get(&lockfile, CACHE_LOCKFILE_KEY, r->pool);
+            }
+            if (lockfile || APR_STATUS_IS_EEXIST(status)) {
+                cache->revalidate = (lockfile != NULL);
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, status, r,
+                        APLOGNO(10586) "Cached URL within its "
+                        "stale-while-revalidate, serving it%s: %s",
+                        cache->revalidate ? " and revalidating it" : "",
+                        r->unparsed_uri);
+
+                warn_head = apr_table_get(h->resp_hdrs, "Warning");
+                if ((warn_head == NULL) ||
+                        (ap_strstr_c(warn_head, "110") == NULL)) {
+                    apr_table_mergen(h->resp_hdrs, "Warning",
+                                     "110 Response is stale");
+                }
+
+                return 1;
+            }
+        }
+    }
+
     /*
      * At this point we are stale, but: if we are under load, we may let
      * a significant number of stale requests through before the first
@@ -1286,6 +1448,114 @@ CACHE_DECLARE(apr_table_t *)ap_cache_cacheable_headers_out(request_rec *r)
     return headers_out;
 }
 
+/*
+ * Return the names of the request headers canonicalized with
+ * CacheVaryNormalize if they cover those of varray.
+ */
+CACHE_DECLARE(apr_array_header_t *)ap_cache_vary_normalized(request_rec *r,
+        apr_array_header_t *varray)
+{
+    cache_server_conf *conf;
+    const char **names, **vary;
+    int i, j;
+
+    conf = (cache_server_conf *)ap_get_module_config(r->server->module_config,
+                                                     &cache_module);
+    if (!conf->vary_headers->nelts || (!varray && !conf->vary_probe)) {
+        return NULL;
+    }
+    if (varray) {
+        names = (const char **)conf->vary_headers->elts;
+        vary = (const char **)varray->elts;
+        for (i = 0; i < varray->nelts; i++) {
+            for (j = 0; j < conf->vary_headers->nelts; j++) {
+                if (!strcasecmp(vary[i], names[j])) {
+                    break;
+                }
+            }
+            if (j == conf->vary_headers->nelts) {
+                return NULL;
+            }
+        }
+    }
+
+    return conf->vary_headers;
+}
+
+/*
+ * Whether the list of a request header (Accept-Encoding, Accept-Language,
+ * ...) accepts the token, explicitly or through "*", with a q-value above
+ * zero.
+ */
+static int cache_vary_accepts(apr_pool_t *p, const char *list,
+                              const char *token)
+{
+    char *item;
+    int star = 0;
+
+    while ((item = ap_get_list_item(p, &list)) != NULL) {
+        char *param = strchr(item, ';');
+        int accepted = 1;
+
+        if (param) {
+            char *end = param;
+
+            while (end > item && apr_isspace(end[-1])) {
+                --end;
+            }
+            *end = '\0';
+            while (param) {
+                ++param;
+                while (apr_isspace(*param)) {
+                    ++param;
+                }
+                if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    accepted = atof(param + 2) > 0;
+                }
+                param = strchr(param, ';');
+            }
+        }
+
+        if (!strcasecmp(item, token)) {
+            return accepted;
+        }
+        if (!strcmp(item, "*")) {
+            star = accepted;
+        }
+    }
+
+    return star;
+}
+
+void cache_vary_normalize(cache_server_conf *conf, request_rec *r)
+{
+    const struct cache_vary_normalize *norm;
+    int i, j;
+
+    norm = (const struct cache_vary_normalize *)conf->vary_normalize->elts;
+    for (i = 0; i < conf->vary_normalize->nelts; i++) {
+        const char **tokens = (const char **)norm[i].tokens->elts;
+        const char *value, *bucket;
+
+        value = cache_table_getm(r->pool, r->headers_in, norm[i].header);
+
+        /* the last token is the default bucket */
+        bucket = tokens[norm[i].tokens->nelts - 1];
+        if (value) {
+            for (j = 0; j < norm[i].tokens->nelts - 1; j++) {
+                if (cache_vary_accepts(r->pool, value, tokens[j])) {
+                    bucket = tokens[j];
+                    break;
+                }
+            }
+        }
+
+        if (!value || strcmp(value, bucket)) {
+            apr_table_setn(r->headers_in, norm[i].header, bucket);
+        }
+    }
+}
+
 apr_table_t *cache_merge_headers_out(request_rec *r)
 {
     apr_table_t *headers_out;
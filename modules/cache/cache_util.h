@@ -92,13 +92,16 @@ extern "C" {
 #define DEFAULT_CACHE_EXPIRE    MSEC_ONE_HR
 #define DEFAULT_CACHE_LMFACTOR  (0.1)
 #define DEFAULT_CACHE_MAXAGE    5
+#define DEFAULT_CACHE_LOCKWAIT  0
 #define DEFAULT_X_CACHE         0
 #define DEFAULT_X_CACHE_DETAIL  0
 #define DEFAULT_CACHE_STALE_ON_ERROR 1
+#define DEFAULT_CACHE_STALE_WHILE_REVALIDATE -1
 #define DEFAULT_CACHE_LOCKPATH "mod_cache-lock"
 #define CACHE_LOCKNAME_KEY "mod_cache-lockname"
 #define CACHE_LOCKFILE_KEY "mod_cache-lockfile"
 #define CACHE_CTX_KEY "mod_cache-ctx"
+#define CACHE_REVALIDATE_KEY "mod_cache-revalidate"
 
 /**
  * cache_util.c
@@ -115,6 +118,11 @@ struct cache_disable {
     apr_size_t pathlen;
 };
 
+struct cache_vary_normalize {
+    const char *header;
+    apr_array_header_t *tokens;
+};
+
 /* static information about the local cache */
 typedef struct {
     apr_array_header_t *cacheenable;    /* URLs to cache */
@@ -123,8 +131,13 @@ typedef struct {
     apr_array_header_t *ignore_headers;
     /** store the identifiers that should not be used for key calculation */
     apr_array_header_t *ignore_session_id;
+    /** request headers canonicalized before the lookup, and their names */
+    apr_array_header_t *vary_normalize;
+    apr_array_header_t *vary_headers;
     const char *lockpath;
     apr_time_t lockmaxage;
+    /** how long a request waits for the one holding the lock */
+    apr_interval_time_t lockwait;
     apr_uri_t *base_uri;
     /** ignore client's requests for uncached responses */
     unsigned int ignorecachecontrol:1;
@@ -136,6 +149,8 @@ typedef struct {
     unsigned int lock:1;
     unsigned int x_cache:1;
     unsigned int x_cache_detail:1;
+    /** look up the normalized variant directly, before the Vary */
+    unsigned int vary_probe:1;
     /* flag if CacheIgnoreHeader has been set */
     #define CACHE_IGNORE_HEADERS_SET   1
     #define CACHE_IGNORE_HEADERS_UNSET 0
@@ -144,6 +159,8 @@ typedef struct {
     #define CACHE_IGNORE_SESSION_ID_SET   1
     #define CACHE_IGNORE_SESSION_ID_UNSET 0
     unsigned int ignore_session_id_set:1;
+    unsigned int vary_normalize_set:1;
+    unsigned int vary_probe_set:1;
     unsigned int base_uri_set:1;
     unsigned int ignorecachecontrol_set:1;
     unsigned int ignorequerystring_set:1;
@@ -151,6 +168,7 @@ typedef struct {
     unsigned int lock_set:1;
     unsigned int lockpath_set:1;
     unsigned int lockmaxage_set:1;
+    unsigned int lockwait_set:1;
     unsigned int x_cache_set:1;
     unsigned int x_cache_detail_set:1;
 } cache_server_conf;
@@ -164,6 +182,8 @@ typedef struct {
     apr_time_t defex;
     /* factor for estimating expires date */
     double factor;
+    /* default stale-while-revalidate in secs, -1 when disabled */
+    apr_int64_t stale_while_revalidate;
     /* cache enabled for this location */
     apr_array_header_t *cacheenable;
     /* cache disabled for this location */
@@ -188,6 +208,7 @@ typedef struct {
     unsigned int x_cache_set:1;
     unsigned int x_cache_detail_set:1;
     unsigned int stale_on_error_set:1;
+    unsigned int stale_while_revalidate_set:1;
     unsigned int no_last_mod_ignore_set:1;
     unsigned int store_expired_set:1;
     unsigned int store_private_set:1;
@@ -216,6 +237,7 @@ typedef struct {
     apr_table_t *stale_headers;         /* original request headers. */
     int in_checked;                     /* CACHE_SAVE must cache the entity */
     int block_response;                 /* CACHE_SAVE must block response. */
+    int revalidate;                     /* revalidate after serving stale */
     apr_bucket_brigade *saved_brigade;  /* copy of partial response */
     apr_off_t saved_size;               /* length of saved_brigade */
     apr_time_t exp;                     /* expiration */
@@ -255,6 +277,10 @@ int ap_cache_check_no_store(cache_request_rec *cache, request_rec *r);
  * @param cache cache_request_rec
  * @param r request_rec
  * @return 0 ==> cache object is stale, 1 ==> cache object is fresh
+ *
+ * A stale object within its stale-while-revalidate window (RFC5861) is
+ * served as fresh, cache->revalidate being set when this request must
+ * revalidate it once its response is sent.
  */
 int cache_check_freshness(cache_handle_t *h, cache_request_rec *cache,
         request_rec *r);
@@ -298,6 +324,24 @@ apr_status_t cache_try_lock(cache_server_conf *conf, cache_request_rec *cache,
 apr_status_t cache_remove_lock(cache_server_conf *conf,
         cache_request_rec *cache, request_rec *r, apr_bucket_brigade *bb);
 
+/**
+ * Wait for the cache lock held by another request to be released.
+ *
+ * When a request misses the cache while another one is already
+ * fetching the same URL, rather than going to the backend too, it waits
+ * up to CacheLockWait for the lock to be removed, which happens once the
+ * response in flight has been cached (or found not cacheable). The lock
+ * files being shared, this works across the children.
+ *
+ * If we return APR_SUCCESS, the lock was released and the cache must be
+ * looked up again. If nobody held the lock, we now hold it and return
+ * APR_NOTFOUND. APR_TIMEUP is returned when the wait timed out, and
+ * anything else when the lock could not be checked; in these cases the
+ * request proceeds to the backend as usual.
+ */
+apr_status_t cache_wait_lock(cache_server_conf *conf,
+        cache_request_rec *cache, request_rec *r);
+
 cache_provider_list *cache_get_providers(request_rec *r,
                                          cache_server_conf *conf);
 
@@ -320,6 +364,14 @@ const char *cache_table_getm(apr_pool_t *p, const apr_table_t *t,
  */
 apr_status_t cache_strqtok(char *str, char **token, char **arg, char **last);
 
+/**
+ * Rewrite the request headers listed with CacheVaryNormalize to the first
+ * of their tokens acceptable to the client, or to the last one when none
+ * is, so that the variants of a response are keyed by a few buckets
+ * rather than by every value seen in the wild.
+ */
+void cache_vary_normalize(cache_server_conf *conf, request_rec *r);
+
 /**
  * Merge err_headers_out into headers_out and add request's Content-Type and
  * Content-Encoding if available.
@@ -13,20 +13,26 @@ cache_storage.lo dnl
 cache_util.lo dnl
 "
 cache_disk_objs="mod_cache_disk.lo"
+cache_slab_objs="mod_cache_slab.lo"
 cache_socache_objs="mod_cache_socache.lo"
+cache_tiered_objs="mod_cache_tiered.lo"
 
 case "$host" in
   *os2*)
     # OS/2 DLLs must resolve all symbols at build time
     # and we need some from main cache module
     cache_disk_objs="$cache_disk_objs mod_cache.la"
+    cache_slab_objs="$cache_slab_objs mod_cache.la"
     cache_socache_objs="$cache_socache_objs mod_cache.la"
+    cache_tiered_objs="$cache_tiered_objs mod_cache.la"
     ;;
 esac
 
 APACHE_MODULE(cache, dynamic file caching.  At least one storage management module (e.g. mod_cache_disk) is also necessary., $cache_objs, , most)
 APACHE_MODULE(cache_disk, disk caching module, $cache_disk_objs, , most, , cache)
+APACHE_MODULE(cache_slab, single file disk caching module, $cache_slab_objs, , most, , cache)
 APACHE_MODULE(cache_socache, shared object caching module, $cache_socache_objs, , most)
+APACHE_MODULE(cache_tiered, memory over disk tiered caching module, $cache_tiered_objs, , most, , cache)
 
 dnl
 dnl APACHE_CHECK_DISTCACHE
@@ -35,6 +35,7 @@ static ap_filter_rec_t *cache_out_filter_handle;
 static ap_filter_rec_t *cache_out_subreq_filter_handle;
 static ap_filter_rec_t *cache_remove_url_filter_handle;
 static ap_filter_rec_t *cache_invalidate_filter_handle;
+static ap_filter_rec_t *cache_discard_filter_handle;
 
 /**
  * Entity headers' names
@@ -80,14 +81,89 @@ static const char *MOD_CACHE_ENTITY_HEADERS[] = {
  * caching goals where the admin understands what they are doing.
  */
 
+/*
+ * Revalidate the stale entity just served within its stale-while-revalidate
+ * window (RFC5861). The response has been flushed to the client, so the
+ * conditional request is made by a GET subrequest following the stale path
+ * of the cache, its response being stored and discarded. It inherits the
+ * lock obtained by this request.
+ */
+static void cache_revalidate(cache_request_rec *cache, request_rec *r)
+{
+    request_rec *rr;
+    void *lockfile;
+
+    /* only our own URL space can be looked up again */
+    if (r->unparsed_uri[0] != '/') {
+        return;
+    }
+
+    apr_pool_userdata_setn(cache, CACHE_REVALIDATE_KEY, NULL, r->pool);
+
+    rr = ap_sub_req_method_uri("GET", r->unparsed_uri, r, NULL);
+    if (rr->status == HTTP_OK) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10587)
+                "cache: revalidating stale %s in the background", r->uri);
+
+        apr_pool_userdata_get(&lockfile, CACHE_LOCKFILE_KEY, r->pool);
+        if (lockfile) {
+            apr_pool_userdata_setn(lockfile, CACHE_LOCKFILE_KEY, NULL,
+                                   rr->pool);
+        }
+        /* The full entity is to be stored, whatever the client asked for;
+         * the cache adds its own conditionals for the stale entity.
+         */
+        apr_table_unset(rr->headers_in, "Range");
+        apr_table_unset(rr->headers_in, "If-Range");
+        apr_table_unset(rr->headers_in, "If-Match");
+        apr_table_unset(rr->headers_in, "If-None-Match");
+        apr_table_unset(rr->headers_in, "If-Modified-Since");
+        apr_table_unset(rr->headers_in, "If-Unmodified-Since");
+
+        ap_add_output_filter_handle(cache_discard_filter_handle, NULL, rr,
+                                    rr->connection);
+        ap_run_sub_req(rr);
+    }
+    ap_destroy_sub_req(rr);
+
+    apr_pool_userdata_setn(NULL, CACHE_REVALIDATE_KEY, NULL, r->pool);
+}
+
+/*
+ * Kick off the filter stack with an EOS, the response being flushed first
+ * when a background revalidation follows.
+ */
+static int cache_serve(cache_request_rec *cache, request_rec *r)
+{
+    apr_bucket_brigade *out;
+    apr_bucket *e;
+    int rv;
+
+    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    if (cache->revalidate) {
+        e = apr_bucket_flush_create(out->bucket_alloc);
+        APR_BRIGADE_INSERT_TAIL(out, e);
+    }
+    e = apr_bucket_eos_create(out->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(out, e);
+
+    rv = ap_pass_brigade_fchk(r, out, "cache(%s): ap_pass_brigade returned",
+                              cache->provider_name);
+
+    if (cache->revalidate && rv == OK && !r->connection->aborted) {
+        cache_revalidate(cache, r);
+    }
+
+    return rv;
+}
+
 static int cache_quick_handler(request_rec *r, int lookup)
 {
     apr_status_t rv;
+    int waited = 0;
     const char *auth;
     cache_provider_list *providers;
     cache_request_rec *cache;
-    apr_bucket_brigade *out;
-    apr_bucket *e;
     ap_filter_t *next;
     ap_filter_rec_t *cache_out_handle;
     cache_server_conf *conf;
@@ -177,6 +253,12 @@ static int cache_quick_handler(request_rec *r, int lookup)
      *   return OK
      */
     rv = cache_select(cache, r);
+    if (rv == DECLINED && !lookup
+            && cache_wait_lock(conf, cache, r) == APR_SUCCESS) {
+        /* the request in flight is done, its response may be cached now */
+        waited = 1;
+        rv = cache_select(cache, r);
+    }
     if (rv != OK) {
         if (rv == DECLINED) {
             if (!lookup) {
@@ -187,8 +269,10 @@ static int cache_quick_handler(request_rec *r, int lookup)
                  * url, and we should just let the request through to the
                  * backend without any attempt to cache. this stops
                  * duplicated simultaneous attempts to cache an entity.
+                 * if we waited for a request which did not cache it, we go
+                 * along with the other waiters rather than after them.
                  */
-                rv = cache_try_lock(conf, cache, r);
+                rv = waited ? APR_EEXIST : cache_try_lock(conf, cache, r);
                 if (APR_SUCCESS == rv) {
 
                     /*
@@ -329,13 +413,7 @@ static int cache_quick_handler(request_rec *r, int lookup)
     }
 
     /* kick off the filter stack */
-    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    e = apr_bucket_eos_create(out->bucket_alloc);
-    APR_BRIGADE_INSERT_TAIL(out, e);
-
-    return ap_pass_brigade_fchk(r, out,
-                                "cache_quick_handler(%s): ap_pass_brigade returned",
-                                cache->provider_name);
+    return cache_serve(cache, r);
 }
 
 /**
@@ -393,10 +471,9 @@ static ap_filter_t *cache_get_filter(ap_filter_t *next, ap_filter_rec_t *rec) {
 static int cache_handler(request_rec *r)
 {
     apr_status_t rv;
+    int waited = 0;
     cache_provider_list *providers;
     cache_request_rec *cache;
-    apr_bucket_brigade *out;
-    apr_bucket *e;
     ap_filter_t *next;
     ap_filter_rec_t *cache_out_handle;
     ap_filter_rec_t *cache_save_handle;
@@ -477,6 +554,11 @@ static int cache_handler(request_rec *r)
      *   return OK
      */
     rv = cache_select(cache, r);
+    if (rv == DECLINED && cache_wait_lock(conf, cache, r) == APR_SUCCESS) {
+        /* the request in flight is done, its response may be cached now */
+        waited = 1;
+        rv = cache_select(cache, r);
+    }
     if (rv != OK) {
         if (rv == DECLINED) {
 
@@ -486,8 +568,10 @@ static int cache_handler(request_rec *r)
              * url, and we should just let the request through to the
              * backend without any attempt to cache. this stops
              * duplicated simultaneous attempts to cache an entity.
+             * if we waited for a request which did not cache it, we go
+             * along with the other waiters rather than after them.
              */
-            rv = cache_try_lock(conf, cache, r);
+            rv = waited ? APR_EEXIST : cache_try_lock(conf, cache, r);
             if (APR_SUCCESS == rv) {
 
                 /*
@@ -625,11 +709,7 @@ static int cache_handler(request_rec *r)
     }
 
     /* kick off the filter stack */
-    out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    e = apr_bucket_eos_create(out->bucket_alloc);
-    APR_BRIGADE_INSERT_TAIL(out, e);
-    return ap_pass_brigade_fchk(r, out, "cache(%s): ap_pass_brigade returned",
-                                cache->provider_name);
+    return cache_serve(cache, r);
 }
 
 /*
@@ -1651,6 +1731,24 @@ static apr_status_t cache_remove_url_filter(ap_filter_t *f,
     return ap_pass_brigade(f->next, in);
 }
 
+/*
+ * CACHE_DISCARD filter
+ * --------------------
+ *
+ * This filter gets added to the subrequest revalidating a stale entity in
+ * the background, after its response was served. Once stored in the cache,
+ * the response has nowhere to go.
+ *
+ * CACHE_DISCARD has to be the last filter of the subrequest, so that the
+ * CACHE_REMOVE_URL filter still sees canned error messages.
+ */
+static apr_status_t cache_discard_filter(ap_filter_t *f,
+                                         apr_bucket_brigade *in)
+{
+    apr_brigade_cleanup(in);
+    return APR_SUCCESS;
+}
+
 /*
  * CACHE_INVALIDATE filter
  * -----------------------
@@ -1948,6 +2046,7 @@ static void *create_dir_config(apr_pool_t *p, char *dummy)
     dconf->x_cache_detail = DEFAULT_X_CACHE_DETAIL;
 
     dconf->stale_on_error = DEFAULT_CACHE_STALE_ON_ERROR;
+    dconf->stale_while_revalidate = DEFAULT_CACHE_STALE_WHILE_REVALIDATE;
 
     /* array of providers for this URL space */
     dconf->cacheenable = apr_array_make(p, 10, sizeof(struct cache_enable));
@@ -1996,6 +2095,11 @@ static void *merge_dir_config(apr_pool_t *p, void *basev, void *addv) {
     new->stale_on_error_set = add->stale_on_error_set
             || base->stale_on_error_set;
 
+    new->stale_while_revalidate = (add->stale_while_revalidate_set == 0)
+            ? base->stale_while_revalidate : add->stale_while_revalidate;
+    new->stale_while_revalidate_set = add->stale_while_revalidate_set
+            || base->stale_while_revalidate_set;
+
     new->cacheenable = add->enable_set ? apr_array_append(p, base->cacheenable,
             add->cacheenable) : base->cacheenable;
     new->enable_set = add->enable_set || base->enable_set;
@@ -2027,10 +2131,17 @@ static void * create_cache_config(apr_pool_t *p, server_rec *s)
     /* array of identifiers that should not be used for key calculation */
     ps->ignore_session_id = apr_array_make(p, 10, sizeof(char *));
     ps->ignore_session_id_set = CACHE_IGNORE_SESSION_ID_UNSET;
+    /* array of request headers canonicalized before the lookup */
+    ps->vary_normalize = apr_array_make(p, 2,
+                                        sizeof(struct cache_vary_normalize));
+    ps->vary_headers = apr_array_make(p, 2, sizeof(char *));
+    ps->vary_probe = 0;
+    ps->vary_probe_set = 0;
     ps->lock = 0; /* thundering herd lock defaults to off */
     ps->lock_set = 0;
     ps->lockpath = ap_runtime_dir_relative(p, DEFAULT_CACHE_LOCKPATH);
     ps->lockmaxage = apr_time_from_sec(DEFAULT_CACHE_MAXAGE);
+    ps->lockwait = apr_time_from_sec(DEFAULT_CACHE_LOCKWAIT);
     ps->x_cache = DEFAULT_X_CACHE;
     ps->x_cache_detail = DEFAULT_X_CACHE_DETAIL;
     return ps;
@@ -2067,6 +2178,18 @@ static void * merge_cache_config(apr_pool_t *p, void *basev, void *overridesv)
         (overrides->ignore_session_id_set == CACHE_IGNORE_SESSION_ID_UNSET)
         ? base->ignore_session_id
         : overrides->ignore_session_id;
+    ps->vary_normalize =
+        (overrides->vary_normalize_set == 0)
+        ? base->vary_normalize
+        : overrides->vary_normalize;
+    ps->vary_headers =
+        (overrides->vary_normalize_set == 0)
+        ? base->vary_headers
+        : overrides->vary_headers;
+    ps->vary_probe =
+        (overrides->vary_probe_set == 0)
+        ? base->vary_probe
+        : overrides->vary_probe;
     ps->lock =
         (overrides->lock_set == 0)
         ? base->lock
@@ -2079,6 +2202,10 @@ static void * merge_cache_config(apr_pool_t *p, void *basev, void *overridesv)
         (overrides->lockmaxage_set == 0)
         ? base->lockmaxage
         : overrides->lockmaxage;
+    ps->lockwait =
+        (overrides->lockwait_set == 0)
+        ? base->lockwait
+        : overrides->lockwait;
     ps->quick =
         (overrides->quick_set == 0)
         ? base->quick
@@ -2222,6 +2349,60 @@ static const char *add_ignore_session_id(cmd_parms *parms, void *dummy,
     return NULL;
 }
 
+static const char *add_vary_normalize(cmd_parms *parms, void *dummy,
+                                      int argc, char *const argv[])
+{
+    cache_server_conf *conf;
+    struct cache_vary_normalize *norm = NULL;
+    const char **names;
+    int i;
+
+    if (argc < 2) {
+        return "CacheVaryNormalize needs a header name followed by at "
+               "least one token";
+    }
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+
+    /* a header listed again gets its new tokens */
+    names = (const char **)conf->vary_headers->elts;
+    for (i = 0; i < conf->vary_headers->nelts; i++) {
+        if (!strcasecmp(names[i], argv[0])) {
+            norm = &((struct cache_vary_normalize *)
+                     conf->vary_normalize->elts)[i];
+            break;
+        }
+    }
+    if (!norm) {
+        norm = (struct cache_vary_normalize *)
+                apr_array_push(conf->vary_normalize);
+        norm->header = argv[0];
+        *(const char **)apr_array_push(conf->vary_headers) = argv[0];
+    }
+
+    norm->tokens = apr_array_make(parms->pool, argc - 1, sizeof(char *));
+    for (i = 1; i < argc; i++) {
+        *(const char **)apr_array_push(norm->tokens) = argv[i];
+    }
+    conf->vary_normalize_set = 1;
+    return NULL;
+}
+
+static const char *set_vary_normalize_probe(cmd_parms *parms, void *dummy,
+                                            int flag)
+{
+    cache_server_conf *conf;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    conf->vary_probe = flag;
+    conf->vary_probe_set = 1;
+    return NULL;
+}
+
 static const char *add_cache_enable(cmd_parms *parms, void *dummy,
                                     const char *type,
                                     const char *url)
@@ -2430,6 +2611,24 @@ static const char *set_cache_lock_maxage(cmd_parms *parms, void *dummy,
     return NULL;
 }
 
+static const char *set_cache_lock_wait(cmd_parms *parms, void *dummy,
+                                    const char *arg)
+{
+    cache_server_conf *conf;
+    apr_interval_time_t timeout;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    if (ap_timeout_parameter_parse(arg, &timeout, "s") != APR_SUCCESS
+            || timeout < 0) {
+        return "CacheLockWait has wrong format";
+    }
+    conf->lockwait = timeout;
+    conf->lockwait_set = 1;
+    return NULL;
+}
+
 static const char *set_cache_x_cache(cmd_parms *parms, void *dummy, int flag)
 {
 
@@ -2508,6 +2707,31 @@ static const char *set_cache_stale_on_error(cmd_parms *parms, void *dummy,
     return NULL;
 }
 
+static const char *set_cache_stale_while_revalidate(cmd_parms *parms,
+        void *dummy, const char *arg)
+{
+    cache_dir_conf *dconf = (cache_dir_conf *)dummy;
+    apr_off_t seconds;
+    char *endp;
+
+    if (!ap_cstr_casecmp(arg, "off")) {
+        dconf->stale_while_revalidate = -1;
+    }
+    else if (!ap_cstr_casecmp(arg, "on")) {
+        dconf->stale_while_revalidate = 0;
+    }
+    else if (!apr_strtoff(&seconds, arg, &endp, 10) && !*endp
+            && seconds >= 0) {
+        dconf->stale_while_revalidate = seconds;
+    }
+    else {
+        return "CacheStaleWhileRevalidate must be on, off or a number "
+               "of seconds";
+    }
+    dconf->stale_while_revalidate_set = 1;
+    return NULL;
+}
+
 static int cache_post_config(apr_pool_t *p, apr_pool_t *plog,
                              apr_pool_t *ptemp, server_rec *s)
 {
@@ -2573,6 +2797,14 @@ static const command_rec cache_cmds[] =
                     NULL, RSRC_CONF, "A space separated list of session "
                     "identifiers that should be ignored for creating the key "
                     "of the cached entity."),
+    AP_INIT_TAKE_ARGV("CacheVaryNormalize", add_vary_normalize, NULL,
+                      RSRC_CONF, "A request header followed by the tokens "
+                      "its values are reduced to, in order of preference, "
+                      "the last one being the default"),
+    AP_INIT_FLAG("CacheVaryNormalizeProbe", set_vary_normalize_probe, NULL,
+                 RSRC_CONF, "Look up the variant of the normalized request "
+                 "headers before the Vary of the URL, saving an I/O for "
+                 "URLs which vary but costing one for those which don't"),
     AP_INIT_TAKE1("CacheLastModifiedFactor", set_cache_factor, NULL, RSRC_CONF|ACCESS_CONF,
                   "The factor used to estimate Expires date from "
                   "LastModified date"),
@@ -2585,6 +2817,10 @@ static const command_rec cache_cmds[] =
                   "DefaultRuntimeDir setting."),
     AP_INIT_TAKE1("CacheLockMaxAge", set_cache_lock_maxage, NULL, RSRC_CONF,
                   "Maximum age of any thundering herd lock."),
+    AP_INIT_TAKE1("CacheLockWait", set_cache_lock_wait, NULL, RSRC_CONF,
+                  "How long a request waits for the thundering herd lock "
+                  "rather than going to the backend, in seconds unless "
+                  "suffixed with ms. Default is 0 (no waiting)."),
     AP_INIT_FLAG("CacheHeader", set_cache_x_cache, NULL, RSRC_CONF | ACCESS_CONF,
                  "Add a X-Cache header to responses. Default is off."),
     AP_INIT_FLAG("CacheDetailHeader", set_cache_x_cache_detail, NULL,
@@ -2595,6 +2831,11 @@ static const command_rec cache_cmds[] =
     AP_INIT_FLAG("CacheStaleOnError", set_cache_stale_on_error,
                  NULL, RSRC_CONF|ACCESS_CONF,
                  "Serve stale content on 5xx errors if present. Defaults to on."),
+    AP_INIT_TAKE1("CacheStaleWhileRevalidate", set_cache_stale_while_revalidate,
+                  NULL, RSRC_CONF|ACCESS_CONF,
+                  "Serve stale content while revalidating it in the background "
+                  "as per stale-while-revalidate, on, off or the default "
+                  "window in seconds. Defaults to off."),
     {NULL}
 };
 
@@ -2688,6 +2929,11 @@ static void register_hooks(apr_pool_t *p)
                                   cache_invalidate_filter,
                                   NULL,
                                   AP_FTYPE_PROTOCOL);
+    cache_discard_filter_handle =
+        ap_register_output_filter("CACHE_DISCARD",
+                                  cache_discard_filter,
+                                  NULL,
+                                  AP_FTYPE_CONNECTION-1);
     ap_hook_post_config(cache_post_config, NULL, NULL, APR_HOOK_REALLY_FIRST);
 }
 
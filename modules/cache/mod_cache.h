@@ -156,6 +156,16 @@ CACHE_DECLARE(apr_table_t *)ap_cache_cacheable_headers_in(request_rec *r);
  */
 CACHE_DECLARE(apr_table_t *)ap_cache_cacheable_headers_out(request_rec *r);
 
+/* Return the names of the request headers canonicalized with
+ * CacheVaryNormalize if they include all the headers of varray, NULL
+ * otherwise. A response varying on these headers only can be keyed by
+ * their values in the request. With a NULL varray, return them only if
+ * CacheVaryNormalizeProbe is on, for the storage managers to look up that
+ * variant directly, before reading the Vary.
+ */
+CACHE_DECLARE(apr_array_header_t *)ap_cache_vary_normalized(request_rec *r,
+        apr_array_header_t *varray);
+
 /**
  * Parse the Cache-Control and Pragma headers in one go, marking
  * which tokens appear within the header. Populate the structure
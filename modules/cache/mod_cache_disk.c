@@ -211,6 +211,67 @@ static apr_status_t file_cache_create(disk_cache_conf *conf, disk_cache_file_t *
     return APR_SUCCESS;
 }
 
+/* Append a record of the file set to the journal read by htcacheclean,
+ * in a single write so that the records of the children do not mix.
+ */
+static void journal_write(disk_cache_conf *conf, disk_cache_object_t *dobj,
+                          apr_uint32_t type, request_rec *r)
+{
+    disk_cache_journal_t *rec;
+    const char *file, *name, *suffix;
+    apr_file_t *fd;
+    apr_finfo_t finfo;
+    apr_size_t len;
+    apr_status_t rv;
+
+    file = dobj->hdrs.file ? dobj->hdrs.file : dobj->data.file;
+    if (!conf->journal || !file || !dobj->root) {
+        return;
+    }
+    name = file + dobj->root_len;
+    while (*name == '/') {
+        name++;
+    }
+    suffix = strrchr(name, '.');
+    if (!suffix) {
+        return;
+    }
+
+    len = sizeof(disk_cache_journal_t) + (suffix - name);
+    rec = apr_pcalloc(r->pool, len);
+    rec->format = JOURNAL_FORMAT_VERSION;
+    rec->type = type;
+    rec->time = apr_time_now();
+    if (type == JOURNAL_STORE) {
+        rec->expire = dobj->disk_info.expire;
+        rec->response_time = dobj->disk_info.response_time;
+        if (apr_stat(&finfo, dobj->hdrs.file, APR_FINFO_SIZE,
+                     r->pool) == APR_SUCCESS) {
+            rec->hsize = finfo.size;
+        }
+        if (!dobj->disk_info.header_only) {
+            rec->dsize = dobj->file_size;
+        }
+    }
+    rec->name_len = suffix - name;
+    memcpy(rec + 1, name, rec->name_len);
+
+    rv = apr_file_open(&fd, apr_pstrcat(r->pool, conf->cache_root, "/",
+                                        CACHE_JOURNAL_FILE, NULL),
+                       APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_APPEND
+                       | APR_FOPEN_BINARY, APR_FPROT_UREAD | APR_FPROT_UWRITE,
+                       r->pool);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_write_full(fd, rec, len, NULL);
+        apr_file_close(fd);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(10596)
+                "could not append to the cache journal in %s",
+                conf->cache_root);
+    }
+}
+
 /* These two functions get and put state information into the data
  * file for an ap_cache_el, this state information will be read
  * and written transparent to clients of this module
@@ -405,7 +466,8 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
 {
     apr_uint32_t format;
     apr_size_t len;
-    const char *nkey;
+    const char *nkey, *dkey = NULL;
+    apr_array_header_t *normalized;
     apr_status_t rc;
     static int error_logged = 0;
     disk_cache_conf *conf = ap_get_module_config(r->server->module_config,
@@ -446,6 +508,33 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     dobj->root_len = conf->cache_root_len;
 
     dobj->vary.file = header_file(r->pool, conf, dobj, key);
+
+    /* A response varying on normalized headers only is keyed by their
+     * values in the request: with CacheVaryNormalizeProbe, try its variant
+     * first, so that a hit reads a single header file rather than the vary
+     * file and then the variant (URLs which don't vary pay an open).
+     */
+    normalized = ap_cache_vary_normalized(r, NULL);
+    if (normalized) {
+        const char *hashfile = dobj->hashfile;
+
+        dkey = regen_key(r->pool, r->headers_in, normalized, key);
+
+        dobj->hashfile = NULL;
+        dobj->prefix = dobj->vary.file;
+        dobj->hdrs.file = header_file(r->pool, conf, dobj, dkey);
+
+        flags = APR_READ|APR_BINARY|APR_BUFFERED;
+        rc = apr_file_open(&dobj->hdrs.fd, dobj->hdrs.file, flags, 0, r->pool);
+        if (rc == APR_SUCCESS) {
+            nkey = dkey;
+            goto found;
+        }
+
+        dobj->hashfile = hashfile;
+        dobj->prefix = NULL;
+    }
+
     flags = APR_READ|APR_BINARY|APR_BUFFERED;
     rc = apr_file_open(&dobj->vary.fd, dobj->vary.file, flags, 0, r->pool);
     if (rc != APR_SUCCESS) {
@@ -475,6 +564,10 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         apr_file_close(dobj->vary.fd);
 
         nkey = regen_key(r->pool, r->headers_in, varray, key);
+        if (dkey && !strcmp(nkey, dkey)) {
+            /* the variant was not there above */
+            return DECLINED;
+        }
 
         dobj->hashfile = NULL;
         dobj->prefix = dobj->vary.file;
@@ -508,6 +601,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         nkey = key;
     }
 
+found:
     obj->key = nkey;
     dobj->key = nkey;
     dobj->name = key;
@@ -625,6 +719,8 @@ static int remove_entity(cache_handle_t *h)
 
 static int remove_url(cache_handle_t *h, request_rec *r)
 {
+    disk_cache_conf *conf = ap_get_module_config(r->server->module_config,
+                                                 &cache_disk_module);
     apr_status_t rc;
     disk_cache_object_t *dobj;
 
@@ -668,6 +764,8 @@ static int remove_url(cache_handle_t *h, request_rec *r)
         }
     }
 
+    journal_write(conf, dobj, JOURNAL_REMOVE, r);
+
     /* now delete directories as far as possible up to our cache root */
     if (dobj->root) {
         const char *str_to_copy;
@@ -981,7 +1079,7 @@ static apr_status_t write_headers(cache_handle_t *h, request_rec *r)
         tmp = apr_table_get(dobj->headers_out, "Vary");
 
         if (tmp) {
-            apr_array_header_t* varray;
+            apr_array_header_t *varray, *normalized;
             apr_uint32_t format = VARY_FORMAT_VERSION;
 
             /* If we were initially opened as a vary format, rollback
@@ -1033,6 +1131,14 @@ static apr_status_t write_headers(cache_handle_t *h, request_rec *r)
             varray = apr_array_make(r->pool, 6, sizeof(char*));
             tokens_to_array(r->pool, tmp, varray);
 
+            /* Key the variants of normalized headers by all of them, as
+             * open_entity() does before it knows the Vary of the response.
+             */
+            normalized = ap_cache_vary_normalized(r, varray);
+            if (normalized) {
+                varray = normalized;
+            }
+
             rv = store_array(dobj->vary.tempfd, varray);
             if (rv != APR_SUCCESS) {
                 ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(10413)
@@ -1368,6 +1474,7 @@ static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00737)
                 "commit_entity: Headers and body for URL %s cached.",
                 dobj->name);
+        journal_write(conf, dobj, JOURNAL_STORE, r);
     }
 
     apr_pool_destroy(dobj->data.pool);
@@ -1430,6 +1537,7 @@ static void *create_config(apr_pool_t *p, server_rec *s)
 
     conf->cache_root = NULL;
     conf->cache_root_len = 0;
+    conf->journal = 0;
 
     return conf;
 }
@@ -1483,6 +1591,16 @@ static const char
     return NULL;
 }
 
+static const char
+*set_cache_journal(cmd_parms *parms, void *in_struct_ptr, int flag)
+{
+    disk_cache_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                 &cache_disk_module);
+
+    conf->journal = flag;
+    return NULL;
+}
+
 static const char
 *set_cache_minfs(cmd_parms *parms, void *in_struct_ptr, const char *arg)
 {
@@ -1549,6 +1667,9 @@ static const command_rec disk_cache_cmds[] =
                   "The number of levels of subdirectories in the cache"),
     AP_INIT_TAKE1("CacheDirLength", set_cache_dirlength, NULL, RSRC_CONF,
                   "The number of characters in subdirectory names"),
+    AP_INIT_FLAG("CacheJournal", set_cache_journal, NULL, RSRC_CONF,
+                 "Append the stored and removed entities to a journal for "
+                 "htcacheclean"),
     AP_INIT_TAKE1("CacheMinFileSize", set_cache_minfs, NULL, RSRC_CONF | ACCESS_CONF,
                   "The minimum file size to cache a document"),
     AP_INIT_TAKE1("CacheMaxFileSize", set_cache_maxfs, NULL, RSRC_CONF | ACCESS_CONF,
@@ -74,6 +74,7 @@ typedef struct {
     apr_size_t cache_root_len;
     int dirlevels;               /* Number of levels of subdirectories */
     int dirlength;               /* Length of subdirectory names */
+    int journal;                 /* Append changes to CACHE_JOURNAL_FILE */
 } disk_cache_conf;
 
 typedef struct {
@@ -0,0 +1,1872 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_lib.h"
+#include "apr_file_io.h"
+#include "apr_mmap.h"
+#include "apr_strings.h"
+#include "apr_buckets.h"
+#include "apr_atomic.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#include "ap_provider.h"
+#include "util_mutex.h"
+
+#include "mod_cache.h"
+#include "mod_status.h"
+
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if AP_NEED_SET_MUTEX_PERMS
+#include "unixd.h"
+#endif
+
+/*
+ * mod_cache_slab: Single File HTTP 1.1 Cache.
+ *
+ * All the entities are stored in one preallocated data file, divided in
+ * regions of CacheSlabRegionSize bytes. The records of an entity are
+ * appended to the region being filled (the head), which is replaced when
+ * full by the next region given by a CLOCK sweep: a region which had a hit
+ * since the hand last passed gets a second chance, the others are reused
+ * whole. Reusing a region bumps its generation, which invalidates all the
+ * index entries pointing to it at once.
+ *
+ * The index is a set associative hash table in a second file, mapped in
+ * memory, shared by the children and kept across restarts:
+ *
+ *   cache_slab_header_t
+ *   cache_slab_region_t[nregions]
+ *   cache_slab_entry_t[nsets * CACHE_SLAB_WAYS]
+ *
+ * An entry maps the hash of a key to its header record and its body in
+ * the data file, the body being served as a file bucket. A region is only
+ * reused after a full turn of the CLOCK without hits, and never while a
+ * body it holds is being sent: the readers pin it as the writers do. The
+ * pins outlive graceful restarts, the children of the previous generation
+ * dropping theirs when done, and those not renewed for
+ * CACHE_SLAB_PIN_MAXAGE are deemed leaked by crashed children.
+ *
+ * Header records:
+ *
+ * Format #1 (the key has Vary bits):
+ *   cache_slab_info_t (format is CACHE_SLAB_VARY_FORMAT_VERSION)
+ *   entity name (sobj->name) [length is in cache_slab_info_t->name_len]
+ *   vary headers (delimited by CRLF)
+ *   CRLF
+ *
+ * Format #2:
+ *   cache_slab_info_t (format is CACHE_SLAB_FORMAT_VERSION)
+ *   entity name (sobj->name) [length is in cache_slab_info_t->name_len]
+ *   r->headers_out (delimited by CRLF)
+ *   CRLF
+ *   r->headers_in (delimited by CRLF)
+ *   CRLF
+ */
+
+module AP_MODULE_DECLARE_DATA cache_slab_module;
+
+#define CACHE_SLAB_MAGIC                0x42414c53 /* "SLAB" */
+#define CACHE_SLAB_INDEX_VERSION        3
+#define CACHE_SLAB_VARY_FORMAT_VERSION  1
+#define CACHE_SLAB_FORMAT_VERSION       2
+
+#define CACHE_SLAB_DATA_FILE    "slab.data"
+#define CACHE_SLAB_INDEX_FILE   "slab.index"
+
+/* Entries per set of the index */
+#define CACHE_SLAB_WAYS 8
+
+/* Age of the last pin of a region after which its pins are cleared */
+#define CACHE_SLAB_PIN_MAXAGE apr_time_from_sec(3600)
+
+typedef struct {
+    /* Indicates the format of the record. */
+    apr_uint32_t format;
+    /* The HTTP status code returned for this response.  */
+    int status;
+    /* The size of the entity name that follows. */
+    apr_size_t name_len;
+    /* Miscellaneous time values. */
+    apr_time_t date;
+    apr_time_t expire;
+    apr_time_t request_time;
+    apr_time_t response_time;
+    /* Does this cached request have a body? */
+    unsigned int header_only:1;
+    /* The parsed cache control header */
+    cache_control_t control;
+} cache_slab_info_t;
+
+/* A record in the data file */
+typedef struct {
+    apr_uint32_t region;
+    apr_uint32_t gen;           /* generation of the region */
+    apr_uint32_t offset;        /* in the region */
+    apr_uint32_t len;
+} cache_slab_ref_t;
+
+/* An entry of the index, free when hash is 0 */
+typedef struct {
+    apr_uint64_t hash;
+    apr_time_t atime;           /* last stored or hit */
+    cache_slab_ref_t hdrs;
+    cache_slab_ref_t body;      /* len is 0 without a body */
+} cache_slab_entry_t;
+
+typedef struct {
+    apr_uint32_t gen;           /* bumped when the region is reused */
+    apr_uint32_t fill;          /* bytes allocated to records */
+    apr_uint32_t writers;       /* records being written (atomic) */
+    apr_uint32_t readers;       /* bodies being sent (atomic) */
+    apr_uint32_t referenced;    /* hit since the CLOCK hand passed */
+    apr_time_t pinned;          /* when last pinned */
+} cache_slab_region_t;
+
+typedef struct {
+    apr_uint32_t magic;
+    apr_uint32_t version;
+    apr_uint32_t nregions;
+    apr_uint32_t region_size;
+    apr_uint32_t nsets;
+    apr_uint32_t epoch;         /* bumped at each (re)start */
+    apr_uint32_t head;          /* the region being filled */
+    apr_uint32_t hand;          /* the CLOCK hand */
+    apr_uint64_t stores;
+    apr_uint64_t evictions;
+} cache_slab_header_t;
+
+/* The store, as mapped by this generation */
+typedef struct {
+    cache_slab_header_t *header;
+    cache_slab_region_t *regions;
+    cache_slab_entry_t *entries;
+    const char *data_file;
+    apr_uint32_t epoch;
+} cache_slab_store_t;
+
+/*
+ * cache_slab_object_t
+ * Pointed to by cache_object_t::vobj
+ */
+typedef struct cache_slab_object_t
+{
+    const char *name; /* Requested URI without vary bits - suitable for mortals. */
+    const char *key; /* URI with Vary bits (if present) */
+    cache_slab_info_t slab_info; /* Header information. */
+    apr_file_t *fd; /* the data file, to recall the body */
+    apr_file_t *wfd; /* the data file, to store the records */
+    char *vary; /* the vary record to store, if any */
+    apr_size_t vary_len;
+    char *hdrs; /* the header record to store */
+    apr_size_t hdrs_len;
+    cache_slab_ref_t reserved; /* where the records are stored */
+    cache_slab_ref_t body; /* the body, recalled or stored */
+    apr_off_t body_len; /* length of the new body */
+    apr_off_t written; /* length of the new body stored so far */
+    request_rec *r; /* for the cleanup of the reservation */
+    apr_uint32_t *readers; /* the pin of the body region, if any */
+    apr_pool_t *readers_pool; /* where the pin is released */
+    unsigned int newbody :1; /* whether a new body is present */
+    unsigned int pending :1; /* whether space is reserved */
+    unsigned int done :1; /* Is the attempt to cache complete? */
+} cache_slab_object_t;
+
+/*
+ * mod_cache_slab configuration
+ */
+#define DEFAULT_SIZE            (APR_INT64_C(1024) * 1024 * 1024)
+#define DEFAULT_REGION_SIZE     (16 * 1024 * 1024)
+#define DEFAULT_ENTRIES         (256 * 1024)
+#define DEFAULT_MIN_FILE_SIZE   1
+#define DEFAULT_MAX_FILE_SIZE   1000000
+#define MIN_REGION_SIZE         (1024 * 1024)
+#define MAX_REGION_SIZE         (1024 * 1024 * 1024)
+#define MAX_ENTRIES             (256 * 1024 * 1024)
+
+typedef struct {
+    const char *root;
+    apr_off_t size;
+    apr_uint32_t region_size;
+    apr_uint32_t entries;
+} cache_slab_conf;
+
+typedef struct {
+    apr_off_t minfs; /* minimum file size for cached files */
+    apr_off_t maxfs; /* maximum file size for cached files */
+    unsigned int minfs_set :1;
+    unsigned int maxfs_set :1;
+} cache_slab_dir_conf;
+
+static const char * const cache_slab_id = "cache-slab";
+static apr_global_mutex_t *slab_mutex = NULL;
+static cache_slab_store_t *slab = NULL;
+
+/*
+ * Local static functions
+ */
+
+static apr_uint64_t slab_hash(const char *key)
+{
+    apr_uint64_t hash = APR_UINT64_C(0xcbf29ce484222325);
+    const unsigned char *p;
+
+    /* FNV-1a */
+    for (p = (const unsigned char *)key; *p; ++p) {
+        hash ^= *p;
+        hash *= APR_UINT64_C(0x100000001b3);
+    }
+
+    /* 0 is a free entry */
+    return hash ? hash : 1;
+}
+
+static apr_off_t slab_offset(const cache_slab_ref_t *ref)
+{
+    return (apr_off_t)ref->region * slab->header->region_size + ref->offset;
+}
+
+static int slab_ref_valid(const cache_slab_ref_t *ref)
+{
+    return ref->region < slab->header->nregions
+           && slab->regions[ref->region].gen == ref->gen;
+}
+
+static int slab_entry_valid(const cache_slab_entry_t *e)
+{
+    return e->hash && slab_ref_valid(&e->hdrs)
+           && (!e->body.len || slab_ref_valid(&e->body));
+}
+
+static apr_status_t slab_lock(request_rec *r)
+{
+    apr_status_t rv;
+
+    rv = apr_global_mutex_lock(slab_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10551)
+                "could not acquire lock, ignoring");
+        return rv;
+    }
+
+    /* After a restart the store belongs to the new generation, which
+     * has its own mutex: the remaining children of the previous one
+     * must leave it alone.
+     */
+    if (slab->header->epoch != slab->epoch) {
+        apr_global_mutex_unlock(slab_mutex);
+        return APR_EAGAIN;
+    }
+
+    return APR_SUCCESS;
+}
+
+static void slab_unlock(request_rec *r)
+{
+    apr_status_t rv;
+
+    rv = apr_global_mutex_unlock(slab_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10552)
+                "could not release lock, ignoring");
+    }
+}
+
+/* The functions below are called with the lock held. */
+
+static cache_slab_entry_t *slab_set(apr_uint64_t hash)
+{
+    return &slab->entries[(hash % slab->header->nsets) * CACHE_SLAB_WAYS];
+}
+
+static cache_slab_entry_t *slab_find(apr_uint64_t hash)
+{
+    cache_slab_entry_t *set = slab_set(hash);
+    int i;
+
+    for (i = 0; i < CACHE_SLAB_WAYS; ++i) {
+        if (set[i].hash == hash && slab_entry_valid(&set[i])) {
+            return &set[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Replace in the set the entry of the same hash, else an invalid one,
+ * else the least recently used one.
+ */
+static void slab_insert(const cache_slab_entry_t *entry)
+{
+    cache_slab_entry_t *set = slab_set(entry->hash), *victim = NULL;
+    int i;
+
+    for (i = 0; i < CACHE_SLAB_WAYS; ++i) {
+        if (set[i].hash == entry->hash) {
+            victim = &set[i];
+            break;
+        }
+        if (!slab_entry_valid(&set[i])) {
+            if (!victim || slab_entry_valid(victim)) {
+                victim = &set[i];
+            }
+        }
+        else if (!victim || (slab_entry_valid(victim)
+                             && set[i].atime < victim->atime)) {
+            victim = &set[i];
+        }
+    }
+
+    *victim = *entry;
+}
+
+static void slab_remove(apr_uint64_t hash)
+{
+    cache_slab_entry_t *set = slab_set(hash);
+    int i;
+
+    for (i = 0; i < CACHE_SLAB_WAYS; ++i) {
+        if (set[i].hash == hash) {
+            set[i].hash = 0;
+        }
+    }
+}
+
+/* Whether a region is pinned, clearing the pins which were not renewed
+ * for too long.
+ */
+static int slab_pinned(request_rec *r, apr_uint32_t i, apr_time_t now)
+{
+    cache_slab_region_t *region = &slab->regions[i];
+
+    if (!apr_atomic_read32(&region->writers)
+            && !apr_atomic_read32(&region->readers)) {
+        return 0;
+    }
+    if (now - region->pinned < CACHE_SLAB_PIN_MAXAGE) {
+        return 1;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(10603)
+            "clearing the pins of region %u, not renewed for %"
+            APR_TIME_T_FMT "s (%u writers, %u readers)", i,
+            apr_time_sec(now - region->pinned),
+            apr_atomic_read32(&region->writers),
+            apr_atomic_read32(&region->readers));
+    apr_atomic_set32(&region->writers, 0);
+    apr_atomic_set32(&region->readers, 0);
+    return 0;
+}
+
+/* Allocate len bytes in the head region, moving the head to the region
+ * given by the CLOCK when it is full. Regions with records being written
+ * or bodies being read are never reused.
+ */
+static apr_status_t slab_reserve(request_rec *r, apr_uint32_t len,
+                                 cache_slab_ref_t *ref)
+{
+    cache_slab_header_t *header = slab->header;
+    cache_slab_region_t *region = &slab->regions[header->head];
+    apr_time_t now = apr_time_now();
+
+    if (region->fill > header->region_size - len) {
+        apr_uint32_t n, i = 0;
+
+        /* twice around at most, the first pass clearing the references */
+        for (n = 0; n < 2 * header->nregions; ++n) {
+            i = header->hand;
+            header->hand = (i + 1) % header->nregions;
+
+            region = &slab->regions[i];
+            if (i == header->head || slab_pinned(r, i, now)) {
+                continue;
+            }
+            if (region->referenced) {
+                region->referenced = 0;
+                continue;
+            }
+            break;
+        }
+        if (n == 2 * header->nregions) {
+            return APR_ENOSPC;
+        }
+
+        if (region->fill) {
+            /* drop all the entries using this region */
+            region->gen++;
+            region->fill = 0;
+            header->evictions++;
+        }
+        header->head = i;
+    }
+
+    ref->region = header->head;
+    ref->gen = region->gen;
+    ref->offset = region->fill;
+    ref->len = len;
+    region->fill += len;
+    region->pinned = now;
+    apr_atomic_inc32(&region->writers);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t slab_lookup(request_rec *r, const char *key,
+                                cache_slab_entry_t *entry)
+{
+    cache_slab_entry_t *e;
+    apr_status_t rv;
+
+    rv = slab_lock(r);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    e = slab_find(slab_hash(key));
+    if (e) {
+        e->atime = r->request_time;
+        slab->regions[e->hdrs.region].referenced = 1;
+        if (e->body.len) {
+            slab->regions[e->body.region].referenced = 1;
+        }
+        *entry = *e;
+    }
+
+    slab_unlock(r);
+
+    return e ? APR_SUCCESS : APR_NOTFOUND;
+}
+
+/* Pin the region of a body so that it is not reused while the body is
+ * sent. The pins are released without the lock, possibly by a child of the
+ * previous generation after a restart, hence the atomics.
+ */
+static apr_status_t slab_pin(request_rec *r, const cache_slab_ref_t *ref,
+                             apr_uint32_t **readers)
+{
+    apr_status_t rv;
+
+    rv = slab_lock(r);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (slab_ref_valid(ref)) {
+        slab->regions[ref->region].pinned = apr_time_now();
+        *readers = &slab->regions[ref->region].readers;
+        apr_atomic_inc32(*readers);
+    }
+    else {
+        rv = APR_NOTFOUND;
+    }
+
+    slab_unlock(r);
+
+    return rv;
+}
+
+/* Drop a pin, unless it was cleared meanwhile */
+static void slab_pin_drop(apr_uint32_t *pins)
+{
+    apr_uint32_t n;
+
+    do {
+        n = apr_atomic_read32(pins);
+        if (!n) {
+            return;
+        }
+    } while (apr_atomic_cas32(pins, n - 1, n) != n);
+}
+
+static apr_status_t slab_unpin(void *baton)
+{
+    slab_pin_drop(baton);
+    return APR_SUCCESS;
+}
+
+static apr_status_t slab_read(request_rec *r, apr_file_t *fd,
+                              const cache_slab_ref_t *ref, char **buffer)
+{
+    apr_off_t offset = slab_offset(ref);
+    apr_status_t rv;
+
+    *buffer = apr_palloc(r->pool, ref->len);
+
+    rv = apr_file_seek(fd, APR_SET, &offset);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_read_full(fd, *buffer, ref->len, NULL);
+    }
+
+    /* the region may have been reused while we were reading it */
+    if (rv == APR_SUCCESS && !slab_ref_valid(ref)) {
+        rv = APR_NOTFOUND;
+    }
+
+    return rv;
+}
+
+static apr_status_t slab_read_info(const char *buffer, apr_size_t len,
+                                   const char *name, cache_slab_info_t *info,
+                                   apr_size_t *slider)
+{
+    if (len < sizeof(*info)) {
+        return APR_EGENERAL;
+    }
+    memcpy(info, buffer, sizeof(*info));
+    *slider = sizeof(*info);
+
+    /* a hash collision */
+    if (info->name_len != strlen(name) || info->name_len > len - *slider
+        || memcmp(buffer + *slider, name, info->name_len)) {
+        return APR_NOTFOUND;
+    }
+    *slider += info->name_len;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t read_array(request_rec *r, apr_array_header_t *arr,
+        const char *buffer, apr_size_t buffer_len, apr_size_t *slider)
+{
+    apr_size_t val = *slider;
+
+    while (*slider < buffer_len) {
+        if (buffer[*slider] == '\r') {
+            if (val == *slider) {
+                (*slider) += 2;
+                return APR_SUCCESS;
+            }
+            *((const char **) apr_array_push(arr)) = apr_pstrmemdup(r->pool,
+                    buffer + val, *slider - val);
+            (*slider) += 2;
+            val = *slider;
+        }
+        else {
+            (*slider)++;
+        }
+    }
+
+    return APR_EOF;
+}
+
+static apr_status_t read_table(request_rec *r, apr_table_t *table,
+        const char *buffer, apr_size_t buffer_len, apr_size_t *slider)
+{
+    apr_size_t key = *slider, colon = 0;
+
+    while (*slider < buffer_len) {
+        if (buffer[*slider] == ':') {
+            if (!colon) {
+                colon = *slider;
+            }
+            (*slider)++;
+        }
+        else if (buffer[*slider] == '\r') {
+            apr_size_t len = colon;
+
+            if (key == *slider) {
+                (*slider) += 2;
+                return APR_SUCCESS;
+            }
+            if (!colon) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10553)
+                        "Premature end of cache headers.");
+                return APR_EGENERAL;
+            }
+            /* skip the ": " */
+            colon += 2;
+            apr_table_addn(table, apr_pstrmemdup(r->pool, buffer + key,
+                                                 len - key),
+                           apr_pstrmemdup(r->pool, buffer + colon,
+                                          *slider - colon));
+            (*slider) += 2;
+            key = *slider;
+            colon = 0;
+        }
+        else {
+            (*slider)++;
+        }
+    }
+
+    return APR_EOF;
+}
+
+static apr_size_t array_len(apr_array_header_t *arr)
+{
+    const char **elts = (const char **) arr->elts;
+    apr_size_t len = sizeof(CRLF) - 1;
+    int i;
+
+    for (i = 0; i < arr->nelts; i++) {
+        len += strlen(elts[i]) + sizeof(CRLF) - 1;
+    }
+
+    return len;
+}
+
+static char *store_array(char *buffer, apr_array_header_t *arr)
+{
+    const char **elts = (const char **) arr->elts;
+    int i;
+
+    for (i = 0; i < arr->nelts; i++) {
+        apr_size_t len = strlen(elts[i]);
+
+        memcpy(buffer, elts[i], len);
+        buffer += len;
+        memcpy(buffer, CRLF, sizeof(CRLF) - 1);
+        buffer += sizeof(CRLF) - 1;
+    }
+    memcpy(buffer, CRLF, sizeof(CRLF) - 1);
+
+    return buffer + sizeof(CRLF) - 1;
+}
+
+static apr_size_t table_len(apr_table_t *table)
+{
+    const apr_array_header_t *arr = apr_table_elts(table);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *) arr->elts;
+    apr_size_t len = sizeof(CRLF) - 1;
+    int i;
+
+    for (i = 0; i < arr->nelts; ++i) {
+        if (elts[i].key != NULL) {
+            len += strlen(elts[i].key) + strlen(elts[i].val) + 2
+                   + sizeof(CRLF) - 1;
+        }
+    }
+
+    return len;
+}
+
+static char *store_table(char *buffer, apr_table_t *table)
+{
+    const apr_array_header_t *arr = apr_table_elts(table);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *) arr->elts;
+    int i;
+
+    for (i = 0; i < arr->nelts; ++i) {
+        if (elts[i].key != NULL) {
+            apr_size_t key_len = strlen(elts[i].key);
+            apr_size_t val_len = strlen(elts[i].val);
+
+            memcpy(buffer, elts[i].key, key_len);
+            buffer += key_len;
+            memcpy(buffer, ": ", 2);
+            buffer += 2;
+            memcpy(buffer, elts[i].val, val_len);
+            buffer += val_len;
+            memcpy(buffer, CRLF, sizeof(CRLF) - 1);
+            buffer += sizeof(CRLF) - 1;
+        }
+    }
+    memcpy(buffer, CRLF, sizeof(CRLF) - 1);
+
+    return buffer + sizeof(CRLF) - 1;
+}
+
+/* Serialize a header record, of format #1 with varray, else #2 */
+static char *slab_record(apr_pool_t *p, cache_slab_info_t *info,
+                         const char *name, apr_array_header_t *varray,
+                         apr_table_t *headers_out, apr_table_t *headers_in,
+                         apr_size_t *len)
+{
+    char *buffer, *pos;
+
+    *len = sizeof(*info) + info->name_len;
+    if (varray) {
+        *len += array_len(varray);
+    }
+    else {
+        *len += table_len(headers_out) + table_len(headers_in);
+    }
+
+    buffer = apr_palloc(p, *len);
+    memcpy(buffer, info, sizeof(*info));
+    memcpy(buffer + sizeof(*info), name, info->name_len);
+    pos = buffer + sizeof(*info) + info->name_len;
+    if (varray) {
+        store_array(pos, varray);
+    }
+    else {
+        store_table(store_table(pos, headers_out), headers_in);
+    }
+
+    return buffer;
+}
+
+static const char* regen_key(apr_pool_t *p, apr_table_t *headers,
+                             apr_array_header_t *varray, const char *oldkey)
+{
+    struct iovec *iov;
+    int i, k;
+    int nvec;
+    const char *header;
+    const char **elts;
+
+    nvec = (varray->nelts * 2) + 1;
+    iov = apr_palloc(p, sizeof(struct iovec) * nvec);
+    elts = (const char **) varray->elts;
+
+    for (i = 0, k = 0; i < varray->nelts; i++) {
+        header = apr_table_get(headers, elts[i]);
+        if (!header) {
+            header = "";
+        }
+        iov[k].iov_base = (char*) elts[i];
+        iov[k].iov_len = strlen(elts[i]);
+        k++;
+        iov[k].iov_base = (char*) header;
+        iov[k].iov_len = strlen(header);
+        k++;
+    }
+    iov[k].iov_base = (char*) oldkey;
+    iov[k].iov_len = strlen(oldkey);
+    k++;
+
+    return apr_pstrcatv(p, iov, k, NULL);
+}
+
+static int array_alphasort(const void *fn1, const void *fn2)
+{
+    return strcmp(*(char**) fn1, *(char**) fn2);
+}
+
+static void tokens_to_array(apr_pool_t *p, const char *data,
+        apr_array_header_t *arr)
+{
+    char *token;
+
+    while ((token = ap_get_list_item(p, &data)) != NULL) {
+        *((const char **) apr_array_push(arr)) = token;
+    }
+
+    /* Sort it so that "Vary: A, B" and "Vary: B, A" are stored the same. */
+    qsort((void *) arr->elts, arr->nelts, sizeof(char *), array_alphasort);
+}
+
+/* Give back the space reserved for the records and the body, which can
+ * not be reused before. The data file is closed first since buffered
+ * writes are flushed then, and the pin is dropped without the lock, which
+ * a child of the previous generation can't take after a restart.
+ */
+static void slab_release(cache_slab_object_t *sobj)
+{
+    if (sobj->wfd) {
+        apr_file_close(sobj->wfd);
+        sobj->wfd = NULL;
+    }
+    if (sobj->pending) {
+        sobj->pending = 0;
+        slab_pin_drop(&slab->regions[sobj->reserved.region].writers);
+    }
+}
+
+static apr_status_t slab_release_cleanup(void *baton)
+{
+    slab_release(baton);
+    return APR_SUCCESS;
+}
+
+/* Prepare the records of the entity, given its headers */
+static void slab_prepare(cache_handle_t *h, request_rec *r,
+                         apr_table_t *headers_out, apr_table_t *headers_in)
+{
+    cache_object_t *obj = h->cache_obj;
+    cache_slab_object_t *sobj = (cache_slab_object_t *) obj->vobj;
+    cache_slab_info_t info;
+    const char *vary;
+
+    sobj->vary_len = 0;
+    vary = apr_table_get(headers_out, "Vary");
+    if (vary) {
+        apr_array_header_t *varray = apr_array_make(r->pool, 6,
+                                                    sizeof(char*));
+
+        tokens_to_array(r->pool, vary, varray);
+
+        memset(&info, 0, sizeof(info));
+        info.format = CACHE_SLAB_VARY_FORMAT_VERSION;
+        info.expire = obj->info.expire;
+        info.name_len = strlen(sobj->name);
+        sobj->vary = slab_record(r->pool, &info, sobj->name, varray,
+                                 NULL, NULL, &sobj->vary_len);
+
+        obj->key = sobj->key = regen_key(r->pool, headers_in, varray,
+                                         sobj->name);
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.format = CACHE_SLAB_FORMAT_VERSION;
+    info.date = obj->info.date;
+    info.expire = obj->info.expire;
+    info.request_time = obj->info.request_time;
+    info.response_time = obj->info.response_time;
+    info.status = obj->info.status;
+    info.name_len = strlen(sobj->name);
+    memcpy(&info.control, &obj->info.control, sizeof(cache_control_t));
+
+    if (r->header_only && r->status != HTTP_NOT_MODIFIED) {
+        info.header_only = 1;
+    }
+    else {
+        info.header_only = sobj->slab_info.header_only;
+    }
+    if (info.header_only && sobj->newbody) {
+        sobj->body_len = 0;
+    }
+
+    sobj->hdrs = slab_record(r->pool, &info, sobj->name, NULL,
+                             headers_out, headers_in, &sobj->hdrs_len);
+}
+
+/* Reserve the space of the records (and of the new body, if any) and
+ * write the records.
+ */
+static apr_status_t slab_write(cache_handle_t *h, request_rec *r)
+{
+    cache_slab_object_t *sobj = (cache_slab_object_t *) h->cache_obj->vobj;
+    apr_off_t offset;
+    apr_off_t len;
+    apr_status_t rv;
+
+    len = sobj->vary_len + sobj->hdrs_len;
+    if (sobj->newbody) {
+        len += sobj->body_len;
+    }
+    if (len > slab->header->region_size) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10554)
+                "URL %s larger than a region, not caching "
+                "(%" APR_OFF_T_FMT " > %u)",
+                sobj->name, len, slab->header->region_size);
+        return APR_ENOSPC;
+    }
+
+    rv = slab_lock(r);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = slab_reserve(r, (apr_uint32_t)len, &sobj->reserved);
+    slab_unlock(r);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10555)
+                "no region available, not caching %s", sobj->name);
+        return rv;
+    }
+    sobj->r = r;
+    sobj->pending = 1;
+    apr_pool_cleanup_register(r->pool, sobj, slab_release_cleanup,
+                              apr_pool_cleanup_null);
+
+    rv = apr_file_open(&sobj->wfd, slab->data_file,
+                       APR_FOPEN_WRITE | APR_FOPEN_BINARY | APR_FOPEN_BUFFERED,
+                       0, r->pool);
+    if (rv == APR_SUCCESS) {
+        offset = slab_offset(&sobj->reserved);
+        rv = apr_file_seek(sobj->wfd, APR_SET, &offset);
+    }
+    if (rv == APR_SUCCESS && sobj->vary_len) {
+        rv = apr_file_write_full(sobj->wfd, sobj->vary, sobj->vary_len, NULL);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_write_full(sobj->wfd, sobj->hdrs, sobj->hdrs_len, NULL);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(10556)
+                "could not write to cache file %s, not caching %s",
+                slab->data_file, sobj->name);
+        slab_release(sobj);
+        return rv;
+    }
+
+    if (sobj->newbody) {
+        /* the body follows the records */
+        sobj->body.region = sobj->reserved.region;
+        sobj->body.gen = sobj->reserved.gen;
+        sobj->body.offset = sobj->reserved.offset + (apr_uint32_t)
+                            (sobj->vary_len + sobj->hdrs_len);
+        sobj->body.len = (apr_uint32_t)sobj->body_len;
+        sobj->written = 0;
+    }
+
+    return APR_SUCCESS;
+}
+
+/*
+ * Hook and mod_cache callback functions
+ */
+static int create_entity(cache_handle_t *h, request_rec *r, const char *key,
+        apr_off_t len, apr_bucket_brigade *bb)
+{
+    cache_slab_dir_conf *dconf =
+            ap_get_module_config(r->per_dir_config, &cache_slab_module);
+    cache_object_t *obj;
+    cache_slab_object_t *sobj;
+
+    if (!slab) {
+        return DECLINED;
+    }
+
+    /* we don't support caching of range requests (yet) */
+    if (r->status == HTTP_PARTIAL_CONTENT) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10557)
+                "URL %s partial content response not cached",
+                key);
+        return DECLINED;
+    }
+
+    /* The space of the body is reserved with the one of the headers,
+     * hence its size must be known.
+     */
+    if (len < 0) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10558)
+                "URL '%s' had no explicit size, ignoring", key);
+        return DECLINED;
+    }
+    if (len > dconf->maxfs || len > slab->header->region_size) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10559)
+                "URL %s failed the size check "
+                "(%" APR_OFF_T_FMT " > %" APR_OFF_T_FMT ")",
+                key, len, dconf->maxfs);
+        return DECLINED;
+    }
+    if (len < dconf->minfs) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10560)
+                "URL %s failed the size check "
+                "(%" APR_OFF_T_FMT " < %" APR_OFF_T_FMT ")",
+                key, len, dconf->minfs);
+        return DECLINED;
+    }
+
+    /* Allocate and initialize cache_object_t and cache_slab_object_t */
+    h->cache_obj = obj = apr_pcalloc(r->pool, sizeof(*obj));
+    obj->vobj = sobj = apr_pcalloc(r->pool, sizeof(*sobj));
+
+    obj->key = apr_pstrdup(r->pool, key);
+    sobj->key = obj->key;
+    sobj->name = obj->key;
+    sobj->body_len = len;
+    sobj->newbody = 1;
+
+    return OK;
+}
+
+static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
+{
+#ifdef APR_SENDFILE_ENABLED
+    core_dir_config *coreconf = ap_get_core_module_config(r->per_dir_config);
+#endif
+    cache_slab_entry_t entry;
+    cache_slab_info_t slab_info;
+    cache_object_t *obj;
+    cache_info *info;
+    cache_slab_object_t *sobj;
+    const char *nkey = key;
+    apr_file_t *fd;
+    apr_int32_t flags;
+    apr_size_t slider;
+    char *buffer;
+    apr_status_t rc;
+
+    h->cache_obj = NULL;
+
+    if (!slab) {
+        return DECLINED;
+    }
+
+    if (slab_lookup(r, key, &entry) != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10561)
+                "Key not found in cache: %s", key);
+        return DECLINED;
+    }
+
+    flags = APR_FOPEN_READ | APR_FOPEN_BINARY;
+#ifdef APR_SENDFILE_ENABLED
+    /* When we are in the quick handler we don't have the per-directory
+     * configuration, so this check only takes the global setting of
+     * the EnableSendFile directive into account.
+     */
+    flags |= AP_SENDFILE_ENABLED(coreconf->enable_sendfile);
+#endif
+    rc = apr_file_open(&fd, slab->data_file, flags, 0, r->pool);
+    if (rc != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rc, r, APLOGNO(10562)
+                "Cannot open data file %s", slab->data_file);
+        return DECLINED;
+    }
+
+    rc = slab_read(r, fd, &entry.hdrs, &buffer);
+    if (rc == APR_SUCCESS) {
+        rc = slab_read_info(buffer, entry.hdrs.len, key, &slab_info, &slider);
+    }
+    if (rc != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rc, r, APLOGNO(10563)
+                "Cache entry for key '%s' not found or unreadable", key);
+        goto fail;
+    }
+
+    if (slab_info.format == CACHE_SLAB_VARY_FORMAT_VERSION) {
+        apr_array_header_t *varray = apr_array_make(r->pool, 5,
+                                                    sizeof(char*));
+
+        rc = read_array(r, varray, buffer, entry.hdrs.len, &slider);
+        if (rc != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rc, r, APLOGNO(10564)
+                    "Cannot parse vary entry for key: %s", key);
+            goto fail;
+        }
+
+        nkey = regen_key(r->pool, r->headers_in, varray, key);
+
+        rc = slab_lookup(r, nkey, &entry);
+        if (rc == APR_SUCCESS) {
+            rc = slab_read(r, fd, &entry.hdrs, &buffer);
+        }
+        if (rc == APR_SUCCESS) {
+            rc = slab_read_info(buffer, entry.hdrs.len, key, &slab_info,
+                                &slider);
+        }
+        if (rc != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rc, r, APLOGNO(10565)
+                    "Cache entry for key '%s' not found or unreadable",
+                    nkey);
+            goto fail;
+        }
+    }
+
+    if (slab_info.format != CACHE_SLAB_FORMAT_VERSION) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10566)
+                "Key '%s' found in cache has version %d, expected %d, "
+                "ignoring", nkey, slab_info.format,
+                CACHE_SLAB_FORMAT_VERSION);
+        goto fail;
+    }
+
+    /* Is this a cached HEAD request? */
+    if (slab_info.header_only && !r->header_only) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10567)
+                "HEAD request cached, non-HEAD requested, ignoring: %s",
+                nkey);
+        goto fail;
+    }
+
+    h->req_hdrs = apr_table_make(r->pool, 20);
+    h->resp_hdrs = apr_table_make(r->pool, 20);
+
+    /* Call routine to read the header lines/status line */
+    if (read_table(r, h->resp_hdrs, buffer, entry.hdrs.len, &slider)
+            != APR_SUCCESS
+        || read_table(r, h->req_hdrs, buffer, entry.hdrs.len, &slider)
+            != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10568)
+                "Cache entry for key '%s' headers unreadable, ignoring",
+                nkey);
+        goto fail;
+    }
+
+    /* Create and init the cache object */
+    obj = apr_pcalloc(r->pool, sizeof(cache_object_t));
+    sobj = apr_pcalloc(r->pool, sizeof(cache_slab_object_t));
+
+    obj->key = nkey;
+    sobj->key = nkey;
+    sobj->name = key;
+    sobj->fd = fd;
+    sobj->body = entry.body;
+    sobj->slab_info = slab_info;
+
+    /* Store it away so we can get it later. */
+    info = &(obj->info);
+    info->status = slab_info.status;
+    info->date = slab_info.date;
+    info->expire = slab_info.expire;
+    info->request_time = slab_info.request_time;
+    info->response_time = slab_info.response_time;
+
+    memcpy(&info->control, &slab_info.control, sizeof(cache_control_t));
+
+    /* the body may have been evicted since the lookup */
+    if (sobj->body.len) {
+        rc = slab_pin(r, &sobj->body, &sobj->readers);
+        if (rc != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rc, r, APLOGNO(10599)
+                    "Cache entry for key '%s' body evicted, ignoring", nkey);
+            goto fail;
+        }
+        sobj->readers_pool = r->pool;
+        apr_pool_cleanup_register(r->pool, sobj->readers, slab_unpin,
+                                  apr_pool_cleanup_null);
+    }
+
+    /* make the configuration stick */
+    h->cache_obj = obj;
+    obj->vobj = sobj;
+
+    return OK;
+
+fail:
+    apr_file_close(fd);
+    return DECLINED;
+}
+
+static int remove_entity(cache_handle_t *h)
+{
+    /* Null out the cache object pointer so next time we start from scratch  */
+    h->cache_obj = NULL;
+    return OK;
+}
+
+static int remove_url(cache_handle_t *h, request_rec *r)
+{
+    cache_slab_object_t *sobj;
+
+    sobj = (cache_slab_object_t *) h->cache_obj->vobj;
+    if (!sobj || !slab) {
+        return DECLINED;
+    }
+
+    /* Remove the key (and the vary key, if any) from the index */
+    if (slab_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    slab_remove(slab_hash(sobj->key));
+    if (strcmp(sobj->key, sobj->name)) {
+        slab_remove(slab_hash(sobj->name));
+    }
+    slab_unlock(r);
+
+    return OK;
+}
+
+static apr_status_t recall_headers(cache_handle_t *h, request_rec *r)
+{
+    /* we recalled the headers during open_entity, so do nothing */
+    return APR_SUCCESS;
+}
+
+static apr_status_t recall_body(cache_handle_t *h, apr_pool_t *p,
+        apr_bucket_brigade *bb)
+{
+    cache_slab_object_t *sobj = (cache_slab_object_t*) h->cache_obj->vobj;
+
+    if (sobj->fd && sobj->body.len) {
+        /* keep the region pinned as long as the file bucket lives */
+        if (sobj->readers && sobj->readers_pool != p) {
+            apr_pool_cleanup_kill(sobj->readers_pool, sobj->readers,
+                                  slab_unpin);
+            apr_pool_cleanup_register(p, sobj->readers, slab_unpin,
+                                      apr_pool_cleanup_null);
+            sobj->readers_pool = p;
+        }
+        apr_brigade_insert_file(bb, sobj->fd, slab_offset(&sobj->body),
+                                sobj->body.len, p);
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
+        cache_info *info)
+{
+    memcpy(&h->cache_obj->info, info, sizeof(cache_info));
+
+    /* When revalidated, the record of the new headers points to the body
+     * already stored.
+     */
+    slab_prepare(h, r, ap_cache_cacheable_headers_out(r),
+                 ap_cache_cacheable_headers_in(r));
+
+    return slab_write(h, r);
+}
+
+static apr_status_t store_body(cache_handle_t *h, request_rec *r,
+        apr_bucket_brigade *in, apr_bucket_brigade *out)
+{
+    apr_bucket *e;
+    apr_status_t rv;
+    cache_slab_object_t *sobj = (cache_slab_object_t *) h->cache_obj->vobj;
+
+    while (!APR_BRIGADE_EMPTY(in)) {
+        const char *str;
+        apr_size_t length;
+
+        e = APR_BRIGADE_FIRST(in);
+
+        /* are we done completely? if so, pass any trailing buckets right through */
+        if (sobj->done || !sobj->newbody || !sobj->pending) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(out, e);
+            continue;
+        }
+
+        /* have we seen eos yet? */
+        if (APR_BUCKET_IS_EOS(e)) {
+            sobj->done = 1;
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(out, e);
+
+            if (r->connection->aborted || r->no_cache) {
+                ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, APLOGNO(10569)
+                        "Discarding body for URL %s "
+                        "because connection has been aborted.",
+                        h->cache_obj->key);
+                slab_release(sobj);
+                return APR_EGENERAL;
+            }
+            if (sobj->written != sobj->body_len) {
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10570)
+                        "URL %s didn't receive complete response, not caching",
+                        h->cache_obj->key);
+                slab_release(sobj);
+                return APR_EGENERAL;
+            }
+            break;
+        }
+
+        /* honour flush buckets, we'll get called again */
+        if (APR_BUCKET_IS_FLUSH(e)) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(out, e);
+            break;
+        }
+
+        /* metadata buckets are preserved as is */
+        if (APR_BUCKET_IS_METADATA(e)) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(out, e);
+            continue;
+        }
+
+        /* read the bucket, write to the cache */
+        rv = apr_bucket_read(e, &str, &length, APR_BLOCK_READ);
+        APR_BUCKET_REMOVE(e);
+        APR_BRIGADE_INSERT_TAIL(out, e);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10571)
+                    "Error when reading bucket for URL %s",
+                    h->cache_obj->key);
+            slab_release(sobj);
+            return rv;
+        }
+
+        /* don't write empty buckets to the cache */
+        if (!length) {
+            continue;
+        }
+
+        if (length > sobj->body_len - sobj->written) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10572)
+                    "URL %s failed the size check "
+                    "(%" APR_OFF_T_FMT " > %" APR_OFF_T_FMT ")",
+                    h->cache_obj->key, sobj->written + (apr_off_t)length,
+                    sobj->body_len);
+            slab_release(sobj);
+            return APR_EGENERAL;
+        }
+
+        /* the region may be reused by the new generation after a restart */
+        if (slab->header->epoch != slab->epoch) {
+            slab_release(sobj);
+            return APR_EGENERAL;
+        }
+
+        rv = apr_file_write_full(sobj->wfd, str, length, NULL);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10573)
+                    "Error when writing cache file for URL %s",
+                    h->cache_obj->key);
+            slab_release(sobj);
+            return rv;
+        }
+        sobj->written += length;
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
+{
+    cache_object_t *obj = h->cache_obj;
+    cache_slab_object_t *sobj = (cache_slab_object_t *) obj->vobj;
+    cache_slab_entry_t entry;
+    apr_status_t rv;
+
+    if (!sobj->pending) {
+        return APR_EGENERAL;
+    }
+
+    /* flush the records and the body */
+    rv = apr_file_close(sobj->wfd);
+    sobj->wfd = NULL;
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(10574)
+                "could not write to cache file %s, not caching %s",
+                slab->data_file, sobj->name);
+        slab_release(sobj);
+        return rv;
+    }
+
+    rv = slab_lock(r);
+    if (rv != APR_SUCCESS) {
+        slab_release(sobj);
+        return rv;
+    }
+
+    /* a revalidated body may have been evicted meanwhile */
+    if (slab_ref_valid(&sobj->reserved)
+        && (!sobj->body.len || slab_ref_valid(&sobj->body))) {
+        memset(&entry, 0, sizeof(entry));
+        entry.atime = r->request_time;
+        entry.hdrs = sobj->reserved;
+        if (sobj->vary_len) {
+            entry.hash = slab_hash(sobj->name);
+            entry.hdrs.len = (apr_uint32_t)sobj->vary_len;
+            slab_insert(&entry);
+            entry.hdrs.offset += entry.hdrs.len;
+        }
+        entry.hash = slab_hash(sobj->key);
+        entry.hdrs.len = (apr_uint32_t)sobj->hdrs_len;
+        entry.body = sobj->body;
+        slab_insert(&entry);
+        slab->header->stores++;
+    }
+    else {
+        slab_remove(slab_hash(sobj->key));
+        rv = APR_NOTFOUND;
+    }
+
+    slab_pin_drop(&slab->regions[sobj->reserved.region].writers);
+    sobj->pending = 0;
+
+    slab_unlock(r);
+
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10575)
+                "commit_entity: URL '%s' not cached, body evicted.",
+                sobj->name);
+        return rv;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10576)
+            "commit_entity: Headers and body for URL %s cached.",
+            sobj->name);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t invalidate_entity(cache_handle_t *h, request_rec *r)
+{
+    apr_status_t rv;
+
+    /* mark the entity as invalidated */
+    h->cache_obj->info.control.invalidated = 1;
+
+    slab_prepare(h, r, h->resp_hdrs, h->req_hdrs);
+
+    rv = slab_write(h, r);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    return commit_entity(h, r);
+}
+
+static void *create_dir_config(apr_pool_t *p, char *dummy)
+{
+    cache_slab_dir_conf *dconf = apr_pcalloc(p, sizeof(cache_slab_dir_conf));
+
+    dconf->maxfs = DEFAULT_MAX_FILE_SIZE;
+    dconf->minfs = DEFAULT_MIN_FILE_SIZE;
+
+    return dconf;
+}
+
+static void *merge_dir_config(apr_pool_t *p, void *basev, void *addv)
+{
+    cache_slab_dir_conf *new = apr_pcalloc(p, sizeof(cache_slab_dir_conf));
+    cache_slab_dir_conf *add = (cache_slab_dir_conf *) addv;
+    cache_slab_dir_conf *base = (cache_slab_dir_conf *) basev;
+
+    new->maxfs = (add->maxfs_set == 0) ? base->maxfs : add->maxfs;
+    new->maxfs_set = add->maxfs_set || base->maxfs_set;
+    new->minfs = (add->minfs_set == 0) ? base->minfs : add->minfs;
+    new->minfs_set = add->minfs_set || base->minfs_set;
+
+    return new;
+}
+
+static void *create_config(apr_pool_t *p, server_rec *s)
+{
+    cache_slab_conf *conf = apr_pcalloc(p, sizeof(cache_slab_conf));
+
+    conf->size = DEFAULT_SIZE;
+    conf->region_size = DEFAULT_REGION_SIZE;
+    conf->entries = DEFAULT_ENTRIES;
+
+    return conf;
+}
+
+/*
+ * mod_cache_slab configuration directives handlers.
+ */
+static const char *set_cache_root(cmd_parms *cmd, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_conf *conf = ap_get_module_config(cmd->server->module_config,
+            &cache_slab_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+    conf->root = ap_server_root_relative(cmd->pool, arg);
+    if (!conf->root) {
+        return apr_pstrcat(cmd->pool, "CacheSlabRoot: invalid path ",
+                           arg, NULL);
+    }
+    return NULL;
+}
+
+static const char *set_cache_size(cmd_parms *cmd, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_conf *conf = ap_get_module_config(cmd->server->module_config,
+            &cache_slab_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (apr_strtoff(&conf->size, arg, NULL, 10) != APR_SUCCESS
+            || conf->size <= 0) {
+        return "CacheSlabSize argument must be a positive integer "
+               "representing the size of the data file in bytes.";
+    }
+    return NULL;
+}
+
+static const char *set_cache_region_size(cmd_parms *cmd, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_conf *conf = ap_get_module_config(cmd->server->module_config,
+            &cache_slab_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_off_t size;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS
+            || size < MIN_REGION_SIZE || size > MAX_REGION_SIZE) {
+        return "CacheSlabRegionSize argument must be an integer "
+               "representing the size of a region in bytes, between "
+               "1048576 (1M) and 1073741824 (1G).";
+    }
+    conf->region_size = (apr_uint32_t)size;
+    return NULL;
+}
+
+static const char *set_cache_entries(cmd_parms *cmd, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_conf *conf = ap_get_module_config(cmd->server->module_config,
+            &cache_slab_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    apr_off_t entries;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (apr_strtoff(&entries, arg, NULL, 10) != APR_SUCCESS
+            || entries < CACHE_SLAB_WAYS || entries > MAX_ENTRIES) {
+        return "CacheSlabEntries argument must be an integer representing "
+               "the number of entries of the index, between 8 and "
+               "268435456.";
+    }
+    conf->entries = (apr_uint32_t)entries;
+    return NULL;
+}
+
+static const char *set_cache_minfs(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_dir_conf *dconf = (cache_slab_dir_conf *) in_struct_ptr;
+
+    if (apr_strtoff(&dconf->minfs, arg, NULL, 10) != APR_SUCCESS
+            || dconf->minfs < 0) {
+        return "CacheSlabMinFileSize argument must be a non-negative integer "
+               "representing the min size of a file to cache in bytes.";
+    }
+    dconf->minfs_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_maxfs(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_slab_dir_conf *dconf = (cache_slab_dir_conf *) in_struct_ptr;
+
+    if (apr_strtoff(&dconf->maxfs, arg, NULL, 10) != APR_SUCCESS
+            || dconf->maxfs < 0) {
+        return "CacheSlabMaxFileSize argument must be a non-negative integer "
+               "representing the max size of a file to cache in bytes.";
+    }
+    dconf->maxfs_set = 1;
+    return NULL;
+}
+
+static apr_status_t remove_lock(void *data)
+{
+    if (slab_mutex) {
+        apr_global_mutex_destroy(slab_mutex);
+        slab_mutex = NULL;
+    }
+    slab = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_status_t slab_map(apr_pool_t *p, const char *fname,
+                             apr_mmap_t **mm)
+{
+#if APR_HAS_MMAP
+    apr_file_t *fd;
+    apr_finfo_t finfo;
+    apr_status_t rv;
+
+    rv = apr_file_open(&fd, fname, APR_FOPEN_READ | APR_FOPEN_WRITE
+                       | APR_FOPEN_BINARY, 0, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_file_info_get(&finfo, APR_FINFO_SIZE, fd);
+    if (rv == APR_SUCCESS && finfo.size < (apr_off_t)sizeof(cache_slab_header_t)) {
+        rv = APR_EGENERAL;
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_mmap_create(mm, fd, 0, (apr_size_t)finfo.size,
+                             APR_MMAP_READ | APR_MMAP_WRITE, p);
+    }
+    /* the mapping outlives the descriptor */
+    apr_file_close(fd);
+
+    return rv;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
+/* Create a (sparse) file of the given size in place of fname, which may
+ * still be open or mapped by the children of the previous generation.
+ */
+static apr_status_t slab_create(apr_pool_t *p, server_rec *s,
+                                const char *fname, apr_off_t size)
+{
+    const char *tmp = apr_pstrcat(p, fname, ".tmp", NULL);
+    apr_file_t *fd;
+    apr_status_t rv;
+
+    rv = apr_file_open(&fd, tmp, APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE
+                       | APR_FOPEN_WRITE | APR_FOPEN_BINARY,
+                       APR_FPROT_UREAD | APR_FPROT_UWRITE, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_file_trunc(fd, size);
+    apr_file_close(fd);
+    if (rv != APR_SUCCESS) {
+        apr_file_remove(tmp, p);
+        return rv;
+    }
+
+#if AP_NEED_SET_MUTEX_PERMS
+    /* the children open it */
+    if (geteuid() == 0 /* is superuser */
+            && chown(tmp, ap_unixd_config.user_id, (gid_t)-1) == -1) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_FROM_OS_ERROR(errno), s,
+                     APLOGNO(10577) "Can't change owner of %s", tmp);
+    }
+#endif
+
+    return apr_file_rename(tmp, fname, p);
+}
+
+static apr_status_t slab_init(apr_pool_t *pconf, apr_pool_t *ptmp,
+                              server_rec *s, cache_slab_conf *conf)
+{
+    cache_slab_store_t *st;
+    cache_slab_header_t *header = NULL;
+    const char *index_file;
+    apr_uint32_t nregions, nsets, i;
+    apr_size_t index_size;
+    apr_finfo_t finfo;
+    apr_mmap_t *mm;
+    apr_status_t rv;
+
+    nregions = (apr_uint32_t)(conf->size / conf->region_size);
+    nsets = (conf->entries + CACHE_SLAB_WAYS - 1) / CACHE_SLAB_WAYS;
+    index_size = sizeof(cache_slab_header_t)
+                 + nregions * sizeof(cache_slab_region_t)
+                 + (apr_size_t)nsets * CACHE_SLAB_WAYS
+                   * sizeof(cache_slab_entry_t);
+
+    st = apr_pcalloc(pconf, sizeof(*st));
+    st->data_file = ap_make_full_path(pconf, conf->root, CACHE_SLAB_DATA_FILE);
+    index_file = ap_make_full_path(pconf, conf->root, CACHE_SLAB_INDEX_FILE);
+
+    rv = apr_dir_make_recursive(conf->root, APR_OS_DEFAULT, ptmp);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10578)
+                     "could not create CacheSlabRoot %s", conf->root);
+        return rv;
+    }
+
+    /* Keep the store of the previous run if it has the same geometry */
+    if (slab_map(pconf, index_file, &mm) == APR_SUCCESS) {
+        header = mm->mm;
+
+        /* the children of the previous generation stop using it */
+        header->epoch++;
+
+        if (mm->size != index_size
+                || header->magic != CACHE_SLAB_MAGIC
+                || header->version != CACHE_SLAB_INDEX_VERSION
+                || header->nregions != nregions
+                || header->region_size != conf->region_size
+                || header->nsets != nsets
+                || apr_stat(&finfo, st->data_file, APR_FINFO_SIZE, ptmp)
+                   != APR_SUCCESS
+                || finfo.size != (apr_off_t)nregions * conf->region_size) {
+            header = NULL;
+        }
+    }
+
+    if (header) {
+        st->header = header;
+        st->regions = (cache_slab_region_t *)(header + 1);
+
+        /* The children of the previous generation may still be storing
+         * or sending bodies, until they drop their pins: these are only
+         * cleared at startup, not on restarts.
+         */
+        if (!ap_state_query(AP_SQ_CONFIG_GEN)) {
+            for (i = 0; i < nregions; ++i) {
+                st->regions[i].writers = 0;
+                st->regions[i].readers = 0;
+            }
+        }
+    }
+    else {
+        rv = slab_create(ptmp, s, st->data_file,
+                         (apr_off_t)nregions * conf->region_size);
+        if (rv == APR_SUCCESS) {
+            rv = slab_create(ptmp, s, index_file, index_size);
+        }
+        if (rv == APR_SUCCESS) {
+            rv = slab_map(pconf, index_file, &mm);
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10579)
+                         "could not create the cache files in %s",
+                         conf->root);
+            return rv;
+        }
+
+        st->header = header = mm->mm;
+        st->regions = (cache_slab_region_t *)(header + 1);
+
+        header->magic = CACHE_SLAB_MAGIC;
+        header->version = CACHE_SLAB_INDEX_VERSION;
+        header->nregions = nregions;
+        header->region_size = conf->region_size;
+        header->nsets = nsets;
+        for (i = 0; i < nregions; ++i) {
+            st->regions[i].gen = 1;
+        }
+    }
+    st->entries = (cache_slab_entry_t *)(st->regions + nregions);
+    st->epoch = ++header->epoch;
+
+    slab = st;
+
+    return APR_SUCCESS;
+}
+
+static int slab_status_hook(request_rec *r, int flags)
+{
+    cache_slab_header_t header;
+    apr_uint32_t i, used = 0;
+
+    if (!slab || slab_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    header = *slab->header;
+    for (i = 0; i < header.nregions; ++i) {
+        if (slab->regions[i].fill) {
+            used++;
+        }
+    }
+    slab_unlock(r);
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr>\n"
+                 "<table cellspacing=0 cellpadding=0>\n"
+                 "<tr><td bgcolor=\"#000000\">\n"
+                 "<b><font color=\"#ffffff\" face=\"Arial,Helvetica\">"
+                 "mod_cache_slab Status:</font></b>\n"
+                 "</td></tr>\n"
+                 "<tr><td bgcolor=\"#ffffff\">\n", r);
+        ap_rprintf(r, "regions: <b>%u</b> of <b>%u</b> bytes, "
+                   "used: <b>%u</b>, index entries: <b>%u</b><br>",
+                   header.nregions, header.region_size, used,
+                   header.nsets * CACHE_SLAB_WAYS);
+        ap_rprintf(r, "total entities stored since starting: "
+                   "<b>%" APR_UINT64_T_FMT "</b><br>", header.stores);
+        ap_rprintf(r, "total regions evicted since starting: "
+                   "<b>%" APR_UINT64_T_FMT "</b><br>", header.evictions);
+        ap_rputs("</td></tr>\n</table>\n", r);
+    }
+    else {
+        ap_rprintf(r, "CacheSlabRegions: %u\n", header.nregions);
+        ap_rprintf(r, "CacheSlabRegionsUsed: %u\n", used);
+        ap_rprintf(r, "CacheSlabStores: %" APR_UINT64_T_FMT "\n",
+                   header.stores);
+        ap_rprintf(r, "CacheSlabEvictions: %" APR_UINT64_T_FMT "\n",
+                   header.evictions);
+    }
+
+    return OK;
+}
+
+static int slab_precfg(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptmp)
+{
+    apr_status_t rv = ap_mutex_register(pconf, cache_slab_id, NULL,
+            APR_LOCK_DEFAULT, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10580)
+                "failed to register %s mutex", cache_slab_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+
+    /* Register to handle mod_status status page generation */
+    APR_OPTIONAL_HOOK(ap, status_hook, slab_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
+
+    return OK;
+}
+
+static int slab_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptmp, server_rec *s)
+{
+    cache_slab_conf *conf = ap_get_module_config(s->module_config,
+                                                 &cache_slab_module);
+    apr_status_t rv;
+
+    if (!conf->root) {
+        return OK;
+    }
+    if (conf->size / conf->region_size < 2) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, 0, s, APLOGNO(10581)
+                     "CacheSlabSize must be at least twice "
+                     "CacheSlabRegionSize");
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+
+    rv = ap_global_mutex_create(&slab_mutex, NULL, cache_slab_id, NULL, s,
+                                pconf, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10582)
+                "failed to create %s mutex", cache_slab_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    apr_pool_cleanup_register(pconf, NULL, remove_lock,
+                              apr_pool_cleanup_null);
+
+    rv = slab_init(pconf, ptmp, s, conf);
+    if (rv != APR_SUCCESS) {
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+
+    return OK;
+}
+
+static void slab_child_init(apr_pool_t *p, server_rec *s)
+{
+    const char *lock;
+    apr_status_t rv;
+
+    if (!slab_mutex) {
+        return;
+    }
+    lock = apr_global_mutex_lockfile(slab_mutex);
+    rv = apr_global_mutex_child_init(&slab_mutex, lock, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10583)
+                "failed to initialise mutex in child_init");
+    }
+}
+
+static const command_rec cache_slab_cmds[] =
+{
+    AP_INIT_TAKE1("CacheSlabRoot", set_cache_root, NULL, RSRC_CONF,
+            "The directory of the cache files"),
+    AP_INIT_TAKE1("CacheSlabSize", set_cache_size, NULL, RSRC_CONF,
+            "The size of the data file in bytes"),
+    AP_INIT_TAKE1("CacheSlabRegionSize", set_cache_region_size, NULL, RSRC_CONF,
+            "The size of the regions of the data file in bytes"),
+    AP_INIT_TAKE1("CacheSlabEntries", set_cache_entries, NULL, RSRC_CONF,
+            "The number of entries of the index"),
+    AP_INIT_TAKE1("CacheSlabMinFileSize", set_cache_minfs, NULL, RSRC_CONF | ACCESS_CONF,
+            "The minimum file size to cache a document"),
+    AP_INIT_TAKE1("CacheSlabMaxFileSize", set_cache_maxfs, NULL, RSRC_CONF | ACCESS_CONF,
+            "The maximum file size to cache a document"),
+    { NULL }
+};
+
+static const cache_provider cache_slab_provider =
+{
+    &remove_entity, &store_headers, &store_body, &recall_headers, &recall_body,
+    &create_entity, &open_entity, &remove_url, &commit_entity,
+    &invalidate_entity
+};
+
+static void cache_slab_register_hook(apr_pool_t *p)
+{
+    /* cache initializer */
+    ap_register_provider(p, CACHE_PROVIDER_GROUP, "slab", "0",
+            &cache_slab_provider);
+    ap_hook_pre_config(slab_precfg, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(slab_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(slab_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(cache_slab) = { STANDARD20_MODULE_STUFF,
+    create_dir_config,  /* create per-directory config structure */
+    merge_dir_config, /* merge per-directory config structures */
+    create_config, /* create per-server config structure */
+    NULL, /* merge per-server config structures */
+    cache_slab_cmds, /* command apr_table_t */
+    cache_slab_register_hook /* register hooks */
+};
@@ -452,12 +452,13 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     apr_uint32_t format;
     apr_size_t slider;
     unsigned int buffer_len;
-    const char *nkey;
+    const char *nkey, *dkey = NULL;
+    apr_array_header_t *normalized;
     apr_status_t rc;
     cache_object_t *obj;
     cache_info *info;
     cache_socache_object_t *sobj;
-    apr_size_t len;
+    apr_size_t len, dlen = 0;
 
     nkey = NULL;
     h->cache_obj = NULL;
@@ -482,6 +483,49 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
     sobj->buffer = apr_palloc(sobj->pool, dconf->max);
     sobj->buffer_len = dconf->max;
 
+    /* A response varying on normalized headers only is keyed by their
+     * values in the request: with CacheVaryNormalizeProbe, try its variant
+     * first, so that a hit is a single retrieval rather than the vary entry
+     * and then the variant (URLs which don't vary pay a retrieval).
+     */
+    normalized = ap_cache_vary_normalized(r, NULL);
+    if (normalized) {
+        dkey = regen_key(r->pool, r->headers_in, normalized, key, &dlen);
+
+        if (socache_mutex) {
+            apr_status_t status = apr_global_mutex_lock(socache_mutex);
+            if (status != APR_SUCCESS) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(10597)
+                        "could not acquire lock, ignoring: %s", key);
+                apr_pool_destroy(sobj->pool);
+                sobj->pool = NULL;
+                return DECLINED;
+            }
+        }
+        buffer_len = sobj->buffer_len;
+        rc = conf->provider->socache_provider->retrieve(
+                conf->provider->socache_instance, r->server,
+                (unsigned char *) dkey, dlen, sobj->buffer,
+                &buffer_len, r->pool);
+        if (socache_mutex) {
+            apr_status_t status = apr_global_mutex_unlock(socache_mutex);
+            if (status != APR_SUCCESS) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(10598)
+                        "could not release lock, ignoring: %s", key);
+                apr_pool_destroy(sobj->pool);
+                sobj->pool = NULL;
+                return DECLINED;
+            }
+        }
+        if (rc == APR_SUCCESS && buffer_len < sobj->buffer_len) {
+            memcpy(&format, sobj->buffer, sizeof(format));
+            if (format == CACHE_SOCACHE_DISK_FORMAT_VERSION) {
+                nkey = dkey;
+                goto found;
+            }
+        }
+    }
+
     /* attempt to retrieve the cached entry */
     if (socache_mutex) {
         apr_status_t status = apr_global_mutex_lock(socache_mutex);
@@ -544,6 +588,12 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         }
 
         nkey = regen_key(r->pool, r->headers_in, varray, key, &len);
+        if (dkey && len == dlen && !memcmp(nkey, dkey, len)) {
+            /* the variant was not there above */
+            apr_pool_destroy(sobj->pool);
+            sobj->pool = NULL;
+            return DECLINED;
+        }
 
         /* attempt to retrieve the cached entry */
         if (socache_mutex) {
@@ -595,6 +645,7 @@ static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
         nkey = key;
     }
 
+found:
     obj->key = nkey;
     sobj->key = nkey;
     sobj->name = key;
@@ -819,7 +870,7 @@ static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
         vary = apr_table_get(sobj->headers_out, "Vary");
 
         if (vary) {
-            apr_array_header_t* varray;
+            apr_array_header_t *varray, *normalized;
             apr_uint32_t format = CACHE_SOCACHE_VARY_FORMAT_VERSION;
 
             memcpy(sobj->buffer, &format, sizeof(format));
@@ -832,6 +883,14 @@ static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
             varray = apr_array_make(r->pool, 6, sizeof(char*));
             tokens_to_array(r->pool, vary, varray);
 
+            /* Key the variants of normalized headers by all of them, as
+             * open_entity() does before it knows the Vary of the response.
+             */
+            normalized = ap_cache_vary_normalized(r, varray);
+            if (normalized) {
+                varray = normalized;
+            }
+
             if (APR_SUCCESS != (rv = store_array(varray, sobj->buffer,
                     sobj->buffer_len, &slider))) {
                 ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(02370)
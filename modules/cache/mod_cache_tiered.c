@@ -0,0 +1,905 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_atomic.h"
+#include "apr_shm.h"
+#include "apr_strings.h"
+#include "apr_buckets.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#include "ap_provider.h"
+
+#include "mod_cache.h"
+#include "mod_status.h"
+
+/*
+ * mod_cache_tiered: Two Level HTTP 1.1 Cache.
+ *
+ * The "tiered" provider stacks two other cache providers: a small and
+ * fast memory tier (CacheTieredMemory, mod_cache_socache by default) over
+ * a large disk tier (CacheTieredDisk, mod_cache_disk by default).
+ *
+ * Lookups try the memory tier first, then the disk tier. Responses are
+ * always written through to the disk tier, and to the memory tier only
+ * when admitted: the lookups of every key are counted in a count-min
+ * sketch shared by the children, whose counters are halved regularly so
+ * that the counts follow the recent popularity (as TinyLFU does). A key
+ * looked up at least CacheTieredPromote times is admitted, and an entity
+ * served from the disk tier for such a key is copied to the memory tier
+ * on the way out.
+ *
+ * The memory tier evicts on its own; an entity evicted from it is still
+ * found in the disk tier, and promoted again once hot.
+ */
+
+module AP_MODULE_DECLARE_DATA cache_tiered_module;
+
+#define CACHE_TIERED_MEMORY 0
+#define CACHE_TIERED_DISK   1
+#define CACHE_TIERED_NUM    2
+
+/* Rows of the sketch, each one with its own hash of the key */
+#define CACHE_TIERED_ROWS 4
+
+/* Halve the counters after this many lookups per counter of a row */
+#define CACHE_TIERED_SAMPLE 10
+
+#define DEFAULT_MEMORY_PROVIDER "socache"
+#define DEFAULT_DISK_PROVIDER   "disk"
+#define DEFAULT_SKETCH_WIDTH    65536
+#define DEFAULT_PROMOTE         2
+
+typedef struct {
+    apr_uint32_t width;         /* counters per row, a power of two */
+    apr_uint32_t lookups;       /* since the counters were last halved */
+    apr_uint32_t aging;         /* set while the counters are halved */
+    apr_uint32_t memory_hits;
+    apr_uint32_t disk_hits;
+    apr_uint32_t misses;
+    apr_uint32_t promotions;
+    apr_uint32_t agings;
+} cache_tiered_header_t;
+
+typedef struct {
+    cache_tiered_header_t *header;
+    apr_uint32_t *counters;     /* CACHE_TIERED_ROWS * width */
+} cache_tiered_sketch_t;
+
+typedef struct {
+    const cache_provider *provider;
+    cache_handle_t h;
+    int active;                 /* the entity is being stored in the tier */
+} cache_tiered_tier_t;
+
+typedef struct {
+    request_rec *r;
+    const char *name;           /* the key given by mod_cache */
+    cache_tiered_tier_t tiers[CACHE_TIERED_NUM];
+    int source;                 /* the tier an opened entity comes from */
+    int promote;
+    apr_bucket_brigade *mid;    /* between the disk and the memory tiers */
+} cache_tiered_object_t;
+
+/* What the last lookup of the request found, for create_entity() */
+typedef struct {
+    const char *name;
+    int resident;
+} cache_tiered_request_t;
+
+typedef struct {
+    const char *memory_name;
+    const char *disk_name;
+    const cache_provider *memory;
+    const cache_provider *disk;
+    apr_uint32_t width;
+    int promote;
+    unsigned int memory_set:1;
+    unsigned int disk_set:1;
+    unsigned int promote_set:1;
+} cache_tiered_conf;
+
+static const char * const cache_tiered_shm = "cache-tiered.shm";
+static apr_shm_t *tiered_shm = NULL;
+static cache_tiered_sketch_t *sketch = NULL;
+
+static void tiered_hash(const char *key, apr_uint32_t *h1, apr_uint32_t *h2)
+{
+    /* FNV-1a, 64 bits, split in two independent halves */
+    apr_uint64_t h = APR_UINT64_C(0xcbf29ce484222325);
+    const unsigned char *p;
+
+    for (p = (const unsigned char *)key; *p; ++p) {
+        h ^= *p;
+        h *= APR_UINT64_C(0x100000001b3);
+    }
+    *h1 = (apr_uint32_t)h;
+    *h2 = (apr_uint32_t)(h >> 32) | 1;
+}
+
+static apr_uint32_t *tiered_counter(apr_uint32_t h1, apr_uint32_t h2,
+                                    apr_uint32_t row)
+{
+    apr_uint32_t width = sketch->header->width;
+
+    return &sketch->counters[row * width + ((h1 + row * h2) & (width - 1))];
+}
+
+static void tiered_age(void)
+{
+    apr_uint32_t i, n = CACHE_TIERED_ROWS * sketch->header->width;
+
+    /* racing increments may be lost, which the estimate can afford */
+    for (i = 0; i < n; ++i) {
+        apr_atomic_set32(&sketch->counters[i],
+                         apr_atomic_read32(&sketch->counters[i]) >> 1);
+    }
+    apr_atomic_set32(&sketch->header->lookups, 0);
+    apr_atomic_inc32(&sketch->header->agings);
+}
+
+/* Count a lookup of the key, returning the estimated number of lookups */
+static apr_uint32_t tiered_count(const char *key)
+{
+    apr_uint32_t h1, h2, i, count, estimate = APR_UINT32_MAX;
+
+    if (!sketch) {
+        return 0;
+    }
+
+    tiered_hash(key, &h1, &h2);
+    for (i = 0; i < CACHE_TIERED_ROWS; ++i) {
+        count = apr_atomic_inc32(tiered_counter(h1, h2, i)) + 1;
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+
+    if (apr_atomic_inc32(&sketch->header->lookups)
+            >= sketch->header->width * CACHE_TIERED_SAMPLE
+        && !apr_atomic_cas32(&sketch->header->aging, 1, 0)) {
+        tiered_age();
+        apr_atomic_set32(&sketch->header->aging, 0);
+    }
+
+    return estimate;
+}
+
+/* Count the stat in the shared header */
+#define tiered_stat(field) \
+    do { if (sketch) apr_atomic_inc32(&sketch->header->field); } while (0)
+
+static int tiered_admit(request_rec *r, cache_tiered_conf *conf,
+                        const char *key)
+{
+    cache_tiered_request_t *req = ap_get_module_config(r->request_config,
+                                                       &cache_tiered_module);
+    apr_uint32_t h1, h2, i, count, estimate = APR_UINT32_MAX;
+
+    /* refresh what the memory tier has, lest it shadows the disk tier */
+    if (req && req->resident && !strcmp(req->name, key)) {
+        return 1;
+    }
+    if (!sketch) {
+        return 0;
+    }
+
+    tiered_hash(key, &h1, &h2);
+    for (i = 0; i < CACHE_TIERED_ROWS; ++i) {
+        count = apr_atomic_read32(tiered_counter(h1, h2, i));
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+
+    return estimate >= (apr_uint32_t)conf->promote;
+}
+
+static void tiered_request(request_rec *r, const char *key, int resident)
+{
+    cache_tiered_request_t *req = ap_get_module_config(r->request_config,
+                                                       &cache_tiered_module);
+
+    if (!req) {
+        req = apr_pcalloc(r->pool, sizeof(cache_tiered_request_t));
+        ap_set_module_config(r->request_config, &cache_tiered_module, req);
+    }
+    req->name = key;
+    req->resident = resident;
+}
+
+static cache_object_t *tiered_object(request_rec *r, cache_tiered_conf *conf,
+                                     const char *key)
+{
+    cache_object_t *obj = apr_pcalloc(r->pool, sizeof(cache_object_t));
+    cache_tiered_object_t *tobj = apr_pcalloc(r->pool,
+                                              sizeof(cache_tiered_object_t));
+
+    tobj->r = r;
+    tobj->name = apr_pstrdup(r->pool, key);
+    tobj->tiers[CACHE_TIERED_MEMORY].provider = conf->memory;
+    tobj->tiers[CACHE_TIERED_DISK].provider = conf->disk;
+    tobj->mid = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    obj->key = tobj->name;
+    obj->vobj = tobj;
+
+    return obj;
+}
+
+/* Expose the entity of the source tier through the outer handle */
+static void tiered_sync(cache_handle_t *h)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    cache_handle_t *sh = &tobj->tiers[tobj->source].h;
+
+    h->cache_obj->key = sh->cache_obj->key;
+    h->cache_obj->info = sh->cache_obj->info;
+    h->req_hdrs = sh->req_hdrs;
+    h->resp_hdrs = sh->resp_hdrs;
+}
+
+static int tiered_active(cache_tiered_object_t *tobj)
+{
+    return tobj->tiers[CACHE_TIERED_MEMORY].active
+        || tobj->tiers[CACHE_TIERED_DISK].active;
+}
+
+static int create_entity(cache_handle_t *h, request_rec *r, const char *key,
+        apr_off_t len, apr_bucket_brigade *bb)
+{
+    cache_tiered_conf *conf = ap_get_module_config(r->server->module_config,
+                                                   &cache_tiered_module);
+    cache_object_t *obj;
+    cache_tiered_object_t *tobj;
+    cache_tiered_tier_t *t;
+
+    if (!conf->memory || !conf->disk) {
+        return DECLINED;
+    }
+
+    obj = tiered_object(r, conf, key);
+    tobj = (cache_tiered_object_t *) obj->vobj;
+
+    /* write through to the disk tier */
+    t = &tobj->tiers[CACHE_TIERED_DISK];
+    t->active = (t->provider->create_entity(&t->h, r, key, len, bb) == OK);
+
+    t = &tobj->tiers[CACHE_TIERED_MEMORY];
+    if (tiered_admit(r, conf, key)) {
+        t->active = (t->provider->create_entity(&t->h, r, key, len, bb) == OK);
+    }
+
+    if (!tiered_active(tobj)) {
+        return DECLINED;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10588)
+            "Caching URL %s, disk tier: %s, memory tier: %s", key,
+            tobj->tiers[CACHE_TIERED_DISK].active ? "yes" : "no",
+            tobj->tiers[CACHE_TIERED_MEMORY].active ? "yes" : "no");
+
+    h->cache_obj = obj;
+    h->req_hdrs = NULL;
+    h->resp_hdrs = NULL;
+
+    return OK;
+}
+
+static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
+{
+    cache_tiered_conf *conf = ap_get_module_config(r->server->module_config,
+                                                   &cache_tiered_module);
+    cache_object_t *obj;
+    cache_tiered_object_t *tobj;
+    cache_tiered_tier_t *t;
+    apr_uint32_t count;
+
+    h->cache_obj = NULL;
+
+    if (!conf->memory || !conf->disk) {
+        return DECLINED;
+    }
+
+    count = tiered_count(key);
+
+    obj = tiered_object(r, conf, key);
+    tobj = (cache_tiered_object_t *) obj->vobj;
+
+    t = &tobj->tiers[CACHE_TIERED_MEMORY];
+    if (t->provider->open_entity(&t->h, r, key) == OK) {
+        tobj->source = CACHE_TIERED_MEMORY;
+        tiered_stat(memory_hits);
+    }
+    else {
+        t = &tobj->tiers[CACHE_TIERED_DISK];
+        if (t->provider->open_entity(&t->h, r, key) != OK) {
+            tiered_request(r, key, 0);
+            tiered_stat(misses);
+            return DECLINED;
+        }
+        tobj->source = CACHE_TIERED_DISK;
+        tobj->promote = (count >= (apr_uint32_t)conf->promote);
+        tiered_stat(disk_hits);
+    }
+    tiered_request(r, key, tobj->source == CACHE_TIERED_MEMORY);
+
+    /* a revalidated entity has its headers stored back where it was found */
+    tobj->tiers[tobj->source].active = 1;
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+            "Recalled URL %s from the %s tier, %u lookups%s", key,
+            tobj->source == CACHE_TIERED_MEMORY ? "memory" : "disk", count,
+            tobj->promote ? ", promoting" : "");
+
+    h->cache_obj = obj;
+    tiered_sync(h);
+
+    return OK;
+}
+
+static int remove_entity(cache_handle_t *h)
+{
+    cache_tiered_object_t *tobj;
+    int i;
+
+    if (h->cache_obj) {
+        tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+        for (i = 0; i < CACHE_TIERED_NUM; ++i) {
+            if (tobj->tiers[i].h.cache_obj) {
+                tobj->tiers[i].provider->remove_entity(&tobj->tiers[i].h);
+            }
+        }
+    }
+
+    /* Null out the cache object pointer so next time we start from scratch  */
+    h->cache_obj = NULL;
+    return OK;
+}
+
+/* Run the operation on the entity in both tiers, opening it as needed */
+static int tiered_each(cache_handle_t *h, request_rec *r, int remove)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    int i, rv = DECLINED;
+
+    for (i = 0; i < CACHE_TIERED_NUM; ++i) {
+        cache_tiered_tier_t *t = &tobj->tiers[i];
+
+        if (!t->h.cache_obj
+            && t->provider->open_entity(&t->h, r, tobj->name) != OK) {
+            continue;
+        }
+        if (remove) {
+            if (t->provider->remove_url(&t->h, r) == OK) {
+                rv = OK;
+            }
+        }
+        else {
+            if (t->provider->invalidate_entity(&t->h, r) == APR_SUCCESS) {
+                rv = OK;
+            }
+        }
+    }
+
+    return rv;
+}
+
+static int remove_url(cache_handle_t *h, request_rec *r)
+{
+    if (!h->cache_obj) {
+        return DECLINED;
+    }
+    return tiered_each(h, r, 1);
+}
+
+static apr_status_t recall_headers(cache_handle_t *h, request_rec *r)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    cache_tiered_tier_t *t = &tobj->tiers[tobj->source];
+    apr_status_t rv;
+
+    rv = t->provider->recall_headers(&t->h, r);
+    if (rv == APR_SUCCESS) {
+        tiered_sync(h);
+    }
+
+    return rv;
+}
+
+/* Copy an entity recalled from the disk tier to the memory tier */
+static void tiered_promote(cache_handle_t *h, apr_pool_t *p,
+                           apr_bucket_brigade *bb)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    cache_tiered_tier_t *t = &tobj->tiers[CACHE_TIERED_MEMORY];
+    request_rec *r = tobj->r;
+    apr_bucket_brigade *tmp;
+    apr_bucket *eos;
+    apr_off_t len;
+    apr_status_t rv;
+
+    /* a stale entity waits to be refreshed, and stored in both tiers */
+    if (r->header_only || h->cache_obj->info.expire < r->request_time) {
+        return;
+    }
+
+    if (apr_brigade_length(bb, 0, &len) != APR_SUCCESS || len < 0) {
+        return;
+    }
+
+    if (t->provider->create_entity(&t->h, r, tobj->name, len, bb) != OK) {
+        return;
+    }
+
+    rv = t->provider->store_headers(&t->h, r, &h->cache_obj->info);
+    if (rv != APR_SUCCESS) {
+        t->provider->remove_entity(&t->h);
+        return;
+    }
+
+    /* the body is complete, have the tier see its end */
+    eos = apr_bucket_eos_create(bb->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(bb, eos);
+    tmp = apr_brigade_create(p, bb->bucket_alloc);
+    while (rv == APR_SUCCESS && !APR_BRIGADE_EMPTY(bb)) {
+        rv = t->provider->store_body(&t->h, r, bb, tmp);
+    }
+    APR_BRIGADE_PREPEND(bb, tmp);
+    apr_bucket_delete(eos);
+    apr_brigade_destroy(tmp);
+
+    if (rv == APR_SUCCESS) {
+        rv = t->provider->commit_entity(&t->h, r);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10589)
+                "Could not promote URL %s to the memory tier", tobj->name);
+        t->provider->remove_entity(&t->h);
+        return;
+    }
+
+    tiered_stat(promotions);
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10590)
+            "Promoted URL %s to the memory tier", tobj->name);
+}
+
+static apr_status_t recall_body(cache_handle_t *h, apr_pool_t *p,
+                                apr_bucket_brigade *bb)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    cache_tiered_tier_t *t = &tobj->tiers[tobj->source];
+    apr_status_t rv;
+
+    rv = t->provider->recall_body(&t->h, p, bb);
+    if (rv == APR_SUCCESS && tobj->promote) {
+        tobj->promote = 0;
+        tiered_promote(h, p, bb);
+    }
+
+    return rv;
+}
+
+static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
+        cache_info *info)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    apr_status_t rv = APR_EGENERAL;
+    int i;
+
+    for (i = 0; i < CACHE_TIERED_NUM; ++i) {
+        cache_tiered_tier_t *t = &tobj->tiers[i];
+
+        if (!t->active) {
+            continue;
+        }
+        rv = t->provider->store_headers(&t->h, r, info);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10591)
+                    "Could not store headers of URL %s in the %s tier",
+                    tobj->name, i == CACHE_TIERED_MEMORY ? "memory" : "disk");
+            t->active = 0;
+        }
+    }
+
+    if (!tiered_active(tobj)) {
+        return rv;
+    }
+    h->cache_obj->info = *info;
+
+    return APR_SUCCESS;
+}
+
+/* Have a tier store what it can of the brigade in, the rest moving to out
+ * untouched should the tier fail.
+ */
+static void tiered_store(cache_tiered_object_t *tobj, int tier,
+                         request_rec *r, apr_bucket_brigade *in,
+                         apr_bucket_brigade *out)
+{
+    cache_tiered_tier_t *t = &tobj->tiers[tier];
+    apr_bucket *first = APR_BRIGADE_FIRST(in);
+    apr_status_t rv;
+
+    if (t->active) {
+        rv = t->provider->store_body(&t->h, r, in, out);
+        if (rv == APR_SUCCESS && !APR_BRIGADE_EMPTY(in)
+            && APR_BRIGADE_FIRST(in) == first) {
+            /* no progress, don't spin */
+            rv = APR_EGENERAL;
+        }
+        if (rv == APR_SUCCESS) {
+            return;
+        }
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10592)
+                "Could not store body of URL %s in the %s tier",
+                tobj->name, tier == CACHE_TIERED_MEMORY ? "memory" : "disk");
+        t->active = 0;
+    }
+
+    APR_BRIGADE_CONCAT(out, in);
+}
+
+static apr_status_t store_body(cache_handle_t *h, request_rec *r,
+        apr_bucket_brigade *in, apr_bucket_brigade *out)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+
+    /* in -> disk tier -> mid -> memory tier -> out; a tier may take only
+     * part of its input, what is left in mid is drained once mod_cache
+     * has nothing more to give us.
+     */
+    do {
+        if (!APR_BRIGADE_EMPTY(in)) {
+            tiered_store(tobj, CACHE_TIERED_DISK, r, in, tobj->mid);
+        }
+        if (!APR_BRIGADE_EMPTY(tobj->mid)) {
+            tiered_store(tobj, CACHE_TIERED_MEMORY, r, tobj->mid, out);
+        }
+    } while (APR_BRIGADE_EMPTY(in) && !APR_BRIGADE_EMPTY(tobj->mid));
+
+    if (!tiered_active(tobj)) {
+        return APR_EGENERAL;
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
+{
+    cache_tiered_object_t *tobj = (cache_tiered_object_t *) h->cache_obj->vobj;
+    apr_status_t rv = APR_EGENERAL;
+    int i, committed = 0;
+
+    for (i = 0; i < CACHE_TIERED_NUM; ++i) {
+        cache_tiered_tier_t *t = &tobj->tiers[i];
+
+        if (!t->active) {
+            continue;
+        }
+        rv = t->provider->commit_entity(&t->h, r);
+        if (rv == APR_SUCCESS) {
+            committed = 1;
+        }
+        else {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10593)
+                    "Could not commit URL %s to the %s tier",
+                    tobj->name, i == CACHE_TIERED_MEMORY ? "memory" : "disk");
+        }
+    }
+
+    return committed ? APR_SUCCESS : rv;
+}
+
+static apr_status_t invalidate_entity(cache_handle_t *h, request_rec *r)
+{
+    return tiered_each(h, r, 0) == OK ? APR_SUCCESS : APR_NOTFOUND;
+}
+
+static void *create_config(apr_pool_t *p, server_rec *s)
+{
+    cache_tiered_conf *conf = apr_pcalloc(p, sizeof(cache_tiered_conf));
+
+    conf->memory_name = DEFAULT_MEMORY_PROVIDER;
+    conf->disk_name = DEFAULT_DISK_PROVIDER;
+    conf->width = DEFAULT_SKETCH_WIDTH;
+    conf->promote = DEFAULT_PROMOTE;
+
+    return conf;
+}
+
+static void *merge_config(apr_pool_t *p, void *basev, void *addv)
+{
+    cache_tiered_conf *new = apr_pcalloc(p, sizeof(cache_tiered_conf));
+    cache_tiered_conf *add = (cache_tiered_conf *) addv;
+    cache_tiered_conf *base = (cache_tiered_conf *) basev;
+
+    new->memory_name = (add->memory_set == 0) ? base->memory_name
+                                              : add->memory_name;
+    new->memory_set = add->memory_set || base->memory_set;
+    new->disk_name = (add->disk_set == 0) ? base->disk_name : add->disk_name;
+    new->disk_set = add->disk_set || base->disk_set;
+    new->promote = (add->promote_set == 0) ? base->promote : add->promote;
+    new->promote_set = add->promote_set || base->promote_set;
+    new->width = base->width;
+
+    return new;
+}
+
+static const char *set_cache_memory(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_tiered_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                   &cache_tiered_module);
+
+    if (!strcasecmp(arg, "tiered")) {
+        return "CacheTieredMemory cannot be the tiered cache itself";
+    }
+    conf->memory_name = arg;
+    conf->memory_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_disk(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_tiered_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                   &cache_tiered_module);
+
+    if (!strcasecmp(arg, "tiered")) {
+        return "CacheTieredDisk cannot be the tiered cache itself";
+    }
+    conf->disk_name = arg;
+    conf->disk_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_promote(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_tiered_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                   &cache_tiered_module);
+    apr_off_t promote;
+
+    if (apr_strtoff(&promote, arg, NULL, 10) != APR_SUCCESS || promote < 1
+        || promote > APR_INT32_MAX) {
+        return "CacheTieredPromote argument must be a positive integer.";
+    }
+    conf->promote = (int)promote;
+    conf->promote_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_sketch_width(cmd_parms *parms,
+        void *in_struct_ptr, const char *arg)
+{
+    cache_tiered_conf *conf = ap_get_module_config(parms->server->module_config,
+                                                   &cache_tiered_module);
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+    apr_off_t width;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (apr_strtoff(&width, arg, NULL, 10) != APR_SUCCESS
+        || width < 1024 || width > (1 << 24)) {
+        return "CacheTieredSketchWidth argument must be an integer "
+               "between 1024 and 16777216.";
+    }
+
+    /* round up to a power of two */
+    conf->width = 1024;
+    while (conf->width < width) {
+        conf->width <<= 1;
+    }
+    return NULL;
+}
+
+static apr_status_t tiered_cleanup(void *data)
+{
+    if (tiered_shm) {
+        apr_shm_destroy(tiered_shm);
+        tiered_shm = NULL;
+    }
+    sketch = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_status_t tiered_sketch_create(apr_pool_t *pconf, server_rec *s,
+                                         apr_uint32_t width)
+{
+    apr_size_t size = sizeof(cache_tiered_header_t)
+                      + sizeof(apr_uint32_t) * CACHE_TIERED_ROWS * width;
+    apr_status_t rv;
+    char *base;
+
+    rv = apr_shm_create(&tiered_shm, size, NULL, pconf);
+    if (rv == APR_ENOTIMPL) {
+        /* no anonymous shared memory here, use a named segment */
+        const char *fname = ap_runtime_dir_relative(pconf, cache_tiered_shm);
+
+        apr_shm_remove(fname, pconf);
+        rv = apr_shm_create(&tiered_shm, size, fname, pconf);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10594)
+                     "Could not allocate %" APR_SIZE_T_FMT " bytes of "
+                     "shared memory for the tiered cache", size);
+        return rv;
+    }
+    apr_pool_cleanup_register(pconf, NULL, tiered_cleanup,
+                              apr_pool_cleanup_null);
+
+    base = apr_shm_baseaddr_get(tiered_shm);
+    memset(base, 0, size);
+    sketch = apr_palloc(pconf, sizeof(cache_tiered_sketch_t));
+    sketch->header = (cache_tiered_header_t *) base;
+    sketch->counters = (apr_uint32_t *) (base + sizeof(cache_tiered_header_t));
+    sketch->header->width = width;
+
+    return APR_SUCCESS;
+}
+
+static int tiered_status_hook(request_rec *r, int flags)
+{
+    cache_tiered_header_t header;
+    apr_uint64_t lookups;
+
+    if (!sketch) {
+        return DECLINED;
+    }
+    header = *sketch->header;
+    lookups = (apr_uint64_t)header.memory_hits + header.disk_hits
+              + header.misses;
+
+#define TIERED_RATIO(n) (lookups ? (double)(n) * 100 / lookups : 0.0)
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr>\n"
+                 "<table cellspacing=0 cellpadding=0>\n"
+                 "<tr><td bgcolor=\"#000000\">\n"
+                 "<b><font color=\"#ffffff\" face=\"Arial,Helvetica\">"
+                 "mod_cache_tiered Status:</font></b>\n"
+                 "</td></tr>\n"
+                 "<tr><td bgcolor=\"#ffffff\">\n", r);
+        ap_rprintf(r, "lookups: <b>%" APR_UINT64_T_FMT "</b>, "
+                   "memory hits: <b>%u</b> (%.1f%%), "
+                   "disk hits: <b>%u</b> (%.1f%%), "
+                   "misses: <b>%u</b> (%.1f%%)<br>", lookups,
+                   header.memory_hits, TIERED_RATIO(header.memory_hits),
+                   header.disk_hits, TIERED_RATIO(header.disk_hits),
+                   header.misses, TIERED_RATIO(header.misses));
+        ap_rprintf(r, "promotions to memory: <b>%u</b><br>",
+                   header.promotions);
+        ap_rprintf(r, "sketch: <b>%u</b>x<b>%u</b> counters, "
+                   "halved <b>%u</b> times<br>", CACHE_TIERED_ROWS,
+                   header.width, header.agings);
+        ap_rputs("</td></tr>\n</table>\n", r);
+    }
+    else {
+        ap_rprintf(r, "CacheTieredLookups: %" APR_UINT64_T_FMT "\n", lookups);
+        ap_rprintf(r, "CacheTieredMemoryHits: %u\n", header.memory_hits);
+        ap_rprintf(r, "CacheTieredDiskHits: %u\n", header.disk_hits);
+        ap_rprintf(r, "CacheTieredMisses: %u\n", header.misses);
+        ap_rprintf(r, "CacheTieredMemoryHitRatio: %.1f\n",
+                   TIERED_RATIO(header.memory_hits));
+        ap_rprintf(r, "CacheTieredDiskHitRatio: %.1f\n",
+                   TIERED_RATIO(header.disk_hits));
+        ap_rprintf(r, "CacheTieredPromotions: %u\n", header.promotions);
+    }
+
+#undef TIERED_RATIO
+
+    return OK;
+}
+
+static int tiered_precfg(apr_pool_t *pconf, apr_pool_t *plog,
+                         apr_pool_t *ptmp)
+{
+    /* Register to handle mod_status status page generation */
+    APR_OPTIONAL_HOOK(ap, status_hook, tiered_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
+
+    return OK;
+}
+
+static const cache_provider *tiered_lookup(server_rec *s, const char *name,
+                                           int explicit, const char *directive,
+                                           int *failed)
+{
+    const cache_provider *provider = ap_lookup_provider(CACHE_PROVIDER_GROUP,
+                                                        name, "0");
+
+    if (!provider && explicit) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, 0, s, APLOGNO(10595)
+                     "%s: no cache provider named '%s', is its module "
+                     "loaded?", directive, name);
+        *failed = 1;
+    }
+
+    return provider;
+}
+
+static int tiered_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptmp, server_rec *s)
+{
+    cache_tiered_conf *conf = ap_get_module_config(s->module_config,
+                                                   &cache_tiered_module);
+    server_rec *sp;
+    int failed = 0;
+
+    for (sp = s; sp; sp = sp->next) {
+        cache_tiered_conf *sconf = ap_get_module_config(sp->module_config,
+                                                        &cache_tiered_module);
+
+        sconf->memory = tiered_lookup(sp, sconf->memory_name,
+                                      sconf->memory_set, "CacheTieredMemory",
+                                      &failed);
+        sconf->disk = tiered_lookup(sp, sconf->disk_name, sconf->disk_set,
+                                    "CacheTieredDisk", &failed);
+    }
+    if (failed) {
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+
+    if (tiered_sketch_create(pconf, s, conf->width) != APR_SUCCESS) {
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+
+    return OK;
+}
+
+static const command_rec cache_tiered_cmds[] =
+{
+    AP_INIT_TAKE1("CacheTieredMemory", set_cache_memory, NULL, RSRC_CONF,
+            "The cache provider of the memory tier"),
+    AP_INIT_TAKE1("CacheTieredDisk", set_cache_disk, NULL, RSRC_CONF,
+            "The cache provider of the disk tier"),
+    AP_INIT_TAKE1("CacheTieredPromote", set_cache_promote, NULL, RSRC_CONF,
+            "The number of recent lookups for an entity to be kept in "
+            "the memory tier"),
+    AP_INIT_TAKE1("CacheTieredSketchWidth", set_cache_sketch_width, NULL,
+            RSRC_CONF,
+            "The number of counters per row of the popularity sketch"),
+    { NULL }
+};
+
+static const cache_provider cache_tiered_provider =
+{
+    &remove_entity, &store_headers, &store_body, &recall_headers, &recall_body,
+    &create_entity, &open_entity, &remove_url, &commit_entity,
+    &invalidate_entity
+};
+
+static void cache_tiered_register_hook(apr_pool_t *p)
+{
+    /* cache initializer */
+    ap_register_provider(p, CACHE_PROVIDER_GROUP, "tiered", "0",
+            &cache_tiered_provider);
+    ap_hook_pre_config(tiered_precfg, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(tiered_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(cache_tiered) = { STANDARD20_MODULE_STUFF,
+    NULL, /* create per-directory config structure */
+    NULL, /* merge per-directory config structures */
+    create_config, /* create per-server config structure */
+    merge_config, /* merge per-server config structures */
+    cache_tiered_cmds, /* command apr_table_t */
+    cache_tiered_register_hook /* register hooks */
+};
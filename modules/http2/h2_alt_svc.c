@@ -0,0 +1,122 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <apr_strings.h>
+
+#include <httpd.h>
+#include <http_core.h>
+#include <http_config.h>
+#include <http_protocol.h>
+#include <http_request.h>
+#include <http_ssl.h>
+#include <http_log.h>
+
+#include "h2_private.h"
+#include "h2.h"
+#include "h2_alt_svc.h"
+#include "h2_config.h"
+
+/*******************************************************************************
+ * parsing
+ ******************************************************************************/
+
+h2_alt_svc *h2_alt_svc_parse(const char *s, apr_pool_t *pool)
+{
+    const char *sep = ap_strchr_c(s, '=');
+    const char *colon;
+    h2_alt_svc *as;
+
+    if (!sep || sep == s) {
+        return NULL;
+    }
+    as = apr_pcalloc(pool, sizeof(*as));
+    as->alpn = apr_pstrndup(pool, s, (apr_size_t)(sep - s));
+    if (*ap_scan_http_token(as->alpn)) {
+        return NULL;
+    }
+    s = sep + 1;
+    colon = ap_strrchr_c(s, ':');
+    if (!colon) {
+        return NULL;
+    }
+    if (colon != s) {
+        as->host = apr_pstrndup(pool, s, (apr_size_t)(colon - s));
+    }
+    as->port = (int)apr_atoi64(colon + 1);
+    if (as->port <= 0 || as->port > 65535) {
+        return NULL;
+    }
+    return as;
+}
+
+/*******************************************************************************
+ * announcing
+ ******************************************************************************/
+
+static int h2_alt_svc_fixups(request_rec *r)
+{
+    apr_array_header_t *alt_svcs;
+    conn_rec *c;
+    const char *value = NULL;
+    int i, max_age;
+
+    if (r->main || r->prev) {
+        return DECLINED;
+    }
+    alt_svcs = h2_config_alt_svcs(r->server);
+    if (!alt_svcs || alt_svcs->nelts <= 0 || !r->hostname) {
+        return DECLINED;
+    }
+    /* Clients send this when the request already arrives via an
+     * announced alternative. Nothing more to tell them. */
+    if (apr_table_get(r->headers_in, "Alt-Used")) {
+        return DECLINED;
+    }
+    /* On HTTP/1.1, announce on the first response of a connection only.
+     * HTTP/2 requests are served on secondary connections, where this
+     * check does not apply, but they share the same main connection. */
+    c = r->connection->master? r->connection->master : r->connection;
+    if (!r->connection->master && r->connection->keepalives > 0) {
+        return DECLINED;
+    }
+    /* Alternative services, especially on other hosts, need the
+     * authority to have been verified over TLS. */
+    if (!ap_ssl_conn_is_ssl(c)) {
+        return DECLINED;
+    }
+
+    max_age = h2_config_sgeti(r->server, H2_CONF_ALT_SVC_MAX_AGE);
+    for (i = 0; i < alt_svcs->nelts; ++i) {
+        const h2_alt_svc *as = APR_ARRAY_IDX(alt_svcs, i, const h2_alt_svc*);
+        const char *entry = apr_psprintf(r->pool, "%s=\"%s:%d\"%s",
+                                         as->alpn, as->host? as->host : "",
+                                         as->port, (max_age >= 0)?
+                                         apr_psprintf(r->pool, "; ma=%d", max_age) : "");
+        value = value? apr_pstrcat(r->pool, value, ", ", entry, NULL) : entry;
+    }
+    if (value) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                      "h2_alt_svc: announcing %s", value);
+        apr_table_setn(r->err_headers_out, "Alt-Svc", value);
+    }
+    return DECLINED;
+}
+
+void h2_alt_svc_register_hooks(void)
+{
+    ap_hook_fixups(h2_alt_svc_fixups, NULL, NULL, APR_HOOK_LAST);
+}
@@ -0,0 +1,44 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __mod_h2__h2_alt_svc__
+#define __mod_h2__h2_alt_svc__
+
+/**
+ * Announcement of alternative services (RFC 7838), e.g. a HTTP/3
+ * endpoint terminating QUIC for this server, via the "Alt-Svc"
+ * response header on HTTP/1.1 and HTTP/2 responses.
+ */
+typedef struct h2_alt_svc h2_alt_svc;
+
+struct h2_alt_svc {
+    const char *alpn;      /* ALPN protocol id of the service, e.g. "h3" */
+    const char *host;      /* host name of the service, NULL for same host */
+    int port;              /* port the service listens on */
+};
+
+/**
+ * Parse an alternative service from a string of the form
+ * "alpn-id=[host]:port", e.g. "h3=:443".
+ * @param s the string to parse
+ * @param pool the pool to allocate from
+ * @return the parsed service or NULL if the string is not valid
+ */
+h2_alt_svc *h2_alt_svc_parse(const char *s, apr_pool_t *pool);
+
+void h2_alt_svc_register_hooks(void);
+
+#endif /* defined(__mod_h2__h2_alt_svc__) */
@@ -581,7 +581,9 @@ cleanup:
     }
     apr_thread_cond_broadcast(beam->change);
 
-    report_consumption(beam, 1);
+    if (beam->recv_bytes - beam->recv_bytes_reported >= beam->report_threshold) {
+        report_consumption(beam, 1);
+    }
     if (beam->aborted) {
         rv = APR_ECONNABORTED;
     }
@@ -724,7 +726,9 @@ transfer:
         ++consumed_buckets;
     }
 
-    if (beam->recv_cb && consumed_buckets > 0) {
+    if (beam->recv_cb && consumed_buckets > 0
+        && (beam->recv_bytes - beam->recv_bytes_reported >= beam->report_threshold
+            || buffer_is_empty(beam) || beam->closed)) {
         beam->recv_cb(beam->recv_ctx, beam);
     }
 
@@ -764,6 +768,13 @@ void h2_beam_on_consumed(h2_bucket_beam *beam,
     apr_thread_mutex_unlock(beam->lock);
 }
 
+void h2_beam_set_report_threshold(h2_bucket_beam *beam, apr_off_t threshold)
+{
+    apr_thread_mutex_lock(beam->lock);
+    beam->report_threshold = threshold;
+    apr_thread_mutex_unlock(beam->lock);
+}
+
 void h2_beam_on_received(h2_bucket_beam *beam,
                          h2_beam_ev_callback *recv_cb, void *ctx)
 {
@@ -72,6 +72,7 @@ struct h2_bucket_beam {
 
     apr_off_t recv_bytes;             /* amount of bytes transferred in h2_beam_receive() */
     apr_off_t recv_bytes_reported;    /* amount of bytes reported as received via callback */
+    apr_off_t report_threshold;       /* min unreported bytes before reporting/notifying */
     h2_beam_io_callback *cons_io_cb;  /* report: recv_bytes deltas for sender */
     void *cons_ctx;
 };
@@ -207,6 +208,17 @@ void h2_beam_on_consumed(h2_bucket_beam *beam,
 void h2_beam_on_received(h2_bucket_beam *beam,
                          h2_beam_ev_callback *recv_cb, void *ctx);
 
+/**
+ * Set the amount of received, but not yet reported, bytes that need
+ * to accumulate before the received callback is invoked or h2_beam_send()
+ * reports the consumption. Notifications still happen whenever the
+ * receiver has emptied the beam, so a sender waiting on the consumption
+ * is never stalled. 0, the default, reports on every transfer.
+ * @param beam the beam to set the threshold on
+ * @param threshold the number of bytes to collect
+ */
+void h2_beam_set_report_threshold(h2_bucket_beam *beam, apr_off_t threshold);
+
 /**
  * Register a callback to be invoked on the receiver side whenever
  * APR_EAGAIN is being returned in h2_beam_receive().
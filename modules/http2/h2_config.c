@@ -30,6 +30,7 @@
 #include <apr_strings.h>
 
 #include "h2.h"
+#include "h2_alt_svc.h"
 #include "h2_conn_ctx.h"
 #include "h2_c1.h"
 #include "h2_config.h"
@@ -79,6 +80,11 @@ typedef struct h2_config {
     int max_data_frame_len;          /* max # bytes in a single h2 DATA frame */
     int proxy_requests;              /* act as forward proxy */
     int h2_websockets;               /* if mod_h2 negotiating WebSockets */
+    int adaptive_streams;            /* adapt MAX_CONCURRENT_STREAMS to worker load */
+    apr_array_header_t *alt_svcs;    /* h2_alt_svc specs for this server */
+    int alt_svc_max_age;             /* seconds clients can rely on alt_svc info*/
+    int win_update_threshold;        /* consumed input before reporting it, 0 auto */
+    int h2_window_size_max;          /* max stream window when tuning to BDP */
 } h2_config;
 
 typedef struct h2_dir_config {
@@ -119,6 +125,11 @@ static h2_config defconf = {
     0,                      /* max DATA frame len, 0 == no extra limit */
     0,                      /* forward proxy */
     0,                      /* WebSockets negotiation, enabled */
+    0,                      /* adaptive max concurrent streams */
+    NULL,                   /* no alt-svcs */
+    -1,                     /* alt-svc max age, client default */
+    0,                      /* window update threshold, 0 == auto */
+    0,                      /* max window size, 0 == no BDP tuning */
 };
 
 static h2_dir_config defdconf = {
@@ -167,6 +178,11 @@ void *h2_config_create_svr(apr_pool_t *pool, server_rec *s)
     conf->max_data_frame_len   = DEF_VAL;
     conf->proxy_requests       = DEF_VAL;
     conf->h2_websockets        = DEF_VAL;
+    conf->adaptive_streams     = DEF_VAL;
+    conf->alt_svcs             = NULL;
+    conf->alt_svc_max_age      = DEF_VAL;
+    conf->win_update_threshold = DEF_VAL;
+    conf->h2_window_size_max   = DEF_VAL;
     return conf;
 }
 
@@ -218,6 +234,11 @@ static void *h2_config_merge(apr_pool_t *pool, void *basev, void *addv)
     n->max_data_frame_len   = H2_CONFIG_GET(add, base, max_data_frame_len);
     n->proxy_requests       = H2_CONFIG_GET(add, base, proxy_requests);
     n->h2_websockets        = H2_CONFIG_GET(add, base, h2_websockets);
+    n->adaptive_streams     = H2_CONFIG_GET(add, base, adaptive_streams);
+    n->alt_svcs             = add->alt_svcs? add->alt_svcs : base->alt_svcs;
+    n->alt_svc_max_age      = H2_CONFIG_GET(add, base, alt_svc_max_age);
+    n->win_update_threshold = H2_CONFIG_GET(add, base, win_update_threshold);
+    n->h2_window_size_max   = H2_CONFIG_GET(add, base, h2_window_size_max);
     return n;
 }
 
@@ -313,6 +334,14 @@ static apr_int64_t h2_srv_config_geti64(const h2_config *conf, h2_config_var_t v
             return H2_CONFIG_GET(conf, &defconf, proxy_requests);
         case H2_CONF_WEBSOCKETS:
             return H2_CONFIG_GET(conf, &defconf, h2_websockets);
+        case H2_CONF_ADAPTIVE_STREAMS:
+            return H2_CONFIG_GET(conf, &defconf, adaptive_streams);
+        case H2_CONF_ALT_SVC_MAX_AGE:
+            return H2_CONFIG_GET(conf, &defconf, alt_svc_max_age);
+        case H2_CONF_WIN_UPDATE_THRESHOLD:
+            return H2_CONFIG_GET(conf, &defconf, win_update_threshold);
+        case H2_CONF_WIN_SIZE_MAX:
+            return H2_CONFIG_GET(conf, &defconf, h2_window_size_max);
         default:
             return DEF_VAL;
     }
@@ -381,6 +410,18 @@ static void h2_srv_config_seti(h2_config *conf, h2_config_var_t var, int val)
         case H2_CONF_WEBSOCKETS:
             H2_CONFIG_SET(conf, h2_websockets, val);
             break;
+        case H2_CONF_ADAPTIVE_STREAMS:
+            H2_CONFIG_SET(conf, adaptive_streams, val);
+            break;
+        case H2_CONF_ALT_SVC_MAX_AGE:
+            H2_CONFIG_SET(conf, alt_svc_max_age, val);
+            break;
+        case H2_CONF_WIN_UPDATE_THRESHOLD:
+            H2_CONFIG_SET(conf, win_update_threshold, val);
+            break;
+        case H2_CONF_WIN_SIZE_MAX:
+            H2_CONFIG_SET(conf, h2_window_size_max, val);
+            break;
         default:
             break;
     }
@@ -558,6 +599,11 @@ apr_table_t *h2_config_early_headers(request_rec *r)
     return sconf? sconf->early_headers : NULL;
 }
 
+apr_array_header_t *h2_config_alt_svcs(server_rec *s)
+{
+    return h2_config_sget(s)->alt_svcs;
+}
+
 const struct h2_priority *h2_cconfig_get_priority(conn_rec *c, const char *content_type)
 {
     const h2_config *conf = h2_config_get(c);
@@ -1004,6 +1050,70 @@ static const char *h2_conf_set_proxy_requests(cmd_parms *cmd,
     return "value must be On or Off";
 }
 
+static const char *h2_conf_set_adaptive_streams(cmd_parms *cmd,
+                                                void *dirconf, const char *value)
+{
+    if (!strcasecmp(value, "On")) {
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_ADAPTIVE_STREAMS, 1);
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_ADAPTIVE_STREAMS, 0);
+        return NULL;
+    }
+    return "value must be On or Off";
+}
+
+static const char *h2_conf_add_alt_svc(cmd_parms *cmd,
+                                       void *dirconf, const char *value)
+{
+    h2_config *cfg = h2_config_sget(cmd->server);
+    h2_alt_svc *as = h2_alt_svc_parse(value, cmd->pool);
+
+    (void)dirconf;
+    if (!as) {
+        return "unable to parse alt-svc specifier, expected 'alpn-id=[host]:port'";
+    }
+    if (!cfg->alt_svcs) {
+        cfg->alt_svcs = apr_array_make(cmd->pool, 5, sizeof(h2_alt_svc*));
+    }
+    APR_ARRAY_PUSH(cfg->alt_svcs, h2_alt_svc*) = as;
+    return NULL;
+}
+
+static const char *h2_conf_set_alt_svc_max_age(cmd_parms *cmd,
+                                               void *dirconf, const char *value)
+{
+    int val = (int)apr_atoi64(value);
+    if (val < 0) {
+        return "value must be >= 0";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_ALT_SVC_MAX_AGE, val);
+    return NULL;
+}
+
+static const char *h2_conf_set_win_update_threshold(cmd_parms *cmd,
+                                                    void *dirconf, const char *value)
+{
+    int val = (int)apr_atoi64(value);
+    if (val < 0) {
+        return "value must be >= 0";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_WIN_UPDATE_THRESHOLD, val);
+    return NULL;
+}
+
+static const char *h2_conf_set_window_size_max(cmd_parms *cmd,
+                                               void *dirconf, const char *value)
+{
+    apr_int64_t val = apr_atoi64(value);
+    if (val != 0 && (val < 1024 || val > NGHTTP2_MAX_WINDOW_SIZE)) {
+        return "value must be 0 or between 1024 and 2^31-1";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_WIN_SIZE_MAX, (int)val);
+    return NULL;
+}
+
 void h2_get_workers_config(server_rec *s, int *pminw, int *pmaxw,
                            apr_time_t *pidle_limit)
 {
@@ -1077,6 +1187,16 @@ const command_rec h2_cmds[] = {
                   OR_FILEINFO, "Enables forward proxy requests via HTTP/2"),
     AP_INIT_TAKE1("H2WebSockets", h2_conf_set_websockets, NULL,
                   RSRC_CONF, "off to disable WebSockets over HTTP/2"),
+    AP_INIT_TAKE1("H2AdaptiveStreams", h2_conf_set_adaptive_streams, NULL,
+                  RSRC_CONF, "on to adapt the announced max concurrent streams to worker load"),
+    AP_INIT_TAKE1("H2AltSvc", h2_conf_add_alt_svc, NULL,
+                  RSRC_CONF, "adds an Alt-Svc for this server, e.g. 'h3=:443'"),
+    AP_INIT_TAKE1("H2AltSvcMaxAge", h2_conf_set_alt_svc_max_age, NULL,
+                  RSRC_CONF, "set the maximum age (in seconds) that client can rely on alt-svc information"),
+    AP_INIT_TAKE1("H2WindowUpdateThreshold", h2_conf_set_win_update_threshold, NULL,
+                  RSRC_CONF, "amount of consumed request body bytes collected before the window is updated"),
+    AP_INIT_TAKE1("H2WindowSizeMax", h2_conf_set_window_size_max, NULL,
+                  RSRC_CONF, "maximum stream window size when growing it to the bandwidth-delay product"),
     AP_END_CMD
 };
 
@@ -46,6 +46,10 @@ typedef enum {
     H2_CONF_MAX_DATA_FRAME_LEN,
     H2_CONF_PROXY_REQUESTS,
     H2_CONF_WEBSOCKETS,
+    H2_CONF_ADAPTIVE_STREAMS,
+    H2_CONF_ALT_SVC_MAX_AGE,
+    H2_CONF_WIN_UPDATE_THRESHOLD,
+    H2_CONF_WIN_SIZE_MAX,
 } h2_config_var_t;
 
 struct apr_hash_t;
@@ -91,6 +95,11 @@ apr_int64_t h2_config_rgeti64(request_rec *r, h2_config_var_t var);
 apr_array_header_t *h2_config_push_list(request_rec *r);
 apr_table_t *h2_config_early_headers(request_rec *r);
 
+/**
+ * Get the alternative services (h2_alt_svc*) configured for a server.
+ */
+apr_array_header_t *h2_config_alt_svcs(server_rec *s);
+
 
 void h2_get_workers_config(server_rec *s, int *pminw, int *pmaxw,
                            apr_time_t *pidle_limit);
@@ -302,6 +302,17 @@ h2_mplx *h2_mplx_c1_create(int child_num, apr_uint32_t id, h2_stream *stream0,
 
     m->max_streams = h2_config_sgeti(s, H2_CONF_MAX_STREAMS);
     m->stream_max_mem = h2_config_sgeti(s, H2_CONF_STREAM_MAX_MEM);
+    /* Collect consumed request body data before waking up c1 to
+     * update the client's window. Never wait for more than half the
+     * initial window, the client might be blocked on it. */
+    m->input_report_min = h2_config_sgeti(s, H2_CONF_WIN_SIZE) / 2;
+    if (h2_config_sgeti(s, H2_CONF_WIN_UPDATE_THRESHOLD) > 0) {
+        m->input_report_min = H2MIN(m->input_report_min,
+                                    h2_config_sgeti(s, H2_CONF_WIN_UPDATE_THRESHOLD));
+    }
+    else {
+        m->input_report_min /= 2;
+    }
 
     m->streams = h2_ihash_create(m->pool, offsetof(h2_stream,id));
     m->shold = h2_ihash_create(m->pool, offsetof(h2_stream,id));
@@ -845,6 +856,7 @@ static apr_status_t c2_setup_io(h2_mplx *m, conn_rec *c2, h2_stream *stream, h2_
         h2_beam_on_send(stream->input, c2_beam_input_write_notify, c2);
         h2_beam_on_received(stream->input, c2_beam_input_read_notify, c2);
         h2_beam_on_consumed(stream->input, c1_input_consumed, stream);
+        h2_beam_set_report_threshold(stream->input, m->input_report_min);
 #if H2_USE_PIPES
         action = "create input write pipe";
         rv = apr_file_pipe_create_pools(&conn_ctx->pipe_in[H2_PIPE_OUT],
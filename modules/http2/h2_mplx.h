@@ -75,6 +75,7 @@ struct h2_mplx {
     struct h2_iqueue *q;            /* all stream ids that need to be started */
 
     apr_size_t stream_max_mem;      /* max memory to buffer for a stream */
+    apr_off_t input_report_min;     /* consumed input to collect before reporting */
     apr_uint32_t max_streams;       /* max # of concurrent streams */
     apr_uint32_t max_stream_id_started; /* highest stream id that started processing */
 
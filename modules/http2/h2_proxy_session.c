@@ -277,6 +277,10 @@ static int on_frame_recv(nghttp2_session *ngh2, const nghttp2_frame *frame,
         case NGHTTP2_HEADERS:
             stream = nghttp2_session_get_stream_user_data(ngh2, frame->hd.stream_id);
             if (!stream) {
+                if (h2_proxy_iq_contains(session->detached, frame->hd.stream_id)) {
+                    /* stream of a request gone, reset already submitted */
+                    return 0;
+                }
                 return NGHTTP2_ERR_CALLBACK_FAILURE;
             }
             r = stream->r;
@@ -562,6 +566,7 @@ static int on_stream_close(nghttp2_session *ngh2, int32_t stream_id,
 {
     h2_proxy_session *session = user_data;
     h2_proxy_stream *stream;
+    h2_proxy_iq_remove(session->detached, stream_id);
     if (!session->aborted) {
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03360)
                       "h2_proxy_session(%s): stream=%d, closed, err=%d", 
@@ -614,6 +619,10 @@ static ssize_t stream_request_data(nghttp2_session *ngh2, int32_t stream_id,
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf, APLOGNO(03361)
                      "h2_proxy_stream(NULL): data_read, stream %d not found", 
                      stream_id);
+        if (h2_proxy_iq_contains(((h2_proxy_session *)user_data)->detached,
+                                 stream_id)) {
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
         return NGHTTP2_ERR_CALLBACK_FAILURE;
     }
     
@@ -747,6 +756,7 @@ h2_proxy_session *h2_proxy_session_setup(const char *id, proxy_conn_rec *p_conn,
         session->window_bits_connection = window_bits_connection;
         session->streams = h2_proxy_ihash_create(pool, offsetof(h2_proxy_stream, id));
         session->suspended = h2_proxy_iq_create(pool, 5);
+        session->detached = h2_proxy_iq_create(pool, 5);
         session->done = done;
     
         session->input = apr_brigade_create(session->pool, session->c->bucket_alloc);
@@ -951,6 +961,7 @@ static apr_status_t submit_stream(h2_proxy_session *session, h2_proxy_stream *st
     if (rv > 0) {
         stream->id = rv;
         stream->state = H2_STREAM_ST_OPEN;
+        session->last_stream_submitted = apr_time_now();
         h2_proxy_ihash_add(session->streams, stream);
         dispatch_event(session, H2_PROXYS_EV_STREAM_SUBMITTED, rv, NULL);
         
@@ -1106,6 +1117,21 @@ static int is_waiting_for_backend(h2_proxy_session *session)
                 && nghttp2_session_want_read(session->ngh2)));
 }
 
+/* When reads are limited by max_wait, the socket timeout (ProxyTimeout or
+ * the ping timeout) still applies to the time since the last frame. */
+static int is_backend_timedout(h2_proxy_session *session)
+{
+    apr_interval_time_t timeout = 0;
+    apr_socket_t *socket = ap_get_conn_socket(session->c);
+
+    if (socket) {
+        apr_socket_timeout_get(socket, &timeout);
+    }
+    return timeout >= 0
+           && (apr_time_now() - H2MAX(session->last_frame_received,
+                                      session->last_stream_submitted)) >= timeout;
+}
+
 static apr_status_t check_suspended(h2_proxy_session *session)
 {
     h2_proxy_stream *stream;
@@ -1582,11 +1608,16 @@ run_loop:
                  * configured via ProxyTimeout in our socket. There is
                  * nothing we want to send or check until we get more data
                  * from the backend. */
-                status = h2_proxy_session_read(session, 1, 0);
+                status = h2_proxy_session_read(session, 1, session->max_wait);
                 if (status == APR_SUCCESS) {
                     have_read = 1;
                     dispatch_event(session, H2_PROXYS_EV_DATA_READ, 0, NULL);
                 }
+                else if (APR_STATUS_IS_TIMEUP(status) && session->max_wait > 0
+                         && !is_backend_timedout(session)) {
+                    /* shared session, let the other requests in */
+                    transit(session, "wait cycle", H2_PROXYS_ST_BUSY);
+                }
                 else {
                     dispatch_event(session, H2_PROXYS_EV_CONN_ERROR, status, NULL);
                     return status;
@@ -1602,6 +1633,10 @@ run_loop:
                     session->wait_timeout = H2MIN(apr_time_from_msec(100), 
                                                   2*session->wait_timeout);
                 }
+                if (session->max_wait > 0) {
+                    session->wait_timeout = H2MIN(session->max_wait,
+                                                  session->wait_timeout);
+                }
                 
                 status = h2_proxy_session_read(session, 1, session->wait_timeout);
                 ap_log_cerror(APLOG_MARK, APLOG_TRACE3, status, session->c, 
@@ -1716,6 +1751,71 @@ int h2_proxy_session_is_reusable(h2_proxy_session *session)
            h2_proxy_ihash_empty(session->streams);
 }
 
+int h2_proxy_session_can_submit(h2_proxy_session *session)
+{
+    apr_size_t open_streams;
+    int max;
+
+    if (!session->ngh2) {
+        return 0;
+    }
+    switch (session->state) {
+        case H2_PROXYS_ST_INIT:
+        case H2_PROXYS_ST_IDLE:
+        case H2_PROXYS_ST_BUSY:
+        case H2_PROXYS_ST_WAIT:
+            break;
+        default:
+            return 0;
+    }
+    /* until the backend's SETTINGS arrive, this is our assumed default */
+    max = (int)nghttp2_session_get_remote_settings(
+                    session->ngh2, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+    open_streams = h2_proxy_ihash_count(session->streams)
+                   + h2_proxy_iq_count(session->detached);
+    return max > 0 && open_streams < (apr_size_t)max;
+}
+
+typedef struct {
+    request_rec *r;
+    h2_proxy_stream *stream;
+} find_iter_ctx;
+
+static int find_iter(void *udata, void *val)
+{
+    find_iter_ctx *ctx = udata;
+    h2_proxy_stream *stream = val;
+    if (stream->r == ctx->r) {
+        ctx->stream = stream;
+        return 0;
+    }
+    return 1;
+}
+
+void h2_proxy_session_detach(h2_proxy_session *session, request_rec *r)
+{
+    find_iter_ctx ctx;
+
+    ctx.r = r;
+    ctx.stream = NULL;
+    h2_proxy_ihash_iter(session->streams, find_iter, &ctx);
+    if (ctx.stream) {
+        int stream_id = ctx.stream->id;
+
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c,
+                      "h2_proxy_session(%s): detach stream %d",
+                      session->id, stream_id);
+        h2_proxy_ihash_remove(session->streams, stream_id);
+        h2_proxy_iq_remove(session->suspended, stream_id);
+        if (session->ngh2) {
+            nghttp2_session_set_stream_user_data(session->ngh2, stream_id, NULL);
+            h2_proxy_iq_add(session->detached, stream_id, NULL, NULL);
+            nghttp2_submit_rst_stream(session->ngh2, NGHTTP2_FLAG_NONE,
+                                      stream_id, NGHTTP2_CANCEL);
+        }
+    }
+}
+
 static int ping_arrived_iter(void *udata, void *val)
 {
     h2_proxy_stream *stream = val;
@@ -93,9 +93,11 @@ struct h2_proxy_session {
 
     struct h2_proxy_ihash_t *streams;
     struct h2_proxy_iqueue *suspended;
+    struct h2_proxy_iqueue *detached; /* streams reset for requests gone */
     apr_size_t remote_max_concurrent;
     int last_stream_id;     /* last stream id processed by backend, or 0 */
     apr_time_t last_frame_received;
+    apr_time_t last_stream_submitted;
     
     apr_bucket_brigade *input;
     apr_bucket_brigade *output;
@@ -103,6 +105,10 @@ struct h2_proxy_session {
     h2_ping_state_t ping_state;
     apr_time_t ping_timeout;
     apr_time_t save_timeout;
+
+    apr_interval_time_t max_wait; /* if > 0, the longest blocking read, so
+                                   * that other requests sharing the session
+                                   * get to submit their streams */
 };
 
 h2_proxy_session *h2_proxy_session_setup(const char *id, proxy_conn_rec *p_conn,
@@ -133,4 +139,21 @@ void h2_proxy_session_cleanup(h2_proxy_session *s, h2_proxy_request_done *done);
 
 int h2_proxy_session_is_reusable(h2_proxy_session *s);
 
+/**
+ * Check if the session may take one more stream, e.g. it did not receive
+ * a GOAWAY and the backend's SETTINGS_MAX_CONCURRENT_STREAMS is not reached.
+ * @param s the session to check
+ * @return != 0 iff a stream may be submitted
+ */
+int h2_proxy_session_can_submit(h2_proxy_session *s);
+
+/**
+ * Forget about the stream of a request which is going away before the
+ * stream is done, resetting it on the backend. The session does not touch
+ * the request anymore afterwards.
+ * @param s the session the stream was submitted to
+ * @param r the request going away
+ */
+void h2_proxy_session_detach(h2_proxy_session *s, request_rec *r);
+
 #endif /* h2_proxy_session_h */
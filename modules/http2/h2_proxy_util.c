@@ -278,6 +278,17 @@ int h2_proxy_iq_remove(h2_proxy_iqueue *q, int sid)
     return 0;
 }
 
+int h2_proxy_iq_contains(h2_proxy_iqueue *q, int sid)
+{
+    int i;
+    for (i = 0; i < q->nelts; ++i) {
+        if (sid == q->elts[(q->head + i) % q->nalloc]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void h2_proxy_iq_clear(h2_proxy_iqueue *q)
 {
     q->nelts = 0;
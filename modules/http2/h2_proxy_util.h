@@ -122,6 +122,13 @@ void h2_proxy_iq_add(h2_proxy_iqueue *q, int sid, h2_proxy_iq_cmp *cmp, void *ct
  */
 int h2_proxy_iq_remove(h2_proxy_iqueue *q, int sid);
 
+/**
+ * Return != 0 iff the stream id is in the queue.
+ * @param q the task queue
+ * @param sid the stream id to look for
+ */
+int h2_proxy_iq_contains(h2_proxy_iqueue *q, int sid);
+
 /**
  * Remove all entries in the queue.
  */
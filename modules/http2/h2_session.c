@@ -229,6 +229,83 @@ static int on_invalid_frame_recv_cb(nghttp2_session *ngh2,
     return 0;
 }
 
+/* Opaque data of the PINGs we send to measure the bandwidth-delay product */
+static const uint8_t H2_BDP_PING[8] = { 'h', '2', '-', 'b', 'd', 'p', 0, 0 };
+
+/* Minimum time between two BDP measurements */
+#define H2_BDP_PING_INTERVAL    apr_time_from_msec(100)
+
+/**
+ * Uploads are limited to one stream window per round trip. While the
+ * stream window has not reached its configured maximum, measure how
+ * much DATA a client sends on a stream during one round trip, using
+ * a PING. The window is grown in on_bdp_ping_ack() when the client
+ * manages to send most of it in that time.
+ */
+static void bdp_on_data(h2_session *session, int32_t stream_id, size_t len)
+{
+    apr_time_t now;
+
+    if (session->stream_win_size >= session->stream_win_max) {
+        return;
+    }
+    if (session->bdp_stream_id) {
+        if (session->bdp_stream_id == stream_id) {
+            session->bdp_bytes += (apr_off_t)len;
+        }
+        return;
+    }
+    now = apr_time_now();
+    if (now - session->bdp_ping_at < H2_BDP_PING_INTERVAL) {
+        return;
+    }
+    if (!nghttp2_submit_ping(session->ngh2, NGHTTP2_FLAG_NONE, H2_BDP_PING)) {
+        session->bdp_stream_id = stream_id;
+        session->bdp_ping_at = now;
+        session->bdp_bytes = (apr_off_t)len;
+    }
+}
+
+static void on_bdp_ping_ack(h2_session *session)
+{
+    apr_interval_time_t rtt;
+    apr_off_t win;
+
+    if (!session->bdp_stream_id) {
+        return;
+    }
+    rtt = apr_time_now() - session->bdp_ping_at;
+    session->rtt = session->rtt? (7 * session->rtt + rtt) / 8 : rtt;
+    session->bdp_stream_id = 0;
+
+    if (session->bdp_bytes < (2 * (apr_off_t)session->stream_win_size) / 3) {
+        /* not limited by the window */
+        return;
+    }
+    win = H2MIN(2 * session->bdp_bytes, (apr_off_t)session->stream_win_max);
+    if (win > session->stream_win_size) {
+        nghttp2_settings_entry entry;
+        int rv;
+
+        entry.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+        entry.value = (uint32_t)win;
+        rv = nghttp2_submit_settings(session->ngh2, NGHTTP2_FLAG_NONE, &entry, 1);
+        if (rv != 0) {
+            ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c1,
+                          H2_SSSN_LOG(APLOGNO(10509), session,
+                          "growing INITIAL_WINDOW_SIZE: %s"),
+                          nghttp2_strerror(rv));
+            session->stream_win_max = session->stream_win_size;
+            return;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c1,
+                      H2_SSSN_MSG(session, "%ld bytes received in %ld usec rtt, "
+                      "INITIAL_WINDOW_SIZE %d -> %d"), (long)session->bdp_bytes,
+                      (long)rtt, session->stream_win_size, (int)win);
+        session->stream_win_size = (int)win;
+    }
+}
+
 static int on_data_chunk_recv_cb(nghttp2_session *ngh2, uint8_t flags,
                                  int32_t stream_id,
                                  const uint8_t *data, size_t len, void *userp)
@@ -244,6 +321,7 @@ static int on_data_chunk_recv_cb(nghttp2_session *ngh2, uint8_t flags,
                       H2_SSSN_STRM_MSG(session, stream_id, "write %ld bytes of DATA"),
                       (long)len);
         status = h2_stream_recv_DATA(stream, flags, data, len);
+        bdp_on_data(session, stream_id, len);
     }
     else {
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c1, APLOGNO(03064)
@@ -439,6 +517,13 @@ static int on_frame_recv_cb(nghttp2_session *ng2s,
             ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
                           H2_SSSN_MSG(session, "SETTINGS, len=%ld"), (long)frame->hd.length);
             break;
+        case NGHTTP2_PING:
+            if ((frame->hd.flags & NGHTTP2_FLAG_ACK)
+                && !memcmp(frame->ping.opaque_data, H2_BDP_PING,
+                           sizeof(H2_BDP_PING))) {
+                on_bdp_ping_ack(session);
+            }
+            break;
         default:
             if (APLOGctrace2(session->c1)) {
                 char buffer[256];
@@ -922,6 +1007,10 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
     session->max_stream_count = h2_config_sgeti(s, H2_CONF_MAX_STREAMS);
     session->max_stream_mem = h2_config_sgeti(s, H2_CONF_STREAM_MAX_MEM);
     session->max_data_frame_len = h2_config_sgeti(s, H2_CONF_MAX_DATA_FRAME_LEN);
+    session->announced_stream_count = session->max_stream_count;
+    session->adaptive_streams = h2_config_sgeti(s, H2_CONF_ADAPTIVE_STREAMS);
+    session->stream_win_size = h2_config_sgeti(s, H2_CONF_WIN_SIZE);
+    session->stream_win_max = h2_config_sgeti(s, H2_CONF_WIN_SIZE_MAX);
 
     session->out_c1_blocked = h2_iq_create(session->pool, (int)session->max_stream_count);
     session->ready_to_process = h2_iq_create(session->pool, (int)session->max_stream_count);
@@ -1762,6 +1851,73 @@ static void unblock_c1_out(h2_session *session) {
     }
 }
 
+/* The lowest MAX_CONCURRENT_STREAMS we announce when workers are
+ * under load. Matches the traditional HTTP/1 parallel connections
+ * a browser opens. */
+#define H2_ADAPTIVE_STREAMS_MIN     6
+
+/**
+ * Adapt the MAX_CONCURRENT_STREAMS announced to the client to the
+ * load on the shared h2 workers. Up to half of the workers busy, the
+ * configured maximum is announced. Above that, the number decreases
+ * linearly towards H2_ADAPTIVE_STREAMS_MIN at full load. Streams already
+ * opened by the client are not affected, a lowered limit only keeps
+ * it from opening new ones.
+ */
+static void adapt_max_streams(h2_session *session)
+{
+    apr_size_t target, min_count, step;
+    apr_time_t now;
+    int load;
+
+    if (!session->adaptive_streams || !session->local.accepting) {
+        return;
+    }
+    now = apr_time_now();
+    if (now - session->streams_adapted_at < apr_time_from_sec(1)) {
+        return;
+    }
+    session->streams_adapted_at = now;
+
+    min_count = H2MIN(H2_ADAPTIVE_STREAMS_MIN, session->max_stream_count);
+    load = h2_workers_get_load(session->workers);
+    if (load <= 50) {
+        target = session->max_stream_count;
+    }
+    else {
+        target = session->max_stream_count
+                 - ((session->max_stream_count - min_count) * (apr_size_t)(load - 50)) / 50;
+        target = H2MAX(target, min_count);
+    }
+
+    /* avoid sending SETTINGS for every minor change in load */
+    step = H2MAX(1, session->max_stream_count / 8);
+    if (target != session->announced_stream_count
+        && (target == session->max_stream_count || target == min_count
+            || (target > session->announced_stream_count?
+                target - session->announced_stream_count :
+                session->announced_stream_count - target) >= step)) {
+        nghttp2_settings_entry entry;
+        int rv;
+
+        entry.settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+        entry.value = (uint32_t)target;
+        rv = nghttp2_submit_settings(session->ngh2, NGHTTP2_FLAG_NONE, &entry, 1);
+        if (rv != 0) {
+            ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c1,
+                          H2_SSSN_LOG(APLOGNO(10501), session,
+                          "adapting MAX_CONCURRENT_STREAMS: %s"),
+                          nghttp2_strerror(rv));
+            return;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c1,
+                      H2_SSSN_MSG(session, "workers load %d%%, "
+                      "MAX_CONCURRENT_STREAMS %d -> %d"), load,
+                      (int)session->announced_stream_count, (int)target);
+        session->announced_stream_count = target;
+    }
+}
+
 apr_status_t h2_session_process(h2_session *session, int async)
 {
     apr_status_t status = APR_SUCCESS;
@@ -1816,7 +1972,11 @@ apr_status_t h2_session_process(h2_session *session, int async)
         }
 
         session->status[0] = '\0';
-        
+
+        if (session->state != H2_SESSION_ST_INIT) {
+            adapt_max_streams(session);
+        }
+
         if (h2_session_want_send(session)) {
             h2_session_send(session);
         }
@@ -102,6 +102,15 @@ typedef struct h2_session {
     apr_size_t frames_sent;         /* number of http/2 frames sent */
     
     apr_size_t max_stream_count;    /* max number of open streams */
+    apr_size_t announced_stream_count; /* MAX_CONCURRENT_STREAMS last sent to client */
+    int adaptive_streams;           /* adapt announced streams to worker load */
+    apr_time_t streams_adapted_at;  /* when announced streams were last checked */
+    int stream_win_size;            /* INITIAL_WINDOW_SIZE announced to client */
+    int stream_win_max;             /* max window when growing it to the BDP, 0 if off */
+    int bdp_stream_id;              /* stream measured during pending BDP PING, or 0 */
+    apr_time_t bdp_ping_at;         /* when the last BDP PING was sent */
+    apr_off_t bdp_bytes;            /* DATA bytes on measured stream since the PING */
+    apr_interval_time_t rtt;        /* smoothed round trip time, from BDP PINGs */
     apr_size_t max_stream_mem;      /* max buffer memory for a single stream */
     apr_size_t max_data_frame_len;  /* max amount of bytes for a single DATA frame */
 
@@ -1315,7 +1315,8 @@ apr_status_t h2_stream_in_consumed(h2_stream *stream, apr_off_t amount)
         }
 
 #ifdef H2_NG2_LOCAL_WIN_SIZE
-        if (1) {
+        /* not when the session tunes windows to the bandwidth-delay product */
+        if (!session->stream_win_max) {
             int cur_size = nghttp2_session_get_stream_local_window_size(
                 session->ngh2, stream->id);
             int win = stream->in_window_size;
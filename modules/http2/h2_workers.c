@@ -85,6 +85,8 @@ struct h2_workers {
 
     volatile apr_uint32_t active_slots;
     volatile apr_uint32_t idle_slots;
+    volatile apr_uint32_t busy_slots;
+    apr_uint32_t prod_count;
 
     apr_threadattr_t *thread_attr;
     h2_slot *slots;
@@ -198,6 +200,42 @@ static void wake_idle_worker(h2_workers *workers, ap_conn_producer_t *prod)
     }
 }
 
+/**
+ * The number of slots a producer may occupy before other active
+ * producers are given precedence.
+ */
+static int fair_share(h2_workers *workers)
+{
+    return (int)H2MAX(1, workers->max_slots / H2MAX(1, workers->prod_count));
+}
+
+/**
+ * Select the active producer to ask for the next connection.
+ * Producers are served round robin. One that already keeps its fair
+ * share of slots busy is passed over in favour of the next producer
+ * below its share. When all active producers are at or above their
+ * share, the first one is taken so that no slot stays idle while
+ * there is work to do.
+ */
+static ap_conn_producer_t *select_producer(h2_workers *workers)
+{
+    ap_conn_producer_t *prod;
+    int share;
+
+    if (APR_RING_EMPTY(&workers->prod_active, ap_conn_producer_t, link)) {
+        return NULL;
+    }
+    share = fair_share(workers);
+    for (prod = APR_RING_FIRST(&workers->prod_active);
+         prod != APR_RING_SENTINEL(&workers->prod_active, ap_conn_producer_t, link);
+         prod = APR_RING_NEXT(prod, link)) {
+        if (prod->conns_active < share) {
+            return prod;
+        }
+    }
+    return APR_RING_FIRST(&workers->prod_active);
+}
+
 /**
  * Get the next connection to work on.
  */
@@ -209,8 +247,8 @@ static conn_rec *get_next(h2_slot *slot)
     int has_more;
 
     slot->prod = NULL;
-    if (!APR_RING_EMPTY(&workers->prod_active, ap_conn_producer_t, link)) {
-        slot->prod = prod = APR_RING_FIRST(&workers->prod_active);
+    if ((prod = select_producer(workers)) != NULL) {
+        slot->prod = prod;
         APR_RING_REMOVE(prod, link);
         AP_DEBUG_ASSERT(PROD_ACTIVE == prod->state);
 
@@ -225,6 +263,7 @@ static conn_rec *get_next(h2_slot *slot)
         }
         if (c) {
             ++prod->conns_active;
+            ++workers->busy_slots;
         }
     }
 
@@ -301,6 +340,7 @@ static void* APR_THREAD_FUNC slot_run(apr_thread_t *thread, void *wctx)
                 slot->prod->fn_done(slot->prod->baton, c);
 
                 apr_thread_mutex_lock(workers->lock);
+                --workers->busy_slots;
                 if (--slot->prod->conns_active <= 0) {
                     apr_thread_cond_broadcast(workers->prod_done);
                 }
@@ -545,6 +585,16 @@ apr_uint32_t h2_workers_get_max_workers(h2_workers *workers)
     return workers->max_slots;
 }
 
+int h2_workers_get_load(h2_workers *workers)
+{
+    int load;
+
+    apr_thread_mutex_lock(workers->lock);
+    load = (int)((100 * workers->busy_slots) / H2MAX(1, workers->max_slots));
+    apr_thread_mutex_unlock(workers->lock);
+    return load;
+}
+
 void h2_workers_shutdown(h2_workers *workers, int graceful)
 {
     ap_conn_producer_t *prod;
@@ -586,6 +636,7 @@ ap_conn_producer_t *h2_workers_register(h2_workers *workers,
     apr_thread_mutex_lock(workers->lock);
     prod->state = PROD_IDLE;
     APR_RING_INSERT_TAIL(&workers->prod_idle, prod, ap_conn_producer_t, link);
+    ++workers->prod_count;
     apr_thread_mutex_unlock(workers->lock);
 
     return prod;
@@ -604,6 +655,7 @@ apr_status_t h2_workers_join(h2_workers *workers, ap_conn_producer_t *prod)
         AP_DEBUG_ASSERT(PROD_ACTIVE == prod->state || PROD_IDLE == prod->state);
         APR_RING_REMOVE(prod, link);
         prod->state = PROD_JOINED; /* prevent further activations */
+        --workers->prod_count;
         while (prod->conns_active > 0) {
             apr_thread_cond_wait(workers->prod_done, workers->lock);
         }
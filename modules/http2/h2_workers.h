@@ -55,6 +55,13 @@ void h2_workers_shutdown(h2_workers *workers, int graceful);
  */
 apr_uint32_t h2_workers_get_max_workers(h2_workers *workers);
 
+/**
+ * Get the current load of the workers, e.g. the percentage of
+ * worker slots busy processing a connection.
+ * @return load in the range 0 to 100
+ */
+int h2_workers_get_load(h2_workers *workers);
+
 /**
  * ap_conn_producer_t is the source of connections (conn_rec*) to run.
  *
@@ -29,6 +29,7 @@
 #include "mod_http2.h"
 
 #include <nghttp2/nghttp2.h>
+#include "h2_alt_svc.h"
 #include "h2_stream.h"
 #include "h2_c1.h"
 #include "h2_c2.h"
@@ -201,6 +202,7 @@ static void h2_hooks(apr_pool_t *pool)
     h2_switch_register_hooks();
     h2_c2_register_hooks();
     h2_ws_register_hooks();
+    h2_alt_svc_register_hooks();
 
     /* Setup subprocess env for certain variables
      */
@@ -101,6 +101,10 @@ PostBuild_Cmds=if exist $(TargetPath).manifest mt.exe -manifest $(TargetPath).ma
 # Name "mod_http2 - Win32 Debug"
 # Begin Source File
 
+SOURCE=./h2_alt_svc.c
+# End Source File
+# Begin Source File
+
 SOURCE=./h2_bucket_beam.c
 # End Source File
 # Begin Source File
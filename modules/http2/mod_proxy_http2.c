@@ -16,8 +16,13 @@
  
 #include <nghttp2/nghttp2.h>
 
+#include <apr_hash.h>
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+
 #include <ap_mmn.h>
 #include <httpd.h>
+#include <http_config.h>
 #include <mod_proxy.h>
 #include "mod_http2.h"
 
@@ -31,14 +36,18 @@
 #define H2MIN(x,y) ((x) < (y) ? (x) : (y))
 
 static void register_hook(apr_pool_t *p);
+static void *h2_proxy_create_server_config(apr_pool_t *p, server_rec *s);
+static void *h2_proxy_merge_server_config(apr_pool_t *p, void *basev,
+                                          void *addv);
+static const command_rec h2_proxy_cmds[];
 
 AP_DECLARE_MODULE(proxy_http2) = {
     STANDARD20_MODULE_STUFF,
     NULL,              /* create per-directory config structure */
     NULL,              /* merge per-directory config structures */
-    NULL,              /* create per-server config structure */
-    NULL,              /* merge per-server config structures */
-    NULL,              /* command apr_table_t */
+    h2_proxy_create_server_config, /* create per-server config structure */
+    h2_proxy_merge_server_config,  /* merge per-server config structures */
+    h2_proxy_cmds,     /* command apr_table_t */
     register_hook,     /* register hooks */
 #if defined(AP_MODULE_FLAG_NONE)
     AP_MODULE_FLAG_ALWAYS_MERGE
@@ -69,8 +78,86 @@ typedef struct h2_proxy_ctx {
     int r_done;                /* request was processed, not necessarily successfully */
     int r_may_retry;           /* request may be retried */
     int has_reusable_session;  /* http2 session is live and clean */
+    unsigned can_share : 1;    /* request may use a shared session */
 } h2_proxy_ctx;
 
+typedef struct {
+    int shared_sessions;
+} h2_proxy_srv_conf;
+
+#if APR_HAS_THREADS
+/* The longest a request processing a shared session blocks on reading
+ * from the backend before letting the other requests submit their streams.
+ */
+#define H2_PROXY_SHARED_MAX_WAIT   apr_time_from_msec(10)
+
+/* An h2 session shared by the concurrent requests of the child to the same
+ * worker, each request being a stream. The backend connection is held out
+ * of the worker's connection pool for as long as the session lives.
+ */
+typedef struct h2_proxy_shared h2_proxy_shared;
+struct h2_proxy_shared {
+    h2_proxy_shared *next;
+    proxy_conn_rec *p_conn;
+    h2_proxy_session *session;
+    int users;                 /* requests attached to the session */
+    unsigned leading : 1;      /* a request owns the session */
+    unsigned closing : 1;      /* no new requests, close when unused */
+};
+
+/* The shared sessions of a worker. The mutex protects the lists and the
+ * fields of the entries, and is released while a request owns (leads) a
+ * session to call it (nghttp2 and the session's): the calls on a session
+ * are serialized by its ownership, and those on different sessions or
+ * waiting for the mutex are not delayed by its processing.
+ */
+typedef struct {
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    h2_proxy_shared *sessions;
+    h2_proxy_shared *spares;   /* unused entries */
+} h2_proxy_shpool;
+
+static apr_pool_t *shpools_pool;
+static apr_thread_mutex_t *shpools_mutex;
+static apr_hash_t *shpools;
+#endif
+
+static void *h2_proxy_create_server_config(apr_pool_t *p, server_rec *s)
+{
+    h2_proxy_srv_conf *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->shared_sessions = -1;
+    return conf;
+}
+
+static void *h2_proxy_merge_server_config(apr_pool_t *p, void *basev,
+                                          void *addv)
+{
+    h2_proxy_srv_conf *base = basev, *add = addv;
+    h2_proxy_srv_conf *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->shared_sessions = (add->shared_sessions != -1)?
+                            add->shared_sessions : base->shared_sessions;
+    return conf;
+}
+
+static const char *h2_proxy_conf_set_shared(cmd_parms *cmd, void *dummy,
+                                            int flag)
+{
+    h2_proxy_srv_conf *conf = ap_get_module_config(cmd->server->module_config,
+                                                   &proxy_http2_module);
+    conf->shared_sessions = flag;
+    return NULL;
+}
+
+static const command_rec h2_proxy_cmds[] = {
+    AP_INIT_FLAG("H2ProxySharedSessions", h2_proxy_conf_set_shared, NULL,
+                 RSRC_CONF, "on to share backend h2 sessions between the "
+                 "concurrent requests of a child"),
+    { NULL }
+};
+
 static int h2_proxy_post_config(apr_pool_t *p, apr_pool_t *plog,
                                 apr_pool_t *ptemp, server_rec *s)
 {
@@ -212,19 +299,19 @@ static int proxy_http2_canon(request_rec *r, char *url)
 
 static apr_status_t add_request(h2_proxy_session *session, request_rec *r)
 {
-    h2_proxy_ctx *ctx = session->user_data;
+    proxy_conn_rec *p_conn = session->p_conn;
     const char *url;
     apr_status_t status;
 
     url = apr_table_get(r->notes, H2_PROXY_REQ_URL_NOTE);
     apr_table_setn(r->notes, "proxy-source-port", apr_psprintf(r->pool, "%hu",
-                   ctx->p_conn->connection->local_addr->port));
+                   p_conn->connection->local_addr->port));
     status = h2_proxy_session_submit(session, url, r, 1);
     if (status != APR_SUCCESS) {
         ap_log_cerror(APLOG_MARK, APLOG_ERR, status, r->connection, APLOGNO(03351)
                       "pass request body failed to %pI (%s) from %s (%s)",
-                      ctx->p_conn->addr, ctx->p_conn->hostname ? 
-                      ctx->p_conn->hostname: "", session->c->client_ip, 
+                      p_conn->addr, p_conn->hostname ? 
+                      p_conn->hostname: "", session->c->client_ip, 
                       session->c->remote_host ? session->c->remote_host: "");
     }
     return status;
@@ -248,7 +335,16 @@ static void request_done(h2_proxy_ctx *ctx, request_rec *r,
 static void session_req_done(h2_proxy_session *session, request_rec *r,
                              apr_status_t status, int touched, int error_code)
 {
-    request_done(session->user_data, r, status, touched, error_code);
+    h2_proxy_ctx *ctx = session->user_data;
+
+    if (!ctx) {
+        /* shared session, find the request's own context */
+        ctx = ap_get_module_config(r->connection->conn_config,
+                                   &proxy_http2_module);
+    }
+    if (ctx) {
+        request_done(ctx, r, status, touched, error_code);
+    }
 }
 
 static apr_status_t ctx_run(h2_proxy_ctx *ctx) {
@@ -309,6 +405,309 @@ out:
     return status;
 }
 
+/* Steps One to Three: get a backend connection for the request in
+ * ctx->p_conn, connected and with its conn_rec created. */
+static int ctx_connect(h2_proxy_ctx *ctx, apr_uri_t *uri, char **locurl,
+                       const char *proxyname, apr_port_t proxyport)
+{
+    int status;
+
+    /* Get a proxy_conn_rec from the worker, might be a new one, might
+     * be one still open from another request, or it might fail if the
+     * worker is stopped or in error. */
+    if ((status = ap_proxy_acquire_connection(ctx->proxy_func, &ctx->p_conn,
+                                              ctx->worker, ctx->server)) != OK) {
+        return status;
+    }
+
+    ctx->p_conn->is_ssl = ctx->is_ssl;
+
+    /* Step One: Determine the URL to connect to (might be a proxy),
+     * initialize the backend accordingly and determine the server
+     * port string we can expect in responses. */
+    if ((status = ap_proxy_determine_connection(ctx->pool, ctx->r, ctx->conf,
+                                                ctx->worker, ctx->p_conn,
+                                                uri, locurl,
+                                                proxyname, proxyport,
+                                                ctx->server_portstr,
+                                                sizeof(ctx->server_portstr))) != OK) {
+        return status;
+    }
+
+    /* Step Two: Make the Connection (or check that an already existing
+     * socket is still usable). On success, we have a socket connected to
+     * backend->hostname. */
+    if (ap_proxy_connect_backend(ctx->proxy_func, ctx->p_conn, ctx->worker,
+                                 ctx->server)) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->cfront, APLOGNO(03352)
+                      "H2: failed to make connection to backend: %s",
+                      ctx->p_conn->hostname);
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    /* Step Three: Create conn_rec for the socket we have open now. */
+    status = ap_proxy_connection_create_ex(ctx->proxy_func, ctx->p_conn, ctx->r);
+    if (status != OK) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->cfront, APLOGNO(03353)
+                      "setup new connection: is_ssl=%d %s %s %s",
+                      ctx->p_conn->is_ssl, ctx->p_conn->ssl_hostname,
+                      *locurl, ctx->p_conn->hostname);
+        ctx->r_status = ap_map_http_request_error(status, HTTP_SERVICE_UNAVAILABLE);
+        return status;
+    }
+
+    if (!ctx->p_conn->data && ctx->is_ssl) {
+        /* New SSL connection: set a note on the connection about what
+         * protocol we need. */
+        apr_table_setn(ctx->p_conn->connection->notes,
+                       "proxy-request-alpn-protos", "h2");
+    }
+    return OK;
+}
+
+#if APR_HAS_THREADS
+static int can_share(h2_proxy_ctx *ctx, const char *proxyname)
+{
+    h2_proxy_srv_conf *sconf = ap_get_module_config(ctx->server->module_config,
+                                                    &proxy_http2_module);
+    proxy_dir_conf *dconf;
+
+    if (sconf->shared_sessions != 1 || !shpools || proxyname
+        || ctx->r->proxyreq != PROXYREQ_REVERSE
+        || !ctx->worker->s->is_address_reusable
+        || ctx->worker->s->disablereuse) {
+        return 0;
+    }
+    /* The SNI of a shared TLS connection must not depend on the request */
+    dconf = ap_get_module_config(ctx->r->per_dir_config, &proxy_module);
+    return !(ctx->is_ssl && dconf->preserve_host);
+}
+
+static h2_proxy_shpool *get_shpool(proxy_worker *worker)
+{
+    h2_proxy_shpool *sp;
+
+    apr_thread_mutex_lock(shpools_mutex);
+    sp = apr_hash_get(shpools, &worker, sizeof(worker));
+    if (!sp) {
+        sp = apr_pcalloc(shpools_pool, sizeof(*sp));
+        apr_thread_mutex_create(&sp->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                shpools_pool);
+        apr_thread_cond_create(&sp->cond, shpools_pool);
+        apr_hash_set(shpools, apr_pmemdup(shpools_pool, &worker, sizeof(worker)),
+                     sizeof(worker), sp);
+    }
+    apr_thread_mutex_unlock(shpools_mutex);
+    return sp;
+}
+
+/* Find a session to submit to, one not being processed first since only
+ * those can be checked right away. The entry returned is owned.
+ */
+static h2_proxy_shared *shared_find(h2_proxy_shpool *sp)
+{
+    h2_proxy_shared *sh;
+    int pass;
+
+    for (pass = 0; pass < 2; ++pass) {
+        for (sh = sp->sessions; sh; sh = sh->next) {
+            if (sh->closing || (!pass && sh->leading)) {
+                continue;
+            }
+            while (sh->leading) {
+                apr_thread_cond_wait(sp->cond, sp->mutex);
+            }
+            if (!sh->closing && h2_proxy_session_can_submit(sh->session)) {
+                sh->leading = 1;
+                return sh;
+            }
+            /* the list may have changed while waiting */
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Take the ownership of a session, waiting for the current owner */
+static void shared_lead(h2_proxy_shpool *sp, h2_proxy_shared *sh)
+{
+    while (sh->leading) {
+        apr_thread_cond_wait(sp->cond, sp->mutex);
+    }
+    sh->leading = 1;
+}
+
+static void shared_unlead(h2_proxy_shpool *sp, h2_proxy_shared *sh)
+{
+    sh->leading = 0;
+    apr_thread_cond_broadcast(sp->cond);
+}
+
+static void shared_unlink(h2_proxy_shpool *sp, h2_proxy_shared *sh)
+{
+    h2_proxy_shared **psh;
+
+    /* for those waiting in shared_find() */
+    sh->closing = 1;
+    for (psh = &sp->sessions; *psh; psh = &(*psh)->next) {
+        if (*psh == sh) {
+            *psh = sh->next;
+            break;
+        }
+    }
+    sh->next = sp->spares;
+    sp->spares = sh;
+}
+
+/* Step Four, on a session shared with the other requests to the worker.
+ * The requests take turns owning the session to process it for all of
+ * them, while the others wait for their stream to be done. The owner
+ * releases the mutex of the worker while processing, which may block on
+ * the backend or on the clients.
+ */
+static int ctx_run_shared(h2_proxy_ctx *ctx, apr_uri_t *uri, char **locurl,
+                          const char *proxyname, apr_port_t proxyport)
+{
+    h2_proxy_shpool *sp = get_shpool(ctx->worker);
+    h2_proxy_shared *sh;
+    h2_proxy_session *session;
+    proxy_conn_rec *p_conn = NULL;
+    apr_status_t status = APR_SUCCESS;
+    int h2_front = is_h2? is_h2(ctx->cfront) : 0;
+
+    ctx->has_reusable_session = 0;
+    ctx->r_done = 0;
+
+    apr_thread_mutex_lock(sp->mutex);
+    sh = shared_find(sp);
+    if (sh) {
+        ++sh->users;
+        apr_thread_mutex_unlock(sp->mutex);
+        /* pings the backend if the session was idle for a while */
+        h2_proxy_session_setup(ctx->id, sh->p_conn, ctx->conf, h2_front, 30,
+                               h2_proxy_log2((int)ctx->req_buffer_size),
+                               session_req_done);
+    }
+    else {
+        apr_thread_mutex_unlock(sp->mutex);
+
+        /* connect a new session, outside of the lock */
+        if ((status = ctx_connect(ctx, uri, locurl, proxyname, proxyport)) != OK) {
+            ctx->r_may_retry = 0;
+            return status;
+        }
+        session = h2_proxy_session_setup(ctx->id, ctx->p_conn, ctx->conf,
+                                         h2_front, 30,
+                                         h2_proxy_log2((int)ctx->req_buffer_size),
+                                         session_req_done);
+        if (!session) {
+            ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->cfront,
+                          APLOGNO(10528) "shared session unavailable");
+            return HTTP_SERVICE_UNAVAILABLE;
+        }
+        session->max_wait = H2_PROXY_SHARED_MAX_WAIT;
+
+        apr_thread_mutex_lock(sp->mutex);
+        if (sp->spares) {
+            sh = sp->spares;
+            sp->spares = sh->next;
+            memset(sh, 0, sizeof(*sh));
+        }
+        else {
+            apr_thread_mutex_lock(shpools_mutex);
+            sh = apr_pcalloc(shpools_pool, sizeof(*sh));
+            apr_thread_mutex_unlock(shpools_mutex);
+        }
+        /* the session now owns the connection, and we own the session */
+        sh->p_conn = ctx->p_conn;
+        sh->session = session;
+        sh->users = 1;
+        sh->leading = 1;
+        sh->next = sp->sessions;
+        sp->sessions = sh;
+        ctx->p_conn = NULL;
+        apr_thread_mutex_unlock(sp->mutex);
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->cfront, APLOGNO(10529)
+                      "eng(%s): new shared session %s to %s",
+                      ctx->id, session->id, sh->p_conn->hostname);
+    }
+    session = sh->session;
+
+    /* submit while owning the session */
+    if (add_request(session, ctx->r) != APR_SUCCESS) {
+        ctx->r_done = 1;
+    }
+
+    for (;;) {
+        if (!ctx->r_done && !ctx->cfront->aborted) {
+            status = h2_proxy_session_process(session);
+        }
+
+        apr_thread_mutex_lock(sp->mutex);
+        if (status != APR_SUCCESS) {
+            /* Encountered an error during session processing, fail all
+             * its requests, those not touched may be retried. */
+            ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->cfront,
+                          APLOGNO(10530) "eng(%s): end of shared session %s",
+                          ctx->id, session->id);
+            sh->closing = 1;
+            h2_proxy_session_cleanup(session, session_req_done);
+        }
+        else if (!h2_proxy_session_can_submit(session)
+                 && !h2_proxy_session_is_reusable(session)
+                 && session->state != H2_PROXYS_ST_BUSY
+                 && session->state != H2_PROXYS_ST_WAIT) {
+            /* GOAWAY sent or received, let the streams finish */
+            sh->closing = 1;
+        }
+        if (ctx->r_done || ctx->cfront->aborted) {
+            break;
+        }
+        shared_unlead(sp, sh);
+        apr_thread_mutex_unlock(sp->mutex);
+
+        /* give the others a chance to submit or lead */
+        apr_thread_yield();
+
+        apr_thread_mutex_lock(sp->mutex);
+        while (sh->leading && !ctx->r_done && !ctx->cfront->aborted) {
+            apr_thread_cond_wait(sp->cond, sp->mutex);
+        }
+        if (ctx->r_done || ctx->cfront->aborted) {
+            /* owned for the cleanup below */
+            shared_lead(sp, sh);
+            break;
+        }
+        sh->leading = 1;
+        apr_thread_mutex_unlock(sp->mutex);
+    }
+
+    /* the session is owned and the mutex held here */
+    if (!ctx->r_done) {
+        /* master connection gone, reset the stream on the backend */
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->cfront,
+                      APLOGNO(10531) "eng(%s): master connection gone", ctx->id);
+        h2_proxy_session_detach(session, ctx->r);
+    }
+#if AP_MODULE_MAGIC_AT_LEAST(20140207, 2)
+    proxy_run_detach_backend(ctx->r, sh->p_conn);
+#endif
+    if (--sh->users == 0
+        && (sh->closing || !h2_proxy_session_is_reusable(session))) {
+        shared_unlink(sp, sh);
+        p_conn = sh->p_conn;
+    }
+    shared_unlead(sp, sh);
+    apr_thread_mutex_unlock(sp->mutex);
+
+    if (p_conn) {
+        p_conn->close = 1;
+        ap_proxy_release_connection(ctx->proxy_func, p_conn, ctx->server);
+    }
+    return status;
+}
+#endif /* APR_HAS_THREADS */
+
 static int proxy_http2_handler(request_rec *r, 
                                proxy_worker *worker,
                                proxy_server_conf *conf,
@@ -363,6 +762,9 @@ static int proxy_http2_handler(request_rec *r,
     ctx->r_status = status = HTTP_SERVICE_UNAVAILABLE;
     ctx->r_done = 0;
     ctx->r_may_retry =  1;
+#if APR_HAS_THREADS
+    ctx->can_share = can_share(ctx, proxyname);
+#endif
     
     ap_set_module_config(ctx->cfront->conn_config, &proxy_http2_module, ctx);
 
@@ -374,59 +776,20 @@ static int proxy_http2_handler(request_rec *r,
 run_connect:    
     if (ctx->cfront->aborted) goto cleanup;
 
-    /* Get a proxy_conn_rec from the worker, might be a new one, might
-     * be one still open from another request, or it might fail if the
-     * worker is stopped or in error. */
-    if ((status = ap_proxy_acquire_connection(ctx->proxy_func, &ctx->p_conn,
-                                              ctx->worker, ctx->server)) != OK) {
-        goto cleanup;
-    }
-
-    ctx->p_conn->is_ssl = ctx->is_ssl;
-
-    /* Step One: Determine the URL to connect to (might be a proxy),
-     * initialize the backend accordingly and determine the server 
-     * port string we can expect in responses. */
-    if ((status = ap_proxy_determine_connection(ctx->pool, ctx->r, conf, worker, 
-                                                ctx->p_conn, &uri, &locurl, 
-                                                proxyname, proxyport, 
-                                                ctx->server_portstr,
-                                                sizeof(ctx->server_portstr))) != OK) {
-        goto cleanup;
-    }
-    
-    /* Step Two: Make the Connection (or check that an already existing
-     * socket is still usable). On success, we have a socket connected to
-     * backend->hostname. */
-    if (ap_proxy_connect_backend(ctx->proxy_func, ctx->p_conn, ctx->worker, 
-                                 ctx->server)) {
-        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->cfront, APLOGNO(03352)
-                      "H2: failed to make connection to backend: %s",
-                      ctx->p_conn->hostname);
-        goto cleanup;
+#if APR_HAS_THREADS
+    if (ctx->can_share) {
+        status = ctx_run_shared(ctx, &uri, &locurl, proxyname, proxyport);
     }
-    
-    /* Step Three: Create conn_rec for the socket we have open now. */
-    status = ap_proxy_connection_create_ex(ctx->proxy_func, ctx->p_conn, ctx->r);
-    if (status != OK) {
-        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->cfront, APLOGNO(03353)
-                      "setup new connection: is_ssl=%d %s %s %s", 
-                      ctx->p_conn->is_ssl, ctx->p_conn->ssl_hostname, 
-                      locurl, ctx->p_conn->hostname);
-        ctx->r_status = ap_map_http_request_error(status, HTTP_SERVICE_UNAVAILABLE);
-        goto cleanup;
-    }
-    
-    if (!ctx->p_conn->data && ctx->is_ssl) {
-        /* New SSL connection: set a note on the connection about what
-         * protocol we need. */
-        apr_table_setn(ctx->p_conn->connection->notes,
-                       "proxy-request-alpn-protos", "h2");
+    else
+#endif
+    {
+        if ((status = ctx_connect(ctx, &uri, &locurl, proxyname, proxyport)) != OK) {
+            goto cleanup;
+        }
+        if (ctx->cfront->aborted) goto cleanup;
+        status = ctx_run(ctx);
     }
 
-    if (ctx->cfront->aborted) goto cleanup;
-    status = ctx_run(ctx);
-
     if (ctx->r_status != OK && ctx->r_may_retry && !ctx->cfront->aborted) {
         /* Not successfully processed, but may retry, tear down old conn and start over */
         if (ctx->p_conn) {
@@ -472,9 +835,32 @@ cleanup:
     return ctx->r_status;
 }
 
+#if APR_HAS_THREADS
+static void h2_proxy_child_init(apr_pool_t *pchild, server_rec *s)
+{
+    apr_allocator_t *alloc;
+
+    /* The shared sessions live as long as the child, their bookkeeping
+     * has its own allocator as it happens in any thread (under lock). */
+    if (apr_allocator_create(&alloc) != APR_SUCCESS
+        || apr_pool_create_ex(&shpools_pool, pchild, NULL, alloc) != APR_SUCCESS) {
+        ap_abort_on_oom();
+    }
+    apr_allocator_owner_set(alloc, shpools_pool);
+    apr_pool_tag(shpools_pool, "proxy_http2_shared");
+    if (apr_thread_mutex_create(&shpools_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                pchild) == APR_SUCCESS) {
+        shpools = apr_hash_make(shpools_pool);
+    }
+}
+#endif
+
 static void register_hook(apr_pool_t *p)
 {
     ap_hook_post_config(h2_proxy_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+#if APR_HAS_THREADS
+    ap_hook_child_init(h2_proxy_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+#endif
 
     proxy_hook_scheme_handler(proxy_http2_handler, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_canon_handler(proxy_http2_canon, NULL, NULL, APR_HOOK_FIRST);
@@ -0,0 +1,504 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mod_early_hints.c: learn the "Link: rel=preload" headers of responses
+ * and send them as "103 Early Hints" on later requests for the same URL.
+ *
+ * The links are kept in a shared object cache (socache), keyed by
+ * server name and URL path. The interim response is sent in the
+ * fixups phase, e.g. before the handler runs, so a client can start
+ * loading the resources while a slow backend is still working on the
+ * final response.
+ */
+
+#include "apr_strings.h"
+#include "apr_lib.h"
+
+#include "ap_config.h"
+#include "ap_provider.h"
+#include "httpd.h"
+#include "http_config.h"
+#include "http_core.h"
+#include "http_log.h"
+#include "http_protocol.h"
+#include "http_request.h"
+
+#include "ap_socache.h"
+#include "util_mutex.h"
+
+module AP_MODULE_DECLARE_DATA early_hints_module;
+
+/* Maximum length of the learned Link header value for a URL */
+#define EH_MAX_LINKS_LEN   4096
+/* Maximum length of a cache key, longer URLs are not learned */
+#define EH_MAX_KEY_LEN     1024
+
+#define EH_DEFAULT_MAX_AGE apr_time_from_sec(3600)
+
+typedef struct eh_dir_conf {
+    int learning;                     /* learn and send hints, -1 unset */
+    apr_interval_time_t max_age;      /* lifetime of learned hints, -1 unset */
+} eh_dir_conf;
+
+/* What we found in the cache when the request started */
+typedef struct eh_req_ctx {
+    const char *key;
+    const char *links;                /* NULL if nothing was cached */
+} eh_req_ctx;
+
+static apr_global_mutex_t *eh_mutex = NULL;
+static ap_socache_provider_t *socache_provider = NULL;
+static ap_socache_instance_t *socache_instance = NULL;
+static const char *const eh_cache_id = "early-hints-socache";
+static int configured;
+
+static apr_status_t remove_lock(void *data)
+{
+    if (eh_mutex) {
+        apr_global_mutex_destroy(eh_mutex);
+        eh_mutex = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t destroy_cache(void *data)
+{
+    if (socache_instance) {
+        socache_provider->destroy(socache_instance, (server_rec*)data);
+        socache_instance = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static int eh_pre_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *ptmp)
+{
+    apr_status_t rv = ap_mutex_register(pconf, eh_cache_id,
+                                        NULL, APR_LOCK_DEFAULT, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10502)
+                      "failed to register %s mutex", eh_cache_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    socache_provider = ap_lookup_provider(AP_SOCACHE_PROVIDER_GROUP,
+                                          AP_SOCACHE_DEFAULT_PROVIDER,
+                                          AP_SOCACHE_PROVIDER_VERSION);
+    socache_instance = NULL;
+    configured = 0;
+    return OK;
+}
+
+static int eh_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                          apr_pool_t *ptmp, server_rec *s)
+{
+    static struct ap_socache_hints eh_cache_hints = {256, 1024, 3600000000};
+    const char *errmsg;
+    apr_status_t rv;
+
+    if (!configured) {
+        return OK;    /* don't waste the overhead of creating mutex & cache */
+    }
+    if (socache_provider == NULL) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, 0, plog, APLOGNO(10503)
+                      "Please select a socache provider with EarlyHintsSOCache "
+                      "(no default found on this platform). Maybe you need to "
+                      "load mod_socache_shmcb or another socache module first");
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    if (socache_instance == NULL) {
+        errmsg = socache_provider->create(&socache_instance, NULL,
+                                          ptmp, pconf);
+        if (errmsg) {
+            ap_log_perror(APLOG_MARK, APLOG_CRIT, 0, plog, APLOGNO(10504)
+                          "failed to create early hints socache "
+                          "instance: %s", errmsg);
+            return 500;
+        }
+    }
+
+    rv = ap_global_mutex_create(&eh_mutex, NULL, eh_cache_id, NULL,
+                                s, pconf, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10505)
+                      "failed to create %s mutex", eh_cache_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    apr_pool_cleanup_register(pconf, NULL, remove_lock, apr_pool_cleanup_null);
+
+    rv = socache_provider->init(socache_instance, eh_cache_id,
+                                &eh_cache_hints, s, pconf);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10506)
+                      "failed to initialise %s cache", eh_cache_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    apr_pool_cleanup_register(pconf, (void*)s, destroy_cache, apr_pool_cleanup_null);
+    return OK;
+}
+
+static void eh_child_init(apr_pool_t *p, server_rec *s)
+{
+    const char *lock;
+    apr_status_t rv;
+
+    if (!configured || !eh_mutex) {
+        return;
+    }
+    lock = apr_global_mutex_lockfile(eh_mutex);
+    rv = apr_global_mutex_child_init(&eh_mutex, lock, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10507)
+                     "failed to initialise mutex in child_init");
+    }
+}
+
+static int cache_lock(request_rec *r)
+{
+    apr_status_t rv;
+
+    if (!(socache_provider->flags & AP_SOCACHE_FLAG_NOTMPSAFE)) {
+        return 1;
+    }
+    /* don't wait around; hints are an optimisation only */
+    rv = apr_global_mutex_trylock(eh_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, rv, r,
+                      "early hints cache not accessed (mutex busy)");
+        return 0;
+    }
+    return 1;
+}
+
+static void cache_unlock(request_rec *r)
+{
+    apr_status_t rv;
+
+    if (!(socache_provider->flags & AP_SOCACHE_FLAG_NOTMPSAFE)) {
+        return;
+    }
+    rv = apr_global_mutex_unlock(eh_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10508)
+                      "Failed to release mutex!");
+    }
+}
+
+static int is_eligible(request_rec *r, const eh_dir_conf *conf)
+{
+    return configured && socache_instance && conf->learning > 0
+           && !r->main && !r->prev
+           && r->method_number == M_GET;
+}
+
+static const char *construct_key(request_rec *r)
+{
+    const char *key = apr_pstrcat(r->pool, ap_get_server_name(r), ":",
+                                  apr_itoa(r->pool, ap_get_server_port(r)),
+                                  r->uri, NULL);
+    return (strlen(key) > EH_MAX_KEY_LEN)? NULL : key;
+}
+
+/**
+ * Send the learned links as interim "103 Early Hints" response.
+ * Only the links go into the interim response, the final response
+ * headers are left untouched.
+ */
+static void send_early_hints(request_rec *r, const char *links)
+{
+    apr_table_t *headers_out = r->headers_out;
+    const char *status_line = r->status_line;
+    int status = r->status;
+
+    r->headers_out = apr_table_make(r->pool, 1);
+    apr_table_setn(r->headers_out, "Link", links);
+    r->status = 103;
+    r->status_line = "103 Early Hints";
+    ap_send_interim_response(r, 1);
+    r->status = status;
+    r->status_line = status_line;
+    r->headers_out = headers_out;
+}
+
+static int eh_fixups(request_rec *r)
+{
+    eh_dir_conf *conf = ap_get_module_config(r->per_dir_config,
+                                             &early_hints_module);
+    unsigned char val[EH_MAX_LINKS_LEN];
+    unsigned int vallen = EH_MAX_LINKS_LEN - 1;
+    eh_req_ctx *ctx;
+    apr_status_t rv;
+    const char *key;
+
+    if (!is_eligible(r, conf) || !(key = construct_key(r))) {
+        return DECLINED;
+    }
+    /* Without a lookup, what is cached is unknown: leave no ctx so that
+     * nothing is stored either (the next request will learn it). */
+    if (!cache_lock(r)) {
+        return DECLINED;
+    }
+    ctx = apr_pcalloc(r->pool, sizeof(*ctx));
+    ctx->key = key;
+    ap_set_module_config(r->request_config, &early_hints_module, ctx);
+
+    rv = socache_provider->retrieve(socache_instance, r->server,
+                                    (unsigned char*)key, strlen(key),
+                                    val, &vallen, r->pool);
+    cache_unlock(r);
+    if (rv != APR_SUCCESS || vallen == 0) {
+        return DECLINED;
+    }
+    val[vallen] = 0;
+    ctx->links = apr_pstrmemdup(r->pool, (const char *)val, vallen);
+
+    /* Interim responses exist since HTTP/1.1. A client waiting for
+     * "100 Continue" is not confused with anything else. */
+    if (r->proto_num >= HTTP_VERSION(1,1) && !r->expecting_100) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                      "sending learned early hints: %s", ctx->links);
+        send_early_hints(r, ctx->links);
+    }
+    return DECLINED;
+}
+
+typedef struct {
+    request_rec *r;
+    char *buf;
+    apr_size_t len;
+} collect_ctx;
+
+static void collect_link(collect_ctx *cc, const char *start, const char *end)
+{
+    const char *params;
+    apr_size_t n;
+
+    while (start < end && apr_isspace(*start)) {
+        ++start;
+    }
+    while (end > start && apr_isspace(end[-1])) {
+        --end;
+    }
+    if (start >= end || *start != '<') {
+        return;
+    }
+    n = (apr_size_t)(end - start);
+    params = apr_pstrmemdup(cc->r->pool, start, n);
+    if (!ap_strcasestr(params, "rel=preload")
+        && !ap_strcasestr(params, "rel=\"preload")) {
+        return;
+    }
+    /* "nopush" only concerns HTTP/2 server push, it is fine for hints */
+    if (cc->len + n + 2 >= EH_MAX_LINKS_LEN) {
+        return;
+    }
+    if (cc->len) {
+        memcpy(cc->buf + cc->len, ", ", 2);
+        cc->len += 2;
+    }
+    memcpy(cc->buf + cc->len, start, n);
+    cc->len += n;
+}
+
+/* Split a Link header value into its link-values, observing the
+ * <uri-reference> and quoted parameters. */
+static int collect_links(void *baton, const char *key, const char *value)
+{
+    collect_ctx *cc = baton;
+    const char *s, *start = value;
+    int in_uri = 0, in_quote = 0;
+
+    for (s = value; *s; ++s) {
+        if (in_quote) {
+            if (*s == '\\' && s[1]) {
+                ++s;
+            }
+            else if (*s == '"') {
+                in_quote = 0;
+            }
+        }
+        else if (in_uri) {
+            in_uri = (*s != '>');
+        }
+        else if (*s == '<') {
+            in_uri = 1;
+        }
+        else if (*s == '"') {
+            in_quote = 1;
+        }
+        else if (*s == ',') {
+            collect_link(cc, start, s);
+            start = s + 1;
+        }
+    }
+    collect_link(cc, start, s);
+    return 1;
+}
+
+static int eh_log_transaction(request_rec *r)
+{
+    eh_dir_conf *conf = ap_get_module_config(r->per_dir_config,
+                                             &early_hints_module);
+    eh_req_ctx *ctx = ap_get_module_config(r->request_config,
+                                           &early_hints_module);
+    collect_ctx cc;
+    apr_status_t rv;
+
+    if (!ctx || r->status != HTTP_OK) {
+        return DECLINED;
+    }
+
+    cc.r = r;
+    cc.buf = apr_palloc(r->pool, EH_MAX_LINKS_LEN);
+    cc.len = 0;
+    apr_table_do(collect_links, &cc, r->headers_out, "Link", NULL);
+    apr_table_do(collect_links, &cc, r->err_headers_out, "Link", NULL);
+    cc.buf[cc.len] = '\0';
+
+    if (ctx->links? !strcmp(ctx->links, cc.buf) : !cc.len) {
+        /* nothing new learned */
+        return DECLINED;
+    }
+    if (!cache_lock(r)) {
+        return DECLINED;
+    }
+    if (cc.len) {
+        rv = socache_provider->store(socache_instance, r->server,
+                                     (unsigned char*)ctx->key, strlen(ctx->key),
+                                     apr_time_now() + ((conf->max_age > 0)?
+                                     conf->max_age : EH_DEFAULT_MAX_AGE),
+                                     (unsigned char*)cc.buf, cc.len, r->pool);
+    }
+    else {
+        rv = socache_provider->remove(socache_instance, r->server,
+                                      (unsigned char*)ctx->key, strlen(ctx->key),
+                                      r->pool);
+    }
+    cache_unlock(r);
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, rv, r,
+                  "learned early hints for %s: %s", ctx->key, cc.buf);
+    return DECLINED;
+}
+
+static void *create_eh_dir_config(apr_pool_t *p, char *d)
+{
+    eh_dir_conf *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->learning = -1;
+    conf->max_age = -1;
+    return conf;
+}
+
+static void *merge_eh_dir_config(apr_pool_t *p, void *basev, void *addv)
+{
+    eh_dir_conf *base = basev, *add = addv;
+    eh_dir_conf *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->learning = (add->learning != -1)? add->learning : base->learning;
+    conf->max_age = (add->max_age != -1)? add->max_age : base->max_age;
+    return conf;
+}
+
+static const char *set_learning(cmd_parms *cmd, void *dconf, int flag)
+{
+    eh_dir_conf *conf = dconf;
+
+    conf->learning = flag;
+    if (flag) {
+        configured = 1;
+    }
+    return NULL;
+}
+
+static const char *set_max_age(cmd_parms *cmd, void *dconf, const char *arg)
+{
+    eh_dir_conf *conf = dconf;
+    apr_interval_time_t timeout;
+
+    if (ap_timeout_parameter_parse(arg, &timeout, "s") != APR_SUCCESS
+        || timeout <= 0) {
+        return "EarlyHintsMaxAge must be a positive duration";
+    }
+    conf->max_age = timeout;
+    return NULL;
+}
+
+static const char *set_socache(cmd_parms *cmd, void *dconf, const char *arg)
+{
+    const char *errmsg = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    const char *sep, *name;
+
+    if (errmsg)
+        return errmsg;
+
+    /* Argument is of form 'name:args' or just 'name'. */
+    sep = ap_strchr_c(arg, ':');
+    if (sep) {
+        name = apr_pstrmemdup(cmd->pool, arg, sep - arg);
+        sep++;
+    }
+    else {
+        name = arg;
+    }
+
+    socache_provider = ap_lookup_provider(AP_SOCACHE_PROVIDER_GROUP, name,
+                                          AP_SOCACHE_PROVIDER_VERSION);
+    if (socache_provider == NULL) {
+        errmsg = apr_psprintf(cmd->pool,
+                              "Unknown socache provider '%s'. Maybe you need "
+                              "to load the appropriate socache module "
+                              "(mod_socache_%s?)", name, name);
+    }
+    else {
+        errmsg = socache_provider->create(&socache_instance, sep,
+                                          cmd->temp_pool, cmd->pool);
+    }
+
+    if (errmsg) {
+        errmsg = apr_psprintf(cmd->pool, "EarlyHintsSOCache: %s", errmsg);
+    }
+    return errmsg;
+}
+
+static const command_rec early_hints_cmds[] =
+{
+    AP_INIT_FLAG("EarlyHintsLearning", set_learning, NULL, RSRC_CONF|ACCESS_CONF,
+                 "Learn preload links of responses and send them as 103 Early Hints"),
+    AP_INIT_TAKE1("EarlyHintsMaxAge", set_max_age, NULL, RSRC_CONF|ACCESS_CONF,
+                  "How long learned early hints are kept (default 1 hour)"),
+    AP_INIT_TAKE1("EarlyHintsSOCache", set_socache, NULL, RSRC_CONF,
+                  "socache provider and arguments for learned early hints"),
+    {NULL}
+};
+
+static void register_hooks(apr_pool_t *p)
+{
+    ap_hook_pre_config(eh_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(eh_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(eh_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_fixups(eh_fixups, NULL, NULL, APR_HOOK_LAST);
+    ap_hook_log_transaction(eh_log_transaction, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(early_hints) =
+{
+    STANDARD20_MODULE_STUFF,
+    create_eh_dir_config,       /* dir config creater */
+    merge_eh_dir_config,        /* dir merger --- default is to override */
+    NULL,                       /* server config */
+    NULL,                       /* merge server configs */
+    early_hints_cmds,           /* command apr_table_t */
+    register_hooks              /* register hooks */
+};
@@ -134,6 +134,8 @@ struct ajp_msg
 #define AJP_MAX_BUFFER_SZ           65536
 #define AJP13_MAX_SEND_BODY_SZ      (AJP_MAX_BUFFER_SZ - AJP_HEADER_SZ)
 #define AJP_PING_PONG_SZ            128
+/** Max number of messages sent at once by ajp_ilink_sendv() */
+#define AJP_ILINK_MAX_MSGS          2
 
 /** Send a request from web server to container*/
 #define CMD_AJP13_FORWARD_REQUEST   (unsigned char)2
@@ -397,6 +399,17 @@ apr_status_t ajp_msg_log(request_rec *r, ajp_msg_t *msg, char *err);
  */
 apr_status_t ajp_ilink_send(apr_socket_t *sock, ajp_msg_t *msg);
 
+/**
+ * Send AJP messages to backend, in a single write when possible
+ *
+ * @param sock      backend socket
+ * @param msgs      AJP messages to put serialized messages
+ * @param nmsgs     number of messages, at most AJP_ILINK_MAX_MSGS
+ * @return          APR_SUCCESS or error
+ */
+apr_status_t ajp_ilink_sendv(apr_socket_t *sock, ajp_msg_t **msgs,
+                             int nmsgs);
+
 /**
  * Receive an AJP message from backend
  *
@@ -407,18 +420,17 @@ apr_status_t ajp_ilink_send(apr_socket_t *sock, ajp_msg_t *msg);
 apr_status_t ajp_ilink_receive(apr_socket_t *sock, ajp_msg_t *msg);
 
 /**
- * Build the ajp header message and send it
- * @param sock      backend socket
+ * Build the ajp header message, to be sent with ajp_ilink_send[v]()
  * @param r         current request
- * @param buffsize  max size of the AJP packet.
+ * @param msg       AJP message to build, reused
  * @param uri       requested uri
  * @param secret    authentication secret
  * @return          APR_SUCCESS or error
  */
-apr_status_t ajp_send_header(apr_socket_t *sock, request_rec *r,
-                             apr_size_t buffsize,
-                             apr_uri_t *uri,
-                             const char *secret);
+apr_status_t ajp_build_header(request_rec *r,
+                              ajp_msg_t *msg,
+                              apr_uri_t *uri,
+                              const char *secret);
 
 /**
  * Read the ajp message and return the type of the message.
@@ -434,15 +446,21 @@ apr_status_t ajp_read_header(apr_socket_t *sock,
                              ajp_msg_t **msg);
 
 /**
- * Allocate a msg to send data
- * @param pool      pool to allocate from
+ * Prepare a msg to send data
+ * @param msg       AJP message to reuse
  * @param ptr       data buffer
- * @param len       the length of allocated data buffer
- * @param msg       returned AJP message
+ * @param len       on input the size of the message buffer, on output
+ *                  the length of the data buffer
  * @return          APR_SUCCESS or error
  */
-apr_status_t  ajp_alloc_data_msg(apr_pool_t *pool, char **ptr,
-                                 apr_size_t *len, ajp_msg_t **msg);
+apr_status_t  ajp_init_data_msg(ajp_msg_t *msg, char **ptr, apr_size_t *len);
+
+/**
+ * Set the length of the data in the message, before sending it
+ * @param msg       AJP message
+ * @param len       length of the data
+ */
+void ajp_end_data_msg(ajp_msg_t *msg, apr_size_t len);
 
 /**
  * Send the data message
@@ -48,92 +48,76 @@ static const char *long_res_header_for_sc(int sc)
 
 #define UNKNOWN_METHOD (-1)
 
+/* The request headers with an SC code, by length of their names: a header
+ * name is compared (case insensitively) to the one or two of its length
+ * only, with no copy.
+ */
+typedef struct {
+    const char *name;
+    int sc;
+} sc_req_header_t;
+
+static const sc_req_header_t sc_req_headers_4[] = {
+    { "Host", SC_HOST }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_6[] = {
+    { "Accept", SC_ACCEPT }, { "Cookie", SC_COOKIE },
+    { "Pragma", SC_PRAGMA }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_7[] = {
+    { "Cookie2", SC_COOKIE2 }, { "Referer", SC_REFERER }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_10[] = {
+    { "Connection", SC_CONNECTION }, { "User-Agent", SC_USER_AGENT },
+    { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_12[] = {
+    { "Content-Type", SC_CONTENT_TYPE }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_13[] = {
+    { "Authorization", SC_AUTHORIZATION }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_14[] = {
+    { "Accept-Charset", SC_ACCEPT_CHARSET },
+    { "Content-Length", SC_CONTENT_LENGTH }, { NULL, 0 }
+};
+static const sc_req_header_t sc_req_headers_15[] = {
+    { "Accept-Encoding", SC_ACCEPT_ENCODING },
+    { "Accept-Language", SC_ACCEPT_LANGUAGE }, { NULL, 0 }
+};
+
+/* ACCEPT-LANGUAGE is the longest header that is of interest */
+static const sc_req_header_t *const sc_req_headers[16] = {
+    NULL, NULL, NULL, NULL,
+    sc_req_headers_4,
+    NULL,
+    sc_req_headers_6,
+    sc_req_headers_7,
+    NULL, NULL,
+    sc_req_headers_10,
+    NULL,
+    sc_req_headers_12,
+    sc_req_headers_13,
+    sc_req_headers_14,
+    sc_req_headers_15
+};
+
 static int sc_for_req_header(const char *header_name)
 {
-    char header[16];
     apr_size_t len = strlen(header_name);
-    const char *p = header_name;
-    int i = 0;
+    const sc_req_header_t *h;
 
-    /* ACCEPT-LANGUAGE is the longest header
-     * that is of interest.
-     */
-    if (len < 4 || len > 15)
+    if (len >= sizeof(sc_req_headers) / sizeof(sc_req_headers[0])
+        || !(h = sc_req_headers[len])) {
         return UNKNOWN_METHOD;
+    }
+    for (; h->name; ++h) {
+        if (ap_cstr_casecmp(header_name, h->name) == 0) {
+            return h->sc;
+        }
+    }
 
-    memset(header, 0, sizeof header);
-    while (*p)
-        header[i++] = apr_toupper(*p++);
-    header[i] = '\0';
-    p = &header[1];
-
-    switch (header[0]) {
-        case 'A':
-            if (memcmp(p, "CCEPT", 5) == 0) {
-                if (!header[6])
-                    return SC_ACCEPT;
-                else if (header[6] == '-') {
-                    p += 6;
-                    if (strcmp(p, "CHARSET") == 0)
-                        return SC_ACCEPT_CHARSET;
-                    else if (strcmp(p,  "ENCODING") == 0)
-                        return SC_ACCEPT_ENCODING;
-                    else if (strcmp(p, "LANGUAGE") == 0)
-                        return SC_ACCEPT_LANGUAGE;
-                    else
-                        return UNKNOWN_METHOD;
-                }
-                else
-                    return UNKNOWN_METHOD;
-            }
-            else if (strcmp(p, "UTHORIZATION") == 0)
-                return SC_AUTHORIZATION;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        case 'C':
-            if (strcmp(p, "OOKIE2") == 0)
-                return SC_COOKIE2;
-            else if (strcmp(p, "OOKIE") == 0)
-                return SC_COOKIE;
-            else if (strcmp(p, "ONNECTION") == 0)
-                return SC_CONNECTION;
-            else if (strcmp(p, "ONTENT-TYPE") == 0)
-                return SC_CONTENT_TYPE;
-            else if (strcmp(p, "ONTENT-LENGTH") == 0)
-                return SC_CONTENT_LENGTH;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        case 'H':
-            if (strcmp(p, "OST") == 0)
-                return SC_HOST;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        case 'P':
-            if (strcmp(p, "RAGMA") == 0)
-                return SC_PRAGMA;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        case 'R':
-            if (strcmp(p, "EFERER") == 0)
-                return SC_REFERER;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        case 'U':
-            if (strcmp(p, "SER-AGENT") == 0)
-                return SC_USER_AGENT;
-            else
-                return UNKNOWN_METHOD;
-        break;
-        default:
-            return UNKNOWN_METHOD;
-    }
-
-    /* NOTREACHED */
+    return UNKNOWN_METHOD;
 }
 
 /* Apache method number to SC methods transform table */
@@ -266,8 +250,8 @@ static apr_status_t ajp_marshal_into_msgb(ajp_msg_t *msg,
 
     for (i = 0 ; i < num_headers ; i++) {
         int sc;
-        const apr_array_header_t *t = apr_table_elts(r->headers_in);
-        const apr_table_entry_t *elts = (apr_table_entry_t *)t->elts;
+        const apr_table_entry_t *elts =
+            (apr_table_entry_t *)apr_table_elts(r->headers_in)->elts;
 
         if ((sc = sc_for_req_header(elts[i].key)) != UNKNOWN_METHOD) {
             if (ajp_msg_append_uint16(msg, (apr_uint16_t)sc)) {
@@ -683,36 +667,20 @@ static apr_status_t ajp_unmarshal_response(ajp_msg_t *msg,
 }
 
 /*
- * Build the ajp header message and send it
+ * Build the ajp header message, to be sent by the caller
  */
-apr_status_t ajp_send_header(apr_socket_t *sock,
-                             request_rec *r,
-                             apr_size_t buffsize,
-                             apr_uri_t *uri,
-                             const char *secret)
+apr_status_t ajp_build_header(request_rec *r,
+                              ajp_msg_t *msg,
+                              apr_uri_t *uri,
+                              const char *secret)
 {
-    ajp_msg_t *msg;
     apr_status_t rc;
 
-    rc = ajp_msg_create(r->pool, buffsize, &msg);
-    if (rc != APR_SUCCESS) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00987)
-               "ajp_send_header: ajp_msg_create failed");
-        return rc;
-    }
-
+    ajp_msg_reuse(msg);
     rc = ajp_marshal_into_msgb(msg, r, uri, secret);
     if (rc != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00988)
-               "ajp_send_header: ajp_marshal_into_msgb failed");
-        return rc;
-    }
-
-    rc = ajp_ilink_send(sock, msg);
-    ajp_msg_log(r, msg, "ajp_send_header: ajp_ilink_send packet dump");
-    if (rc != APR_SUCCESS) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00989)
-               "ajp_send_header: ajp_ilink_send failed");
+               "ajp_build_header: ajp_marshal_into_msgb failed");
         return rc;
     }
 
@@ -870,27 +838,21 @@ apr_status_t ajp_parse_reuse(request_rec *r, ajp_msg_t *msg,
 }
 
 /*
- * Allocate a msg to send data
+ * Prepare a msg to send data
  */
-apr_status_t  ajp_alloc_data_msg(apr_pool_t *pool, char **ptr, apr_size_t *len,
-                                 ajp_msg_t **msg)
+apr_status_t  ajp_init_data_msg(ajp_msg_t *msg, char **ptr, apr_size_t *len)
 {
-    apr_status_t rc;
-
-    if ((rc = ajp_msg_create(pool, *len, msg)) != APR_SUCCESS)
-        return rc;
-    ajp_msg_reset(*msg);
-    *ptr = (char *)&((*msg)->buf[6]);
+    ajp_msg_reuse(msg);
+    *ptr = (char *)&(msg->buf[6]);
     *len =  *len - 6;
 
     return APR_SUCCESS;
 }
 
 /*
- * Send the data message
+ * Set the length of the data in the message
  */
-apr_status_t  ajp_send_data_msg(apr_socket_t *sock,
-                                ajp_msg_t *msg, apr_size_t len)
+void ajp_end_data_msg(ajp_msg_t *msg, apr_size_t len)
 {
 
     msg->buf[4] = (apr_byte_t)((len >> 8) & 0xFF);
@@ -898,6 +860,17 @@ apr_status_t  ajp_send_data_msg(apr_socket_t *sock,
 
     msg->len += len + 2; /* + 1 XXXX where is '\0' */
 
+}
+
+/*
+ * Send the data message
+ */
+apr_status_t  ajp_send_data_msg(apr_socket_t *sock,
+                                ajp_msg_t *msg, apr_size_t len)
+{
+
+    ajp_end_data_msg(msg, len);
+
     return ajp_ilink_send(sock, msg);
 
 }
@@ -18,33 +18,53 @@
 
 APLOG_USE_MODULE(proxy_ajp);
 
-apr_status_t ajp_ilink_send(apr_socket_t *sock, ajp_msg_t *msg)
+apr_status_t ajp_ilink_sendv(apr_socket_t *sock, ajp_msg_t **msgs,
+                            int nmsgs)
 {
-    char         *buf;
+    struct iovec vec[AJP_ILINK_MAX_MSGS];
+    struct iovec *v = vec;
     apr_status_t status;
-    apr_size_t   length;
+    apr_size_t   length = 0;
+    int          nvec = nmsgs, i;
 
-    ajp_msg_end(msg);
+    AP_DEBUG_ASSERT(nmsgs > 0 && nmsgs <= AJP_ILINK_MAX_MSGS);
 
-    length = msg->len;
-    buf    = (char *)msg->buf;
+    for (i = 0; i < nmsgs; i++) {
+        ajp_msg_end(msgs[i]);
+        vec[i].iov_base = (void *)msgs[i]->buf;
+        vec[i].iov_len = msgs[i]->len;
+        length += msgs[i]->len;
+    }
 
     do {
-        apr_size_t written = length;
+        apr_size_t written = 0;
 
-        status = apr_socket_send(sock, buf, &written);
+        status = apr_socket_sendv(sock, v, nvec, &written);
         if (status != APR_SUCCESS) {
             ap_log_error(APLOG_MARK, APLOG_ERR, status, NULL, APLOGNO(01029)
                           "ajp_ilink_send(): send failed");
             return status;
         }
         length -= written;
-        buf    += written;
+        while (nvec && written >= v->iov_len) {
+            written -= v->iov_len;
+            v++;
+            nvec--;
+        }
+        if (written) {
+            v->iov_base = (char *)v->iov_base + written;
+            v->iov_len -= written;
+        }
     } while (length);
 
     return APR_SUCCESS;
 }
 
+apr_status_t ajp_ilink_send(apr_socket_t *sock, ajp_msg_t *msg)
+{
+    return ajp_ilink_sendv(sock, &msg, 1);
+}
+
 
 static apr_status_t ilink_read(apr_socket_t *sock, apr_byte_t *buf,
                                apr_size_t len)
@@ -27,38 +27,51 @@ static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
                             *ap_proxy_balancer_get_best_worker_fn = NULL;
 
 
+/* The busy counts and lbstatus of the workers are read and updated
+ * atomically, and compared as read once (not re-read from the best worker
+ * so far, which concurrent elections may be changing), so no lock is needed.
+ */
+typedef struct {
+    int total_factor;
+    int best_lbstatus;
+    apr_size_t best_busy;
+} bybusyness_baton;
+
 static int is_best_bybusyness(proxy_worker *current, proxy_worker *prev_best, void *baton)
 {
-    int *total_factor = (int *)baton;
+    bybusyness_baton *b = baton;
     apr_size_t current_busy = ap_proxy_get_busy_count(current);
-    apr_size_t prev_best_busy = 0;
+    int lbfactor = current->s->lbfactor;
+    int lbstatus = ap_proxy_add_lbstatus(current, lbfactor);
 
-    current->s->lbstatus += current->s->lbfactor;
-    *total_factor += current->s->lbfactor;
-    if (prev_best)
-        prev_best_busy = ap_proxy_get_busy_count(prev_best);
-     
+    b->total_factor += lbfactor;
 
-    return (
+    if (
         !prev_best
-        || (current_busy < prev_best_busy)
+        || (current_busy < b->best_busy)
         || (
-            (current_busy == prev_best_busy)
-            && (current->s->lbstatus > prev_best->s->lbstatus)
+            (current_busy == b->best_busy)
+            && (lbstatus > b->best_lbstatus)
         )
-    );
+    ) {
+        b->best_busy = current_busy;
+        b->best_lbstatus = lbstatus;
+        return TRUE;
+    }
+
+    return FALSE;
 }
 
 static proxy_worker *find_best_bybusyness(proxy_balancer *balancer,
                                           request_rec *r)
 {
-    int total_factor = 0;
+    bybusyness_baton baton = { 0, 0, 0 };
     proxy_worker *worker =
         ap_proxy_balancer_get_best_worker_fn(balancer, r, is_best_bybusyness,
-                                          &total_factor);
+                                          &baton);
 
     if (worker) {
-        worker->s->lbstatus -= total_factor;
+        ap_proxy_add_lbstatus(worker, -baton.total_factor);
     }
 
     return worker;
@@ -89,7 +102,8 @@ static const proxy_balancer_method bybusyness =
     NULL,
     &reset,
     &age,
-    NULL
+    NULL,
+    1           /* lockless */
 };
 
 /* post_config hook: */
@@ -0,0 +1,424 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Load balancing by consistent hashing of a request key (Maglev).
+ *
+ * Each balancer gets, in every child, a lookup table of a fixed prime size
+ * where every slot designates one of the regular workers of its first
+ * lbset. The table is populated from a permutation of the slots specific
+ * to each worker (derived from its name, so all the children and restarts
+ * agree), the workers taking turns to claim their next free preferred slot,
+ * each lbfactor times per round relatively to the biggest one. Electing a
+ * worker is then a lookup of the request key's hash modulo the table size.
+ *
+ * The table is rebuilt only when the balancer is synced after its members
+ * changed (ap_proxy_sync_balancer()). When the worker found is unusable, a
+ * second table of the usable candidates (spares, standbys and next lbsets
+ * included) elects another one; it is rebuilt only when the candidates
+ * change, so only the keys of the unusable workers move.
+ */
+
+#include "mod_proxy.h"
+#include "proxy_util.h"
+#include "scoreboard.h"
+#include "ap_mpm.h"
+#include "apr_version.h"
+#include "ap_hooks.h"
+#include "ap_expr.h"
+
+#if APR_HAS_THREADS
+#include "apr_thread_mutex.h"
+#endif
+
+module AP_MODULE_DECLARE_DATA lbmethod_byhash_module;
+
+static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
+                            *ap_proxy_balancer_get_best_worker_fn = NULL;
+
+/* Lookup table size, a prime giving 100 slots per worker for up to 160
+ * workers (the fewer slots per worker, the less the lbfactors are honored).
+ */
+#define BYHASH_TABLE_SIZE 16381
+#define BYHASH_NO_SLOT ((apr_uint16_t)-1)
+
+typedef struct {
+    ap_expr_info_t *key;
+} byhash_dir_conf_t;
+
+typedef struct {
+    apr_array_header_t *workers;     /* the workers in the table */
+    apr_uint16_t *slots;             /* indexes in workers */
+} byhash_table_t;
+
+/* Per child and balancer context, allocated on first use by the finder
+ * which runs under the balancer's lock (byhash is not lockless).
+ */
+typedef struct {
+    apr_pool_t *pool;
+    apr_time_t wupdated;             /* balancer->wupdated of all's build */
+    byhash_table_t all;              /* regular workers of the first lbset */
+    byhash_table_t usable;           /* usable candidates, for fallbacks */
+} byhash_ctx_t;
+
+static apr_pool_t *byhash_pool = NULL;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *byhash_mutex = NULL;
+#endif
+
+static byhash_ctx_t *get_ctx(proxy_balancer *balancer)
+{
+    byhash_ctx_t *ctx = balancer->context;
+    apr_allocator_t *alloc;
+    apr_pool_t *pool;
+
+    if (ctx) {
+        return ctx;
+    }
+
+    /* Own allocator, the tables are rebuilt under the balancer lock only,
+     * concurrently with other balancers.
+     */
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(byhash_mutex);
+#endif
+    if (apr_allocator_create(&alloc) != APR_SUCCESS
+        || apr_pool_create_ex(&pool, byhash_pool, NULL, alloc) != APR_SUCCESS) {
+        ap_abort_on_oom();
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(byhash_mutex);
+#endif
+    apr_allocator_owner_set(alloc, pool);
+    apr_pool_tag(pool, "lbmethod_byhash");
+
+    ctx = apr_pcalloc(pool, sizeof(*ctx));
+    ctx->pool = pool;
+    balancer->context = ctx;
+    return ctx;
+}
+
+static void build_table(byhash_table_t *ht, apr_array_header_t *candidates,
+                        apr_pool_t *pool, apr_pool_t *ptemp)
+{
+    int n = candidates->nelts, i, wmax = 1;
+    apr_uint32_t size = BYHASH_TABLE_SIZE, filled = 0, round;
+    apr_uint32_t *offset, *skip, *next, *placed;
+
+    if (!ht->slots) {
+        ht->slots = apr_palloc(pool, size * sizeof(*ht->slots));
+        ht->workers = apr_array_make(pool, n > 0 ? n : 1,
+                                     sizeof(proxy_worker *));
+    }
+    apr_array_clear(ht->workers);
+    apr_array_cat(ht->workers, candidates);
+    if (!n) {
+        return;
+    }
+    memset(ht->slots, 0xff, size * sizeof(*ht->slots));
+
+    offset = apr_palloc(ptemp, n * sizeof(*offset));
+    skip = apr_palloc(ptemp, n * sizeof(*skip));
+    next = apr_pcalloc(ptemp, n * sizeof(*next));
+    placed = apr_pcalloc(ptemp, n * sizeof(*placed));
+    for (i = 0; i < n; ++i) {
+        proxy_worker *worker = APR_ARRAY_IDX(candidates, i, proxy_worker *);
+
+        offset[i] = ap_proxy_hashfunc(worker->s->name, PROXY_HASHFUNC_DEFAULT) % size;
+        skip[i] = ap_proxy_hashfunc(worker->s->name, PROXY_HASHFUNC_FNV) % (size - 1) + 1;
+        if (worker->s->lbfactor > wmax) {
+            wmax = worker->s->lbfactor;
+        }
+    }
+
+    for (round = 1; filled < size; ++round) {
+        for (i = 0; i < n && filled < size; ++i) {
+            proxy_worker *worker = APR_ARRAY_IDX(candidates, i, proxy_worker *);
+            apr_uint64_t weight = worker->s->lbfactor > 0 ? worker->s->lbfactor : 1;
+
+            /* Since size is prime, the permutation visits every slot */
+            while (filled < size
+                   && (apr_uint64_t)placed[i] * wmax < weight * round) {
+                apr_uint32_t slot;
+                do {
+                    slot = (apr_uint32_t)((offset[i] + (apr_uint64_t)next[i]
+                                           * skip[i]) % size);
+                    next[i]++;
+                } while (ht->slots[slot] != BYHASH_NO_SLOT);
+                ht->slots[slot] = (apr_uint16_t)i;
+                placed[i]++;
+                filled++;
+            }
+        }
+    }
+}
+
+/* The regular (neither spare nor standby) workers of the first lbset,
+ * whether usable or not.
+ */
+static void collect_workers(proxy_balancer *balancer,
+                            apr_array_header_t *workers)
+{
+    int i, lbset = -1;
+
+    for (i = 0; i < balancer->workers->nelts; i++) {
+        proxy_worker *worker = APR_ARRAY_IDX(balancer->workers, i,
+                                             proxy_worker *);
+
+        if (PROXY_WORKER_IS_SPARE(worker) || PROXY_WORKER_IS_STANDBY(worker)) {
+            continue;
+        }
+        if (lbset < 0 || worker->s->lbset < lbset) {
+            apr_array_clear(workers);
+            lbset = worker->s->lbset;
+        }
+        if (worker->s->lbset == lbset) {
+            APR_ARRAY_PUSH(workers, proxy_worker *) = worker;
+        }
+    }
+}
+
+/* Collect the candidates of the first lbset having some, and let
+ * ap_proxy_balancer_get_best_worker() handle spares and standbys.
+ */
+static int is_candidate(proxy_worker *current, proxy_worker *prev_best,
+                        void *baton)
+{
+    apr_array_header_t *candidates = baton;
+
+    APR_ARRAY_PUSH(candidates, proxy_worker *) = current;
+    return !prev_best;
+}
+
+static const char *get_key(proxy_balancer *balancer, request_rec *r)
+{
+    byhash_dir_conf_t *dconf = NULL;
+    const char *key, *err = NULL;
+
+    if (balancer->section_config) {
+        dconf = ap_get_module_config(balancer->section_config,
+                                     &lbmethod_byhash_module);
+    }
+    if (!dconf || !dconf->key) {
+        dconf = ap_get_module_config(r->per_dir_config,
+                                     &lbmethod_byhash_module);
+    }
+    if (!dconf->key) {
+        return r->unparsed_uri;
+    }
+
+    key = ap_expr_str_exec(r, dconf->key, &err);
+    if (err) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10525)
+                      "%s: failure evaluating BalancerHashKey: %s",
+                      balancer->s->name, err);
+        return r->unparsed_uri;
+    }
+    return key;
+}
+
+static proxy_worker *find_best_byhash(proxy_balancer *balancer,
+                                      request_rec *r)
+{
+    byhash_ctx_t *ctx = get_ctx(balancer);
+    apr_array_header_t *candidates;
+    proxy_worker *worker;
+    const char *key;
+    apr_uint32_t slot;
+
+    if (!ctx->all.workers || ctx->wupdated != balancer->wupdated) {
+        candidates = apr_array_make(r->pool, balancer->workers->nelts,
+                                    sizeof(proxy_worker *));
+        collect_workers(balancer, candidates);
+        if (candidates->nelts >= BYHASH_NO_SLOT) {
+            apr_array_clear(candidates);
+        }
+        build_table(&ctx->all, candidates, ctx->pool, r->pool);
+        ctx->wupdated = balancer->wupdated;
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10526)
+                      "%s: built hash table of %u slots for %d workers",
+                      balancer->s->name, BYHASH_TABLE_SIZE, candidates->nelts);
+    }
+
+    key = get_key(balancer, r);
+    slot = ap_proxy_hashfunc(key, PROXY_HASHFUNC_DEFAULT) % BYHASH_TABLE_SIZE;
+
+    if (ctx->all.workers->nelts) {
+        worker = APR_ARRAY_IDX(ctx->all.workers, ctx->all.slots[slot],
+                               proxy_worker *);
+        if (!PROXY_WORKER_IS_DRAINING(worker)) {
+            /* Like ap_proxy_balancer_get_best_worker() does */
+            if (!PROXY_WORKER_IS_USABLE(worker)) {
+                ap_proxy_retry_worker("BALANCER", worker, r->server);
+            }
+            if (PROXY_WORKER_IS_USABLE(worker)) {
+                goto elected;
+            }
+        }
+    }
+
+    /* Fall back to the usable candidates */
+    candidates = apr_array_make(r->pool, balancer->workers->nelts,
+                                sizeof(proxy_worker *));
+    if (!ap_proxy_balancer_get_best_worker_fn(balancer, r, is_candidate,
+                                              candidates)) {
+        return NULL;
+    }
+    if (candidates->nelts >= BYHASH_NO_SLOT) {
+        worker = APR_ARRAY_IDX(candidates, 0, proxy_worker *);
+        goto elected;
+    }
+    if (!ctx->usable.workers
+        || ctx->usable.workers->nelts != candidates->nelts
+        || memcmp(ctx->usable.workers->elts, candidates->elts,
+                  candidates->nelts * sizeof(proxy_worker *))) {
+        build_table(&ctx->usable, candidates, ctx->pool, r->pool);
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10600)
+                      "%s: built fallback hash table of %u slots for %d "
+                      "usable workers", balancer->s->name,
+                      BYHASH_TABLE_SIZE, candidates->nelts);
+    }
+    worker = APR_ARRAY_IDX(ctx->usable.workers, ctx->usable.slots[slot],
+                           proxy_worker *);
+
+elected:
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "byhash: %s elected worker %s for key '%s'",
+                  balancer->s->name, ap_proxy_worker_get_name(worker), key);
+
+    return worker;
+}
+
+/* assumed to be mutex protected by caller */
+static apr_status_t reset(proxy_balancer *balancer, server_rec *s)
+{
+    int i;
+    proxy_worker **worker;
+    worker = (proxy_worker **)balancer->workers->elts;
+    for (i = 0; i < balancer->workers->nelts; i++, worker++) {
+        (*worker)->s->lbstatus = 0;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t age(proxy_balancer *balancer, server_rec *s)
+{
+    return APR_SUCCESS;
+}
+
+static const proxy_balancer_method byhash =
+{
+    "byhash",
+    &find_best_byhash,
+    NULL,
+    &reset,
+    &age,
+    NULL
+};
+
+static void *create_byhash_dir_config(apr_pool_t *p, char *dummy)
+{
+    return apr_pcalloc(p, sizeof(byhash_dir_conf_t));
+}
+
+static void *merge_byhash_dir_config(apr_pool_t *p, void *basev, void *addv)
+{
+    byhash_dir_conf_t *base = (byhash_dir_conf_t *)basev;
+    byhash_dir_conf_t *add = (byhash_dir_conf_t *)addv;
+    byhash_dir_conf_t *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->key = add->key ? add->key : base->key;
+    return conf;
+}
+
+static const char *set_byhash_key(cmd_parms *cmd, void *dconf,
+                                  const char *arg)
+{
+    byhash_dir_conf_t *conf = dconf;
+    const char *err = NULL;
+
+    conf->key = ap_expr_parse_cmd(cmd, arg, AP_EXPR_FLAG_STRING_RESULT,
+                                  &err, NULL);
+    if (err) {
+        return apr_pstrcat(cmd->pool, "Cannot parse expression '", arg,
+                           "': ", err, NULL);
+    }
+    return NULL;
+}
+
+static const command_rec byhash_cmds[] = {
+    AP_INIT_TAKE1("BalancerHashKey", set_byhash_key, NULL,
+                  RSRC_CONF|ACCESS_CONF,
+                  "String expression giving the key to hash for electing "
+                  "a worker"),
+    {NULL}
+};
+
+/* post_config hook: */
+static int lbmethod_byhash_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptemp, server_rec *s)
+{
+
+    /* lbmethod_byhash_post_config() will be called twice during startup.  So, don't
+     * set up the static data the 1st time through. */
+    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    ap_proxy_balancer_get_best_worker_fn =
+                 APR_RETRIEVE_OPTIONAL_FN(proxy_balancer_get_best_worker);
+    if (!ap_proxy_balancer_get_best_worker_fn) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10527)
+                     "mod_proxy must be loaded for mod_lbmethod_byhash");
+        return !OK;
+    }
+
+    return OK;
+}
+
+/* The lookup tables are allocated on first use, for the balancers using
+ * byhash only, since the lbmethod of a balancer can change at runtime
+ * (balancer-manager).
+ */
+static void lbmethod_byhash_child_init(apr_pool_t *p, server_rec *s)
+{
+    byhash_pool = p;
+#if APR_HAS_THREADS
+    if (apr_thread_mutex_create(&byhash_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                p) != APR_SUCCESS) {
+        ap_abort_on_oom();
+    }
+#endif
+}
+
+static void register_hook(apr_pool_t *p)
+{
+    static const char * const aszPred[] = { "mod_proxy_balancer.c", NULL };
+
+    ap_register_provider(p, PROXY_LBMETHOD, "byhash", "0", &byhash);
+    ap_hook_post_config(lbmethod_byhash_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(lbmethod_byhash_child_init, aszPred, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(lbmethod_byhash) = {
+    STANDARD20_MODULE_STUFF,
+    create_byhash_dir_config,   /* create per-directory config structure */
+    merge_byhash_dir_config,    /* merge per-directory config structures */
+    NULL,                       /* create per-server config structure */
+    NULL,                       /* merge per-server config structures */
+    byhash_cmds,                /* command apr_table_t */
+    register_hook               /* register hooks */
+};
@@ -0,0 +1,355 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Load balancing by latency ("peak EWMA").
+ *
+ * Each worker keeps, in its shared slot, a time decaying moving average of
+ * the time it took to produce the first bytes of its responses. A sample
+ * higher than the average replaces it right away (the peak), lower samples
+ * are blended in with a weight growing with the time elapsed since the
+ * previous one, and the average decays towards zero while no sample comes,
+ * so that slow workers are tried again after a while.
+ *
+ * The cost of a worker is its average latency multiplied by the number of
+ * requests in flight on it, plus one, and divided by its lbfactor. Rather
+ * than always electing the cheapest worker, which would herd all the
+ * children on the same one between two updates, two usable workers are
+ * picked at random and the cheaper of them is elected ("power of two
+ * choices").
+ */
+
+#include "mod_proxy.h"
+#include "proxy_util.h"
+#include "scoreboard.h"
+#include "ap_mpm.h"
+#include "apr_version.h"
+#include "ap_hooks.h"
+
+module AP_MODULE_DECLARE_DATA lbmethod_bylatency_module;
+
+static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
+                            *ap_proxy_balancer_get_best_worker_fn = NULL;
+
+#define BYLATENCY_FILTER "LBMETHOD_BYLATENCY"
+#define BYLATENCY_DEFAULT_DECAY apr_time_from_sec(10)
+
+typedef struct {
+    apr_interval_time_t decay;
+    unsigned int decay_set:1;
+} bylatency_conf_t;
+
+/* Per request state, the worker waiting for its latency sample */
+typedef struct {
+    proxy_worker *worker;
+    apr_time_t start;
+} bylatency_req_t;
+
+/* Weight of the past given the time elapsed since it was sampled, that is
+ * an approximation of exp(-elapsed/decay) as decay/(decay + elapsed),
+ * applied to val.
+ */
+static APR_INLINE apr_uint64_t decayed(apr_uint64_t val,
+                                       apr_interval_time_t elapsed,
+                                       apr_interval_time_t decay)
+{
+    if (elapsed <= 0) {
+        return val;
+    }
+    return val * decay / (decay + elapsed);
+}
+
+static apr_uint64_t get_latency(proxy_worker *worker, apr_time_t now,
+                                apr_interval_time_t decay)
+{
+    return decayed(worker->s->latency, now - worker->s->latency_updated,
+                   decay);
+}
+
+static void observe(proxy_worker *worker, apr_interval_time_t sample,
+                    apr_interval_time_t decay, request_rec *r)
+{
+    apr_time_t now = apr_time_now();
+    apr_uint64_t latency = worker->s->latency;
+
+    if (sample < 0) {
+        sample = 0;
+    }
+    else if (sample > APR_UINT32_MAX) {
+        sample = APR_UINT32_MAX;
+    }
+
+    /* The shared latency and its timestamp are updated racily, like the
+     * other lb fields; a lost or mixed sample does no harm here.
+     */
+    if ((apr_uint64_t)sample >= latency || !worker->s->latency_updated) {
+        latency = sample;
+    }
+    else {
+        apr_uint64_t past = decayed(latency, now - worker->s->latency_updated,
+                                    decay);
+        latency = past + (apr_uint64_t)sample - decayed(sample,
+                                    now - worker->s->latency_updated, decay);
+    }
+    worker->s->latency = (apr_uint32_t)latency;
+    worker->s->latency_updated = now;
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                  "bylatency: worker %s sampled %" APR_TIME_T_FMT
+                  "us, average now %" APR_UINT64_T_FMT "us",
+                  ap_proxy_worker_get_name(worker), sample, latency);
+}
+
+static apr_uint64_t get_cost(proxy_worker *worker, apr_time_t now,
+                             apr_interval_time_t decay)
+{
+    apr_size_t busy = ap_proxy_get_busy_count(worker);
+    apr_uint64_t latency;
+    int lbfactor;
+
+    if (!worker->s->latency_updated) {
+        /* Not measured yet, let it have its first request alone */
+        return busy ? APR_UINT64_MAX : 0;
+    }
+
+    latency = get_latency(worker, now, decay) + 1;
+    lbfactor = worker->s->lbfactor > 0 ? worker->s->lbfactor : 1;
+    return latency * (busy + 1) * 100 / lbfactor;
+}
+
+/* Collect the candidates of the first lbset having some, and let
+ * ap_proxy_balancer_get_best_worker() handle spares and standbys.
+ */
+static int is_candidate(proxy_worker *current, proxy_worker *prev_best,
+                        void *baton)
+{
+    apr_array_header_t *candidates = baton;
+
+    APR_ARRAY_PUSH(candidates, proxy_worker *) = current;
+    return !prev_best;
+}
+
+static apr_status_t bylatency_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    request_rec *r = f->r;
+    bylatency_req_t *req = f->ctx;
+
+    if (!APR_BRIGADE_EMPTY(bb)) {
+        if (req->worker) {
+            bylatency_conf_t *conf = ap_get_module_config(r->server->module_config,
+                                                          &lbmethod_bylatency_module);
+            observe(req->worker, apr_time_now() - req->start, conf->decay, r);
+            req->worker = NULL;
+        }
+        ap_remove_output_filter(f);
+    }
+
+    return ap_pass_brigade(f->next, bb);
+}
+
+static proxy_worker *find_best_bylatency(proxy_balancer *balancer,
+                                         request_rec *r)
+{
+    bylatency_conf_t *conf = ap_get_module_config(r->server->module_config,
+                                                  &lbmethod_bylatency_module);
+    bylatency_req_t *req = ap_get_module_config(r->request_config,
+                                                &lbmethod_bylatency_module);
+    apr_array_header_t *candidates;
+    proxy_worker *worker;
+    apr_time_t now;
+
+    candidates = apr_array_make(r->pool, balancer->workers->nelts,
+                                sizeof(proxy_worker *));
+    if (!ap_proxy_balancer_get_best_worker_fn(balancer, r, is_candidate,
+                                              candidates)) {
+        return NULL;
+    }
+
+    now = apr_time_now();
+    worker = APR_ARRAY_IDX(candidates, 0, proxy_worker *);
+    if (candidates->nelts > 1) {
+        apr_uint32_t n = candidates->nelts - 1;
+        apr_uint32_t i = ap_random_pick(0, n);
+        apr_uint32_t j = ap_random_pick(0, n - 1);
+        proxy_worker *w1, *w2;
+
+        if (j >= i) {
+            j++;
+        }
+        w1 = APR_ARRAY_IDX(candidates, i, proxy_worker *);
+        w2 = APR_ARRAY_IDX(candidates, j, proxy_worker *);
+        worker = (get_cost(w2, now, conf->decay) < get_cost(w1, now, conf->decay)
+                  ? w2 : w1);
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "bylatency: %s elected worker %s among %d",
+                  balancer->s->name, ap_proxy_worker_get_name(worker),
+                  candidates->nelts);
+
+    /* Time the first bytes of the response (possibly after a failover) */
+    if (!req) {
+        req = apr_pcalloc(r->pool, sizeof(*req));
+        ap_set_module_config(r->request_config, &lbmethod_bylatency_module,
+                             req);
+        ap_add_output_filter(BYLATENCY_FILTER, req, r, r->connection);
+    }
+    req->worker = worker;
+    req->start = now;
+
+    return worker;
+}
+
+/* Account for requests which failed before any response, so that a worker
+ * timing out does not look fast. Runs before mod_proxy_balancer's hook.
+ */
+static int bylatency_post_request(proxy_worker *worker,
+                                  proxy_balancer *balancer,
+                                  request_rec *r,
+                                  proxy_server_conf *sconf)
+{
+    bylatency_req_t *req = ap_get_module_config(r->request_config,
+                                                &lbmethod_bylatency_module);
+
+    /* Responses of suspended requests come later, through the filter */
+    if (req && req->worker == worker && r->status != SUSPENDED) {
+        bylatency_conf_t *conf = ap_get_module_config(r->server->module_config,
+                                                      &lbmethod_bylatency_module);
+        observe(worker, apr_time_now() - req->start, conf->decay, r);
+        req->worker = NULL;
+    }
+
+    return DECLINED;
+}
+
+/* assumed to be mutex protected by caller */
+static apr_status_t reset(proxy_balancer *balancer, server_rec *s)
+{
+    int i;
+    proxy_worker **worker;
+    worker = (proxy_worker **)balancer->workers->elts;
+    for (i = 0; i < balancer->workers->nelts; i++, worker++) {
+        (*worker)->s->lbstatus = 0;
+        (*worker)->s->latency = 0;
+        (*worker)->s->latency_updated = 0;
+        ap_proxy_set_busy_count(*worker, 0);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t age(proxy_balancer *balancer, server_rec *s)
+{
+    return APR_SUCCESS;
+}
+
+static const proxy_balancer_method bylatency =
+{
+    "bylatency",
+    &find_best_bylatency,
+    NULL,
+    &reset,
+    &age,
+    NULL,
+    1           /* lockless */
+};
+
+static void *create_bylatency_config(apr_pool_t *p, server_rec *s)
+{
+    bylatency_conf_t *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->decay = BYLATENCY_DEFAULT_DECAY;
+    return conf;
+}
+
+static void *merge_bylatency_config(apr_pool_t *p, void *basev, void *overridesv)
+{
+    bylatency_conf_t *base = (bylatency_conf_t *)basev;
+    bylatency_conf_t *overrides = (bylatency_conf_t *)overridesv;
+    bylatency_conf_t *conf = apr_pcalloc(p, sizeof(*conf));
+
+    conf->decay = overrides->decay_set ? overrides->decay : base->decay;
+    conf->decay_set = overrides->decay_set || base->decay_set;
+    return conf;
+}
+
+static const char *set_bylatency_decay(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    bylatency_conf_t *conf = ap_get_module_config(cmd->server->module_config,
+                                                  &lbmethod_bylatency_module);
+    apr_interval_time_t decay;
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err) {
+        return err;
+    }
+    if (ap_timeout_parameter_parse(arg, &decay, "s") != APR_SUCCESS
+        || decay <= 0) {
+        return "BalancerLatencyDecay must be a positive time";
+    }
+    conf->decay = decay;
+    conf->decay_set = 1;
+    return NULL;
+}
+
+static const command_rec bylatency_cmds[] = {
+    AP_INIT_TAKE1("BalancerLatencyDecay", set_bylatency_decay, NULL, RSRC_CONF,
+                  "Time constant of the latency average decay (seconds "
+                  "unless a unit is given)"),
+    {NULL}
+};
+
+/* post_config hook: */
+static int lbmethod_bylatency_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptemp, server_rec *s)
+{
+
+    /* lbmethod_bylatency_post_config() will be called twice during startup.  So, don't
+     * set up the static data the 1st time through. */
+    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    ap_proxy_balancer_get_best_worker_fn =
+                 APR_RETRIEVE_OPTIONAL_FN(proxy_balancer_get_best_worker);
+    if (!ap_proxy_balancer_get_best_worker_fn) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10524)
+                     "mod_proxy must be loaded for mod_lbmethod_bylatency");
+        return !OK;
+    }
+
+    return OK;
+}
+
+static void register_hook(apr_pool_t *p)
+{
+    ap_register_provider(p, PROXY_LBMETHOD, "bylatency", "0", &bylatency);
+    ap_register_output_filter(BYLATENCY_FILTER, bylatency_filter, NULL,
+                              AP_FTYPE_RESOURCE);
+    proxy_hook_post_request(bylatency_post_request, NULL, NULL,
+                            APR_HOOK_REALLY_FIRST);
+    ap_hook_post_config(lbmethod_bylatency_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(lbmethod_bylatency) = {
+    STANDARD20_MODULE_STUFF,
+    NULL,                       /* create per-directory config structure */
+    NULL,                       /* merge per-directory config structures */
+    create_bylatency_config,    /* create per-server config structure */
+    merge_bylatency_config,     /* merge per-server config structures */
+    bylatency_cmds,             /* command apr_table_t */
+    register_hook               /* register hooks */
+};
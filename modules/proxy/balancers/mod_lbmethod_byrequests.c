@@ -15,6 +15,7 @@
  */
 
 #include "mod_proxy.h"
+#include "proxy_util.h"
 #include "scoreboard.h"
 #include "ap_mpm.h"
 #include "apr_version.h"
@@ -25,14 +26,25 @@ module AP_MODULE_DECLARE_DATA lbmethod_byrequests_module;
 static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
                             *ap_proxy_balancer_get_best_worker_fn = NULL;
 
+typedef struct {
+    int total_factor;
+    int best_lbstatus;
+} byrequests_baton;
+
 static int is_best_byrequests(proxy_worker *current, proxy_worker *prev_best, void *baton)
 {
-    int *total_factor = (int *)baton;
+    byrequests_baton *b = baton;
+    int lbfactor = current->s->lbfactor;
+    int lbstatus = ap_proxy_add_lbstatus(current, lbfactor);
+
+    b->total_factor += lbfactor;
 
-    current->s->lbstatus += current->s->lbfactor;
-    *total_factor += current->s->lbfactor;
+    if (!prev_best || (lbstatus > b->best_lbstatus)) {
+        b->best_lbstatus = lbstatus;
+        return TRUE;
+    }
 
-    return (!prev_best || (current->s->lbstatus > prev_best->s->lbstatus));
+    return FALSE;
 }
 
 /*
@@ -79,15 +91,21 @@ static int is_best_byrequests(proxy_worker *current, proxy_worker *prev_best, vo
  *
  *   b a d c d a c d b d ...
  *
+ * The lbstatus of the workers live in shared memory and are updated with
+ * atomic additions only, so no lock is needed: concurrent elections (in
+ * any child) may see each other's distribution partially and pick the
+ * same worker, but every quota distributed is taken back from the elected
+ * worker, so the sum of all lbstatus still does not change and the
+ * schedule converges.
  */
 static proxy_worker *find_best_byrequests(proxy_balancer *balancer,
                                 request_rec *r)
 {
-    int total_factor = 0;
-    proxy_worker *worker = ap_proxy_balancer_get_best_worker_fn(balancer, r, is_best_byrequests, &total_factor);
+    byrequests_baton baton = { 0, 0 };
+    proxy_worker *worker = ap_proxy_balancer_get_best_worker_fn(balancer, r, is_best_byrequests, &baton);
 
     if (worker) {
-        worker->s->lbstatus -= total_factor;
+        ap_proxy_add_lbstatus(worker, -baton.total_factor);
     }
 
     return worker;
@@ -115,6 +133,9 @@ static apr_status_t age(proxy_balancer *balancer, server_rec *s)
  *   1. Create func which determines "best" candidate worker
  *      (eg: find_best_bytraffic, above)
  *   2. Register it as a provider.
+ *   3. If it can run concurrently (eg: only atomic updates of the
+ *      shared worker data), set lockless to elect without the
+ *      balancer mutex.
  */
 static const proxy_balancer_method byrequests =
 {
@@ -123,7 +144,8 @@ static const proxy_balancer_method byrequests =
     NULL,
     &reset,
     &age,
-    NULL
+    NULL,
+    1           /* lockless */
 };
 
 /* post_config hook: */
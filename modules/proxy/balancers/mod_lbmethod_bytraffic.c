@@ -28,8 +28,9 @@ static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
 static int is_best_bytraffic(proxy_worker *current, proxy_worker *prev_best, void *baton)
 {
     apr_off_t *min_traffic = (apr_off_t *)baton;
-    apr_off_t traffic = (current->s->transferred / current->s->lbfactor)
-                        + (current->s->read / current->s->lbfactor);
+    int lbfactor = current->s->lbfactor;
+    apr_off_t traffic = (current->s->transferred / lbfactor)
+                        + (current->s->read / lbfactor);
 
     if (!prev_best || (traffic < *min_traffic)) {
         *min_traffic = traffic;
@@ -56,6 +57,9 @@ static int is_best_bytraffic(proxy_worker *current, proxy_worker *prev_best, voi
  * often as a or b. If, for example, a handled a request that
  * resulted in a large i/o bytecount, then b and c would be
  * chosen more often, to even things out.
+ *
+ * The election only reads the counters in shared memory, so it needs
+ * no lock.
  */
 static proxy_worker *find_best_bytraffic(proxy_balancer *balancer,
                                          request_rec *r)
@@ -91,7 +95,8 @@ static const proxy_balancer_method bytraffic =
     NULL,
     &reset,
     &age,
-    NULL
+    NULL,
+    1           /* lockless */
 };
 
 /* post_config hook: */
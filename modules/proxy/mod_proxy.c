@@ -20,6 +20,7 @@
 #include "apr_strings.h"
 #include "scoreboard.h"
 #include "mod_status.h"
+#include "mod_watchdog.h"
 #include "proxy_util.h"
 
 #if (MODULE_MAGIC_NUMBER_MAJOR > 20020903)
@@ -1606,7 +1607,14 @@ cleanup:
      * in this case r->status might contain the true status and overwriting
      * it with OK or DONE would be wrong.
      */
-    if ((access_status != OK) && (access_status != DONE)) {
+    if (access_status == SUSPENDED) {
+        /*
+         * The response is not known yet, the scheme handler runs
+         * ap_proxy_resume_post_request() once the exchange completes.
+         */
+        ap_proxy_suspend_post_request(worker, balancer, r, conf);
+    }
+    else if ((access_status != OK) && (access_status != DONE)) {
         saved_status = r->status;
         r->status = access_status;
         ap_proxy_post_request(worker, balancer, r, conf);
@@ -1946,6 +1954,17 @@ static void *merge_proxy_dir_config(apr_pool_t *p, void *basev, void *addv)
     new->async_idle_timeout_set = add->async_idle_timeout_set
                                   || base->async_idle_timeout_set;
 
+    if (add->response_buffer_set) {
+        new->response_buffer = add->response_buffer;
+        new->response_buffer_mem = add->response_buffer_mem;
+    }
+    else {
+        new->response_buffer = base->response_buffer;
+        new->response_buffer_mem = base->response_buffer_mem;
+    }
+    new->response_buffer_set = add->response_buffer_set
+                               || base->response_buffer_set;
+
     return new;
 }
 
@@ -2553,6 +2572,30 @@ static const char *
     return NULL;
 }
 
+static const char *
+    set_proxy_response_buffer(cmd_parms *parms, void *dconf,
+                              const char *arg1, const char *arg2)
+{
+    proxy_dir_conf *conf = dconf;
+    apr_off_t limit, mem = PROXY_RESPONSE_BUFFER_MEM;
+    char *end;
+
+    if (!strcasecmp(arg1, "off")) {
+        limit = 0;
+    }
+    else if (apr_strtoff(&limit, arg1, &end, 10) || *end || limit < 0) {
+        return "ProxyResponseBuffer must be Off or a size in bytes";
+    }
+    if (arg2 && (apr_strtoff(&mem, arg2, &end, 10) || *end || mem < 0)) {
+        return "ProxyResponseBuffer memory size must be a size in bytes";
+    }
+
+    conf->response_buffer = limit;
+    conf->response_buffer_mem = (mem < limit) ? mem : limit;
+    conf->response_buffer_set = 1;
+    return NULL;
+}
+
 static const char *
     set_recv_buffer_size(cmd_parms *parms, void *dummy, const char *arg)
 {
@@ -3158,6 +3201,9 @@ static const command_rec proxy_cmds[] =
      "Amount of time to poll before going asynchronous"),
     AP_INIT_TAKE1("ProxyAsyncIdleTimeout", set_proxy_async_idle, NULL, RSRC_CONF|ACCESS_CONF,
      "Timeout for asynchronous inactivity, ProxyTimeout by default"),
+    AP_INIT_TAKE12("ProxyResponseBuffer", set_proxy_response_buffer, NULL, RSRC_CONF|ACCESS_CONF,
+     "Off or maximum size of the response body to read from the backend "
+     "before sending it, and optionally the part of it kept in memory"),
     {NULL}
 };
 
@@ -3208,6 +3254,101 @@ PROXY_DECLARE(const char *) ap_proxy_ssl_val(apr_pool_t *p, server_rec *s,
     return ap_ssl_var_lookup(p, s, c, r, var);
 }
 
+/*
+ * Background refresh of the addresses of the workers with an addressTTL,
+ * in each child when mod_watchdog is loaded, so that requests never wait
+ * for DNS lookups once the workers' addresses are known.
+ */
+#define PROXY_RESOLVER_WATCHDOG_NAME "_proxy_resolver_"
+#define PROXY_RESOLVER_INTERVAL apr_time_from_sec(1)
+
+static void proxy_refresh_addresses(server_rec *s)
+{
+    for (; s; s = s->next) {
+        proxy_server_conf *conf = ap_get_module_config(s->module_config,
+                                                       &proxy_module);
+        proxy_worker *worker = (proxy_worker *)conf->workers->elts;
+        proxy_balancer *balancer = (proxy_balancer *)conf->balancers->elts;
+        int i, n;
+
+        for (i = 0; i < conf->workers->nelts; i++, worker++) {
+            ap_proxy_refresh_worker_address(worker, s);
+        }
+        for (i = 0; i < conf->balancers->nelts; i++, balancer++) {
+            proxy_worker **workers = (proxy_worker **)balancer->workers->elts;
+            for (n = 0; n < balancer->workers->nelts; n++) {
+                ap_proxy_refresh_worker_address(workers[n], s);
+            }
+        }
+    }
+}
+
+static apr_status_t proxy_resolver_callback(int state, void *data,
+                                            apr_pool_t *pool)
+{
+    if (state == AP_WATCHDOG_STATE_RUNNING) {
+        proxy_refresh_addresses(data);
+    }
+    return APR_SUCCESS;
+}
+
+static int proxy_has_address_ttl(server_rec *s)
+{
+    for (; s; s = s->next) {
+        proxy_server_conf *conf = ap_get_module_config(s->module_config,
+                                                       &proxy_module);
+        proxy_worker *worker = (proxy_worker *)conf->workers->elts;
+        proxy_balancer *balancer = (proxy_balancer *)conf->balancers->elts;
+        int i, n;
+
+        for (i = 0; i < conf->workers->nelts; i++, worker++) {
+            if (worker->s->address_ttl > 0) {
+                return 1;
+            }
+        }
+        for (i = 0; i < conf->balancers->nelts; i++, balancer++) {
+            proxy_worker **workers = (proxy_worker **)balancer->workers->elts;
+            for (n = 0; n < balancer->workers->nelts; n++) {
+                if (workers[n]->s->address_ttl > 0) {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void proxy_resolver_init(apr_pool_t *pconf, server_rec *s)
+{
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
+    ap_watchdog_t *watchdog;
+    apr_status_t rv;
+
+    if (!proxy_has_address_ttl(s)) {
+        return;
+    }
+    wd_get_instance = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_get_instance);
+    wd_register_callback = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_register_callback);
+    if (!wd_get_instance || !wd_register_callback) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10536)
+                     "mod_watchdog not loaded, worker addresses will be "
+                     "resolved by requests when their addressTTL expires");
+        return;
+    }
+    rv = wd_get_instance(&watchdog, PROXY_RESOLVER_WATCHDOG_NAME, 0, 0, pconf);
+    if (rv == APR_SUCCESS) {
+        rv = wd_register_callback(watchdog, PROXY_RESOLVER_INTERVAL, s,
+                                  proxy_resolver_callback);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10537)
+                     "failed to register the %s watchdog, worker addresses "
+                     "will be resolved by requests when their addressTTL "
+                     "expires", PROXY_RESOLVER_WATCHDOG_NAME);
+    }
+}
+
 static int proxy_post_config(apr_pool_t *pconf, apr_pool_t *plog,
                              apr_pool_t *ptemp, server_rec *main_s)
 {
@@ -3226,6 +3367,10 @@ static int proxy_post_config(apr_pool_t *pconf, apr_pool_t *plog,
     ap_proxy_strmatch_path = apr_strmatch_precompile(pconf, "path=", 0);
     ap_proxy_strmatch_domain = apr_strmatch_precompile(pconf, "domain=", 0);
 
+    if (ap_state_query(AP_SQ_MAIN_STATE) != AP_SQ_MS_CREATE_PRE_CONFIG) {
+        proxy_resolver_init(pconf, main_s);
+    }
+
     for (; s; s = s->next) {
         int rc, i;
         proxy_server_conf *sconf =
@@ -3290,6 +3435,7 @@ static int proxy_status_hook(request_rec *r, int flags)
                      "<th>Sch</th><th>Host</th><th>Stat</th>"
                      "<th>Route</th><th>Redir</th>"
                      "<th>F</th><th>Set</th><th>Acc</th><th>Busy</th><th>Wr</th><th>Rd</th>"
+                     "<th>Reuse</th>"
                      "</tr>\n", r);
         }
         else {
@@ -3299,6 +3445,7 @@ static int proxy_status_hook(request_rec *r, int flags)
         worker = (proxy_worker **)balancer->workers->elts;
         for (n = 0; n < balancer->workers->nelts; n++) {
             char fbuf[50];
+            apr_size_t uses = (*worker)->s->connects + (*worker)->s->reused;
             if (!(flags & AP_STATUS_SHORT)) {
                 ap_rvputs(r, "<tr>\n<td>", (*worker)->s->scheme, "</td>", NULL);
                 ap_rvputs(r, "<td>", (*worker)->s->hostname_ex, "</td><td>", NULL);
@@ -3314,7 +3461,8 @@ static int proxy_status_hook(request_rec *r, int flags)
                 ap_rputs(apr_strfsize((*worker)->s->transferred, fbuf), r);
                 ap_rputs("</td><td>", r);
                 ap_rputs(apr_strfsize((*worker)->s->read, fbuf), r);
-                ap_rputs("</td>\n", r);
+                ap_rprintf(r, "</td><td>%d%%</td>\n",
+                           uses ? (int)((*worker)->s->reused * 100 / uses) : 0);
 
                 /* TODO: Add the rest of dynamic worker data */
                 ap_rputs("</tr>\n", r);
@@ -3336,6 +3484,15 @@ static int proxy_status_hook(request_rec *r, int flags)
                 ap_rprintf(r, "ProxyBalancer[%d]Worker[%d]Rcvd: %"
                               APR_OFF_T_FMT "K\n",
                            i, n, (*worker)->s->read >> 10);
+                ap_rprintf(r, "ProxyBalancer[%d]Worker[%d]Connects: %"
+                              APR_SIZE_T_FMT "\n",
+                           i, n, (*worker)->s->connects);
+                ap_rprintf(r, "ProxyBalancer[%d]Worker[%d]Reused: %"
+                              APR_SIZE_T_FMT "\n",
+                           i, n, (*worker)->s->reused);
+                ap_rprintf(r, "ProxyBalancer[%d]Worker[%d]Brokered: %"
+                              APR_SIZE_T_FMT "\n",
+                           i, n, (*worker)->s->brokered);
 
                 /* TODO: Add the rest of dynamic worker data */
             }
@@ -3360,6 +3517,7 @@ static int proxy_status_hook(request_rec *r, int flags)
                  "<tr><th>Acc</th><td>Number of uses</td></tr>\n"
                  "<tr><th>Wr</th><td>Number of bytes transferred</td></tr>\n"
                  "<tr><th>Rd</th><td>Number of bytes read</td></tr>\n"
+                 "<tr><th>Reuse</th><td>Ratio of reused backend connections</td></tr>\n"
                  "</table>", r);
     }
 
@@ -3567,6 +3725,12 @@ APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(proxy, PROXY, int, request_status,
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(proxy, PROXY, int, detach_backend,
                                     (request_rec *r, proxy_conn_rec *backend),
                                     (r, backend), OK, DECLINED)
+APR_IMPLEMENT_OPTIONAL_HOOK_RUN_FIRST(proxy, PROXY, int, fetch_connection,
+                                      (proxy_conn_rec *conn, server_rec *s),
+                                      (conn, s), DECLINED)
+APR_IMPLEMENT_OPTIONAL_HOOK_RUN_FIRST(proxy, PROXY, int, park_connection,
+                                      (proxy_conn_rec *conn),
+                                      (conn), DECLINED)
 APR_IMPLEMENT_EXTERNAL_HOOK_RUN_ALL(proxy, PROXY, int, tunnel_forward,
                                     (proxy_tunnel_rec *tunnel,
                                      conn_rec *c_i, conn_rec *c_o,
@@ -258,6 +258,13 @@ typedef struct {
     apr_interval_time_t async_idle_timeout;
     unsigned int async_delay_set:1;
     unsigned int async_idle_timeout_set:1;
+
+    /** ProxyResponseBuffer: buffer the response body up to this size
+     * (0 for no buffering), in memory up to response_buffer_mem and in
+     * a temporary file beyond */
+    apr_off_t response_buffer;
+    apr_off_t response_buffer_mem;
+    unsigned int response_buffer_set:1;
 } proxy_dir_conf;
 
 /* if we interpolate env vars per-request, we'll need a per-request
@@ -397,6 +404,10 @@ PROXY_WORKER_HC_FAIL )
 
 #define PROXY_MAX_PROVIDER_NAME_SIZE     16
 
+/* Default in-memory part of the ProxyResponseBuffer, above which the
+ * response is buffered in a temporary file */
+#define PROXY_RESPONSE_BUFFER_MEM    (64 * 1024)
+
 #define PROXY_STRNCPY(dst, src) ap_proxy_strncpy((dst), (src), (sizeof(dst)))
 
 #define PROXY_COPY_CONF_PARAMS(w, c) \
@@ -496,6 +507,13 @@ typedef struct {
     unsigned int     address_ttl_set:1;
     apr_int32_t      address_ttl;    /* backend address' TTL (seconds) */
     apr_uint32_t     address_expiry; /* backend address' next expiry time */
+    apr_size_t       connects;  /* Number of connections established */
+    apr_size_t       reused;    /* Number of connections reused */
+    apr_size_t       brokered;  /* Number of connections reused from other processes */
+    apr_uint32_t     latency;   /* decaying average of time to first byte (usecs) */
+    apr_time_t       latency_updated; /* time of the last latency sample */
+    apr_uint32_t     ofails;    /* number of consecutive request failures to fail */
+    apr_uint32_t     ocount;    /* current count of consecutive request failures */
 } proxy_worker_shared;
 
 #define ALIGNED_PROXY_WORKER_SHARED_SIZE (APR_ALIGN_DEFAULT(sizeof(proxy_worker_shared)))
@@ -589,6 +607,8 @@ struct proxy_balancer_method {
     apr_status_t (*reset)(proxy_balancer *balancer, server_rec *s);
     apr_status_t (*age)(proxy_balancer *balancer, server_rec *s);
     apr_status_t (*updatelbstatus)(proxy_balancer *balancer, proxy_worker *elected, server_rec *s);
+    int             lockless;   /* finder and updatelbstatus are safe to run
+                                 * concurrently, without the balancer mutex */
 };
 
 #if APR_HAS_THREADS
@@ -674,6 +694,27 @@ PROXY_DECLARE_OPTIONAL_HOOK(proxy, PROXY, int, fixups, (request_rec *r))
 PROXY_DECLARE_OPTIONAL_HOOK(proxy, PROXY, int, detach_backend,
                             (request_rec *r, proxy_conn_rec *backend))
 
+/**
+ * Let modules provide an idle connection to the backend, established by
+ * another process, before a new one is connected.
+ * @param conn The proxy representation of the backend connection
+ * @param s The current server
+ * @return OK if conn->sock was set to a connected socket, DECLINED otherwise
+ */
+PROXY_DECLARE_OPTIONAL_HOOK(proxy, PROXY, int, fetch_connection,
+                            (proxy_conn_rec *conn, server_rec *s))
+
+/**
+ * Let modules take over an idle connection to the backend when the local
+ * connection pool can't keep it anymore (expired from the pool, or child
+ * exit), so that other processes can reuse it.
+ * @param conn The proxy representation of the backend connection
+ * @return OK if the module kept (a duplicate of) the socket, which is then
+ *         closed locally, DECLINED otherwise
+ */
+PROXY_DECLARE_OPTIONAL_HOOK(proxy, PROXY, int, park_connection,
+                            (proxy_conn_rec *conn))
+
 /**
  * pre request hook.
  * It will return the most suitable worker at the moment
@@ -1060,6 +1101,29 @@ PROXY_DECLARE(int) ap_proxy_post_request(proxy_worker *worker,
                                          request_rec *r,
                                          proxy_server_conf *conf);
 
+/**
+ * Defer the post_request of a request whose scheme handler returned
+ * SUSPENDED, until its response is known
+ * @param worker   worker used for processing request
+ * @param balancer balancer used for processing request
+ * @param r        current request
+ * @param conf     current proxy server configuration
+ */
+PROXY_DECLARE(void) ap_proxy_suspend_post_request(proxy_worker *worker,
+                                                  proxy_balancer *balancer,
+                                                  request_rec *r,
+                                                  proxy_server_conf *conf);
+
+/**
+ * Run the post_request deferred by ap_proxy_suspend_post_request(), once
+ * the suspended exchange with the backend completed
+ * @param r        current request
+ * @param status   OK or DONE if the response was relayed, HTTP_XXX error
+ * @return         OK or  HTTP_XXX error
+ * @note This is a noop if the post_request was not deferred or already run.
+ */
+PROXY_DECLARE(int) ap_proxy_resume_post_request(request_rec *r, int status);
+
 /* Bitmask for ap_proxy_determine_address() */
 #define PROXY_DETERMINE_ADDRESS_CHECK   (1u << 0)
 /**
@@ -1083,6 +1147,18 @@ PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_functio
                                                        request_rec *r,
                                                        server_rec *s);
 
+/**
+ * Resolve the worker's address again if it is about to expire, replacing
+ * it only if it changed. Meant to be called periodically (by a watchdog),
+ * requests then keep using the expired address until it is refreshed.
+ * @param worker   worker whose address to refresh
+ * @param s        current server
+ * @return         APR_SUCCESS, APR_ENOTIMPL if the worker's address is not
+ *                 reusable or has no TTL, or the resolution error
+ */
+PROXY_DECLARE(apr_status_t) ap_proxy_refresh_worker_address(proxy_worker *worker,
+                                                           server_rec *s);
+
 /**
  * Determine backend hostname and port
  * @param p       memory pool used for processing
@@ -1390,6 +1466,33 @@ PROXY_DECLARE(int) ap_proxy_read_input(request_rec *r,
                                        apr_bucket_brigade *input_brigade,
                                        apr_off_t max_read);
 
+/**
+ * Tell whether the client request body can be spliced (zero-copy) to the
+ * backend, that is when no input filter needs to see it and neither side
+ * uses SSL, and no 100 Continue is still due to the client (the body must
+ * be read through the filters until then). Only supported on Linux.
+ * @param r             client request
+ * @param backend       backend connection
+ * @return              non-zero if ap_proxy_splice_input() may be used
+ */
+PROXY_DECLARE(int) ap_proxy_can_splice_input(request_rec *r,
+                                             proxy_conn_rec *backend);
+
+/**
+ * Splice the remaining bytes of the client request body from the client
+ * socket to the backend socket, without reading them in userspace. Any
+ * data pending for the backend is flushed first. Subsequent reads of the
+ * request body return EOS.
+ * @param r             client request
+ * @param backend       backend connection
+ * @param remaining     number of body bytes still to be read from the client
+ * @return              OK, DECLINED if splicing is not possible (now), or
+ *                      HTTP_* error code
+ */
+PROXY_DECLARE(int) ap_proxy_splice_input(request_rec *r,
+                                         proxy_conn_rec *backend,
+                                         apr_off_t remaining);
+
 /**
  * @param bucket_alloc  bucket allocator
  * @param r             request
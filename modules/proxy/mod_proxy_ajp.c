@@ -175,6 +175,43 @@ static apr_off_t get_content_length(request_rec * r)
  * http://issues.apache.org/bugzilla/show_bug.cgi?id=37100
  */
 
+/*
+ * The AJP messages of a backend connection, allocated from its pool and
+ * reused by the requests on this connection.
+ */
+typedef struct {
+    ajp_msg_t *header;      /* the forward request */
+    ajp_msg_t *data;        /* the request body chunks */
+    ajp_msg_t *response;    /* the messages from the backend */
+    apr_size_t size;        /* the size of their buffers */
+} ajp_conn_msgs_t;
+
+static ajp_conn_msgs_t *get_conn_msgs(proxy_conn_rec *conn,
+                                      apr_size_t maxsize)
+{
+    ajp_conn_msgs_t *msgs = conn->data;
+
+    /* The buffers only grow (up to AJP_MAX_BUFFER_SZ), for the largest
+     * ProxyIOBufferSize of the requests using this connection.
+     */
+    if (!msgs || msgs->size < maxsize) {
+        msgs = apr_pcalloc(conn->pool, sizeof(*msgs));
+        if (ajp_msg_create(conn->pool, maxsize, &msgs->header) != APR_SUCCESS
+            || ajp_msg_create(conn->pool, maxsize, &msgs->data) != APR_SUCCESS
+            || ajp_msg_create(conn->pool, maxsize,
+                              &msgs->response) != APR_SUCCESS) {
+            return NULL;
+        }
+        msgs->size = maxsize;
+        conn->data = msgs;
+    }
+    msgs->header->max_size = maxsize;
+    msgs->data->max_size = maxsize;
+    msgs->response->max_size = maxsize;
+
+    return msgs;
+}
+
 /*
  * process the request and write the response.
  */
@@ -190,7 +227,9 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
     apr_bucket *e;
     apr_bucket_brigade *input_brigade;
     apr_bucket_brigade *output_brigade;
+    ajp_conn_msgs_t *msgs;
     ajp_msg_t *msg;
+    ajp_msg_t *send_msgs[AJP_ILINK_MAX_MSGS];
     apr_size_t bufsiz = 0;
     char *buff;
     char *send_body_chunk_buff;
@@ -231,8 +270,16 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
      * Send the AJP request to the remote server
      */
 
-    /* send request headers */
-    status = ajp_send_header(conn->sock, r, maxsize, uri, secret);
+    msgs = get_conn_msgs(conn, maxsize);
+    if (!msgs) {
+        conn->close = 1;
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00869)
+                      "allocating AJP messages failed");
+        return HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    /* build request headers, sent below with the first block of data */
+    status = ajp_build_header(r, msgs->header, uri, secret);
     if (status != APR_SUCCESS) {
         conn->close = 1;
         ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(00868)
@@ -240,29 +287,13 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
                       conn->addr, conn->hostname, conn->port);
         if (status == AJP_EOVERFLOW)
             return HTTP_BAD_REQUEST;
-        else {
-            /*
-             * This is only non fatal when the method is idempotent. In this
-             * case we can dare to retry it with a different worker if we are
-             * a balancer member.
-             */
-            if (is_idempotent(r) == METHOD_IDEMPOTENT) {
-                return HTTP_SERVICE_UNAVAILABLE;
-            }
-            return HTTP_INTERNAL_SERVER_ERROR;
-        }
+        return HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    /* allocate an AJP message to store the data of the buckets */
+    /* use an AJP message to store the data of the buckets */
+    msg = msgs->data;
     bufsiz = maxsize;
-    status = ajp_alloc_data_msg(r->pool, &buff, &bufsiz, &msg);
-    if (status != APR_SUCCESS) {
-        /* We had a failure: Close connection to backend */
-        conn->close = 1;
-        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00869)
-                      "ajp_alloc_data_msg failed");
-        return HTTP_INTERNAL_SERVER_ERROR;
-    }
+    ajp_init_data_msg(msg, &buff, &bufsiz);
 
     /* read the first block of data */
     input_brigade = apr_brigade_create(p, r->connection->bucket_alloc);
@@ -325,22 +356,7 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00875)
                       "got %" APR_SIZE_T_FMT " bytes of data", bufsiz);
         if (bufsiz > 0) {
-            status = ajp_send_data_msg(conn->sock, msg, bufsiz);
-            ajp_msg_log(r, msg, "First ajp_send_data_msg: ajp_ilink_send packet dump");
-            if (status != APR_SUCCESS) {
-                /* We had a failure: Close connection to backend */
-                conn->close = 1;
-                apr_brigade_destroy(input_brigade);
-                ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(00876)
-                              "send failed to %pI (%s:%hu)",
-                              conn->addr, conn->hostname, conn->port);
-                /*
-                 * It is fatal when we failed to send a (part) of the request
-                 * body.
-                 */
-                return HTTP_INTERNAL_SERVER_ERROR;
-            }
-            conn->worker->s->transferred += bufsiz;
+            ajp_end_data_msg(msg, bufsiz);
             send_body = 1;
         }
         else if (content_length > 0) {
@@ -351,22 +367,46 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
             /*
              * We can only get here if the client closed the connection
              * to us without sending the body.
-             * Now the connection is in the wrong state on the backend.
-             * Sending an empty data msg doesn't help either as it does
-             * not move this connection to the correct state on the backend
-             * for later resusage by the next request again.
-             * Close it to clean things up.
+             * Nothing has been sent to the backend yet, so the connection
+             * is still in the correct state for the next request.
              */
-            conn->close = 1;
             apr_brigade_destroy(input_brigade);
             return HTTP_BAD_REQUEST;
         }
     }
 
+    /* send request headers, along with the first block of data if any */
+    send_msgs[0] = msgs->header;
+    send_msgs[1] = msg;
+    status = ajp_ilink_sendv(conn->sock, send_msgs, send_body ? 2 : 1);
+    ajp_msg_log(r, msgs->header, "ajp_build_header: ajp_ilink_send packet dump");
+    if (send_body) {
+        ajp_msg_log(r, msg, "First ajp_send_data_msg: ajp_ilink_send packet dump");
+    }
+    if (status != APR_SUCCESS) {
+        /* We had a failure: Close connection to backend */
+        conn->close = 1;
+        apr_brigade_destroy(input_brigade);
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, status, r, APLOGNO(00876)
+                      "send failed to %pI (%s:%hu)",
+                      conn->addr, conn->hostname, conn->port);
+        /*
+         * It is fatal when we failed to send a (part) of the request
+         * body. Otherwise this is only non fatal when the method is
+         * idempotent. In this case we can dare to retry it with a
+         * different worker if we are a balancer member.
+         */
+        if (!send_body && is_idempotent(r) == METHOD_IDEMPOTENT) {
+            return HTTP_SERVICE_UNAVAILABLE;
+        }
+        return HTTP_INTERNAL_SERVER_ERROR;
+    }
+    if (send_body) {
+        conn->worker->s->transferred += bufsiz;
+    }
+
     /* read the response */
-    conn->data = NULL;
-    status = ajp_read_header(conn->sock, r, maxsize,
-                             (ajp_msg_t **)&(conn->data));
+    status = ajp_read_header(conn->sock, r, maxsize, &msgs->response);
     if (status != APR_SUCCESS) {
         /* We had a failure: Close connection to backend */
         conn->close = 1;
@@ -397,7 +437,7 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
         return HTTP_INTERNAL_SERVER_ERROR;
     }
     /* parse the response */
-    result = ajp_parse_type(r, conn->data);
+    result = ajp_parse_type(r, msgs->response);
     output_brigade = apr_brigade_create(p, r->connection->bucket_alloc);
 
     /*
@@ -483,7 +523,7 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
                     break;
                 }
                 /* AJP13_SEND_HEADERS: process them */
-                status = ajp_parse_header(r, conf, conn->data);
+                status = ajp_parse_header(r, conf, msgs->response);
                 if (status != APR_SUCCESS) {
                     backend_failed = 1;
                 }
@@ -502,7 +542,7 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
                 break;
             case CMD_AJP13_SEND_BODY_CHUNK:
                 /* AJP13_SEND_BODY_CHUNK: piece of data */
-                status = ajp_parse_data(r, conn->data, &size, &send_body_chunk_buff);
+                status = ajp_parse_data(r, msgs->response, &size, &send_body_chunk_buff);
                 if (status == APR_SUCCESS) {
                     /* If we are overriding the errors, we can't put the content
                      * of the page into the brigade.
@@ -575,7 +615,7 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
                  * the client, especially as the brigade already contains headers.
                  * So do nothing here, and it will be cleaned up below.
                  */
-                status = ajp_parse_reuse(r, conn->data, &conn_reuse);
+                status = ajp_parse_reuse(r, msgs->response, &conn_reuse);
                 if (status != APR_SUCCESS) {
                     backend_failed = 1;
                 }
@@ -624,15 +664,14 @@ static int ap_proxy_ajp_request(apr_pool_t *p, request_rec *r,
             break;
 
         /* read the response */
-        status = ajp_read_header(conn->sock, r, maxsize,
-                                 (ajp_msg_t **)&(conn->data));
+        status = ajp_read_header(conn->sock, r, maxsize, &msgs->response);
         if (status != APR_SUCCESS) {
             backend_failed = 1;
             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, status, r, APLOGNO(00889)
                           "ajp_read_header failed");
             break;
         }
-        result = ajp_parse_type(r, conn->data);
+        result = ajp_parse_type(r, msgs->response);
     }
     apr_brigade_destroy(input_brigade);
 
@@ -367,10 +367,15 @@ static proxy_worker *find_best_worker(proxy_balancer *balancer,
                                       request_rec *r)
 {
     proxy_worker *candidate = NULL;
+    /* Read once, a concurrent sync may change it (to a method which is not
+     * lockless, whose finder must then not run without the lock).
+     */
+    proxy_balancer_method *lbmethod = balancer->lbmethod;
+    int lockless = lbmethod->lockless;
     apr_status_t rv;
 
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
+    if (!lockless && (rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01163)
                       "%s: Lock failed for find_best_worker()",
                       balancer->s->name);
@@ -378,13 +383,13 @@ static proxy_worker *find_best_worker(proxy_balancer *balancer,
     }
 #endif
 
-    candidate = (*balancer->lbmethod->finder)(balancer, r);
+    candidate = (*lbmethod->finder)(balancer, r);
 
     if (candidate)
-        candidate->s->elected++;
+        ap_proxy_increment_elected_count(candidate);
 
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_UNLOCK(balancer)) != APR_SUCCESS) {
+    if (!lockless && (rv = PROXY_THREAD_UNLOCK(balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01164)
                       "%s: Unlock failed for find_best_worker()",
                       balancer->s->name);
@@ -495,6 +500,8 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
     char *route = NULL;
     const char *sticky = NULL;
     apr_status_t rv;
+    proxy_balancer_method *lbmethod;
+    int locked;
 
     *worker = NULL;
     /* Step 1: check if the url is for us
@@ -506,11 +513,15 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
         !(*balancer = ap_proxy_get_balancer(r->pool, conf, *url, 1)))
         return DECLINED;
 
-    /* Step 2: Lock the LoadBalancer
+    /* Step 2: Lock the LoadBalancer, unless its lbmethod does without and
+     * there is no update of the members to sync (balancer-manager).
      * XXX: perhaps we need the process lock here
      */
+    lbmethod = (*balancer)->lbmethod;
+    locked = ((*balancer)->s->wupdated > (*balancer)->wupdated
+              || !lbmethod || !lbmethod->lockless);
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_LOCK(*balancer)) != APR_SUCCESS) {
+    if (locked && (rv = PROXY_THREAD_LOCK(*balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01166)
                       "%s: Lock failed for pre_request", (*balancer)->s->name);
         return DECLINED;
@@ -520,16 +531,22 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
     /* Step 3: force recovery */
     force_recovery(*balancer, r->server);
 
-    /* Step 3.5: Update member list for the balancer */
+    /* Step 3.5: Update member list for the balancer, under the lock only
+     * since it modifies the balancer; the lockless path saw nothing to sync
+     * and will sync on a later request otherwise.
+     */
     /* TODO: Implement as provider! */
-    ap_proxy_sync_balancer(*balancer, r->server, conf);
+    if (locked) {
+        ap_proxy_sync_balancer(*balancer, r->server, conf);
+        lbmethod = (*balancer)->lbmethod;
+    }
 
     /* Step 4: find the session route */
     runtime = find_session_route(*balancer, r, &route, &sticky, url);
     if (runtime) {
-        if ((*balancer)->lbmethod && (*balancer)->lbmethod->updatelbstatus) {
+        if (lbmethod && lbmethod->updatelbstatus) {
             /* Call the LB implementation */
-            (*balancer)->lbmethod->updatelbstatus(*balancer, runtime, r->server);
+            lbmethod->updatelbstatus(*balancer, runtime, r->server);
         }
         else { /* Use the default one */
             int i, total_factor = 0;
@@ -545,14 +562,15 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
                  * not in error state or not disabled.
                  */
                 if (PROXY_WORKER_IS_USABLE(*workers)) {
-                    (*workers)->s->lbstatus += (*workers)->s->lbfactor;
-                    total_factor += (*workers)->s->lbfactor;
+                    int lbfactor = (*workers)->s->lbfactor;
+                    ap_proxy_add_lbstatus(*workers, lbfactor);
+                    total_factor += lbfactor;
                 }
                 workers++;
             }
-            runtime->s->lbstatus -= total_factor;
+            ap_proxy_add_lbstatus(runtime, -total_factor);
         }
-        runtime->s->elected++;
+        ap_proxy_increment_elected_count(runtime);
 
         *worker = runtime;
     }
@@ -577,7 +595,7 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
                           "%s: All workers are in error state for route (%s)",
                           (*balancer)->s->name, route);
 #if APR_HAS_THREADS
-            if ((rv = PROXY_THREAD_UNLOCK(*balancer)) != APR_SUCCESS) {
+            if (locked && (rv = PROXY_THREAD_UNLOCK(*balancer)) != APR_SUCCESS) {
                 ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01168)
                               "%s: Unlock failed for pre_request",
                               (*balancer)->s->name);
@@ -588,7 +606,7 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
     }
 
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_UNLOCK(*balancer)) != APR_SUCCESS) {
+    if (locked && (rv = PROXY_THREAD_UNLOCK(*balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01169)
                       "%s: Unlock failed for pre_request",
                       (*balancer)->s->name);
@@ -667,6 +685,12 @@ static int proxy_balancer_post_request(proxy_worker *worker,
 
     apr_status_t rv;
 
+    /* Nothing to check, don't bother locking */
+    if (apr_is_empty_array(balancer->errstatuses)
+        && !balancer->failontimeout) {
+        goto done;
+    }
+
 #if APR_HAS_THREADS
     if ((rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01173)
@@ -712,6 +736,7 @@ static int proxy_balancer_post_request(proxy_worker *worker,
                       "%s: Unlock failed for post_request", balancer->s->name);
     }
 #endif
+done:
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01176)
                   "proxy_balancer_post_request for (%s)", balancer->s->name);
 
@@ -969,6 +994,17 @@ static int balancer_post_config(apr_pool_t *pconf, apr_pool_t *plog,
             PROXY_STRNCPY(balancer->s->sname, sname); /* We know this will succeed */
 
             balancer->max_workers = balancer->workers->nelts + balancer->growth;
+            /* Room for all the workers up front, the list must not be
+             * reallocated at runtime while lockless lbmethods walk it */
+            if (balancer->workers->nalloc < balancer->max_workers) {
+                apr_array_header_t *arr = balancer->workers;
+                char *elts = apr_pcalloc(arr->pool,
+                                         balancer->max_workers * arr->elt_size);
+
+                memcpy(elts, arr->elts, arr->nelts * arr->elt_size);
+                arr->elts = elts;
+                arr->nalloc = balancer->max_workers;
+            }
             /* Create global mutex */
             rv = ap_global_mutex_create(&(balancer->gmutex), NULL, balancer_mutex_type,
                                         balancer->s->sname, s, pconf, 0);
@@ -1190,6 +1226,15 @@ static int balancer_process_balancer_worker(request_rec *r, proxy_server_conf *c
                 wsel->s->lbset = ival;
              }
         }
+        /* Let the children sync the balancer, for the lbmethods which
+         * depend on its layout (e.g. byhash's table).
+         */
+        if (bsel && (apr_table_get(params, "w_lf")
+                     || apr_table_get(params, "w_ls")
+                     || apr_table_get(params, "w_status_H")
+                     || apr_table_get(params, "w_status_R"))) {
+            bsel->s->wupdated = apr_time_now();
+        }
         if ((val = apr_table_get(params, "w_hi"))) {
             apr_interval_time_t hci;
             if (ap_timeout_parameter_parse(val, &hci, "ms") == APR_SUCCESS) {
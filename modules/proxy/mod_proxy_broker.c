@@ -0,0 +1,826 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mod_proxy_broker: share idle backend connections between the children.
+ *
+ * A broker daemon, forked by the parent like the cgid daemon, holds the idle
+ * backend connections released by any child. When a child needs a new
+ * connection to a backend, it first asks the broker for an idle one. The
+ * sockets are passed over a Unix domain socket with SCM_RIGHTS, hence only
+ * connections with no state in the child (no TLS) can be brokered.
+ */
+
+#include "mod_proxy.h"
+
+#include "apr_portable.h"
+#include "apr_signal.h"
+
+#include "ap_mpm.h"
+#include "ap_listen.h"
+#include "mpm_common.h"
+#include "unixd.h"
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+
+#ifndef CMSG_DATA
+#error This module only works on unix platforms with the correct OS support
+#endif
+
+module AP_MODULE_DECLARE_DATA proxy_broker_module;
+
+#define DEFAULT_BROKER_SOCKET       "proxy-broker"
+#define DEFAULT_BROKER_MAX_IDLE     32
+#define DEFAULT_BROKER_IDLE_TIMEOUT apr_time_from_sec(15)
+#define DEFAULT_BROKER_BACKLOG      511
+/* How long a child waits on the broker before connecting by itself */
+#define BROKER_IO_TIMEOUT           100000 /* 100 milliseconds */
+#define BROKER_MAX_KEY              512
+#define BROKER_STARTUP_ERROR        254
+
+#define BROKER_OP_PARK  'P'
+#define BROKER_OP_FETCH 'F'
+
+typedef struct {
+    char op;
+    apr_uint32_t keylen;
+} broker_req_t;
+
+typedef struct {
+    char *key;
+    int fd;
+    apr_time_t since;
+} broker_idle_t;
+
+typedef struct {
+    int enabled;
+    int max_idle;
+    apr_interval_time_t idle_timeout;
+} broker_conf_t;
+
+/* Global, the broker serves the whole server */
+static broker_conf_t broker_conf = {
+    0, DEFAULT_BROKER_MAX_IDLE, DEFAULT_BROKER_IDLE_TIMEOUT
+};
+
+static pid_t daemon_pid;
+static int daemon_should_exit = 0;
+static server_rec *root_server = NULL;
+static apr_pool_t *root_pool = NULL;
+static apr_pool_t *pbroker = NULL;
+static const char *sockname;
+static struct sockaddr_un *server_addr;
+static apr_socklen_t server_addr_len;
+
+static int broker_start(apr_pool_t *p, server_rec *main_server,
+                        apr_proc_t *procnew);
+
+/* Connections with no state in the child, and protocols which don't keep
+ * any state on the connection between requests.
+ */
+static int broker_eligible(proxy_conn_rec *conn)
+{
+    proxy_worker *worker = conn->worker;
+    const char *scheme = worker->s->scheme;
+
+    if (!broker_conf.enabled
+            || !worker->s->is_address_reusable
+            || worker->s->disablereuse
+            || conn->is_ssl || conn->forward) {
+        return 0;
+    }
+    return (ap_cstr_casecmp(scheme, "http") == 0
+            || ap_cstr_casecmp(scheme, "ws") == 0
+            || ap_cstr_casecmp(scheme, "ajp") == 0
+            || ap_cstr_casecmp(scheme, "fcgi") == 0
+            || ap_cstr_casecmp(scheme, "scgi") == 0
+            || ap_cstr_casecmp(scheme, "uwsgi") == 0);
+}
+
+/*
+ * Child side
+ */
+
+static int broker_connect(void)
+{
+    struct timeval tv;
+    int sd;
+
+    if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    /* Before connect(), which blocks up to SO_SNDTIMEO when the broker's
+     * backlog is full.
+     */
+    tv.tv_sec = 0;
+    tv.tv_usec = BROKER_IO_TIMEOUT;
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (connect(sd, (struct sockaddr *)server_addr, server_addr_len) < 0) {
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+/* Sends a request for key, along with fd if not -1 */
+static apr_status_t broker_send(int sd, char op, const char *key, int fd)
+{
+    struct msghdr msg;
+    struct iovec iov[2];
+    broker_req_t req;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.keylen = strlen(key);
+    if (req.keylen > BROKER_MAX_KEY) {
+        return APR_EINVAL;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = &req;
+    iov[0].iov_len = sizeof(req);
+    iov[1].iov_base = (void *)key;
+    iov[1].iov_len = req.keylen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    if (fd != -1) {
+        struct cmsghdr *cmsg;
+
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    if (sendmsg(sd, &msg, 0) < 0) {
+        return errno;
+    }
+    return APR_SUCCESS;
+}
+
+/* Receives some data in buf, and the passed fd if any (-1 otherwise) */
+static apr_ssize_t broker_recv(int sd, void *buf, apr_size_t len, int *fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    apr_ssize_t n;
+
+    *fd = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        n = recvmsg(sd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return n;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET
+                && cmsg->cmsg_type == SCM_RIGHTS
+                && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return n;
+}
+
+static int broker_park_connection(proxy_conn_rec *conn)
+{
+    apr_os_sock_t fd;
+    apr_status_t rv;
+    int sd;
+
+    if (!broker_eligible(conn)
+            || apr_os_sock_get(&fd, conn->sock) != APR_SUCCESS) {
+        return DECLINED;
+    }
+
+    if ((sd = broker_connect()) < 0) {
+        ap_log_perror(APLOG_MARK, APLOG_TRACE1, errno, conn->pool,
+                      "proxy_broker: can't connect to %s", sockname);
+        return DECLINED;
+    }
+    rv = broker_send(sd, BROKER_OP_PARK,
+                     ap_proxy_worker_get_name(conn->worker), fd);
+    close(sd);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_TRACE1, rv, conn->pool,
+                      "proxy_broker: can't park connection for %s",
+                      ap_proxy_worker_get_name(conn->worker));
+        return DECLINED;
+    }
+
+    ap_log_perror(APLOG_MARK, APLOG_TRACE2, 0, conn->pool,
+                  "proxy_broker: parked connection for %s",
+                  ap_proxy_worker_get_name(conn->worker));
+    return OK;
+}
+
+static int broker_fetch_connection(proxy_conn_rec *conn, server_rec *s)
+{
+    apr_os_sock_info_t info;
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    apr_socket_t *sock = NULL;
+    apr_status_t rv;
+    char found = 0;
+    int sd, fd = -1;
+
+    if (!broker_eligible(conn)) {
+        return DECLINED;
+    }
+
+    if ((sd = broker_connect()) < 0) {
+        ap_log_error(APLOG_MARK, APLOG_TRACE1, errno, s,
+                     "proxy_broker: can't connect to %s", sockname);
+        return DECLINED;
+    }
+    rv = broker_send(sd, BROKER_OP_FETCH,
+                     ap_proxy_worker_get_name(conn->worker), -1);
+    if (rv != APR_SUCCESS || broker_recv(sd, &found, 1, &fd) != 1
+            || found != '1' || fd < 0) {
+        close(sd);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return DECLINED;
+    }
+    close(sd);
+
+    /* The parking process may have connected to another address (family)
+     * than the one conn->addr resolves to here, ask the socket.
+     */
+    peerlen = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &peerlen) < 0) {
+        close(fd);
+        return DECLINED;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.os_sock = &fd;
+    info.remote = (struct sockaddr *)&peer;
+    info.family = peer.ss_family;
+    info.type = SOCK_STREAM;
+    rv = apr_os_sock_make(&sock, &info, conn->scpool);
+    if (rv != APR_SUCCESS) {
+        close(fd);
+        return DECLINED;
+    }
+    if (!ap_proxy_is_socket_connected(sock)) {
+        apr_socket_close(sock);
+        return DECLINED;
+    }
+
+    conn->sock = sock;
+    return OK;
+}
+
+/*
+ * Broker side
+ */
+
+static void daemon_signal_handler(int sig)
+{
+    if (sig == SIGHUP) {
+        ++daemon_should_exit;
+    }
+}
+
+static void broker_idle_remove(apr_array_header_t *idle, int i)
+{
+    broker_idle_t *entries = (broker_idle_t *)idle->elts;
+
+    close(entries[i].fd);
+    free(entries[i].key);
+    memmove(&entries[i], &entries[i + 1],
+            (idle->nelts - i - 1) * sizeof(broker_idle_t));
+    idle->nelts--;
+}
+
+/* Whether an idle connection was closed or got unexpected data */
+static int broker_idle_broken(int fd)
+{
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) != 0;
+}
+
+static void broker_serve(apr_array_header_t *idle, int sd)
+{
+    char buf[sizeof(broker_req_t) + BROKER_MAX_KEY + 1];
+    broker_idle_t *entries;
+    broker_req_t req;
+    apr_size_t len, need;
+    apr_ssize_t n;
+    struct timeval tv;
+    char *key;
+    int fd, i, count;
+
+    /* Don't let a stuck child hold the broker */
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    n = broker_recv(sd, buf, sizeof(buf) - 1, &fd);
+    if (n < (apr_ssize_t)sizeof(req)) {
+        goto done;
+    }
+    memcpy(&req, buf, sizeof(req));
+    if (req.keylen == 0 || req.keylen > BROKER_MAX_KEY) {
+        goto done;
+    }
+    len = n;
+    need = sizeof(req) + req.keylen;
+    while (len < need) {
+        n = read(sd, buf + len, need - len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            goto done;
+        }
+        len += n;
+    }
+    key = buf + sizeof(req);
+    key[req.keylen] = '\0';
+
+    entries = (broker_idle_t *)idle->elts;
+    switch (req.op) {
+    case BROKER_OP_PARK:
+        if (fd < 0) {
+            break;
+        }
+        for (i = 0, count = 0; i < idle->nelts; ++i) {
+            if (strcmp(entries[i].key, key) == 0) {
+                count++;
+            }
+        }
+        if (count < broker_conf.max_idle) {
+            broker_idle_t *e = &APR_ARRAY_PUSH(idle, broker_idle_t);
+            e->key = strdup(key);
+            e->fd = fd;
+            e->since = apr_time_now();
+            fd = -1;
+        }
+        break;
+
+    case BROKER_OP_FETCH: {
+        char found = '0';
+        int passed = -1;
+
+        /* The most recently parked is the most likely alive */
+        for (i = idle->nelts - 1; i >= 0; --i) {
+            if (strcmp(entries[i].key, key) != 0) {
+                continue;
+            }
+            if (broker_idle_broken(entries[i].fd)) {
+                broker_idle_remove(idle, i);
+                entries = (broker_idle_t *)idle->elts;
+                continue;
+            }
+            found = '1';
+            passed = entries[i].fd;
+            break;
+        }
+        if (passed >= 0) {
+            struct msghdr msg;
+            struct iovec iov;
+            struct cmsghdr *cmsg;
+            union {
+                struct cmsghdr align;
+                char buf[CMSG_SPACE(sizeof(int))];
+            } control;
+
+            memset(&msg, 0, sizeof(msg));
+            memset(&control, 0, sizeof(control));
+            iov.iov_base = &found;
+            iov.iov_len = 1;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &passed, sizeof(int));
+            if (sendmsg(sd, &msg, 0) == 1) {
+                /* The child has its own descriptor now */
+                broker_idle_remove(idle, i);
+            }
+        }
+        else {
+            (void)write(sd, &found, 1);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+
+done:
+    if (fd >= 0) {
+        close(fd);
+    }
+    close(sd);
+}
+
+static int broker_server(void *data)
+{
+    server_rec *main_server = data;
+    apr_array_header_t *idle;
+    struct pollfd *pfds = NULL;
+    int npfds = 0;
+    mode_t omask;
+    int sd, rc, i;
+    apr_status_t rv;
+
+    apr_signal(SIGCHLD, SIG_IGN);
+    apr_signal(SIGHUP, daemon_signal_handler);
+    apr_signal(SIGPIPE, SIG_IGN);
+
+    /* Close our copy of the listening sockets */
+    ap_close_listeners();
+
+    if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10511)
+                     "Couldn't create unix domain socket");
+        return errno;
+    }
+
+    omask = umask(0077); /* so that only Apache can use socket */
+    rc = bind(sd, (struct sockaddr *)server_addr, server_addr_len);
+    umask(omask); /* can't fail, so can't clobber errno */
+    if (rc < 0) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10512)
+                     "Couldn't bind unix domain socket %s",
+                     sockname);
+        return errno;
+    }
+
+    /* Not all flavors of unix use the current umask for AF_UNIX perms */
+    rv = apr_file_perms_set(sockname, APR_FPROT_UREAD|APR_FPROT_UWRITE|APR_FPROT_UEXECUTE);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, main_server, APLOGNO(10513)
+                     "Couldn't set permissions on unix domain socket %s",
+                     sockname);
+        return rv;
+    }
+
+    if (listen(sd, DEFAULT_BROKER_BACKLOG) < 0) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10514)
+                     "Couldn't listen on unix domain socket");
+        return errno;
+    }
+
+    if (!geteuid()) {
+        if (chown(sockname, ap_unixd_config.user_id, -1) < 0) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10515)
+                         "Couldn't change owner of unix domain socket %s",
+                         sockname);
+            return errno;
+        }
+    }
+
+    /* if running as root, switch to configured user/group */
+    if ((rc = ap_run_drop_privileges(pbroker, ap_server_conf)) != 0) {
+        return rc;
+    }
+
+    idle = apr_array_make(pbroker, 64, sizeof(broker_idle_t));
+
+    while (!daemon_should_exit) {
+        broker_idle_t *entries = (broker_idle_t *)idle->elts;
+        apr_time_t now;
+        int n = idle->nelts;
+
+        if (npfds < n + 1) {
+            npfds = (n + 1) * 2;
+            pfds = realloc(pfds, npfds * sizeof(struct pollfd));
+            if (!pfds) {
+                return -1;
+            }
+        }
+        pfds[0].fd = sd;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        /* Idle connections becoming readable were closed by the backend */
+        for (i = 0; i < n; ++i) {
+            pfds[i + 1].fd = entries[i].fd;
+            pfds[i + 1].events = POLLIN;
+            pfds[i + 1].revents = 0;
+        }
+
+        rc = poll(pfds, n + 1, 1000);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10516)
+                         "proxy_broker: poll failed");
+            break;
+        }
+
+        now = apr_time_now();
+        for (i = n - 1; i >= 0; --i) {
+            if (pfds[i + 1].revents
+                    || now - entries[i].since > broker_conf.idle_timeout) {
+                broker_idle_remove(idle, i);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int sd2 = accept(sd, NULL, NULL);
+            if (sd2 >= 0) {
+                broker_serve(idle, sd2);
+            }
+            else if (errno != EINTR && errno != EAGAIN
+                     && errno != ECONNABORTED) {
+                ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server,
+                             APLOGNO(10517) "Error accepting on broker socket");
+            }
+        }
+    }
+
+    free(pfds);
+    return -1; /* should be <= 0 to distinguish from startup errors */
+}
+
+#if APR_HAS_OTHER_CHILD
+static void broker_maint(int reason, void *data, apr_wait_t status)
+{
+    apr_proc_t *proc = data;
+    int mpm_state;
+    int stopping;
+
+    switch (reason) {
+        case APR_OC_REASON_DEATH:
+            apr_proc_other_child_unregister(data);
+            /* If apache is not terminating or restarting,
+             * restart the broker daemon
+             */
+            stopping = 1; /* if MPM doesn't support query,
+                           * assume we shouldn't restart daemon
+                           */
+            if (ap_mpm_query(AP_MPMQ_MPM_STATE, &mpm_state) == APR_SUCCESS &&
+                mpm_state != AP_MPMQ_STOPPING) {
+                stopping = 0;
+            }
+            if (!stopping) {
+                if (status == BROKER_STARTUP_ERROR) {
+                    ap_log_error(APLOG_MARK, APLOG_CRIT, 0, ap_server_conf, APLOGNO(10518)
+                                 "proxy broker daemon failed to initialize");
+                }
+                else {
+                    ap_log_error(APLOG_MARK, APLOG_ERR, 0, ap_server_conf, APLOGNO(10519)
+                                 "proxy broker daemon process died, restarting");
+                    broker_start(root_pool, root_server, proc);
+                }
+            }
+            break;
+        case APR_OC_REASON_RESTART:
+            /* don't do anything; server is stopping or restarting */
+            apr_proc_other_child_unregister(data);
+            break;
+        case APR_OC_REASON_LOST:
+            /* Restart the broker daemon process */
+            apr_proc_other_child_unregister(data);
+            broker_start(root_pool, root_server, proc);
+            break;
+        case APR_OC_REASON_UNREGISTER:
+            /* we get here when pconf gets cleaned up */
+            kill(proc->pid, SIGHUP); /* send signal to daemon telling it to die */
+
+            if (unlink(sockname) < 0 && errno != ENOENT) {
+                ap_log_error(APLOG_MARK, APLOG_ERR, errno, ap_server_conf, APLOGNO(10520)
+                             "Couldn't unlink unix domain socket %s",
+                             sockname);
+            }
+            break;
+    }
+}
+#endif
+
+static int broker_start(apr_pool_t *p, server_rec *main_server,
+                        apr_proc_t *procnew)
+{
+    daemon_should_exit = 0; /* clear setting from previous generation */
+    if ((daemon_pid = fork()) < 0) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, errno, main_server, APLOGNO(10521)
+                     "mod_proxy_broker: Couldn't spawn broker daemon process");
+        return DECLINED;
+    }
+    else if (daemon_pid == 0) {
+        if (pbroker == NULL) {
+            apr_pool_create(&pbroker, p);
+            apr_pool_tag(pbroker, "proxy_broker");
+        }
+        exit(broker_server(main_server) > 0 ? BROKER_STARTUP_ERROR : -1);
+    }
+    procnew->pid = daemon_pid;
+    procnew->err = procnew->in = procnew->out = NULL;
+    apr_pool_note_subprocess(p, procnew, APR_KILL_AFTER_TIMEOUT);
+#if APR_HAS_OTHER_CHILD
+    apr_proc_other_child_register(procnew, broker_maint, procnew, NULL, p);
+#endif
+    return OK;
+}
+
+static int broker_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
+                             apr_pool_t *ptemp)
+{
+    sockname = ap_append_pid(pconf, DEFAULT_BROKER_SOCKET, ".");
+    broker_conf.enabled = 0;
+    broker_conf.max_idle = DEFAULT_BROKER_MAX_IDLE;
+    broker_conf.idle_timeout = DEFAULT_BROKER_IDLE_TIMEOUT;
+    return OK;
+}
+
+static int broker_post_config(apr_pool_t *p, apr_pool_t *plog,
+                              apr_pool_t *ptemp, server_rec *main_server)
+{
+    apr_proc_t *procnew = NULL;
+    const char *userdata_key = "proxy_broker_init";
+    void *data;
+
+    root_server = main_server;
+    root_pool = p;
+
+    apr_pool_userdata_get(&data, userdata_key, main_server->process->pool);
+    if (!data) {
+        procnew = apr_pcalloc(main_server->process->pool, sizeof(*procnew));
+        procnew->pid = -1;
+        procnew->err = procnew->in = procnew->out = NULL;
+        apr_pool_userdata_set((const void *)procnew, userdata_key,
+                     apr_pool_cleanup_null, main_server->process->pool);
+        return OK;
+    }
+    procnew = data;
+
+    if (!broker_conf.enabled
+            || ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    {
+        char *tmp_sockname = ap_runtime_dir_relative(p, sockname);
+        if (!tmp_sockname) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, main_server, APLOGNO(10522)
+                         "Invalid socket path %s", sockname);
+            return DECLINED;
+        }
+        if (strlen(tmp_sockname) > sizeof(server_addr->sun_path) - 1) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, main_server, APLOGNO(10523)
+                         "The length of the ProxyBrokerSocket path exceeds "
+                         "the maximum of %" APR_SIZE_T_FMT,
+                         sizeof(server_addr->sun_path) - 1);
+            return DECLINED;
+        }
+        sockname = tmp_sockname;
+    }
+
+    server_addr_len = APR_OFFSETOF(struct sockaddr_un, sun_path) + strlen(sockname);
+    server_addr = (struct sockaddr_un *)apr_palloc(p, server_addr_len + 1);
+    server_addr->sun_family = AF_UNIX;
+    strcpy(server_addr->sun_path, sockname);
+
+    return broker_start(p, main_server, procnew);
+}
+
+static const char *set_broker(cmd_parms *cmd, void *dummy, int flag)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+    broker_conf.enabled = flag;
+    return NULL;
+}
+
+static const char *set_broker_socket(cmd_parms *cmd, void *dummy,
+                                     const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    /* Make sure the pid is appended to the sockname */
+    sockname = ap_append_pid(cmd->pool, arg, ".");
+    sockname = ap_runtime_dir_relative(cmd->pool, sockname);
+    if (!sockname) {
+        return apr_pstrcat(cmd->pool, "Invalid ProxyBrokerSocket path ",
+                           arg, NULL);
+    }
+    return NULL;
+}
+
+static const char *set_broker_max_idle(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+    broker_conf.max_idle = atoi(arg);
+    if (broker_conf.max_idle < 1) {
+        return "ProxyBrokerMaxIdle must be a positive number";
+    }
+    return NULL;
+}
+
+static const char *set_broker_idle_timeout(cmd_parms *cmd, void *dummy,
+                                           const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+    if (ap_timeout_parameter_parse(arg, &broker_conf.idle_timeout, "s")
+            != APR_SUCCESS || broker_conf.idle_timeout <= 0) {
+        return "ProxyBrokerIdleTimeout has wrong format";
+    }
+    return NULL;
+}
+
+static const command_rec broker_cmds[] =
+{
+    AP_INIT_FLAG("ProxyBroker", set_broker, NULL, RSRC_CONF,
+                 "On to share idle backend connections between the children"),
+    AP_INIT_TAKE1("ProxyBrokerSocket", set_broker_socket, NULL, RSRC_CONF,
+                  "the name of the socket to use for communication with "
+                  "the proxy broker daemon."),
+    AP_INIT_TAKE1("ProxyBrokerMaxIdle", set_broker_max_idle, NULL, RSRC_CONF,
+                  "Maximum number of idle connections kept per worker"),
+    AP_INIT_TAKE1("ProxyBrokerIdleTimeout", set_broker_idle_timeout, NULL,
+                  RSRC_CONF,
+                  "Time after which idle connections are closed"),
+    {NULL}
+};
+
+static void register_hooks(apr_pool_t *p)
+{
+    ap_hook_pre_config(broker_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(broker_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(proxy, fetch_connection, broker_fetch_connection,
+                      NULL, NULL, APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(proxy, park_connection, broker_park_connection,
+                      NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(proxy_broker) = {
+    STANDARD20_MODULE_STUFF,
+    NULL,                       /* create per-directory config structure */
+    NULL,                       /* merge per-directory config structures */
+    NULL,                       /* create per-server config structure */
+    NULL,                       /* merge per-server config structures */
+    broker_cmds,                /* command apr_table_t */
+    register_hooks              /* register hooks */
+};
@@ -19,6 +19,10 @@
 #include "util_script.h"
 #include "ap_expr.h"
 
+#include "apr_hash.h"
+#include "apr_thread_cond.h"
+#include "apr_thread_mutex.h"
+
 module AP_MODULE_DECLARE_DATA proxy_fcgi_module;
 
 typedef struct {
@@ -47,8 +51,82 @@ typedef enum {
 typedef struct {
     fcgi_backend_t backend_type;
     apr_array_header_t *env_fixups;
+    int multiplex;
 } fcgi_dirconf_t;
 
+typedef struct fcgi_mux_req fcgi_mux_req;
+
+#if APR_HAS_THREADS
+/* The most requests multiplexed on a backend connection, whatever the
+ * backend's FCGI_MAX_REQS, and the most data read for a request and not
+ * consumed yet before the other requests stop reading the connection.
+ */
+#define FCGI_MUX_MAX_REQS   256
+#define FCGI_MUX_MAX_QUEUED (256 * 1024)
+
+/* How long the backend has to answer FCGI_GET_VALUES */
+#define FCGI_MUX_PROBE_TIMEOUT apr_time_from_sec(1)
+
+typedef struct fcgi_mux_pool fcgi_mux_pool;
+typedef struct fcgi_mux fcgi_mux;
+typedef struct fcgi_mux_rec fcgi_mux_rec;
+
+/* A record read for a request, as received (header, content, padding) */
+struct fcgi_mux_rec {
+    fcgi_mux_rec *next;
+    apr_size_t len;
+    apr_size_t off;            /* consumed so far */
+    char data[1];
+};
+
+/* A request attached to a multiplexed connection */
+struct fcgi_mux_req {
+    fcgi_mux_req *next;
+    fcgi_mux *mx;
+    apr_uint16_t id;
+    fcgi_mux_rec *first, *last; /* records read for the request */
+    apr_size_t queued;
+    unsigned int ended:1;       /* FCGI_END_REQUEST read */
+    unsigned int full:1;        /* FCGI_MUX_MAX_QUEUED reached */
+};
+
+/* A backend connection shared by the concurrent requests of the child to
+ * the same worker, held out of the worker's connection pool while used.
+ * The requests take turns reading the records for all of them.
+ */
+struct fcgi_mux {
+    fcgi_mux *next;
+    fcgi_mux_pool *mp;
+    proxy_conn_rec *conn;
+    apr_thread_mutex_t *wmutex; /* serializes the writes of records */
+    fcgi_mux_req *reqs;
+    int users;                  /* requests attached */
+    int orphans;                /* aborted requests not ended yet */
+    int full;                   /* requests with FCGI_MUX_MAX_QUEUED */
+    apr_uint16_t next_id;
+    apr_status_t status;        /* the connection failed */
+    unsigned int reading:1;     /* a request is reading the connection */
+    unsigned int closing:1;     /* no new requests */
+    unsigned char ids[65536 / 8]; /* request ids in use */
+};
+
+/* The multiplexed connections of a worker, their state is protected by
+ * the mutex.
+ */
+struct fcgi_mux_pool {
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    fcgi_mux *muxes;
+    fcgi_mux *spares;           /* unused entries */
+    int max_reqs;               /* per connection, 0 if not known yet,
+                                 * -1 while asking the backend */
+};
+
+static apr_pool_t *muxes_pool;
+static apr_thread_mutex_t *muxes_mutex;
+static apr_hash_t *muxes;
+#endif
+
 /*
  * Canonicalise http-like URLs.
  * scheme is the scheme for the URL
@@ -270,13 +348,28 @@ static apr_status_t send_data(proxy_conn_rec *conn,
     return rv;
 }
 
-/* Wrapper for apr_socket_recv that handles updating the worker stats. */
+#if APR_HAS_THREADS
+static apr_status_t mux_recv(fcgi_mux_req *mreq, char *buffer,
+                             apr_size_t *buflen);
+#endif
+
+/* Wrapper for apr_socket_recv that handles updating the worker stats.
+ * For a multiplexed request (mreq), this reads the records of the request
+ * only, as demultiplexed. */
 static apr_status_t get_data(proxy_conn_rec *conn,
+                             fcgi_mux_req *mreq,
                              char *buffer,
                              apr_size_t *buflen)
 {
-    apr_status_t rv = apr_socket_recv(conn->sock, buffer, buflen);
+    apr_status_t rv;
 
+#if APR_HAS_THREADS
+    if (mreq) {
+        return mux_recv(mreq, buffer, buflen);
+    }
+#endif
+
+    rv = apr_socket_recv(conn->sock, buffer, buflen);
     if (rv == APR_SUCCESS) {
         conn->worker->s->read += *buflen;
     }
@@ -285,6 +378,7 @@ static apr_status_t get_data(proxy_conn_rec *conn,
 }
 
 static apr_status_t get_data_full(proxy_conn_rec *conn,
+                                  fcgi_mux_req *mreq,
                                   char *buffer,
                                   apr_size_t buflen)
 {
@@ -294,7 +388,7 @@ static apr_status_t get_data_full(proxy_conn_rec *conn,
 
     do {
         readlen = buflen - cumulative_len;
-        rv = get_data(conn, buffer + cumulative_len, &readlen);
+        rv = get_data(conn, mreq, buffer + cumulative_len, &readlen);
         if (rv != APR_SUCCESS) {
             return rv;
         }
@@ -304,10 +398,14 @@ static apr_status_t get_data_full(proxy_conn_rec *conn,
     return APR_SUCCESS;
 }
 
+/* Send the FCGI_BEGIN_REQUEST record and the FCGI_PARAMS ones, as encoded
+ * by build_environment(), at once. */
 static apr_status_t send_begin_request(proxy_conn_rec *conn,
-                                       apr_uint16_t request_id)
+                                       apr_uint16_t request_id,
+                                       const char *params,
+                                       apr_size_t params_len)
 {
-    struct iovec vec[2];
+    struct iovec vec[3];
     ap_fcgi_header header;
     unsigned char farray[AP_FCGI_HEADER_LEN];
     ap_fcgi_begin_request_body brb;
@@ -328,23 +426,56 @@ static apr_status_t send_begin_request(proxy_conn_rec *conn,
     vec[0].iov_len = sizeof(farray);
     vec[1].iov_base = (void *)abrb;
     vec[1].iov_len = sizeof(abrb);
+    vec[2].iov_base = (void *)params;
+    vec[2].iov_len = params_len;
 
-    return send_data(conn, vec, 2, &len);
+    return send_data(conn, vec, 3, &len);
 }
 
-static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
-                                     apr_pool_t *temp_pool,
-                                     apr_uint16_t request_id)
+/* Our limit per FCGI_PARAMS record, which could have been up to
+ * AP_FCGI_MAX_CONTENT_LEN */
+#define FCGI_PARAMS_MAX_LEN (16 * 1024)
+
+/* Size of the encoded length of a name or a value in name-value pairs */
+#define FCGI_NV_LEN_SIZE(len) ((len) >> 7 == 0 ? 1 : 4)
+
+static char *put_nv_len(char *itr, apr_size_t len)
+{
+    if (len >> 7 == 0) {
+        *itr++ = (char)len;
+    }
+    else {
+        *itr++ = (char)(0x80 | ((len >> 24) & 0x7f));
+        *itr++ = (char)((len >> 16) & 0xff);
+        *itr++ = (char)((len >> 8) & 0xff);
+        *itr++ = (char)(len & 0xff);
+    }
+    return itr;
+}
+
+static void put_params_header(char *rec, apr_uint16_t request_id,
+                              apr_size_t len)
+{
+    ap_fcgi_header header;
+
+    ap_fcgi_fill_in_header(&header, AP_FCGI_PARAMS, request_id,
+                           (apr_uint16_t)len, 0);
+    ap_fcgi_header_to_array(&header, (unsigned char *)rec);
+}
+
+/* Build the environment of the request and encode it in as many FCGI_PARAMS
+ * records as it takes, followed by the empty one, all in the same buffer. */
+static apr_status_t build_environment(request_rec *r, apr_pool_t *temp_pool,
+                                      apr_uint16_t request_id,
+                                      const char **params,
+                                      apr_size_t *params_len)
 {
     const apr_array_header_t *envarr;
     const apr_table_entry_t *elts;
-    struct iovec vec[2];
-    ap_fcgi_header header;
-    unsigned char farray[AP_FCGI_HEADER_LEN];
-    char *body;
+    apr_size_t *lens, size, reclen;
+    char *buf, *itr, *rec;
     apr_status_t rv;
-    apr_size_t avail_len, len, required_len;
-    int next_elem, starting_elem;
+    int i;
     fcgi_req_config_t *rconf = ap_get_module_config(r->request_config, &proxy_fcgi_module);
     fcgi_dirconf_t *dconf = ap_get_module_config(r->per_dir_config, &proxy_fcgi_module);
 
@@ -405,8 +536,6 @@ static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
     elts = (const apr_table_entry_t *) envarr->elts;
 
     if (APLOGrtrace8(r)) {
-        int i;
-
         for (i = 0; i < envarr->nelts; ++i) {
             ap_log_rerror(APLOG_MARK, APLOG_TRACE8, 0, r, APLOGNO(01062)
                           "sending env var '%s' value '%s'",
@@ -414,60 +543,184 @@ static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
         }
     }
 
-    /* Send envvars over in as many FastCGI records as it takes, */
-    next_elem = 0; /* starting with the first one */
-
-    avail_len = 16 * 1024; /* our limit per record, which could have been up
-                            * to AP_FCGI_MAX_CONTENT_LEN
-                            */
+    /* Measure each envvar once, and the records that will hold them whole
+     * (an envvar is never split across records), to size the buffer. */
+    lens = apr_palloc(temp_pool, (envarr->nelts * 2 + 1) * sizeof(*lens));
+    size = AP_FCGI_HEADER_LEN; /* the empty record */
+    reclen = 0;
+    for (i = 0; i < envarr->nelts; ++i) {
+        apr_size_t keylen, vallen, pairlen;
+
+        lens[2 * i] = 0;
+        if (!elts[i].key) {
+            continue;
+        }
+        keylen = strlen(elts[i].key);
+        vallen = elts[i].val ? strlen(elts[i].val) : 0;
+        pairlen = FCGI_NV_LEN_SIZE(keylen) + keylen
+                  + FCGI_NV_LEN_SIZE(vallen) + vallen;
+        if (pairlen > FCGI_PARAMS_MAX_LEN) {
+            ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                          APLOGNO(02536) "couldn't encode envvar '%s' in %"
+                          APR_SIZE_T_FMT " bytes",
+                          elts[i].key, (apr_size_t)FCGI_PARAMS_MAX_LEN);
+            /* skip this envvar and continue */
+            continue;
+        }
+        if (!reclen || reclen + pairlen > FCGI_PARAMS_MAX_LEN) {
+            size += AP_FCGI_HEADER_LEN;
+            reclen = 0;
+        }
+        reclen += pairlen;
+        size += pairlen;
+        lens[2 * i] = keylen + 1; /* 0 for skipped */
+        lens[2 * i + 1] = vallen;
+    }
 
-    while (next_elem < envarr->nelts) {
-        starting_elem = next_elem;
-        required_len = ap_fcgi_encoded_env_len(r->subprocess_env,
-                                               avail_len,
-                                               &next_elem);
+    /* Then encode them, splitting records the same way */
+    buf = itr = apr_palloc(temp_pool, size);
+    rec = NULL;
+    reclen = 0;
+    for (i = 0; i < envarr->nelts; ++i) {
+        apr_size_t keylen, vallen, pairlen;
 
-        if (!required_len) {
-            if (next_elem < envarr->nelts) {
-                ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
-                              APLOGNO(02536) "couldn't encode envvar '%s' in %"
-                              APR_SIZE_T_FMT " bytes",
-                              elts[next_elem].key, avail_len);
-                /* skip this envvar and continue */
-                ++next_elem;
-                continue;
+        if (!lens[2 * i]) {
+            continue;
+        }
+        keylen = lens[2 * i] - 1;
+        vallen = lens[2 * i + 1];
+        pairlen = FCGI_NV_LEN_SIZE(keylen) + keylen
+                  + FCGI_NV_LEN_SIZE(vallen) + vallen;
+        if (!rec || reclen + pairlen > FCGI_PARAMS_MAX_LEN) {
+            if (rec) {
+                put_params_header(rec, request_id, reclen);
             }
-            /* only an unused element at the end of the array */
-            break;
+            rec = itr;
+            itr += AP_FCGI_HEADER_LEN;
+            reclen = 0;
+        }
+        itr = put_nv_len(itr, keylen);
+        itr = put_nv_len(itr, vallen);
+        memcpy(itr, elts[i].key, keylen);
+        itr += keylen;
+        if (vallen) {
+            memcpy(itr, elts[i].val, vallen);
+            itr += vallen;
         }
+        reclen += pairlen;
+    }
+    if (rec) {
+        put_params_header(rec, request_id, reclen);
+    }
 
-        body = apr_palloc(temp_pool, required_len);
-        rv = ap_fcgi_encode_env(r, r->subprocess_env, body, required_len,
-                                &starting_elem);
-        /* we pre-compute, so we can't run out of space */
-        ap_assert(rv == APR_SUCCESS);
-        /* compute and encode must be in sync */
-        ap_assert(starting_elem == next_elem);
+    /* Envvars encoded, so say we're done */
+    put_params_header(itr, request_id, 0);
+    itr += AP_FCGI_HEADER_LEN;
 
-        ap_fcgi_fill_in_header(&header, AP_FCGI_PARAMS, request_id,
-                               (apr_uint16_t)required_len, 0);
-        ap_fcgi_header_to_array(&header, farray);
+    /* compute and encode must be in sync */
+    ap_assert((apr_size_t)(itr - buf) == size);
 
-        vec[0].iov_base = (void *)farray;
-        vec[0].iov_len = sizeof(farray);
-        vec[1].iov_base = body;
-        vec[1].iov_len = required_len;
+    *params = buf;
+    *params_len = size;
+    return APR_SUCCESS;
+}
 
-        rv = send_data(conn, vec, 2, &len);
-        apr_pool_clear(temp_pool);
+/* Number of buckets framed per FCGI_STDIN record by send_stdin() */
+#define FCGI_STDIN_MAX_VEC 64
 
-        if (rv) {
-            return rv;
+/* Send the data of bb as FCGI_STDIN records framed over its buckets, with no
+ * copy, followed by the empty record if last. Each record goes in a single
+ * writev, with the empty record when it's the last one. bb is emptied. */
+static apr_status_t send_stdin(proxy_conn_rec *conn, apr_bucket_brigade *bb,
+                               apr_uint16_t request_id, int last)
+{
+    struct iovec vec[FCGI_STDIN_MAX_VEC + 2];
+    ap_fcgi_header header;
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    unsigned char earray[AP_FCGI_HEADER_LEN];
+    apr_status_t rv = APR_SUCCESS;
+    apr_bucket *e;
+    apr_size_t len;
+    int done = 0;
+
+    while (!done) {
+        apr_size_t clen = 0;
+        int nvec = 1;
+
+        e = APR_BRIGADE_FIRST(bb);
+        while (e != APR_BRIGADE_SENTINEL(bb)
+               && nvec <= FCGI_STDIN_MAX_VEC
+               && clen < AP_FCGI_MAX_CONTENT_LEN) {
+            if (!APR_BUCKET_IS_METADATA(e)) {
+                const char *data;
+                apr_size_t n;
+
+                rv = apr_bucket_read(e, &data, &n, APR_BLOCK_READ);
+                if (rv != APR_SUCCESS) {
+                    apr_brigade_cleanup(bb);
+                    return rv;
+                }
+                if (n > AP_FCGI_MAX_CONTENT_LEN - clen) {
+                    n = AP_FCGI_MAX_CONTENT_LEN - clen;
+                    apr_bucket_split(e, n);
+                }
+                if (n) {
+                    vec[nvec].iov_base = (void *)data;
+                    vec[nvec].iov_len = n;
+                    ++nvec;
+                    clen += n;
+                }
+            }
+            e = APR_BUCKET_NEXT(e);
+        }
+        done = (e == APR_BRIGADE_SENTINEL(bb));
+
+        if (clen) {
+            ap_fcgi_fill_in_header(&header, AP_FCGI_STDIN, request_id,
+                                   (apr_uint16_t)clen, 0);
+            ap_fcgi_header_to_array(&header, farray);
+            vec[0].iov_base = (void *)farray;
+            vec[0].iov_len = sizeof(farray);
+        }
+        else {
+            nvec = 0;
+        }
+        if (done && last) {
+            /* signal EOF (empty FCGI_STDIN) */
+            ap_fcgi_fill_in_header(&header, AP_FCGI_STDIN, request_id, 0, 0);
+            ap_fcgi_header_to_array(&header, earray);
+            vec[nvec].iov_base = (void *)earray;
+            vec[nvec].iov_len = sizeof(earray);
+            ++nvec;
+        }
+        if (nvec) {
+            rv = send_data(conn, vec, nvec, &len);
+        }
+
+        /* The data are sent, release the buckets */
+        while (APR_BRIGADE_FIRST(bb) != e) {
+            apr_bucket_delete(APR_BRIGADE_FIRST(bb));
+        }
+        if (rv != APR_SUCCESS) {
+            apr_brigade_cleanup(bb);
+            break;
         }
     }
 
-    /* Envvars sent, so say we're done */
-    ap_fcgi_fill_in_header(&header, AP_FCGI_PARAMS, request_id, 0, 0);
+    return rv;
+}
+
+#if APR_HAS_THREADS
+
+static apr_status_t send_abort_request(proxy_conn_rec *conn,
+                                       apr_uint16_t request_id)
+{
+    struct iovec vec[1];
+    ap_fcgi_header header;
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    apr_size_t len;
+
+    ap_fcgi_fill_in_header(&header, AP_FCGI_ABORT_REQUEST, request_id, 0, 0);
     ap_fcgi_header_to_array(&header, farray);
 
     vec[0].iov_base = (void *)farray;
@@ -476,6 +729,339 @@ static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
     return send_data(conn, vec, 1, &len);
 }
 
+/* Decode the length of a name or a value in name-value pairs */
+static int get_nv_len(const unsigned char **p, const unsigned char *end,
+                      apr_size_t *len)
+{
+    const unsigned char *s = *p;
+
+    if (s < end && !(s[0] & 0x80)) {
+        *len = s[0];
+        *p = s + 1;
+        return 1;
+    }
+    if (end - s >= 4) {
+        *len = ((apr_size_t)(s[0] & 0x7f) << 24) | ((apr_size_t)s[1] << 16)
+               | ((apr_size_t)s[2] << 8) | (apr_size_t)s[3];
+        *p = s + 4;
+        return 1;
+    }
+    return 0;
+}
+
+/* Ask the backend whether it multiplexes requests on a connection, and
+ * how many (FCGI_GET_VALUES). max_reqs is set to 1 if it does not.
+ */
+static apr_status_t get_max_reqs(proxy_conn_rec *conn, request_rec *r,
+                                 int *max_reqs)
+{
+    static const char query[] = "\017\000" AP_FCGI_MPXS_CONNS_STR
+                                "\015\000" AP_FCGI_MAX_REQS_STR;
+    struct iovec vec[2];
+    ap_fcgi_header header;
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    unsigned char version = 0, type = 0, plen;
+    apr_uint16_t rid = 0, clen = 0;
+    const unsigned char *p, *end;
+    unsigned char *buf = NULL;
+    apr_interval_time_t timeout;
+    int mpxs = 0, reqs = 0;
+    apr_size_t len;
+    apr_status_t rv;
+
+    ap_fcgi_fill_in_header(&header, AP_FCGI_GET_VALUES, 0,
+                           sizeof(query) - 1, 0);
+    ap_fcgi_header_to_array(&header, farray);
+
+    vec[0].iov_base = (void *)farray;
+    vec[0].iov_len = sizeof(farray);
+    vec[1].iov_base = (void *)query;
+    vec[1].iov_len = sizeof(query) - 1;
+
+    rv = send_data(conn, vec, 2, &len);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    apr_socket_timeout_get(conn->sock, &timeout);
+    apr_socket_timeout_set(conn->sock, FCGI_MUX_PROBE_TIMEOUT);
+    rv = get_data_full(conn, NULL, (char *)farray, AP_FCGI_HEADER_LEN);
+    if (rv == APR_SUCCESS) {
+        ap_fcgi_header_fields_from_array(&version, &type, &rid,
+                                         &clen, &plen, farray);
+        if (clen + plen) {
+            buf = apr_palloc(r->pool, clen + plen);
+            rv = get_data_full(conn, NULL, (char *)buf, clen + plen);
+        }
+    }
+    apr_socket_timeout_set(conn->sock, timeout);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (version != AP_FCGI_VERSION_1 || rid != 0) {
+        return APR_EINVAL;
+    }
+
+    if (type == AP_FCGI_GET_VALUES_RESULT) {
+        p = buf;
+        end = buf + clen;
+        while (p < end) {
+            apr_size_t nlen, vlen;
+            const char *value;
+
+            if (!get_nv_len(&p, end, &nlen) || !get_nv_len(&p, end, &vlen)
+                    || nlen > (apr_size_t)(end - p)
+                    || vlen > (apr_size_t)(end - p) - nlen) {
+                return APR_EINVAL;
+            }
+            value = apr_pstrmemdup(r->pool, (const char *)p + nlen, vlen);
+            if (nlen == strlen(AP_FCGI_MPXS_CONNS_STR)
+                    && !memcmp(p, AP_FCGI_MPXS_CONNS_STR, nlen)) {
+                mpxs = (atoi(value) > 0);
+            }
+            else if (nlen == strlen(AP_FCGI_MAX_REQS_STR)
+                     && !memcmp(p, AP_FCGI_MAX_REQS_STR, nlen)) {
+                reqs = atoi(value);
+            }
+            p += nlen + vlen;
+        }
+    }
+    else if (type != AP_FCGI_UNKNOWN_TYPE) {
+        return APR_EINVAL;
+    }
+
+    if (!mpxs) {
+        *max_reqs = 1;
+    }
+    else if (reqs <= 0 || reqs > FCGI_MUX_MAX_REQS) {
+        *max_reqs = FCGI_MUX_MAX_REQS;
+    }
+    else {
+        *max_reqs = reqs;
+    }
+    return APR_SUCCESS;
+}
+
+#define MUX_ID_ISSET(mx, id) ((mx)->ids[(id) >> 3] & (1 << ((id) & 7)))
+#define MUX_ID_SET(mx, id)   ((mx)->ids[(id) >> 3] |= (1 << ((id) & 7)))
+#define MUX_ID_CLR(mx, id)   ((mx)->ids[(id) >> 3] &= ~(1 << ((id) & 7)))
+
+/* Read the next record from a multiplexed connection */
+static apr_status_t mux_read_record(fcgi_mux *mx, fcgi_mux_rec **prec,
+                                    unsigned char *type, apr_uint16_t *rid)
+{
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    unsigned char version, plen;
+    apr_uint16_t clen;
+    fcgi_mux_rec *rec;
+    apr_size_t len;
+    apr_status_t rv;
+
+    rv = get_data_full(mx->conn, NULL, (char *)farray, AP_FCGI_HEADER_LEN);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    ap_fcgi_header_fields_from_array(&version, type, rid, &clen, &plen,
+                                     farray);
+    if (version != AP_FCGI_VERSION_1) {
+        return APR_EINVAL;
+    }
+
+    len = AP_FCGI_HEADER_LEN + clen + plen;
+    rec = ap_malloc(sizeof(*rec) + len);
+    memcpy(rec->data, farray, AP_FCGI_HEADER_LEN);
+    if (len > AP_FCGI_HEADER_LEN) {
+        rv = get_data_full(mx->conn, NULL, rec->data + AP_FCGI_HEADER_LEN,
+                           len - AP_FCGI_HEADER_LEN);
+        if (rv != APR_SUCCESS) {
+            free(rec);
+            return rv;
+        }
+    }
+    rec->next = NULL;
+    rec->len = len;
+    rec->off = 0;
+
+    *prec = rec;
+    return APR_SUCCESS;
+}
+
+/* Hand a record read from the connection to its request, under lock */
+static void mux_route(fcgi_mux *mx, fcgi_mux_rec *rec, unsigned char type,
+                      apr_uint16_t rid)
+{
+    fcgi_mux_req *mreq;
+
+    for (mreq = mx->reqs; mreq; mreq = mreq->next) {
+        if (mreq->id == rid && !mreq->ended) {
+            break;
+        }
+    }
+    if (type == AP_FCGI_END_REQUEST && rid && MUX_ID_ISSET(mx, rid)) {
+        MUX_ID_CLR(mx, rid);
+        if (mreq) {
+            mreq->ended = 1;
+        }
+        else {
+            /* an aborted request is done with */
+            --mx->orphans;
+        }
+    }
+    if (!mreq) {
+        /* management record, or late record of an aborted request */
+        free(rec);
+        return;
+    }
+
+    if (mreq->last) {
+        mreq->last->next = rec;
+    }
+    else {
+        mreq->first = rec;
+    }
+    mreq->last = rec;
+    mreq->queued += rec->len;
+    if (!mreq->full && mreq->queued >= FCGI_MUX_MAX_QUEUED) {
+        mreq->full = 1;
+        ++mx->full;
+    }
+}
+
+/* Read the records of a multiplexed request. When no other request
+ * does, read the connection for all of them, until a record comes for
+ * this one.
+ */
+static apr_status_t mux_recv(fcgi_mux_req *mreq, char *buffer,
+                             apr_size_t *buflen)
+{
+    fcgi_mux *mx = mreq->mx;
+    fcgi_mux_pool *mp = mx->mp;
+    apr_interval_time_t timeout;
+    apr_time_t now, deadline;
+    apr_status_t rv = APR_SUCCESS;
+
+    apr_socket_timeout_get(mx->conn->sock, &timeout);
+    deadline = apr_time_now() + timeout;
+
+    apr_thread_mutex_lock(mp->mutex);
+    for (;;) {
+        fcgi_mux_rec *rec = mreq->first;
+
+        if (rec) {
+            apr_size_t len = rec->len - rec->off;
+
+            if (len > *buflen) {
+                len = *buflen;
+            }
+            memcpy(buffer, rec->data + rec->off, len);
+            rec->off += len;
+            mreq->queued -= len;
+            if (rec->off == rec->len) {
+                mreq->first = rec->next;
+                if (!mreq->first) {
+                    mreq->last = NULL;
+                }
+                free(rec);
+            }
+            if (mreq->full && mreq->queued < FCGI_MUX_MAX_QUEUED) {
+                /* the others can read again */
+                mreq->full = 0;
+                --mx->full;
+                apr_thread_cond_broadcast(mp->cond);
+            }
+            *buflen = len;
+            break;
+        }
+        if (mx->status != APR_SUCCESS) {
+            rv = mx->status;
+            break;
+        }
+
+        now = apr_time_now();
+        if (timeout > 0 && now >= deadline) {
+            rv = APR_TIMEUP;
+            break;
+        }
+
+        if (!mx->reading && !mx->full) {
+            apr_pollfd_t pfd;
+            apr_int32_t n = 0;
+            unsigned char type;
+            apr_uint16_t rid;
+
+            mx->reading = 1;
+            apr_thread_mutex_unlock(mp->mutex);
+
+            /* Wait for a record until this request times out, the
+             * connection's timeout applies to the record itself. */
+            memset(&pfd, 0, sizeof(pfd));
+            pfd.desc_type = APR_POLL_SOCKET;
+            pfd.desc.s = mx->conn->sock;
+            pfd.reqevents = APR_POLLIN;
+            pfd.p = mx->conn->pool;
+            do {
+                rv = apr_poll(&pfd, 1, &n, timeout > 0 ? deadline - now : -1);
+            } while (APR_STATUS_IS_EINTR(rv));
+            if (rv == APR_SUCCESS) {
+                rv = mux_read_record(mx, &rec, &type, &rid);
+            }
+
+            apr_thread_mutex_lock(mp->mutex);
+            mx->reading = 0;
+            if (rv == APR_SUCCESS) {
+                mux_route(mx, rec, type, rid);
+            }
+            else if (!APR_STATUS_IS_TIMEUP(rv) || n) {
+                if (mx->status == APR_SUCCESS) {
+                    mx->status = rv;
+                }
+            }
+            apr_thread_cond_broadcast(mp->cond);
+            rv = APR_SUCCESS;
+            continue;
+        }
+
+        if (timeout > 0) {
+            apr_thread_cond_timedwait(mp->cond, mp->mutex, deadline - now);
+        }
+        else {
+            apr_thread_cond_wait(mp->cond, mp->mutex);
+        }
+    }
+    apr_thread_mutex_unlock(mp->mutex);
+
+    return rv;
+}
+
+/* Whether records were read for a multiplexed request and not consumed */
+static int mux_pending(fcgi_mux_req *mreq)
+{
+    fcgi_mux_pool *mp = mreq->mx->mp;
+    int pending;
+
+    apr_thread_mutex_lock(mp->mutex);
+    pending = (mreq->first != NULL);
+    apr_thread_mutex_unlock(mp->mutex);
+
+    return pending;
+}
+
+/* Fail a multiplexed connection, and all its requests */
+static void mux_fail(fcgi_mux *mx, apr_status_t rv)
+{
+    fcgi_mux_pool *mp = mx->mp;
+
+    apr_thread_mutex_lock(mp->mutex);
+    if (mx->status == APR_SUCCESS) {
+        mx->status = rv;
+        /* wake up the reader */
+        apr_socket_shutdown(mx->conn->sock, APR_SHUTDOWN_READWRITE);
+    }
+    apr_thread_cond_broadcast(mp->cond);
+    apr_thread_mutex_unlock(mp->mutex);
+}
+#endif /* APR_HAS_THREADS */
+
 enum {
   HDR_STATE_READING_HEADERS,
   HDR_STATE_GOT_CR,
@@ -544,29 +1130,46 @@ static int handle_headers(request_rec *r, int *state,
     return 0;
 }
 
+/* Whether more of the response is coming soon (flushpackets=auto) */
+static int more_data_pending(proxy_conn_rec *conn, fcgi_mux_req *mreq,
+                             apr_pollfd_t *flushpoll)
+{
+    apr_int32_t n;
+
+#if APR_HAS_THREADS
+    if (mreq) {
+        return mux_pending(mreq);
+    }
+#endif
+    return apr_poll(flushpoll, 1, &n,
+                    conn->worker->s->flush_wait) != APR_TIMEUP;
+}
+
+/* end_status is set to the protocolStatus of the FCGI_END_REQUEST record
+ * if the request ended with all of its stdin sent, -1 otherwise. */
 static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
                              request_rec *r, apr_pool_t *setaside_pool,
                              apr_uint16_t request_id, const char **err,
                              int *bad_request, int *has_responded,
-                             apr_bucket_brigade *input_brigade)
+                             apr_bucket_brigade *input_brigade,
+                             fcgi_mux_req *mreq, int *end_status)
 {
     apr_bucket_brigade *ib, *ob;
     int seen_end_of_headers = 0, done = 0, ignore_body = 0;
+    int stdin_done = (mreq != NULL), protocol_status = -1;
     apr_status_t rv = APR_SUCCESS;
     int script_error_status = HTTP_OK;
     conn_rec *c = r->connection;
-    struct iovec vec[2];
-    ap_fcgi_header header;
     unsigned char farray[AP_FCGI_HEADER_LEN];
     apr_pollfd_t pfd;
     apr_pollfd_t *flushpoll = NULL;
-    apr_int32_t flushpoll_fd;
     int header_state = HDR_STATE_READING_HEADERS;
     char stack_iobuf[AP_IOBUFSIZE];
     apr_size_t iobuf_size = AP_IOBUFSIZE;
     char *iobuf = stack_iobuf;
 
     *err = NULL;
+    *end_status = -1;
     if (conn->worker->s->io_buffer_size_set) {
         iobuf_size = conn->worker->s->io_buffer_size;
         iobuf = apr_palloc(r->pool, iobuf_size);
@@ -575,7 +1178,8 @@ static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
     pfd.desc_type = APR_POLL_SOCKET;
     pfd.desc.s = conn->sock;
     pfd.p = r->pool;
-    pfd.reqevents = APR_POLLIN | APR_POLLOUT;
+    /* A multiplexed request was sent whole already */
+    pfd.reqevents = stdin_done ? APR_POLLIN : APR_POLLIN | APR_POLLOUT;
 
     if (conn->worker->s->flush_packets == flush_auto) {
         flushpoll = apr_pcalloc(r->pool, sizeof(apr_pollfd_t));
@@ -589,26 +1193,29 @@ static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
 
     while (! done) {
         apr_interval_time_t timeout;
-        apr_size_t len;
         int n;
 
-        /* We need SOME kind of timeout here, or virtually anything will
-         * cause timeout errors. */
-        apr_socket_timeout_get(conn->sock, &timeout);
+        if (mreq) {
+            /* Records are demultiplexed by get_data(), which waits */
+            pfd.rtnevents = APR_POLLIN;
+        }
+        else {
+            /* We need SOME kind of timeout here, or virtually anything will
+             * cause timeout errors. */
+            apr_socket_timeout_get(conn->sock, &timeout);
 
-        rv = apr_poll(&pfd, 1, &n, timeout);
-        if (rv != APR_SUCCESS) {
-            if (APR_STATUS_IS_EINTR(rv)) {
-                continue;
+            rv = apr_poll(&pfd, 1, &n, timeout);
+            if (rv != APR_SUCCESS) {
+                if (APR_STATUS_IS_EINTR(rv)) {
+                    continue;
+                }
+                *err = "polling";
+                break;
             }
-            *err = "polling";
-            break;
         }
 
         if (pfd.rtnevents & APR_POLLOUT) {
-            apr_size_t to_send, writebuflen;
             int last_stdin = 0;
-            char *iobuf_cursor;
 
             if (APR_BRIGADE_EMPTY(input_brigade)) {
                 rv = ap_get_brigade(r->input_filters, ib,
@@ -640,68 +1247,16 @@ static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
                 last_stdin = 1;
             }
 
-            writebuflen = iobuf_size;
-
-            rv = apr_brigade_flatten(ib, iobuf, &writebuflen);
-
-            apr_brigade_cleanup(ib);
-
-            if (rv != APR_SUCCESS) {
-                *err = "flattening brigade";
-                break;
-            }
-
-            to_send = writebuflen;
-            iobuf_cursor = iobuf;
-            while (to_send > 0) {
-                int nvec = 0;
-                apr_size_t write_this_time;
-
-                write_this_time =
-                    to_send < AP_FCGI_MAX_CONTENT_LEN ? to_send : AP_FCGI_MAX_CONTENT_LEN;
-
-                ap_fcgi_fill_in_header(&header, AP_FCGI_STDIN, request_id,
-                                       (apr_uint16_t)write_this_time, 0);
-                ap_fcgi_header_to_array(&header, farray);
-
-                vec[nvec].iov_base = (void *)farray;
-                vec[nvec].iov_len = sizeof(farray);
-                ++nvec;
-                if (writebuflen) {
-                    vec[nvec].iov_base = iobuf_cursor;
-                    vec[nvec].iov_len = write_this_time;
-                    ++nvec;
-                }
-
-                rv = send_data(conn, vec, nvec, &len);
-                if (rv != APR_SUCCESS) {
-                    *err = "sending stdin";
-                    break;
-                }
-
-                to_send -= write_this_time;
-                iobuf_cursor += write_this_time;
-            }
+            /* Framed over the buckets, with the end of stdin if last */
+            rv = send_stdin(conn, ib, request_id, last_stdin);
             if (rv != APR_SUCCESS) {
+                *err = "sending stdin";
                 break;
             }
 
             if (last_stdin) {
                 pfd.reqevents = APR_POLLIN; /* Done with input data */
-
-                /* signal EOF (empty FCGI_STDIN) */
-                ap_fcgi_fill_in_header(&header, AP_FCGI_STDIN, request_id,
-                                       0, 0);
-                ap_fcgi_header_to_array(&header, farray);
-
-                vec[0].iov_base = (void *)farray;
-                vec[0].iov_len = sizeof(farray);
-
-                rv = send_data(conn, vec, 1, &len);
-                if (rv != APR_SUCCESS) {
-                    *err = "sending empty stdin";
-                    break;
-                }
+                stdin_done = 1;
             }
         }
 
@@ -714,7 +1269,8 @@ static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
             int mayflush = 0;
 
             /* First, we grab the header... */
-            rv = get_data_full(conn, (char *) farray, AP_FCGI_HEADER_LEN);
+            rv = get_data_full(conn, mreq, (char *) farray,
+                               AP_FCGI_HEADER_LEN);
             if (rv != APR_SUCCESS) {
                 ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01067)
                               "Failed to read FastCGI header");
@@ -753,7 +1309,7 @@ recv_again:
              * recv call, this will eventually change when we move to real
              * nonblocking recv calls. */
             if (readbuflen != 0) {
-                rv = get_data(conn, iobuf, &readbuflen);
+                rv = get_data(conn, mreq, iobuf, &readbuflen);
                 if (rv != APR_SUCCESS) {
                     *err = "reading response body";
                     break;
@@ -919,12 +1475,23 @@ recv_again:
                 break;
 
             case AP_FCGI_END_REQUEST:
+                if (clen == readbuflen
+                        && clen > AP_FCGI_ERB_PROTOCOL_STATUS_OFFSET) {
+                    protocol_status = (unsigned char)
+                        iobuf[AP_FCGI_ERB_PROTOCOL_STATUS_OFFSET];
+                }
                 done = 1;
                 break;
 
             default:
                 ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01072)
                               "Got bogus record %d", type);
+
+                /* Skip it, the next record follows */
+                if (clen > readbuflen) {
+                    clen -= readbuflen;
+                    goto recv_again;
+                }
                 break;
             }
             /* Leave on above switch's inner error. */
@@ -933,7 +1500,7 @@ recv_again:
             }
 
             if (plen) {
-                rv = get_data_full(conn, iobuf, plen);
+                rv = get_data_full(conn, mreq, iobuf, plen);
                 if (rv != APR_SUCCESS) {
                     ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02537)
                                   "Error occurred reading padding");
@@ -943,8 +1510,7 @@ recv_again:
 
             if (mayflush && ((conn->worker->s->flush_packets == flush_on) ||
                              ((conn->worker->s->flush_packets == flush_auto) && 
-                              (apr_poll(flushpoll, 1, &flushpoll_fd,
-                               conn->worker->s->flush_wait) == APR_TIMEUP)))) {
+                              !more_data_pending(conn, mreq, flushpoll)))) {
                 apr_bucket* flush_b = apr_bucket_flush_create(r->connection->bucket_alloc);
                 APR_BRIGADE_INSERT_TAIL(ob, flush_b);
                 rv = ap_pass_brigade(r->output_filters, ob);
@@ -960,6 +1526,10 @@ recv_again:
     apr_brigade_destroy(ib);
     apr_brigade_destroy(ob);
 
+    if (done && stdin_done) {
+        *end_status = protocol_status;
+    }
+
     if (script_error_status != HTTP_OK) {
         ap_die(script_error_status, r); /* send ErrorDocument */
         *has_responded = 1;
@@ -968,6 +1538,40 @@ recv_again:
     return rv;
 }
 
+/*
+ * map a failed dispatch() to the status of the request.
+ */
+static int dispatch_error(request_rec *r, apr_status_t rv, const char *err,
+                          int bad_request, int has_responded,
+                          const char *server_portstr)
+{
+    /* If the client aborted the connection during retrieval or (partially)
+     * sending the response, don't return a HTTP_SERVICE_UNAVAILABLE, since
+     * this is not a backend problem. */
+    if (r->connection->aborted) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, rv, r,
+                      "The client aborted the connection.");
+        return OK;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01075)
+                  "Error dispatching request to %s: %s%s%s",
+                  server_portstr,
+                  err ? "(" : "",
+                  err ? err : "",
+                  err ? ")" : "");
+    if (has_responded) {
+        return AP_FILTER_ERROR;
+    }
+    if (bad_request) {
+        return ap_map_http_request_error(rv, HTTP_BAD_REQUEST);
+    }
+    if (APR_STATUS_IS_TIMEUP(rv)) {
+        return HTTP_GATEWAY_TIME_OUT;
+    }
+    return HTTP_SERVICE_UNAVAILABLE;
+}
+
 /*
  * process the request and write the response.
  */
@@ -980,31 +1584,23 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
                            apr_bucket_brigade *input_brigade)
 {
     /* Request IDs are arbitrary numbers that we assign to a
-     * single request. This would allow multiplex/pipelining of
-     * multiple requests to the same FastCGI connection, but
-     * we don't support that, and always use a value of '1' to
-     * keep things simple. */
+     * single request. A connection of its own carries one request
+     * at a time, so this always uses a value of '1' (multiplexed
+     * requests get theirs from the connection). */
     apr_uint16_t request_id = 1;
     apr_status_t rv;
     apr_pool_t *temp_pool;
-    const char *err;
+    const char *err, *params;
+    apr_size_t params_len;
     int bad_request = 0,
-        has_responded = 0;
-
-    /* Step 1: Send AP_FCGI_BEGIN_REQUEST */
-    rv = send_begin_request(conn, request_id);
-    if (rv != APR_SUCCESS) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01073)
-                      "Failed Writing Request to %s:", server_portstr);
-        conn->close = 1;
-        return HTTP_SERVICE_UNAVAILABLE;
-    }
+        has_responded = 0,
+        end_status;
 
     apr_pool_create(&temp_pool, r->pool);
     apr_pool_tag(temp_pool, "proxy_fcgi_do_request");
 
-    /* Step 2: Send Environment via FCGI_PARAMS */
-    rv = send_environment(conn, r, temp_pool, request_id);
+    /* Step 1: Encode the Environment in FCGI_PARAMS records */
+    rv = build_environment(r, temp_pool, request_id, &params, &params_len);
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01074)
                       "Failed writing Environment to %s:", server_portstr);
@@ -1012,38 +1608,29 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
         return HTTP_SERVICE_UNAVAILABLE;
     }
 
+    /* Step 2: Send AP_FCGI_BEGIN_REQUEST and the Environment at once */
+    rv = send_begin_request(conn, request_id, params, params_len);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01073)
+                      "Failed Writing Request to %s:", server_portstr);
+        conn->close = 1;
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
     /* Step 3: Read records from the back end server and handle them. */
     rv = dispatch(conn, conf, r, temp_pool, request_id,
                   &err, &bad_request, &has_responded,
-                  input_brigade);
+                  input_brigade, NULL, &end_status);
     if (rv != APR_SUCCESS) {
-        /* If the client aborted the connection during retrieval or (partially)
-         * sending the response, don't return a HTTP_SERVICE_UNAVAILABLE, since
-         * this is not a backend problem. */
-        if (r->connection->aborted) {
-            ap_log_rerror(APLOG_MARK, APLOG_TRACE1, rv, r,
-                          "The client aborted the connection.");
-            conn->close = 1;
-            return OK;
-        }
-
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01075)
-                      "Error dispatching request to %s: %s%s%s",
-                      server_portstr,
-                      err ? "(" : "",
-                      err ? err : "",
-                      err ? ")" : "");
         conn->close = 1;
-        if (has_responded) {
-            return AP_FILTER_ERROR;
-        }
-        if (bad_request) {
-            return ap_map_http_request_error(rv, HTTP_BAD_REQUEST);
-        }
-        if (APR_STATUS_IS_TIMEUP(rv)) {
-            return HTTP_GATEWAY_TIME_OUT;
-        }
-        return HTTP_SERVICE_UNAVAILABLE;
+        return dispatch_error(r, rv, err, bad_request, has_responded,
+                              server_portstr);
+    }
+
+    /* The connection can be reused only if the backend is done with the
+     * request, and with all of it. */
+    if (end_status != AP_FCGI_REQUEST_COMPLETE) {
+        conn->close = 1;
     }
 
     return OK;
@@ -1053,6 +1640,287 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
 
 #define MAX_MEM_SPOOL 16384
 
+#if APR_HAS_THREADS
+/* The multiplexed connections to the worker, if the request may use one */
+static fcgi_mux_pool *mux_pool_get(request_rec *r, proxy_worker *worker,
+                                   apr_bucket_brigade *input_brigade)
+{
+    fcgi_dirconf_t *dconf = ap_get_module_config(r->per_dir_config,
+                                                 &proxy_fcgi_module);
+    fcgi_mux_pool *mp;
+
+    /* The backend has to keep the connections (opted in by enablereuse=on),
+     * and the request body must have been read whole to send the request
+     * at once. */
+    if (dconf->multiplex != 1 || !muxes
+            || !worker->s->disablereuse_set || worker->s->disablereuse
+            || !worker->s->is_address_reusable
+            || APR_BRIGADE_EMPTY(input_brigade)
+            || !APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(input_brigade))) {
+        return NULL;
+    }
+
+    apr_thread_mutex_lock(muxes_mutex);
+    mp = apr_hash_get(muxes, &worker, sizeof(worker));
+    if (!mp) {
+        mp = apr_pcalloc(muxes_pool, sizeof(*mp));
+        apr_thread_mutex_create(&mp->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                muxes_pool);
+        apr_thread_cond_create(&mp->cond, muxes_pool);
+        apr_hash_set(muxes, apr_pmemdup(muxes_pool, &worker, sizeof(worker)),
+                     sizeof(worker), mp);
+    }
+    apr_thread_mutex_unlock(muxes_mutex);
+    return mp;
+}
+
+/* Learn from the backend whether requests can be multiplexed on the
+ * worker's connections, once, on a connection done with its request.
+ */
+static void mux_probe(fcgi_mux_pool *mp, request_rec *r,
+                      proxy_conn_rec *conn)
+{
+    int max_reqs = 1;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(mp->mutex);
+    if (mp->max_reqs != 0) {
+        apr_thread_mutex_unlock(mp->mutex);
+        return;
+    }
+    mp->max_reqs = -1;
+    apr_thread_mutex_unlock(mp->mutex);
+
+    rv = get_max_reqs(conn, r, &max_reqs);
+    if (rv != APR_SUCCESS) {
+        /* No telling what is left on the connection */
+        conn->close = 1;
+        max_reqs = 1;
+    }
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10547)
+                  "FastCGI backend %s takes %d request(s) per connection",
+                  conn->hostname, max_reqs);
+
+    apr_thread_mutex_lock(mp->mutex);
+    mp->max_reqs = max_reqs;
+    apr_thread_mutex_unlock(mp->mutex);
+}
+
+/* Attach the request to a multiplexed connection with room for it or,
+ * given a connected *pconn, to a new one on *pconn (then owned by the
+ * multiplexed connection, and set to NULL).
+ */
+static fcgi_mux_req *mux_attach(fcgi_mux_pool *mp, request_rec *r,
+                                proxy_conn_rec **pconn)
+{
+    fcgi_mux_req *mreq = NULL;
+    fcgi_mux *mx;
+
+    apr_thread_mutex_lock(mp->mutex);
+    if (mp->max_reqs <= 1) {
+        apr_thread_mutex_unlock(mp->mutex);
+        return NULL;
+    }
+
+    for (mx = mp->muxes; mx; mx = mx->next) {
+        if (!mx->closing && mx->status == APR_SUCCESS
+                && mx->users + mx->orphans < mp->max_reqs) {
+            break;
+        }
+    }
+    if (!mx && pconn) {
+        apr_thread_mutex_t *wmutex;
+
+        if (mp->spares) {
+            mx = mp->spares;
+            mp->spares = mx->next;
+            wmutex = mx->wmutex;
+        }
+        else {
+            apr_thread_mutex_lock(muxes_mutex);
+            mx = apr_palloc(muxes_pool, sizeof(*mx));
+            apr_thread_mutex_create(&wmutex, APR_THREAD_MUTEX_DEFAULT,
+                                    muxes_pool);
+            apr_thread_mutex_unlock(muxes_mutex);
+        }
+        memset(mx, 0, sizeof(*mx));
+        mx->wmutex = wmutex;
+        mx->mp = mp;
+        mx->conn = *pconn;
+        mx->next_id = 1;
+        mx->next = mp->muxes;
+        mp->muxes = mx;
+        *pconn = NULL;
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10548)
+                      "new multiplexed connection to %s",
+                      mx->conn->hostname);
+    }
+    if (mx) {
+        mreq = apr_pcalloc(r->pool, sizeof(*mreq));
+        mreq->mx = mx;
+        /* The ids of aborted requests are not reused until they end,
+         * there are less of them than ids so this terminates. */
+        do {
+            mreq->id = mx->next_id++;
+            if (!mx->next_id) {
+                mx->next_id = 1;
+            }
+        } while (MUX_ID_ISSET(mx, mreq->id));
+        MUX_ID_SET(mx, mreq->id);
+        mreq->next = mx->reqs;
+        mx->reqs = mreq;
+        ++mx->users;
+    }
+    apr_thread_mutex_unlock(mp->mutex);
+
+    return mreq;
+}
+
+/* Detach the request from its multiplexed connection, aborting it on the
+ * backend if it did not end. The last request to leave gives the
+ * connection back to the worker.
+ */
+static void mux_detach(fcgi_mux_req *mreq, request_rec *r)
+{
+    fcgi_mux *mx = mreq->mx, **pmx;
+    fcgi_mux_pool *mp = mx->mp;
+    fcgi_mux_req **pmreq;
+    fcgi_mux_rec *rec;
+    proxy_conn_rec *conn = NULL;
+    int aborted;
+
+    apr_thread_mutex_lock(mp->mutex);
+    for (pmreq = &mx->reqs; *pmreq; pmreq = &(*pmreq)->next) {
+        if (*pmreq == mreq) {
+            *pmreq = mreq->next;
+            break;
+        }
+    }
+    while ((rec = mreq->first)) {
+        mreq->first = rec->next;
+        free(rec);
+    }
+    mreq->last = NULL;
+    if (mreq->full) {
+        --mx->full;
+    }
+    aborted = (!mreq->ended && mx->status == APR_SUCCESS);
+    if (aborted) {
+        ++mx->orphans;
+    }
+    apr_thread_mutex_unlock(mp->mutex);
+
+    if (aborted) {
+        apr_status_t rv;
+
+        apr_thread_mutex_lock(mx->wmutex);
+        rv = send_abort_request(mx->conn, mreq->id);
+        apr_thread_mutex_unlock(mx->wmutex);
+        if (rv != APR_SUCCESS) {
+            mux_fail(mx, rv);
+        }
+    }
+
+    apr_thread_mutex_lock(mp->mutex);
+    if (--mx->users == 0) {
+        for (pmx = &mp->muxes; *pmx; pmx = &(*pmx)->next) {
+            if (*pmx == mx) {
+                *pmx = mx->next;
+                break;
+            }
+        }
+        mx->next = mp->spares;
+        mp->spares = mx;
+
+        /* Reusable unless something is still going on */
+        conn = mx->conn;
+        conn->close = (mx->status != APR_SUCCESS || mx->orphans
+                       || mx->closing);
+    }
+    apr_thread_cond_broadcast(mp->cond);
+    apr_thread_mutex_unlock(mp->mutex);
+
+    if (conn) {
+        ap_proxy_release_connection(FCGI_SCHEME, conn, r->server);
+    }
+}
+
+/*
+ * process the request on a multiplexed connection and write the response.
+ */
+static int fcgi_mux_do_request(request_rec *r, fcgi_mux_req *mreq,
+                               proxy_dir_conf *conf, char *server_portstr,
+                               apr_bucket_brigade *input_brigade)
+{
+    fcgi_mux *mx = mreq->mx;
+    proxy_conn_rec *conn = mx->conn;
+    apr_status_t rv;
+    apr_pool_t *temp_pool;
+    const char *err, *params;
+    apr_size_t params_len;
+    int bad_request = 0,
+        has_responded = 0,
+        end_status;
+
+    apr_pool_create(&temp_pool, r->pool);
+    apr_pool_tag(temp_pool, "proxy_fcgi_do_request");
+
+    /* Step 1: Encode the Environment, outside of the write lock */
+    rv = build_environment(r, temp_pool, mreq->id, &params, &params_len);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10602)
+                      "Failed writing Environment to %s:", server_portstr);
+        /* Never begun, nothing to abort, but its id is free again */
+        apr_thread_mutex_lock(mx->mp->mutex);
+        MUX_ID_CLR(mx, mreq->id);
+        mreq->ended = 1;
+        apr_thread_mutex_unlock(mx->mp->mutex);
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    /* Step 2 and the body: all the records of the request go at once,
+     * between the other requests' */
+    apr_thread_mutex_lock(mx->wmutex);
+    rv = send_begin_request(conn, mreq->id, params, params_len);
+    if (rv == APR_SUCCESS) {
+        rv = send_stdin(conn, input_brigade, mreq->id, 1);
+    }
+    apr_thread_mutex_unlock(mx->wmutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10549)
+                      "Failed writing multiplexed request to %s:",
+                      server_portstr);
+        mux_fail(mx, rv);
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    /* Step 3: Read the records of the request and handle them. */
+    rv = dispatch(conn, conf, r, temp_pool, mreq->id,
+                  &err, &bad_request, &has_responded,
+                  input_brigade, mreq, &end_status);
+    if (rv != APR_SUCCESS) {
+        return dispatch_error(r, rv, err, bad_request, has_responded,
+                              server_portstr);
+    }
+
+    if (end_status == AP_FCGI_CANT_MPX_CONN) {
+        /* Advertised but refused, stop multiplexing to this backend */
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(10550)
+                      "FastCGI backend %s can't multiplex requests, "
+                      "disabled", conn->hostname);
+        apr_thread_mutex_lock(mx->mp->mutex);
+        mx->closing = 1;
+        mx->mp->max_reqs = 1;
+        apr_thread_mutex_unlock(mx->mp->mutex);
+        if (!has_responded) {
+            return HTTP_SERVICE_UNAVAILABLE;
+        }
+    }
+
+    return OK;
+}
+#endif /* APR_HAS_THREADS */
+
 /*
  * This handles fcgi:(dest) URLs
  */
@@ -1068,6 +1936,10 @@ static int proxy_fcgi_handler(request_rec *r, proxy_worker *worker,
     apr_bucket_brigade *input_brigade;
     apr_off_t input_bytes = 0;
     apr_uri_t *uri;
+    fcgi_mux_req *mreq = NULL;
+#if APR_HAS_THREADS
+    fcgi_mux_pool *mp;
+#endif
 
     proxy_dir_conf *dconf = ap_get_module_config(r->per_dir_config,
                                                  &proxy_module);
@@ -1214,9 +2086,20 @@ static int proxy_fcgi_handler(request_rec *r, proxy_worker *worker,
         backend->close = 0;
     }
 
+#if APR_HAS_THREADS
+    /* With ProxyFCGIMultiplex, the request rather joins a connection
+     * multiplexing others to the worker, if any has room.
+     */
+    mp = mux_pool_get(r, worker, input_brigade);
+    if (mp) {
+        mreq = mux_attach(mp, r, NULL);
+    }
+#endif
+
     /* Step Two: Make the Connection */
-    if (ap_proxy_check_connection(FCGI_SCHEME, backend, r->server, 0,
-                                  PROXY_CHECK_CONN_EMPTY)
+    if (!mreq
+            && ap_proxy_check_connection(FCGI_SCHEME, backend, r->server, 0,
+                                         PROXY_CHECK_CONN_EMPTY)
             && ap_proxy_connect_backend(FCGI_SCHEME, backend, worker,
                                         r->server)) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01079)
@@ -1226,12 +2109,33 @@ static int proxy_fcgi_handler(request_rec *r, proxy_worker *worker,
         goto cleanup;
     }
 
+#if APR_HAS_THREADS
+    if (mp && !mreq) {
+        /* or starts multiplexing on this connection */
+        mreq = mux_attach(mp, r, &backend);
+    }
+    if (mreq) {
+        status = fcgi_mux_do_request(r, mreq, dconf, server_portstr,
+                                     input_brigade);
+        mux_detach(mreq, r);
+        goto cleanup;
+    }
+#endif
+
     /* Step Three: Process the Request */
     status = fcgi_do_request(p, r, backend, origin, dconf, uri, url,
                              server_portstr, input_brigade);
 
+#if APR_HAS_THREADS
+    if (mp && status == OK && !backend->close) {
+        mux_probe(mp, r, backend);
+    }
+#endif
+
 cleanup:
-    ap_proxy_release_connection(FCGI_SCHEME, backend, r->server);
+    if (backend) {
+        ap_proxy_release_connection(FCGI_SCHEME, backend, r->server);
+    }
     return status;
 }
 
@@ -1242,6 +2146,7 @@ static void *fcgi_create_dconf(apr_pool_t *p, char *path)
     a = (fcgi_dirconf_t *)apr_pcalloc(p, sizeof(fcgi_dirconf_t));
     a->backend_type = BACKEND_DEFAULT_UNKNOWN;
     a->env_fixups = apr_array_make(p, 20, sizeof(sei_entry));
+    a->multiplex = -1;
 
     return a;
 }
@@ -1258,6 +2163,7 @@ static void *fcgi_merge_dconf(apr_pool_t *p, void *basev, void *overridesv)
                       ? over->backend_type
                       : base->backend_type;
     a->env_fixups = apr_array_append(p, base->env_fixups, over->env_fixups);
+    a->multiplex = (over->multiplex != -1) ? over->multiplex : base->multiplex;
     return a;
 }
 
@@ -1329,8 +2235,41 @@ static const char *cmd_setenv(cmd_parms *cmd, void *in_dconf,
 
     return NULL;
 }
+
+static const char *cmd_multiplex(cmd_parms *cmd, void *in_dconf, int flag)
+{
+    fcgi_dirconf_t *dconf = in_dconf;
+
+    dconf->multiplex = flag;
+    return NULL;
+}
+
+#if APR_HAS_THREADS
+static void fcgi_child_init(apr_pool_t *pchild, server_rec *s)
+{
+    apr_allocator_t *alloc;
+
+    /* The multiplexed connections live as long as the child, their
+     * bookkeeping has its own allocator as it happens in any thread
+     * (under lock). */
+    if (apr_allocator_create(&alloc) != APR_SUCCESS
+        || apr_pool_create_ex(&muxes_pool, pchild, NULL, alloc) != APR_SUCCESS) {
+        ap_abort_on_oom();
+    }
+    apr_allocator_owner_set(alloc, muxes_pool);
+    apr_pool_tag(muxes_pool, "proxy_fcgi_mux");
+    if (apr_thread_mutex_create(&muxes_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                pchild) == APR_SUCCESS) {
+        muxes = apr_hash_make(muxes_pool);
+    }
+}
+#endif
+
 static void register_hooks(apr_pool_t *p)
 {
+#if APR_HAS_THREADS
+    ap_hook_child_init(fcgi_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+#endif
     proxy_hook_scheme_handler(proxy_fcgi_handler, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_canon_handler(proxy_fcgi_canon, NULL, NULL, APR_HOOK_FIRST);
 }
@@ -1340,6 +2279,10 @@ static const command_rec command_table[] = {
                   "Specify the type of FastCGI server: 'Generic', 'FPM'"),
     AP_INIT_TAKE23("ProxyFCGISetEnvIf", cmd_setenv, NULL, OR_FILEINFO,
                   "expr-condition env-name expr-value"),
+    AP_INIT_FLAG("ProxyFCGIMultiplex", cmd_multiplex, NULL,
+                 RSRC_CONF|ACCESS_CONF,
+                 "On to multiplex the concurrent requests to FastCGI "
+                 "backends advertising FCGI_MPXS_CONNS"),
     { NULL }
 };
 
@@ -17,6 +17,7 @@
 #include "mod_watchdog.h"
 #include "ap_slotmem.h"
 #include "ap_expr.h"
+#include "apr_atomic.h"
 #if APR_HAS_THREADS
 #include "apr_thread_pool.h"
 #endif
@@ -41,6 +42,7 @@ typedef struct {
     hcmethod_t method;
     int passes;
     int fails;
+    int outlier;
     apr_interval_time_t interval;
     char *hurl;
     char *hcexpr;
@@ -131,6 +133,7 @@ static const char *set_worker_hc_param(apr_pool_t *p,
                     worker->s->interval = template->interval;
                     worker->s->passes = template->passes;
                     worker->s->fails = template->fails;
+                    worker->s->ofails = template->outlier;
                     PROXY_STRNCPY(worker->s->hcuri, template->hurl);
                     PROXY_STRNCPY(worker->s->hcexpr, template->hcexpr);
                 } else {
@@ -138,6 +141,7 @@ static const char *set_worker_hc_param(apr_pool_t *p,
                     temp->interval = template->interval;
                     temp->passes = template->passes;
                     temp->fails = template->fails;
+                    temp->outlier = template->outlier;
                     temp->hurl = apr_pstrdup(p, template->hurl);
                     temp->hcexpr = apr_pstrdup(p, template->hcexpr);
                 }
@@ -199,6 +203,16 @@ static const char *set_worker_hc_param(apr_pool_t *p,
             temp->fails = ival;
         }
     }
+    else if (!strcasecmp(key, "hcoutlier")) {
+        ival = atoi(val);
+        if (ival < 0)
+            return "Outlier must be a positive value (or 0 to disable)";
+        if (worker) {
+            worker->s->ofails = ival;
+        } else {
+            temp->outlier = ival;
+        }
+    }
     else if (!strcasecmp(key, "hcuri")) {
         if (strlen(val) >= sizeof(worker->s->hcuri))
             return apr_psprintf(p, "Health check uri length must be < %d characters",
@@ -297,6 +311,7 @@ static const char *set_hc_template(cmd_parms *cmd, void *dummy, const char *arg)
 
     template->name = apr_pstrdup(cmd->pool, name);
     template->method = template->passes = template->fails = 1;
+    template->outlier = 0;
     template->interval = apr_time_from_sec(HCHECK_WATHCHDOG_DEFAULT_INTERVAL);
     template->hurl = NULL;
     template->hcexpr = NULL;
@@ -981,6 +996,64 @@ static void * APR_THREAD_FUNC hc_check(apr_thread_t *thread, void *b)
     return NULL;
 }
 
+/*
+ * The checks of a worker are due at a fixed phase of its interval, derived
+ * from its name, so that the members of large balancers are not all probed
+ * in the same watchdog tick. Since the phase depends on the shared state
+ * only, it is the same in whichever child runs the (singleton) watchdog.
+ */
+static int hc_is_due(proxy_worker *worker, apr_time_t now)
+{
+    apr_interval_time_t interval = worker->s->interval;
+    apr_time_t last = worker->s->updated;
+
+    if (interval > 0 && last > 0) {
+        apr_time_t phase = (apr_time_t)(worker->s->hash.def % interval);
+        /* Start of the period the last check happened in */
+        last -= (last - phase) % interval;
+    }
+    return now > last + interval;
+}
+
+/*
+ * Passive health check: eject a worker after a number of consecutive
+ * failures (5xx or timeout) of the requests proxied to it, without
+ * waiting for the next active check. The worker is then put in health
+ * check fail mode, hence re-enabled by the active checks.
+ */
+static int hc_post_request(proxy_worker *worker,
+                           proxy_balancer *balancer,
+                           request_rec *r,
+                           proxy_server_conf *conf)
+{
+    if (!worker || !worker->s->ofails || worker->s->method == NONE
+        || (worker->s->status & PROXY_WORKER_IGNORE_ERRORS)) {
+        return DECLINED;
+    }
+
+    if (r->status >= HTTP_INTERNAL_SERVER_ERROR
+        || apr_table_get(r->notes, "proxy_timedout")) {
+        if (PROXY_WORKER_IS_HCFAILED(worker)) {
+            return DECLINED;
+        }
+        if (apr_atomic_inc32(&worker->s->ocount) + 1 == worker->s->ofails) {
+            ap_proxy_set_wstatus(PROXY_WORKER_HC_FAIL_FLAG, 1, worker);
+            worker->s->error_time = apr_time_now();
+            worker->s->pcount = 0;
+            apr_atomic_set32(&worker->s->ocount, 0);
+            ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, APLOGNO(10543)
+                          "Passive health check DISABLING %s after %u "
+                          "consecutive failures (last status %d)",
+                          worker->s->name, worker->s->ofails, r->status);
+        }
+    }
+    else if (apr_atomic_read32(&worker->s->ocount)) {
+        apr_atomic_set32(&worker->s->ocount, 0);
+    }
+
+    return DECLINED;
+}
+
 static apr_status_t hc_watchdog_callback(int state, void *data,
                                          apr_pool_t *pool)
 {
@@ -1039,7 +1112,7 @@ static apr_status_t hc_watchdog_callback(int state, void *data,
                         if (!PROXY_WORKER_IS(worker, PROXY_WORKER_STOPPED) &&
                             (worker->s->method != NONE) &&
                             (worker->s->updated != 0) &&
-                            (now > worker->s->updated + worker->s->interval)) {
+                            hc_is_due(worker, now)) {
                             baton_t *baton;
                             apr_pool_t *ptemp;
 
@@ -1348,6 +1421,7 @@ static void hc_register_hooks(apr_pool_t *p)
     ap_hook_pre_config(hc_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_post_config(hc_post_config, aszPre, aszSucc, APR_HOOK_LAST);
     ap_hook_expr_lookup(hc_expr_lookup, NULL, NULL, APR_HOOK_MIDDLE);
+    proxy_hook_post_request(hc_post_request, NULL, NULL, APR_HOOK_FIRST);
 }
 
 /* the main config structure */
@@ -278,6 +278,7 @@ static void add_cl(apr_pool_t *p,
 typedef enum {
     PROXY_HTTP_REQ_HAVE_HEADER = 0,
 
+    PROXY_HTTP_WAIT_RESPONSE,
     PROXY_HTTP_TUNNELING
 } proxy_http_state;
 
@@ -314,14 +315,24 @@ typedef struct {
     proxy_tunnel_rec *tunnel;
 
     apr_pool_t *async_pool;
+    apr_array_header_t *pfds;
     apr_interval_time_t idle_timeout;
 
+    /* ProxyResponseBuffer */
+    apr_bucket_brigade *rbuf_bb;
+    apr_file_t *rbuf_file;
+    apr_off_t rbuf_len,
+              rbuf_file_len;
+
     unsigned int can_go_async           :1,
                  do_100_continue        :1,
                  prefetch_nonblocking   :1,
                  force10                :1;
 } proxy_http_req_t;
 
+static void proxy_http_async_cb(void *baton);
+static void proxy_http_async_cancel_cb(void *baton);
+
 static void proxy_http_async_finish(proxy_http_req_t *req)
 { 
     conn_rec *c = req->r->connection;
@@ -337,6 +348,7 @@ static void proxy_http_async_finish(proxy_http_req_t *req)
 
     proxy_run_detach_backend(req->r, req->backend);
     ap_proxy_release_connection(req->proto, req->backend, req->r->server);
+    ap_proxy_resume_post_request(req->r, OK);
 
     ap_finalize_request_protocol(req->r);
     ap_process_request_after_handler(req->r);
@@ -346,6 +358,88 @@ static void proxy_http_async_finish(proxy_http_req_t *req)
     ap_mpm_resume_suspended(c);
 }
 
+/* Processes the response of the backend once it is readable (or the wait
+ * timed out), and completes the request as ap_process_async_request() would
+ * have if the handler did not suspend.
+ */
+static void proxy_http_async_response(proxy_http_req_t *req, int timedout)
+{
+    request_rec *r = req->r;
+    conn_rec *c = r->connection;
+    int status;
+
+    /* The handler may not have returned SUSPENDED yet */
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(r->invoke_mtx);
+#endif
+
+    if (timedout) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10510)
+                      "proxy %s: timeout waiting for the response of %s:%d",
+                      req->proto, req->backend->hostname, req->backend->port);
+        apr_table_setn(r->notes, "proxy_timedout", "1");
+        status = HTTP_GATEWAY_TIME_OUT;
+    }
+    else {
+        status = ap_proxy_http_process_response(req);
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "proxy %s: finish async response (%i)",
+                  req->proto, status);
+
+    if (req->backend) {
+        if (status != OK) {
+            req->backend->close = 1;
+        }
+        proxy_run_detach_backend(r, req->backend);
+        ap_proxy_release_connection(req->proto, req->backend, r->server);
+        req->backend = NULL;
+    }
+    ap_proxy_resume_post_request(r, status);
+
+    if (status == OK || status == DONE) {
+        ap_finalize_request_protocol(r);
+    }
+    else {
+        r->status = HTTP_OK;
+        ap_die(status, r);
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(r->invoke_mtx);
+#endif
+
+    ap_process_request_after_handler(r);
+    /* don't touch req or req->r from here */
+
+    ap_mpm_resume_suspended(c);
+}
+
+/* Registers the sockets of the current state to the MPM, which will call us
+ * back when they are readable or after idle_timeout.
+ */
+static void proxy_http_async_suspend(proxy_http_req_t *req)
+{
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, req->r,
+                  "proxy %s: suspended, going async",
+                  req->proto);
+
+    if (!req->async_pool) {
+        /* Create the subpool used by the MPM to alloc its own
+         * temporary data, which we want to clear on the next
+         * round (in proxy_http_async_cb()) to avoid leaks.
+         */
+        apr_pool_create(&req->async_pool, req->p);
+    }
+
+    ap_mpm_register_poll_callback_timeout(req->async_pool,
+                                          req->pfds,
+                                          proxy_http_async_cb, 
+                                          proxy_http_async_cancel_cb, 
+                                          req, req->idle_timeout);
+}
+
 /* If neither socket becomes readable in the specified timeout,
  * this callback will kill the request.
  * We do not have to worry about having a cancel and a IO both queued.
@@ -357,6 +451,11 @@ static void proxy_http_async_cancel_cb(void *baton)
     ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, req->r,
                   "proxy %s: cancel async", req->proto);
 
+    if (req->state == PROXY_HTTP_WAIT_RESPONSE) {
+        proxy_http_async_response(req, 1);
+        return;
+    }
+
     req->r->connection->keepalive = AP_CONN_CLOSE;
     req->backend->close = 1;
     proxy_http_async_finish(req);
@@ -377,6 +476,11 @@ static void proxy_http_async_cb(void *baton)
     }
 
     switch (req->state) {
+    case PROXY_HTTP_WAIT_RESPONSE:
+        /* The backend answered, relay its response from this thread */
+        proxy_http_async_response(req, 0);
+        return;
+
     case PROXY_HTTP_TUNNELING:
         /* Pump both ends until they'd block and then start over again */
         status = ap_proxy_tunnel_run(req->tunnel);
@@ -394,23 +498,7 @@ static void proxy_http_async_cb(void *baton)
     }
 
     if (status == SUSPENDED) {
-        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, req->r,
-                      "proxy %s: suspended, going async",
-                      req->proto);
-
-        if (!req->async_pool) {
-            /* Create the subpool used by the MPM to alloc its own
-             * temporary data, which we want to clear on the next
-             * round (above) to avoid leaks.
-             */
-            apr_pool_create(&req->async_pool, req->p);
-        }
-
-        ap_mpm_register_poll_callback_timeout(req->async_pool,
-                                              req->tunnel->pfds,
-                                              proxy_http_async_cb, 
-                                              proxy_http_async_cancel_cb, 
-                                              req, req->idle_timeout);
+        proxy_http_async_suspend(req);
     }
     else if (ap_is_HTTP_ERROR(status)) {
         proxy_http_async_cancel_cb(req);
@@ -420,6 +508,43 @@ static void proxy_http_async_cb(void *baton)
     }
 }
 
+/* Whether the response of the backend can be read now, or within the given
+ * timeout. Errors count as ready so that the caller handles them.
+ */
+static int proxy_http_response_ready(proxy_http_req_t *req,
+                                     apr_interval_time_t timeout)
+{
+    apr_bucket_brigade *bb;
+    apr_pollfd_t pfd;
+    apr_int32_t nfds;
+    apr_status_t rv;
+
+    /* Some data might be buffered already in the input filters of the
+     * backend connection (e.g. mod_ssl), which polling would miss.
+     */
+    bb = apr_brigade_create(req->p, req->bucket_alloc);
+    rv = ap_get_brigade(req->origin->input_filters, bb, AP_MODE_SPECULATIVE,
+                        APR_NONBLOCK_READ, 1);
+    apr_brigade_destroy(bb);
+    if (!APR_STATUS_IS_EAGAIN(rv)) {
+        return 1;
+    }
+    if (timeout <= 0) {
+        return 0;
+    }
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.p = req->p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN;
+    pfd.desc.s = req->backend->sock;
+    do {
+        rv = apr_poll(&pfd, 1, &nfds, timeout);
+    } while (APR_STATUS_IS_EINTR(rv));
+
+    return !APR_STATUS_IS_TIMEUP(rv);
+}
+
 static int stream_reqbody(proxy_http_req_t *req)
 {
     request_rec *r = req->r;
@@ -434,14 +559,37 @@ static int stream_reqbody(proxy_http_req_t *req)
     rb_methods rb_method = req->rb_method;
     apr_off_t bytes, bytes_streamed = 0;
     apr_bucket *e;
+    /* A body of known length that no input filter needs to see can be
+     * spliced from the client to the backend socket directly. This is
+     * decided once the 100 Continue, if any, has been sent by HTTP_IN.
+     */
+    int try_splice = (rb_method == RB_STREAM_CL) ? -1 : 0;
 
     do {
         if (APR_BRIGADE_EMPTY(input_brigade)
                 && APR_BRIGADE_EMPTY(header_brigade)) {
-            rv = ap_proxy_read_input(r, p_conn, input_brigade,
-                                     HUGE_STRING_LEN);
-            if (rv != OK) {
-                return rv;
+            rv = DECLINED;
+            if (try_splice < 0 && !r->expecting_100) {
+                try_splice = ap_proxy_can_splice_input(r, p_conn);
+            }
+            if (try_splice > 0 && bytes_streamed < req->cl_val) {
+                rv = ap_proxy_splice_input(r, p_conn,
+                                           req->cl_val - bytes_streamed);
+                if (rv == OK) {
+                    bytes_streamed = req->cl_val;
+                    e = apr_bucket_eos_create(bucket_alloc);
+                    APR_BRIGADE_INSERT_TAIL(input_brigade, e);
+                }
+                else if (rv != DECLINED) {
+                    return rv;
+                }
+            }
+            if (rv == DECLINED) {
+                rv = ap_proxy_read_input(r, p_conn, input_brigade,
+                                         HUGE_STRING_LEN);
+                if (rv != OK) {
+                    return rv;
+                }
             }
         }
 
@@ -1060,6 +1208,133 @@ static int send_continue_body(proxy_http_req_t *req)
     return status;
 }
 
+/*
+ * ProxyResponseBuffer: set aside the response body read from the backend,
+ * in memory and then in a temporary file, so that the backend connection
+ * can be released before the client gets the response. On EOS, when the
+ * limit is reached or on error, everything buffered so far is put back
+ * in bb (ahead of the remaining buckets) and buffering stops, otherwise
+ * bb is emptied.
+ */
+static void buffer_response(proxy_http_req_t *req, apr_bucket_brigade *bb)
+{
+    request_rec *r = req->r;
+    proxy_dir_conf *dconf = req->dconf;
+    apr_status_t rv = APR_SUCCESS;
+    int done = 0;
+    apr_bucket *e;
+
+    while (!done && !APR_BRIGADE_EMPTY(bb)) {
+        const char *data;
+        apr_size_t len;
+
+        e = APR_BRIGADE_FIRST(bb);
+        if (APR_BUCKET_IS_EOS(e)) {
+            done = 1;
+            break;
+        }
+        if (APR_BUCKET_IS_FLUSH(e)) {
+            apr_bucket_delete(e);
+            continue;
+        }
+        if (APR_BUCKET_IS_METADATA(e)) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(req->rbuf_bb, e);
+            continue;
+        }
+
+        rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        if (!req->rbuf_file
+                && req->rbuf_len + (apr_off_t)len <= dconf->response_buffer_mem) {
+            rv = apr_bucket_setaside(e, r->pool);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(req->rbuf_bb, e);
+        }
+        else {
+            if (!req->rbuf_file) {
+                const char *temp_dir;
+                char *template;
+
+                rv = apr_temp_dir_get(&temp_dir, r->pool);
+                if (rv != APR_SUCCESS) {
+                    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10544)
+                                  "search for temporary directory failed");
+                    break;
+                }
+                apr_filepath_merge(&template, temp_dir,
+                                   "modproxy.tmp.XXXXXX",
+                                   APR_FILEPATH_NATIVE, r->pool);
+                rv = apr_file_mktemp(&req->rbuf_file, template, 0, r->pool);
+                if (rv != APR_SUCCESS) {
+                    ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10545)
+                                  "creation of temporary file in directory "
+                                  "%s failed", temp_dir);
+                    req->rbuf_file = NULL;
+                    break;
+                }
+            }
+            rv = apr_file_write_full(req->rbuf_file, data, len, NULL);
+            if (rv != APR_SUCCESS) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10546)
+                              "write to temporary file failed");
+                break;
+            }
+            req->rbuf_file_len += len;
+            apr_bucket_delete(e);
+        }
+        req->rbuf_len += len;
+        if (req->rbuf_len >= dconf->response_buffer) {
+            ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                          "response buffer limit reached (%" APR_OFF_T_FMT
+                          " bytes), streaming", dconf->response_buffer);
+            done = 1;
+        }
+    }
+
+    if (done || rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE2, rv, r,
+                      "response buffered: %" APR_OFF_T_FMT " bytes (%"
+                      APR_OFF_T_FMT " in file)", req->rbuf_len,
+                      req->rbuf_file_len);
+        if (req->rbuf_file_len) {
+            apr_brigade_insert_file(req->rbuf_bb, req->rbuf_file, 0,
+                                    req->rbuf_file_len, r->pool);
+        }
+        APR_BRIGADE_PREPEND(bb, req->rbuf_bb);
+        req->rbuf_bb = NULL;
+    }
+}
+
+/*
+ * The backend failed before the whole response could be buffered, what
+ * was buffered is dropped and the client connection aborted, since the
+ * response can't be completed.
+ */
+static void buffer_response_drop(proxy_http_req_t *req)
+{
+    request_rec *r = req->r;
+
+    if (!req->rbuf_bb) {
+        return;
+    }
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10601)
+                  "backend failed while buffering the response, dropping "
+                  "%" APR_OFF_T_FMT " buffered bytes", req->rbuf_len);
+    apr_brigade_cleanup(req->rbuf_bb);
+    req->rbuf_bb = NULL;
+    if (req->rbuf_file) {
+        apr_file_close(req->rbuf_file);
+        req->rbuf_file = NULL;
+    }
+    r->connection->aborted = 1;
+}
+
 static
 int ap_proxy_http_process_response(proxy_http_req_t *req)
 {
@@ -1562,6 +1837,7 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
             if (req->can_go_async) {
                 /* Let the MPM schedule the work when idle */
                 req->state = PROXY_HTTP_TUNNELING;
+                req->pfds = req->tunnel->pfds;
                 req->tunnel->timeout = dconf->async_delay;
                 proxy_http_async_cb(req);
                 return SUSPENDED;
@@ -1707,7 +1983,16 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                 r->status_line = original_status_line;
             }
 
-            mode = APR_NONBLOCK_READ;
+            /* Buffering the response? No need to flush anything to the
+             * client until it's all read then.
+             */
+            if (dconf->response_buffer > 0) {
+                req->rbuf_bb = apr_brigade_create(r->pool, c->bucket_alloc);
+                mode = APR_BLOCK_READ;
+            }
+            else {
+                mode = APR_NONBLOCK_READ;
+            }
             finish = FALSE;
             do {
                 apr_off_t readbytes;
@@ -1735,6 +2020,7 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                     continue;
                 }
                 if (rv == APR_EOF) {
+                    buffer_response_drop(req);
                     backend->close = 1;
                     break;
                 }
@@ -1763,6 +2049,7 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                      * through a response, our only option is to
                      * disconnect the client too.
                      */
+                    buffer_response_drop(req);
                     apr_brigade_cleanup(bb);
                     ap_proxy_fill_error_brigade(r, error_status, bb, 1);
                     ap_pass_brigade(r->output_filters, bb);
@@ -1772,7 +2059,9 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                     break;
                 }
                 /* next time try a non-blocking read */
-                mode = APR_NONBLOCK_READ;
+                if (!req->rbuf_bb) {
+                    mode = APR_NONBLOCK_READ;
+                }
 
                 if (!apr_is_empty_table(backend->r->trailers_in)) {
                     apr_table_do(add_trailers, r->trailers_out,
@@ -1796,6 +2085,7 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                      * to notice the output filters and then disconnect the
                      * client and backend.
                      */
+                    buffer_response_drop(req);
                     if (!APR_BRIGADE_EMPTY(pass_bb)) {
                         /* Pass what we have still */
                         ap_pass_brigade(r->output_filters, pass_bb);
@@ -1847,6 +2137,14 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
 
                 }
 
+                if (req->rbuf_bb) {
+                    buffer_response(req, pass_bb);
+                    if (APR_BRIGADE_EMPTY(pass_bb)) {
+                        apr_brigade_cleanup(bb);
+                        continue;
+                    }
+                }
+
                 /* try send what we read */
                 if (ap_pass_brigade(r->output_filters, pass_bb) != APR_SUCCESS
                     || c->aborted) {
@@ -2166,7 +2464,30 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
             break;
         }
 
-        /* Step Five: Receive the Response... Fall thru to cleanup */
+        /* Step Five: Receive the Response... Fall thru to cleanup
+         * If the backend takes longer than ProxyAsyncDelay to answer, let
+         * the MPM wake us up when it does rather than holding this thread.
+         * The 100-continue and Upgrade cases are handled synchronously, as
+         * well as secondary connections (e.g. HTTP/2 streams) which are not
+         * polled by the MPM.
+         */
+        if (req->can_go_async && !c->master
+                && !req->do_100_continue && !req->upgrade
+                && !proxy_http_response_ready(req, dconf->async_delay)) {
+            apr_pollfd_t *pfd;
+
+            req->pfds = apr_array_make(req->p, 1, sizeof(apr_pollfd_t));
+            pfd = &APR_ARRAY_PUSH(req->pfds, apr_pollfd_t);
+            memset(pfd, 0, sizeof(*pfd));
+            pfd->p = req->p;
+            pfd->desc_type = APR_POLL_SOCKET;
+            pfd->reqevents = APR_POLLIN;
+            pfd->desc.s = backend->sock;
+
+            req->state = PROXY_HTTP_WAIT_RESPONSE;
+            proxy_http_async_suspend(req);
+            return SUSPENDED;
+        }
         status = ap_proxy_http_process_response(req);
         if (status == SUSPENDED) {
             return SUSPENDED;
@@ -42,6 +42,13 @@
 #include "apr_support.h"        /* for apr_wait_for_io_or_timeout() */
 #endif
 
+#if defined(__linux__)
+#include <fcntl.h>              /* for splice() */
+#if defined(SPLICE_F_MOVE) && defined(SPLICE_F_NONBLOCK)
+#define PROXY_HAVE_SPLICE 1
+#endif
+#endif
+
 APLOG_USE_MODULE(proxy);
 
 /*
@@ -76,6 +83,7 @@ const apr_strmatch_pattern PROXY_DECLARE_DATA *ap_proxy_strmatch_domain;
 extern apr_global_mutex_t *proxy_mutex;
 
 static const apr_time_t *proxy_start_time; /* epoch for expiring addresses */
+static int address_refresh; /* addresses are refreshed in the background */
 
 static int proxy_match_ipaddr(struct dirconn_entry *This, request_rec *r);
 static int proxy_match_domainname(struct dirconn_entry *This, request_rec *r);
@@ -1615,6 +1623,20 @@ PROXY_DECLARE(int) ap_proxy_connection_reusable(proxy_conn_rec *conn)
              || worker->s->disablereuse);
 }
 
+/* Pre-cleanup of conn->pool, which is destroyed when the connection expires
+ * from the reslist or when the child exits. The socket is still open here,
+ * so if it's idle let another process reuse it.
+ */
+static apr_status_t connection_park(void *theconn)
+{
+    proxy_conn_rec *conn = (proxy_conn_rec *)theconn;
+
+    if (conn->inreslist && conn->sock) {
+        proxy_run_park_connection(conn);
+    }
+    return APR_SUCCESS;
+}
+
 static proxy_conn_rec *connection_make(apr_pool_t *p, proxy_worker *worker)
 {
     proxy_conn_rec *conn;
@@ -1622,6 +1644,7 @@ static proxy_conn_rec *connection_make(apr_pool_t *p, proxy_worker *worker)
     conn = apr_pcalloc(p, sizeof(proxy_conn_rec));
     conn->pool = p;
     conn->worker = worker;
+    apr_pool_pre_cleanup_register(p, conn, connection_park);
 
     /*
      * Create another subpool that manages the data for the
@@ -1680,8 +1703,8 @@ static void connection_cleanup(void *theconn)
         ap_proxy_ssl_engine(conn->connection, worker->section_config, 1);
     }
 
+    conn->inreslist = 1;
     if (worker->s->hmax && worker->cp->res) {
-        conn->inreslist = 1;
         apr_reslist_release(worker->cp->res, (void *)conn);
     }
     else {
@@ -1957,6 +1980,26 @@ PROXY_DECLARE(proxy_worker *) ap_proxy_get_worker(apr_pool_t *p,
  * shared. This allows for dynamic addition during
  * config and runtime.
  */
+/*
+ * Append a worker, fully set up, to the balancer's list. The lockless
+ * lbmethods walk the list without the balancer mutex, so the slot is filled
+ * before being counted. The list is sized for max_workers at post_config
+ * time, such that it's never reallocated under their feet at runtime.
+ */
+static void add_balancer_worker(proxy_balancer *balancer,
+                                proxy_worker *worker)
+{
+    apr_array_header_t *workers = balancer->workers;
+
+    if (workers->nelts < workers->nalloc) {
+        ((proxy_worker **)workers->elts)[workers->nelts] = worker;
+        apr_atomic_inc32((apr_uint32_t *)&workers->nelts);
+    }
+    else {
+        APR_ARRAY_PUSH(workers, proxy_worker *) = worker;
+    }
+}
+
 PROXY_DECLARE(char *) ap_proxy_define_worker_ex(apr_pool_t *p,
                                              proxy_worker **worker,
                                              proxy_balancer *balancer,
@@ -2079,13 +2122,8 @@ PROXY_DECLARE(char *) ap_proxy_define_worker_ex(apr_pool_t *p,
      * in which case the worker goes in the conf slot.
      */
     if (balancer) {
-        proxy_worker **runtime;
-        /* recall that we get a ptr to the ptr here */
-        runtime = apr_array_push(balancer->workers);
-        *worker = *runtime = apr_palloc(p, sizeof(proxy_worker));   /* right to left baby */
-        /* we've updated the list of workers associated with
-         * this balancer *locally* */
-        balancer->wupdated = apr_time_now();
+        /* added to the balancer once set up, below */
+        *worker = apr_palloc(p, sizeof(proxy_worker));
     } else if (conf) {
         *worker = apr_array_push(conf->workers);
     } else {
@@ -2173,6 +2211,13 @@ PROXY_DECLARE(char *) ap_proxy_define_worker_ex(apr_pool_t *p,
     (*worker)->balancer = balancer;
     (*worker)->s = wshared;
 
+    if (balancer) {
+        add_balancer_worker(balancer, *worker);
+        /* we've updated the list of workers associated with
+         * this balancer *locally* */
+        balancer->wupdated = apr_time_now();
+    }
+
     return NULL;
 }
 
@@ -2546,6 +2591,71 @@ PROXY_DECLARE(int) ap_proxy_post_request(proxy_worker *worker,
     return access_status;
 }
 
+#define PROXY_SUSPENDED_POST_REQUEST "proxy-suspended-post-request"
+
+typedef struct {
+    proxy_worker *worker;
+    proxy_balancer *balancer;
+    proxy_server_conf *conf;
+} proxy_suspended_post_request;
+
+PROXY_DECLARE(void) ap_proxy_suspend_post_request(proxy_worker *worker,
+                                                  proxy_balancer *balancer,
+                                                  request_rec *r,
+                                                  proxy_server_conf *conf)
+{
+    proxy_suspended_post_request *ctx = apr_palloc(r->pool, sizeof(*ctx));
+
+    ctx->worker = worker;
+    ctx->balancer = balancer;
+    ctx->conf = conf;
+    apr_pool_userdata_setn(ctx, PROXY_SUSPENDED_POST_REQUEST, NULL, r->pool);
+}
+
+PROXY_DECLARE(int) ap_proxy_resume_post_request(request_rec *r, int status)
+{
+    proxy_suspended_post_request *ctx = NULL;
+    int access_status, saved_status;
+
+    apr_pool_userdata_get((void **)&ctx, PROXY_SUSPENDED_POST_REQUEST,
+                          r->pool);
+    if (!ctx) {
+        return OK;
+    }
+    /* run once */
+    apr_pool_userdata_setn(NULL, PROXY_SUSPENDED_POST_REQUEST, NULL, r->pool);
+
+    /* The request can't fail over anymore, but as in proxy_handler() the
+     * worker is put in error for the next ones.
+     */
+    if ((status == HTTP_INTERNAL_SERVER_ERROR
+         || status == HTTP_SERVICE_UNAVAILABLE)
+            && ctx->balancer
+            && !(ctx->worker->s->status & PROXY_WORKER_IGNORE_ERRORS)) {
+        ctx->worker->s->status |= PROXY_WORKER_IN_ERROR;
+        ctx->worker->s->error_time = apr_time_now();
+    }
+
+    /* Same as proxy_handler(), the error status is what post_request
+     * should see, r->status is the response of the backend otherwise.
+     */
+    if (status != OK && status != DONE) {
+        saved_status = r->status;
+        r->status = status;
+        access_status = ap_proxy_post_request(ctx->worker, ctx->balancer,
+                                              r, ctx->conf);
+        if (r->status == status) {
+            r->status = saved_status;
+        }
+    }
+    else {
+        access_status = ap_proxy_post_request(ctx->worker, ctx->balancer,
+                                              r, ctx->conf);
+    }
+
+    return access_status;
+}
+
 /* DEPRECATED */
 PROXY_DECLARE(int) ap_proxy_connect_to_backend(apr_socket_t **newsock,
                                                const char *proxy_function,
@@ -2739,6 +2849,59 @@ static APR_INLINE void worker_address_set(proxy_worker *worker,
     }
 }
 
+/* Interleave the address families of a resolved list, starting with the
+ * one preferred by the resolver and keeping its order within each family
+ * (RFC 8305 section 4), so that connect attempts alternate families.
+ */
+static void proxy_addrs_interleave(apr_sockaddr_t **paddr)
+{
+    apr_sockaddr_t *addr = *paddr, *same = NULL, *other = NULL;
+    apr_sockaddr_t **psame = &same, **pother = &other, **tail = paddr;
+    int family;
+
+    if (!addr || !addr->next) {
+        return;
+    }
+    family = addr->family;
+    for (; addr; addr = addr->next) {
+        if (addr->family == family) {
+            *psame = addr;
+            psame = &addr->next;
+        }
+        else {
+            *pother = addr;
+            pother = &addr->next;
+        }
+    }
+    *psame = *pother = NULL;
+
+    while (same || other) {
+        if (same) {
+            *tail = same;
+            tail = &same->next;
+            same = same->next;
+        }
+        if (other) {
+            *tail = other;
+            tail = &other->next;
+            other = other->next;
+        }
+    }
+    *tail = NULL;
+}
+
+/* Whether the addresses from addr on are of different families */
+static int proxy_addrs_mixed(const apr_sockaddr_t *addr)
+{
+    const apr_sockaddr_t *pos;
+    for (pos = addr->next; pos; pos = pos->next) {
+        if (pos->family != addr->family) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static apr_status_t worker_address_resolve(proxy_worker *worker,
                                            apr_sockaddr_t **paddr,
                                            const char *hostname,
@@ -2773,6 +2936,7 @@ static apr_status_t worker_address_resolve(proxy_worker *worker,
         apr_pool_destroy(pool);
         return rv;
     }
+    proxy_addrs_interleave(paddr);
 
     if (r ? APLOGrdebug(r) : APLOGdebug(s)) {
         char *addrs = NULL;
@@ -2820,6 +2984,96 @@ static int proxy_addrs_equal(const apr_sockaddr_t *addr1,
     return 1;
 }
 
+/* Whether the worker's address needs to be resolved again by the caller.
+ * When addresses are refreshed in the background, an expired address is
+ * still used until the refresh is late by more than the TTL.
+ */
+static APR_INLINE int worker_address_expired(proxy_worker *worker,
+                                             proxy_address *address,
+                                             apr_uint32_t now)
+{
+    apr_uint32_t expiry = apr_atomic_read32(&address->expiry);
+    if (expiry > now) {
+        return 0;
+    }
+    return !address_refresh
+           || now - expiry >= (apr_uint32_t)worker->s->address_ttl;
+}
+
+/* Next expiry of the worker's address after now. We keep each worker's
+ * expiry date shared accross all the children so that they update their
+ * address at the same time, regardless of whether a specific child forced
+ * an address to expire at some point (for connect() issues).
+ */
+static apr_uint32_t worker_address_expiry(proxy_worker *worker,
+                                          apr_uint32_t now)
+{
+    apr_uint32_t ttl = (apr_uint32_t)worker->s->address_ttl;
+    apr_uint32_t expiry = apr_atomic_read32(&worker->s->address_expiry);
+    while (expiry <= now) {
+        apr_uint32_t next = expiry + ttl, prev;
+        while (next <= now) {
+            next += ttl;
+        }
+        prev = apr_atomic_cas32(&worker->s->address_expiry, next, expiry);
+        /* race lost? retry with the winner's (which should be ahead) */
+        expiry = (prev == expiry) ? next : prev;
+    }
+    return expiry;
+}
+
+/* Make addr the worker's new address.
+ * XXX: Call when PROXY_THREAD_LOCK()ed only!
+ */
+static proxy_address *worker_address_publish(proxy_worker *worker,
+                                             apr_sockaddr_t *addr,
+                                             const char *hostname,
+                                             apr_port_t hostport,
+                                             apr_uint32_t now)
+{
+    proxy_address *address;
+
+    address = apr_pcalloc(addr->pool, sizeof(*address));
+    address->hostname = apr_pstrdup(addr->pool, hostname);
+    address->hostport = hostport;
+    address->addr = addr;
+
+    if (worker->s->address_ttl > 0) {
+        address->expiry = worker_address_expiry(worker, now);
+    }
+    else {
+        /* Never expires */
+        address->expiry = APR_UINT32_MAX;
+    }
+
+    /* One ref is for worker->address in any case */
+    if (worker->address || worker->cp->addr) {
+        apr_atomic_set32(&address->refcount, 1);
+    }
+    else {
+        /* Set worker->cp->addr once for compat with third-party
+         * modules. This addr never changed before and can't change
+         * underneath users now because of some TTL configuration.
+         * So we take one more ref for worker->cp->addr to remain
+         * allocated forever (though it might not be up to date..).
+         * Modules should use conn->addr instead of worker->cp-addr
+         * to get the actual address used by each conn, determined
+         * at connect() time.
+         */
+        apr_atomic_set32(&address->refcount, 2);
+        worker->cp->addr = address->addr;
+    }
+
+    /* Publish the changes. The old worker address (if any) is no
+     * longer used by this worker, it will be destroyed now if the
+     * worker is the last user (refcount == 1) or by the last conn
+     * using it (refcount > 1).
+     */
+    worker_address_set(worker, address);
+
+    return address;
+}
+
 PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_function,
                                                        proxy_conn_rec *conn,
                                                        const char *hostname,
@@ -2864,6 +3118,7 @@ PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_functio
             }
             return rv;
         }
+        proxy_addrs_interleave(&conn->addr);
     }
     else {
         apr_sockaddr_t *addr = NULL;
@@ -2918,14 +3173,14 @@ PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_functio
         }
         if (!address
             || conn->address != address
-            || apr_atomic_read32(&address->expiry) <= now) {
+            || worker_address_expired(worker, address, now)) {
             PROXY_THREAD_LOCK(worker);
 
             /* Re-check while locked, might be a new address already */
             if (!addr) {
                 address = worker_address_get(worker);
             }
-            if (!address || apr_atomic_read32(&address->expiry) <= now) {
+            if (!address || worker_address_expired(worker, address, now)) {
                 if (!addr) {
                     rv = worker_address_resolve(worker, &addr,
                                                 hostname, hostport,
@@ -2941,59 +3196,8 @@ PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_functio
                     now = apr_time_sec(apr_time_now() - *proxy_start_time);
                 }
 
-                address = apr_pcalloc(addr->pool, sizeof(*address));
-                address->hostname = apr_pstrdup(addr->pool, hostname);
-                address->hostport = hostport;
-                address->addr = addr;
-
-                if (ttl > 0) {
-                    /* We keep each worker's expiry date shared accross all the
-                     * children so that they update their address at the same
-                     * time, regardless of whether a specific child forced an
-                     * address to expire at some point (for connect() issues).
-                     */
-                    address->expiry = apr_atomic_read32(&worker->s->address_expiry);
-                    if (address->expiry <= now) {
-                        apr_uint32_t new_expiry = address->expiry + ttl;
-                        while (new_expiry <= now) {
-                            new_expiry += ttl;
-                        }
-                        new_expiry = apr_atomic_cas32(&worker->s->address_expiry,
-                                                      new_expiry, address->expiry);
-                        /* race lost? well the expiry should grow anyway.. */
-                        AP_DEBUG_ASSERT(new_expiry > now);
-                        address->expiry = new_expiry;
-                    }
-                }
-                else {
-                    /* Never expires */
-                    address->expiry = APR_UINT32_MAX;
-                }
-
-                /* One ref is for worker->address in any case */
-                if (worker->address || worker->cp->addr) {
-                    apr_atomic_set32(&address->refcount, 1);
-                }
-                else {
-                    /* Set worker->cp->addr once for compat with third-party
-                     * modules. This addr never changed before and can't change
-                     * underneath users now because of some TTL configuration.
-                     * So we take one more ref for worker->cp->addr to remain
-                     * allocated forever (though it might not be up to date..).
-                     * Modules should use conn->addr instead of worker->cp-addr
-                     * to get the actual address used by each conn, determined
-                     * at connect() time.
-                     */
-                    apr_atomic_set32(&address->refcount, 2);
-                    worker->cp->addr = address->addr;
-                }
-
-                /* Publish the changes. The old worker address (if any) is no
-                 * longer used by this worker, it will be destroyed now if the
-                 * worker is the last user (refcount == 1) or by the last conn
-                 * using it (refcount > 1).
-                 */
-                worker_address_set(worker, address);
+                address = worker_address_publish(worker, addr, hostname,
+                                                 hostport, now);
             }
 
             /* Take the ref for conn->address (before dropping the mutex so to
@@ -3049,6 +3253,72 @@ PROXY_DECLARE(apr_status_t) ap_proxy_determine_address(const char *proxy_functio
     return APR_SUCCESS;
 }
 
+PROXY_DECLARE(apr_status_t) ap_proxy_refresh_worker_address(proxy_worker *worker,
+                                                           server_rec *s)
+{
+    proxy_address *address;
+    apr_sockaddr_t *addr = NULL;
+    apr_uint32_t now;
+    apr_status_t rv;
+
+    if (!worker->cp || !worker->s->is_address_reusable
+        || worker->s->address_ttl <= 0) {
+        return APR_ENOTIMPL;
+    }
+
+    /* From now on requests don't wait for expired addresses to resolve */
+    address_refresh = 1;
+
+    /* Refresh a bit ahead of the expiry, for the next call to be on time.
+     * TODO: use a monotonic clock here
+     */
+    now = apr_time_sec(apr_time_now() - *proxy_start_time) + 1;
+
+    /* Take a ref on the address to use its hostname unlocked. No address
+     * yet means no request used the worker, nothing to refresh.
+     */
+    PROXY_THREAD_LOCK(worker);
+    address = worker_address_get(worker);
+    if (address && apr_atomic_read32(&address->expiry) <= now) {
+        proxy_address_inc(address);
+    }
+    else {
+        address = NULL;
+    }
+    PROXY_THREAD_UNLOCK(worker);
+    if (!address) {
+        return APR_SUCCESS;
+    }
+
+    rv = worker_address_resolve(worker, &addr,
+                                address->hostname, address->hostport,
+                                "proxy", NULL, s);
+    if (rv == APR_SUCCESS) {
+        PROXY_THREAD_LOCK(worker);
+        if (worker_address_get(worker) != address) {
+            /* Changed meanwhile (connect() issue) */
+            apr_pool_destroy(addr->pool);
+        }
+        else if (proxy_addrs_equal(address->addr, addr)) {
+            /* Same address, the connections using it can be kept */
+            apr_atomic_set32(&address->expiry,
+                             worker_address_expiry(worker, now));
+            apr_pool_destroy(addr->pool);
+        }
+        else {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10532)
+                         "proxy: address of %s changed",
+                         address->hostname);
+            worker_address_publish(worker, addr, address->hostname,
+                                   address->hostport, now);
+        }
+        PROXY_THREAD_UNLOCK(worker);
+    }
+
+    proxy_address_dec(address);
+    return rv;
+}
+
 PROXY_DECLARE(int)
 ap_proxy_determine_connection(apr_pool_t *p, request_rec *r,
                               proxy_server_conf *conf,
@@ -3605,6 +3875,251 @@ PROXY_DECLARE(apr_status_t) ap_proxy_check_connection(const char *scheme,
     return rv;
 }
 
+/* How long a connect() attempt waits before the next address is tried
+ * along with it (RFC 8305's "Connection Attempt Delay").
+ */
+#define PROXY_CONNECT_ATTEMPT_DELAY apr_time_from_msec(250)
+
+static apr_interval_time_t proxy_connect_timeout(proxy_worker *worker,
+                                                 proxy_server_conf *conf,
+                                                 server_rec *s)
+{
+    if (worker->s->conn_timeout_set) {
+        return worker->s->conn_timeout;
+    }
+    if (worker->s->timeout_set) {
+        return worker->s->timeout;
+    }
+    if (conf->timeout_set) {
+        return conf->timeout;
+    }
+    return s->timeout;
+}
+
+/* Create a socket to connect backend_addr, with the options of the worker
+ * and the connect() timeout.
+ */
+static apr_status_t proxy_socket_create(apr_socket_t **newsock,
+                                        apr_sockaddr_t *backend_addr,
+                                        proxy_conn_rec *conn,
+                                        proxy_worker *worker,
+                                        proxy_server_conf *conf,
+                                        const char *proxy_function,
+                                        server_rec *s)
+{
+    apr_sockaddr_t *local_addr;
+    apr_status_t rv;
+
+    if ((rv = apr_socket_create(newsock, backend_addr->family,
+                                SOCK_STREAM, APR_PROTO_TCP,
+                                conn->scpool)) != APR_SUCCESS) {
+        int loglevel = backend_addr->next ? APLOG_DEBUG : APLOG_ERR;
+        ap_log_error(APLOG_MARK, loglevel, rv, s, APLOGNO(00952)
+                     "%s: error creating fam %d socket to %pI for "
+                     "(%s:%hu)",
+                     proxy_function,
+                     backend_addr->family, backend_addr,
+                     conn->hostname, conn->port);
+        return rv;
+    }
+
+    if (worker->s->recv_buffer_size > 0 &&
+        (rv = apr_socket_opt_set(*newsock, APR_SO_RCVBUF,
+                                 worker->s->recv_buffer_size))) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00953)
+                     "apr_socket_opt_set(SO_RCVBUF): Failed to set "
+                     "ProxyReceiveBufferSize, using default");
+    }
+
+    rv = apr_socket_opt_set(*newsock, APR_TCP_NODELAY, 1);
+    if (rv != APR_SUCCESS && rv != APR_ENOTIMPL) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00954)
+                     "apr_socket_opt_set(APR_TCP_NODELAY): "
+                     "Failed to set");
+    }
+
+    /* Set a timeout for connecting to the backend on the socket */
+    apr_socket_timeout_set(*newsock, proxy_connect_timeout(worker, conf, s));
+
+    /* Set a keepalive option */
+    if (worker->s->keepalive) {
+        if ((rv = apr_socket_opt_set(*newsock,
+                                     APR_SO_KEEPALIVE, 1)) != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00955)
+                         "apr_socket_opt_set(SO_KEEPALIVE): Failed to set"
+                         " Keepalive");
+        }
+    }
+    ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
+                 "%s: fam %d socket created for %pI (%s:%hu)",
+                 proxy_function, backend_addr->family, backend_addr,
+                 conn->hostname, conn->port);
+
+    if (conf->source_address_set) {
+        local_addr = apr_pmemdup(conn->scpool, conf->source_address,
+                                 sizeof(apr_sockaddr_t));
+        local_addr->pool = conn->scpool;
+        rv = apr_socket_bind(*newsock, local_addr);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00956)
+                         "%s: failed to bind socket to local address",
+                         proxy_function);
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+/* Connect the first of the addresses from *paddr on that answers. The next
+ * address is tried whenever the previous attempts did not succeed within
+ * PROXY_CONNECT_ATTEMPT_DELAY, without abandoning them (happy eyeballs, see
+ * RFC 8305). On success the socket is returned in *newsock and its address
+ * in *paddr, otherwise *paddr is NULL.
+ */
+static apr_status_t proxy_connect_race(apr_socket_t **newsock,
+                                       apr_sockaddr_t **paddr,
+                                       proxy_conn_rec *conn,
+                                       proxy_worker *worker,
+                                       proxy_server_conf *conf,
+                                       const char *proxy_function,
+                                       server_rec *s)
+{
+    apr_interval_time_t timeout = proxy_connect_timeout(worker, conf, s);
+    apr_time_t deadline = apr_time_now() + timeout;
+    apr_sockaddr_t *addr = *paddr, *pos;
+    apr_socket_t *sock = NULL;
+    apr_pollfd_t *pfds;
+    apr_status_t rv = APR_EGENERAL;
+    int npfds = 0, i;
+
+    for (i = 0, pos = addr; pos; pos = pos->next) {
+        ++i;
+    }
+    pfds = apr_pcalloc(conn->scpool, i * sizeof(*pfds));
+
+    *newsock = NULL;
+    *paddr = NULL;
+    while (!*newsock && (addr || npfds)) {
+        apr_interval_time_t wait;
+        apr_int32_t nsds;
+
+        if (addr) {
+            /* Start the next attempt */
+            rv = proxy_socket_create(&sock, addr, conn, worker, conf,
+                                     proxy_function, s);
+            if (rv == APR_SUCCESS) {
+                apr_socket_timeout_set(sock, 0);
+                rv = apr_socket_connect(sock, addr);
+                if (rv == APR_SUCCESS) {
+                    *newsock = sock;
+                    *paddr = addr;
+                    break;
+                }
+                if (APR_STATUS_IS_EINPROGRESS(rv)) {
+                    pfds[npfds].p = conn->scpool;
+                    pfds[npfds].desc_type = APR_POLL_SOCKET;
+                    pfds[npfds].reqevents = APR_POLLOUT;
+                    pfds[npfds].rtnevents = 0;
+                    pfds[npfds].desc.s = sock;
+                    pfds[npfds].client_data = addr;
+                    ++npfds;
+                }
+                else {
+                    ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(10533)
+                                 "%s: attempt to connect to %pI (%s:%hu) failed",
+                                 proxy_function, addr,
+                                 conn->hostname, conn->port);
+                    apr_socket_close(sock);
+                }
+            }
+            addr = addr->next;
+            if (!npfds) {
+                continue;
+            }
+        }
+
+        wait = deadline - apr_time_now();
+        if (wait <= 0) {
+            rv = APR_TIMEUP;
+            break;
+        }
+        if (addr && wait > PROXY_CONNECT_ATTEMPT_DELAY) {
+            wait = PROXY_CONNECT_ATTEMPT_DELAY;
+        }
+        rv = apr_poll(pfds, npfds, &nsds, wait);
+        if (rv != APR_SUCCESS) {
+            if (APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_EINTR(rv)) {
+                continue;
+            }
+            break;
+        }
+
+        for (i = 0; i < npfds;) {
+            if (!pfds[i].rtnevents) {
+                ++i;
+                continue;
+            }
+            /* Connecting again tells how the attempt ended */
+            pos = pfds[i].client_data;
+            rv = apr_socket_connect(pfds[i].desc.s, pos);
+            if (rv == APR_SUCCESS) {
+                *newsock = pfds[i].desc.s;
+                *paddr = pos;
+            }
+            else {
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(10534)
+                             "%s: attempt to connect to %pI (%s:%hu) failed",
+                             proxy_function, pos,
+                             conn->hostname, conn->port);
+                apr_socket_close(pfds[i].desc.s);
+            }
+            pfds[i] = pfds[--npfds];
+            if (*newsock) {
+                break;
+            }
+        }
+    }
+
+    /* Abandon the pending attempts */
+    for (i = 0; i < npfds; ++i) {
+        apr_socket_close(pfds[i].desc.s);
+    }
+
+    if (!*newsock) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10535)
+                     "%s: attempts to connect to %s:%hu failed",
+                     proxy_function, conn->hostname, conn->port);
+        return rv;
+    }
+    return APR_SUCCESS;
+}
+
+/* Increment a worker's shared (apr_size_t) counter, atomically since all
+ * the children update it, with the same scheme as the busy count.
+ */
+static void proxy_worker_count(apr_size_t *counter)
+{
+#if APR_SIZEOF_VOIDP == 4
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(apr_uint32_t));
+    apr_atomic_inc32((apr_uint32_t *)counter);
+#elif APR_VERSION_AT_LEAST(1,7,4) /* APR 64bit atomics not safe before 1.7.4 */
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(apr_uint64_t));
+    apr_atomic_inc64((apr_uint64_t *)counter);
+#else /* Use atomics for (64bit) pointers */
+    void *volatile *counter_p = (void *)counter;
+    apr_size_t val, old;
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(void*));
+    AP_DEBUG_ASSERT((apr_uintptr_t)counter_p % sizeof(void*) == 0);
+    val = (apr_uintptr_t)apr_atomic_casptr((void *)counter_p, NULL, NULL);
+    do {
+        old = val;
+        val = (apr_uintptr_t)apr_atomic_casptr((void *)counter_p,
+                                               (void *)(apr_uintptr_t)(val + 1),
+                                               (void *)(apr_uintptr_t)old);
+    } while (val != old);
+#endif
+}
+
 PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
                                             proxy_conn_rec *conn,
                                             proxy_worker *worker,
@@ -3614,12 +4129,11 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
     int loglevel;
     forward_info *forward = conn->forward;
     apr_sockaddr_t *backend_addr;
-    /* the local address to use for the outgoing connection */
-    apr_sockaddr_t *local_addr;
     apr_socket_t *newsock;
     void *sconf = s->module_config;
     int address_reusable = worker->s->is_address_reusable;
     int did_dns_lookup = 0;
+    int reused = 0;
     proxy_server_conf *conf =
         (proxy_server_conf *) ap_get_module_config(sconf, &proxy_module);
 
@@ -3627,6 +4141,29 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
     if (rv == APR_EINVAL) {
         return DECLINED;
     }
+    if (rv == APR_SUCCESS) {
+        reused = 1;
+    }
+    else if (address_reusable && !conn->forward
+             && proxy_run_fetch_connection(conn, s) == OK) {
+        /* An idle connection handed over by another process */
+        ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
+                     "%s: reusing brokered connection for (%s:%hu)",
+                     proxy_function, conn->hostname, conn->port);
+        if (worker->s->timeout_set) {
+            apr_socket_timeout_set(conn->sock, worker->s->timeout);
+        }
+        else if (conf->timeout_set) {
+            apr_socket_timeout_set(conn->sock, conf->timeout);
+        }
+        else {
+            apr_socket_timeout_set(conn->sock, s->timeout);
+        }
+        conn->connection = NULL;
+        proxy_worker_count(&worker->s->brokered);
+        reused = 1;
+        rv = APR_SUCCESS;
+    }
 
     /* We'll set conn->addr to the address actually connect()ed, so if the
      * network connection is not reused (per ap_proxy_check_connection()
@@ -3677,92 +4214,45 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
         else
 #endif
         {
-            if ((rv = apr_socket_create(&newsock, backend_addr->family,
-                                        SOCK_STREAM, APR_PROTO_TCP,
-                                        conn->scpool)) != APR_SUCCESS) {
-                loglevel = backend_addr->next ? APLOG_DEBUG : APLOG_ERR;
-                ap_log_error(APLOG_MARK, loglevel, rv, s, APLOGNO(00952)
-                             "%s: error creating fam %d socket to %pI for "
-                             "(%s:%hu)",
-                             proxy_function,
-                             backend_addr->family, backend_addr,
-                             conn->hostname, conn->port);
-                /*
-                 * this could be an IPv6 address from the DNS but the
-                 * local machine won't give us an IPv6 socket; hopefully the
-                 * DNS returned an additional address to try
-                 */
-                backend_addr = backend_addr->next;
-                continue;
-            }
             conn->connection = NULL;
 
-            if (worker->s->recv_buffer_size > 0 &&
-                (rv = apr_socket_opt_set(newsock, APR_SO_RCVBUF,
-                                         worker->s->recv_buffer_size))) {
-                ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00953)
-                             "apr_socket_opt_set(SO_RCVBUF): Failed to set "
-                             "ProxyReceiveBufferSize, using default");
-            }
-
-            rv = apr_socket_opt_set(newsock, APR_TCP_NODELAY, 1);
-            if (rv != APR_SUCCESS && rv != APR_ENOTIMPL) {
-                ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00954)
-                             "apr_socket_opt_set(APR_TCP_NODELAY): "
-                             "Failed to set");
-            }
-
-            /* Set a timeout for connecting to the backend on the socket */
-            if (worker->s->conn_timeout_set) {
-                apr_socket_timeout_set(newsock, worker->s->conn_timeout);
-            }
-            else if (worker->s->timeout_set) {
-                apr_socket_timeout_set(newsock, worker->s->timeout);
-            }
-            else if (conf->timeout_set) {
-                apr_socket_timeout_set(newsock, conf->timeout);
+            if (proxy_addrs_mixed(backend_addr)) {
+                /* Both IPv4 and IPv6 to try, don't wait for one family to
+                 * time out before trying the other.
+                 */
+                rv = proxy_connect_race(&newsock, &backend_addr, conn,
+                                        worker, conf, proxy_function, s);
             }
             else {
-                apr_socket_timeout_set(newsock, s->timeout);
-            }
-            /* Set a keepalive option */
-            if (worker->s->keepalive) {
-                if ((rv = apr_socket_opt_set(newsock,
-                                             APR_SO_KEEPALIVE, 1)) != APR_SUCCESS) {
-                    ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00955)
-                                 "apr_socket_opt_set(SO_KEEPALIVE): Failed to set"
-                                 " Keepalive");
+                rv = proxy_socket_create(&newsock, backend_addr, conn,
+                                         worker, conf, proxy_function, s);
+                if (rv != APR_SUCCESS) {
+                    /*
+                     * this could be an IPv6 address from the DNS but the
+                     * local machine won't give us an IPv6 socket; hopefully the
+                     * DNS returned an additional address to try
+                     */
+                    backend_addr = backend_addr->next;
+                    continue;
                 }
-            }
-            ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
-                         "%s: fam %d socket created for %pI (%s:%hu)",
-                         proxy_function, backend_addr->family, backend_addr,
-                         conn->hostname, conn->port);
 
-            if (conf->source_address_set) {
-                local_addr = apr_pmemdup(conn->scpool, conf->source_address,
-                                         sizeof(apr_sockaddr_t));
-                local_addr->pool = conn->scpool;
-                rv = apr_socket_bind(newsock, local_addr);
+                /* make the connection out of the socket */
+                rv = apr_socket_connect(newsock, backend_addr);
                 if (rv != APR_SUCCESS) {
-                    ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(00956)
-                                 "%s: failed to bind socket to local address",
-                                 proxy_function);
+                    apr_socket_close(newsock);
                 }
             }
 
-            /* make the connection out of the socket */
-            rv = apr_socket_connect(newsock, backend_addr);
-
             /* if an error occurred, loop round and try again */
             if (rv != APR_SUCCESS) {
-                apr_socket_close(newsock);
-                loglevel = backend_addr->next ? APLOG_DEBUG : APLOG_ERR;
-                ap_log_error(APLOG_MARK, loglevel, rv, s, APLOGNO(00957)
-                             "%s: attempt to connect to %pI (%s:%hu) failed",
-                             proxy_function, backend_addr,
-                             conn->hostname, conn->port);
-                backend_addr = backend_addr->next;
+                if (backend_addr) {
+                    loglevel = backend_addr->next ? APLOG_DEBUG : APLOG_ERR;
+                    ap_log_error(APLOG_MARK, loglevel, rv, s, APLOGNO(00957)
+                                 "%s: attempt to connect to %pI (%s:%hu) failed",
+                                 proxy_function, backend_addr,
+                                 conn->hostname, conn->port);
+                    backend_addr = backend_addr->next;
+                }
                 /*
                  * If we run out of resolved IP's when connecting and if
                  * we cache the resolution in the worker the resolution
@@ -3880,6 +4370,12 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
         socket_cleanup(conn);
         return DECLINED;
     }
+    if (reused) {
+        proxy_worker_count(&worker->s->reused);
+    }
+    else {
+        proxy_worker_count(&worker->s->connects);
+    }
     return OK;
 }
 
@@ -4267,24 +4763,24 @@ PROXY_DECLARE(apr_status_t) ap_proxy_sync_balancer(proxy_balancer *b, server_rec
             }
         }
         if (!found) {
-            proxy_worker **runtime;
+            proxy_worker *runtime;
             /* XXX: a thread mutex is maybe enough here */
             apr_global_mutex_lock(proxy_mutex);
-            runtime = apr_array_push(b->workers);
-            *runtime = apr_pcalloc(conf->pool, sizeof(proxy_worker));
+            runtime = apr_pcalloc(conf->pool, sizeof(proxy_worker));
             apr_global_mutex_unlock(proxy_mutex);
-            (*runtime)->hash = shm->hash;
-            (*runtime)->balancer = b;
-            (*runtime)->s = shm;
+            runtime->hash = shm->hash;
+            runtime->balancer = b;
+            runtime->s = shm;
 
-            rv = ap_proxy_initialize_worker(*runtime, s, conf->pool);
+            rv = ap_proxy_initialize_worker(runtime, s, conf->pool);
             if (rv != APR_SUCCESS) {
                 ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(00966) "Cannot init worker");
                 return rv;
             }
+            add_balancer_worker(b, runtime);
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(02403)
                          "grabbing shm[%d] (0x%pp) for worker: %s", i, (void *)shm,
-                         (*runtime)->s->name);
+                         runtime->s->name);
         }
     }
     if (b->s->need_reset) {
@@ -4917,6 +5413,230 @@ PROXY_DECLARE(int) ap_proxy_spool_input(request_rec *r,
     return OK;
 }
 
+#if PROXY_HAVE_SPLICE
+
+/* Don't bother splicing less than this, the pipe setup costs more */
+#define PROXY_SPLICE_MIN    (64 * 1024)
+/* The default capacity of a pipe */
+#define PROXY_SPLICE_CHUNK  (64 * 1024)
+
+static const char proxy_spliced_filter_name[] = "PROXY_SPLICED_IN";
+
+/* Once the body has been spliced, the request's input filters still
+ * expect it to be read. This filter is added on top of them to answer
+ * any later read (like ap_discard_request_body()'s) with EOS.
+ */
+static apr_status_t proxy_spliced_in_filter(ap_filter_t *f,
+                                            apr_bucket_brigade *bb,
+                                            ap_input_mode_t mode,
+                                            apr_read_type_e block,
+                                            apr_off_t readbytes)
+{
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(f->c->bucket_alloc));
+    return APR_SUCCESS;
+}
+
+/* The filters that pass the data through unchanged, any other filter
+ * is given the chance to see the data.
+ */
+static int proxy_splice_filter_ok(ap_filter_t *f)
+{
+    static const char *const names[] = {
+        "HTTP1_BODY_IN", "HTTP1_REQUEST_IN", "HTTP_IN",
+        "reqtimeout", "LOG_INPUT_OUTPUT", "LOGIO_TTFU_IN", "CORE_IN",
+        "CORE",
+        NULL
+    };
+    int i;
+
+    for (i = 0; names[i]; ++i) {
+        if (!ap_cstr_casecmp(f->frec->name, names[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Account spliced bytes to mod_logio, like the core filters would */
+static void proxy_splice_logio(conn_rec *c_i, conn_rec *c_o, apr_off_t len)
+{
+    static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_in) *add_bytes_in;
+    static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_out) *add_bytes_out;
+
+    if (len <= 0) {
+        return;
+    }
+    if (!add_bytes_in) {
+        add_bytes_in = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_in);
+        add_bytes_out = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_out);
+    }
+    if (add_bytes_in && c_i) {
+        add_bytes_in(c_i, len);
+    }
+    if (add_bytes_out && c_o) {
+        add_bytes_out(c_o, len);
+    }
+}
+
+/* Move up to len bytes from fd_in to fd_out (one of which is a pipe),
+ * waiting for sock (the other end, a socket) to be ready when needed.
+ */
+static apr_status_t proxy_splice(int fd_in, int fd_out, apr_size_t len,
+                                 apr_socket_t *sock, int for_read,
+                                 apr_size_t *moved)
+{
+    for (;;) {
+        ssize_t n = splice(fd_in, NULL, fd_out, NULL, len,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            *moved = (apr_size_t)n;
+            return APR_SUCCESS;
+        }
+        if (n == 0) {
+            return APR_EOF;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            return errno;
+        }
+        if (sock) {
+            apr_status_t rv;
+#if APR_MAJOR_VERSION < 2
+            rv = apr_wait_for_io_or_timeout(NULL, sock, for_read);
+#else
+            rv = apr_socket_wait(sock, for_read ? APR_WAIT_READ
+                                                : APR_WAIT_WRITE);
+#endif
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+    }
+}
+
+#endif /* PROXY_HAVE_SPLICE */
+
+PROXY_DECLARE(int) ap_proxy_can_splice_input(request_rec *r,
+                                             proxy_conn_rec *backend)
+{
+#if PROXY_HAVE_SPLICE
+    conn_rec *c = r->connection;
+    ap_filter_t *f;
+
+    if (r->main || c->master || backend->is_ssl || !backend->sock
+        || !ap_get_conn_socket(c) || ap_ssl_conn_is_ssl(c)
+        || r->input_filters != r->proto_input_filters
+        || apr_table_get(r->subprocess_env, "proxy-nosplice")) {
+        return 0;
+    }
+    if (r->expecting_100) {
+        /* HTTP_IN sends the 100 Continue on the first read, splicing
+         * would bypass it and leave the client waiting.
+         */
+        return 0;
+    }
+    for (f = r->proto_input_filters; f; f = f->next) {
+        if (!proxy_splice_filter_ok(f)) {
+            ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                          "proxy: not splicing request body through "
+                          "input filter %s", f->frec->name);
+            return 0;
+        }
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+PROXY_DECLARE(int) ap_proxy_splice_input(request_rec *r,
+                                         proxy_conn_rec *backend,
+                                         apr_off_t remaining)
+{
+#if PROXY_HAVE_SPLICE
+    conn_rec *c = r->connection;
+    apr_socket_t *csock = ap_get_conn_socket(c);
+    apr_bucket_brigade *bb;
+    apr_off_t spliced = 0;
+    apr_status_t rv = APR_SUCCESS;
+    int cfd, bfd, pfd[2], rc;
+
+    if (remaining < PROXY_SPLICE_MIN || ap_filter_input_pending(c) == OK) {
+        /* Too small or data buffered in the filters, read them first */
+        return DECLINED;
+    }
+
+    /* The body goes after whatever is pending for the backend */
+    bb = apr_brigade_create(r->pool, c->bucket_alloc);
+    rc = ap_proxy_pass_brigade(c->bucket_alloc, r, backend,
+                               backend->connection, bb, 1);
+    if (rc != OK) {
+        return rc;
+    }
+
+    if (pipe(pfd) < 0) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, errno, r, APLOGNO(10538)
+                      "proxy: can't create pipe to splice request body");
+        return DECLINED;
+    }
+    apr_os_sock_get(&cfd, csock);
+    apr_os_sock_get(&bfd, backend->sock);
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                  "proxy: splicing %" APR_OFF_T_FMT " bytes of request body "
+                  "to %pI", remaining, backend->addr);
+
+    while (spliced < remaining) {
+        apr_size_t len = PROXY_SPLICE_CHUNK, in_pipe, n;
+        if ((apr_off_t)len > remaining - spliced) {
+            len = (apr_size_t)(remaining - spliced);
+        }
+
+        rv = proxy_splice(cfd, pfd[1], len, csock, 1, &in_pipe);
+        if (rv != APR_SUCCESS) {
+            rc = ap_map_http_request_error(rv == APR_EOF ? APR_INCOMPLETE : rv,
+                                           HTTP_BAD_REQUEST);
+            break;
+        }
+        while (in_pipe) {
+            rv = proxy_splice(pfd[0], bfd, in_pipe, backend->sock, 0, &n);
+            if (rv != APR_SUCCESS) {
+                rc = APR_STATUS_IS_TIMEUP(rv) ? HTTP_GATEWAY_TIME_OUT
+                                              : HTTP_BAD_GATEWAY;
+                break;
+            }
+            in_pipe -= n;
+            spliced += n;
+            backend->worker->s->transferred += n;
+        }
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+    close(pfd[0]);
+    close(pfd[1]);
+
+    proxy_splice_logio(c, backend->connection, spliced);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10539)
+                      "splicing request body to %pI (%s) failed after "
+                      "%" APR_OFF_T_FMT " bytes", backend->addr,
+                      backend->hostname ? backend->hostname : "", spliced);
+        c->keepalive = AP_CONN_CLOSE;
+        backend->close = 1;
+        return rc;
+    }
+
+    /* Nothing left to read from the client for this request */
+    ap_add_input_filter(proxy_spliced_filter_name, NULL, r, c);
+    return OK;
+#else
+    return DECLINED;
+#endif
+}
+
 PROXY_DECLARE(int) ap_proxy_pass_brigade(apr_bucket_alloc_t *bucket_alloc,
                                          request_rec *r, proxy_conn_rec *p_conn,
                                          conn_rec *origin, apr_bucket_brigade *bb,
@@ -5257,8 +5977,17 @@ struct proxy_tunnel_conn {
     apr_off_t bytes_in,
               bytes_out;
 
+#if PROXY_HAVE_SPLICE
+    /* the pipe to splice this side's input through, and how many bytes
+     * it holds (not written to the other side yet) */
+    apr_file_t *pipe_rd,
+               *pipe_wr;
+    apr_size_t pipe_len;
+#endif
+
     unsigned int down_in:1,
-                 down_out:1;
+                 down_out:1,
+                 can_splice:1;
 };
 
 PROXY_DECLARE(apr_off_t) ap_proxy_tunnel_conn_bytes_in(
@@ -5508,6 +6237,40 @@ PROXY_DECLARE(void) ap_proxy_set_busy_count(proxy_worker *worker, apr_size_t to)
 #endif
 }
 
+PROXY_DECLARE(int) ap_proxy_add_lbstatus(proxy_worker *worker, int delta)
+{
+    apr_uint32_t val;
+
+    AP_DEBUG_ASSERT(sizeof(int) == sizeof(apr_uint32_t));
+    val = apr_atomic_add32((apr_uint32_t *)&worker->s->lbstatus,
+                           (apr_uint32_t)delta);
+
+    return (int)(val + (apr_uint32_t)delta);
+}
+
+PROXY_DECLARE(void) ap_proxy_increment_elected_count(proxy_worker *worker)
+{
+#if APR_SIZEOF_VOIDP == 4
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(apr_uint32_t));
+    apr_atomic_inc32(&worker->s->elected);
+#elif APR_VERSION_AT_LEAST(1,7,4) /* APR 64bit atomics not safe before 1.7.4 */
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(apr_uint64_t));
+    apr_atomic_inc64(&worker->s->elected);
+#else /* Use atomics for (64bit) pointers */
+    void *volatile *elected_p = (void *)&worker->s->elected;
+    apr_size_t val, old;
+    AP_DEBUG_ASSERT(sizeof(apr_size_t) == sizeof(void*));
+    AP_DEBUG_ASSERT((apr_uintptr_t)elected_p % sizeof(void*) == 0);
+    val = (apr_uintptr_t)apr_atomic_casptr((void *)elected_p, NULL, NULL);
+    do {
+        old = val;
+        val = (apr_uintptr_t)apr_atomic_casptr((void *)elected_p,
+                                               (void *)(apr_uintptr_t)(val + 1),
+                                               (void *)(apr_uintptr_t)old);
+    } while (val != old);
+#endif
+}
+
 static void add_pollset(apr_pollset_t *pollset, apr_pollfd_t *pfd,
                         apr_int16_t events)
 {
@@ -5561,6 +6324,141 @@ static void del_pollset(apr_pollset_t *pollset, apr_pollfd_t *pfd,
     }
 }
 
+#if PROXY_HAVE_SPLICE
+
+/* Whether the tunneled data can be spliced from one socket to the other,
+ * that is when nothing but the network filters (and no tunnel_forward
+ * hook) would see them.
+ */
+static int proxy_tunnel_can_splice(proxy_tunnel_rec *tunnel)
+{
+    apr_array_header_t *hooks = proxy_hook_get_tunnel_forward();
+    proxy_tunnel_conn_t *tc = tunnel->client;
+    ap_filter_t *f;
+    int i;
+
+    if ((hooks && hooks->nelts)
+        || tunnel->client->pfd->desc_type != APR_POLL_SOCKET
+        || apr_table_get(tunnel->r->subprocess_env, "proxy-nosplice")) {
+        return 0;
+    }
+    for (i = 0; i < 2; ++i, tc = tc->other) {
+        if (tc->c->master || ap_ssl_conn_is_ssl(tc->c)) {
+            return 0;
+        }
+        for (f = tc->c->input_filters; f; f = f->next) {
+            if (!proxy_splice_filter_ok(f)) {
+                return 0;
+            }
+        }
+        for (f = tc->c->output_filters; f; f = f->next) {
+            if (!proxy_splice_filter_ok(f)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* The splice() counterpart of proxy_transfer() for the tunnel, with the
+ * same return values: the data go from the input socket to a pipe and
+ * from the pipe to the output socket without being copied to userspace.
+ */
+static apr_status_t proxy_tunnel_splice(proxy_tunnel_rec *tunnel,
+                                        proxy_tunnel_conn_t *in)
+{
+    proxy_tunnel_conn_t *out = in->other;
+    unsigned int num_reads = 0;
+    apr_off_t len = 0;
+    int fd_i, fd_o, pipe_rd, pipe_wr;
+    apr_status_t rv;
+
+    if (!in->pipe_rd) {
+        rv = apr_file_pipe_create_ex(&in->pipe_rd, &in->pipe_wr,
+                                     APR_FULL_NONBLOCK, tunnel->r->pool);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, tunnel->r, APLOGNO(10540)
+                          "proxy: %s: can't create %s splice pipe",
+                          tunnel->scheme, in->name);
+            return rv;
+        }
+    }
+    apr_os_sock_get(&fd_i, in->pfd->desc.s);
+    apr_os_sock_get(&fd_o, out->pfd->desc.s);
+    apr_os_file_get(&pipe_rd, in->pipe_rd);
+    apr_os_file_get(&pipe_wr, in->pipe_wr);
+
+    for (;;) {
+        ssize_t n;
+
+        if (!in->pipe_len) {
+            /* Give the caller a chance to schedule the other direction */
+            if (++num_reads > PROXY_TRANSFER_MAX_READS) {
+                rv = APR_SUCCESS;
+                break;
+            }
+            n = splice(fd_i, NULL, pipe_wr, NULL, PROXY_SPLICE_CHUNK,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                rv = errno;
+                if (!APR_STATUS_IS_EAGAIN(rv)) {
+                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, tunnel->r,
+                                  APLOGNO(10541) "proxy: %s: can't splice "
+                                  "data from %s", tunnel->scheme, in->name);
+                    in->c->aborted = 1;
+                }
+                break;
+            }
+            if (n == 0) {
+                rv = APR_EOF;
+                break;
+            }
+            in->pipe_len = n;
+            in->bytes_in += n;
+        }
+
+        n = splice(pipe_rd, NULL, fd_o, NULL, in->pipe_len,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rv = errno;
+            if (APR_STATUS_IS_EAGAIN(rv)) {
+                /* Output full, wait for POLLOUT */
+                rv = APR_INCOMPLETE;
+            }
+            else {
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, tunnel->r,
+                              APLOGNO(10542) "proxy: %s: can't splice "
+                              "data to %s", tunnel->scheme, out->name);
+                out->c->aborted = 1;
+            }
+            break;
+        }
+        in->pipe_len -= n;
+        out->bytes_out += n;
+        len += n;
+    }
+
+    proxy_splice_logio(in->c, out->c, len);
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, rv, tunnel->r,
+                  "proxy: %s: spliced %" APR_OFF_T_FMT " bytes from %s "
+                  "(%" APR_SIZE_T_FMT " pending)", tunnel->scheme, len,
+                  in->name, in->pipe_len);
+
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+        rv = APR_SUCCESS;
+    }
+    return rv;
+}
+
+#endif /* PROXY_HAVE_SPLICE */
+
 static int proxy_tunnel_transfer(proxy_tunnel_rec *tunnel,
                                  proxy_tunnel_conn_t *in)
 {
@@ -5571,6 +6469,19 @@ static int proxy_tunnel_transfer(proxy_tunnel_rec *tunnel,
                   "proxy: %s: %s input ready",
                   tunnel->scheme, in->name);
 
+#if PROXY_HAVE_SPLICE
+    /* Splice once the data buffered in the filters are forwarded. Don't
+     * rely on ap_filter_should_yield() for the output side, it never
+     * yields for filters below AsyncFilter even though they may have set
+     * aside data, so ask (and try to flush) the pending filters directly.
+     */
+    if (in->can_splice && (in->pipe_len
+                       || (ap_filter_input_pending(in->c) != OK
+                           && ap_filter_output_pending(out->c) == DECLINED))) {
+        rv = proxy_tunnel_splice(tunnel, in);
+    }
+    else
+#endif
     rv = proxy_transfer(tunnel->r,
                         in->c, out->c,
                         in->bb, out->bb,
@@ -5648,6 +6559,14 @@ PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
                   scheme, timeout >= 0 ? (double)timeout / APR_USEC_PER_SEC
                                        : (double)-1.0);
 
+#if PROXY_HAVE_SPLICE
+    if (!client->can_splice && proxy_tunnel_can_splice(tunnel)) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                      "proxy: %s: splicing tunneled data", scheme);
+        client->can_splice = origin->can_splice = 1;
+    }
+#endif
+
     /* Loop until both directions of the connection are closed,
      * or a failure occurs.
      */
@@ -5819,6 +6738,12 @@ void proxy_util_register_hooks(apr_pool_t *p)
     APR_REGISTER_OPTIONAL_FN(ap_proxy_clear_connection);
     APR_REGISTER_OPTIONAL_FN(proxy_balancer_get_best_worker);
 
+#if PROXY_HAVE_SPLICE
+    ap_register_input_filter(proxy_spliced_filter_name,
+                             proxy_spliced_in_filter, NULL,
+                             AP_FTYPE_RESOURCE);
+#endif
+
     {
         apr_time_t *start_time = ap_retained_data_get("proxy_start_time");
         if (start_time == NULL) {
@@ -75,6 +75,23 @@ PROXY_DECLARE(apr_status_t) ap_proxy_decrement_busy_count(void *worker_);
  */
 PROXY_DECLARE(void) ap_proxy_increment_busy_count(proxy_worker *worker);
 
+/*
+ * atomically add to the lbstatus of the shared worker memory
+ *
+ * @param worker Pointer to the worker structure.
+ * @param delta value to add to lbstatus, possibly negative.
+ * @return      int the resulting lbstatus.
+ */
+PROXY_DECLARE(int) ap_proxy_add_lbstatus(proxy_worker *worker, int delta);
+
+/*
+ * increment the elected counter from the shared worker memory
+ *
+ * @param worker Pointer to the worker structure.
+ * @return      void
+ */
+PROXY_DECLARE(void) ap_proxy_increment_elected_count(proxy_worker *worker);
+
 /** @} */
 
 #endif /* PROXY_UTIL_H_ */
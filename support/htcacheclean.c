@@ -71,6 +71,11 @@
 
 #define DIRINFO (APR_FINFO_MTIME|APR_FINFO_SIZE|APR_FINFO_TYPE|APR_FINFO_LINK)
 
+#define INDEX_FILE    "htcacheclean.index"
+#define INDEX_MAGIC   0x49434348 /* "HCCI" */
+#define INDEX_VERSION 1
+#define JOURNAL_DELAY 100000    /* usecs, for writers to the renamed journal */
+
 typedef struct _direntry {
     APR_RING_ENTRY(_direntry) link;
     int type;         /* type of file/fileset: TEMP, HEADER, DATA, HEADERDATA */
@@ -92,6 +97,24 @@ typedef struct _entry {
     char *basename;           /* fileset base name */
 } ENTRY;
 
+/* the persistent index of the entries, maintained from the journal */
+typedef struct {
+    apr_uint32_t magic;
+    apr_uint32_t version;
+    apr_off_t nodes;          /* inodes used by the cache */
+    apr_off_t entries;        /* number of INDEXENTRY that follow */
+} INDEXHEADER;
+
+typedef struct {
+    apr_time_t expire;
+    apr_time_t response_time;
+    apr_time_t htime;
+    apr_time_t dtime;
+    apr_off_t hsize;
+    apr_off_t dsize;
+    apr_size_t name_len;      /* size of the base name that follows */
+} INDEXENTRY;
+
 
 static int delcount;    /* file deletion count for nice mode */
 static int interrupted; /* flag: true if SIGINT or SIGTERM occurred */
@@ -111,6 +134,10 @@ static apr_file_t *outfile;   /* stdout file handle */
 static apr_off_t unsolicited; /* file size summary for deleted unsolicited
                                  files */
 static ENTRY root; /* ENTRY ring anchor */
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *scan_mutex; /* guards root and unsolicited while
+                                          scanning with threads */
+#endif
 
 /* short program name as called */
 static const char *shortname = "htcacheclean";
@@ -589,9 +616,47 @@ static int list_urls(char *path, apr_pool_t *pool, apr_off_t round)
 }
 
 /*
- * walk the cache directory tree
+ * record an entry found while scanning
+ */
+static void add_entry(ENTRY *e)
+{
+#if APR_HAS_THREADS
+    if (scan_mutex) {
+        apr_thread_mutex_lock(scan_mutex);
+    }
+#endif
+    APR_RING_INSERT_TAIL(&root.link, e, _entry, link);
+#if APR_HAS_THREADS
+    if (scan_mutex) {
+        apr_thread_mutex_unlock(scan_mutex);
+    }
+#endif
+}
+
+/*
+ * account for unsolicited files deleted while scanning
  */
-static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
+static void add_unsolicited(apr_off_t size)
+{
+#if APR_HAS_THREADS
+    if (scan_mutex) {
+        apr_thread_mutex_lock(scan_mutex);
+    }
+#endif
+    unsolicited += size;
+#if APR_HAS_THREADS
+    if (scan_mutex) {
+        apr_thread_mutex_unlock(scan_mutex);
+    }
+#endif
+}
+
+/*
+ * walk the cache directory tree, leaving the subdirectories to the
+ * caller when subdirs is given
+ */
+static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes,
+                       apr_array_header_t *subdirs)
 {
     apr_dir_t *dir;
     apr_pool_t *p;
@@ -684,7 +749,11 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
         if (info.filetype == APR_DIR) {
             char *dirpath = apr_pstrdup(p, d->basename);
 
-            if (process_dir(d->basename, pool, nodes)) {
+            if (subdirs) {
+                APR_ARRAY_PUSH(subdirs, char *) = apr_pstrdup(pool, dirpath);
+                continue;
+            }
+            if (process_dir(d->basename, pool, nodes, NULL)) {
                 return 1;
             }
             /* When given the -t option htcacheclean does not
@@ -782,7 +851,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                                                &len) == APR_SUCCESS) {
                             apr_file_close(fd);
                             e = apr_palloc(pool, sizeof(ENTRY));
-                            APR_RING_INSERT_TAIL(&root.link, e, _entry, link);
+                            add_entry(e);
                             e->expire = disk_info.expire;
                             e->response_time = disk_info.response_time;
                             e->htime = d->htime;
@@ -844,8 +913,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
             if (realclean || d->htime < current - deviation
                 || d->htime > current + deviation) {
                 delete_entry(path, d->basename, nodes, p);
-                unsolicited += d->hsize;
-                unsolicited += d->dsize;
+                add_unsolicited(d->hsize + d->dsize);
             }
             break;
 
@@ -898,7 +966,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
                                                &len) == APR_SUCCESS) {
                             apr_file_close(fd);
                             e = apr_palloc(pool, sizeof(ENTRY));
-                            APR_RING_INSERT_TAIL(&root.link, e, _entry, link);
+                            add_entry(e);
                             e->expire = disk_info.expire;
                             e->response_time = disk_info.response_time;
                             e->htime = d->htime;
@@ -926,7 +994,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
             if (realclean || d->htime < current - deviation
                 || d->htime > current + deviation) {
                 delete_entry(path, d->basename, nodes, p);
-                unsolicited += d->hsize;
+                add_unsolicited(d->hsize);
             }
             break;
 
@@ -935,7 +1003,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
             if (realclean || d->dtime < current - deviation
                 || d->dtime > current + deviation) {
                 delete_entry(path, d->basename, nodes, p);
-                unsolicited += d->dsize;
+                add_unsolicited(d->dsize);
             }
             break;
 
@@ -944,7 +1012,7 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
          */
         case TEMP:
             delete_file(path, d->basename, nodes, p);
-            unsolicited += d->dsize;
+            add_unsolicited(d->dsize);
             break;
         }
     }
@@ -967,12 +1035,25 @@ static int process_dir(char *path, apr_pool_t *pool, apr_off_t *nodes)
 }
 
 /*
- * purge cache entries
+ * order entries oldest first
  */
-static void purge(char *path, apr_pool_t *pool, apr_off_t max,
+static int oldest_first(const void *a, const void *b)
+{
+    const ENTRY *e1 = *(const ENTRY * const *)a;
+    const ENTRY *e2 = *(const ENTRY * const *)b;
+
+    return (e1->dtime > e2->dtime) - (e1->dtime < e2->dtime);
+}
+
+/*
+ * purge cache entries, returning the number of inodes left
+ */
+static apr_off_t purge(char *path, apr_pool_t *pool, apr_off_t max,
         apr_off_t inodes, apr_off_t nodes, apr_off_t round)
 {
-    ENTRY *e, *n, *oldest;
+    ENTRY *e, *n;
+    apr_array_header_t *oldest;
+    int i;
 
     struct stats s;
     s.sum = 0;
@@ -998,7 +1079,7 @@ static void purge(char *path, apr_pool_t *pool, apr_off_t max,
 
     if ((!s.max || s.sum <= s.max) && (!s.inodes || s.nodes <= s.inodes)) {
         printstats(path, &s);
-        return;
+        return s.nodes;
     }
 
     /* process all entries with a timestamp in the future, this may
@@ -1019,14 +1100,14 @@ static void purge(char *path, apr_pool_t *pool, apr_off_t max,
                 if (!interrupted) {
                     printstats(path, &s);
                 }
-                return;
+                return s.nodes;
             }
         }
         e = n;
     }
 
     if (interrupted) {
-        return;
+        return s.nodes;
     }
 
     /* process all entries which are expired */
@@ -1044,44 +1125,389 @@ static void purge(char *path, apr_pool_t *pool, apr_off_t max,
                 if (!interrupted) {
                     printstats(path, &s);
                 }
-                return;
+                return s.nodes;
             }
         }
         e = n;
     }
 
     if (interrupted) {
-         return;
+         return s.nodes;
     }
 
-    /* process remaining entries oldest to newest, the check for an empty
-     * ring actually isn't necessary except when the compiler does
-     * corrupt 64bit arithmetics which happened to me once, so better safe
-     * than sorry
+    /* process remaining entries oldest to newest, sorted once rather
+     * than searching the ring for the oldest entry at each deletion
      */
-    while (!((!s.max || s.sum <= s.max) && (!s.inodes || s.nodes <= s.inodes))
-            && !interrupted && !APR_RING_EMPTY(&root.link, _entry, link)) {
-        oldest = APR_RING_FIRST(&root.link);
-
-        for (e = APR_RING_NEXT(oldest, link);
-             e != APR_RING_SENTINEL(&root.link, _entry, link);
-             e = APR_RING_NEXT(e, link)) {
-            if (e->dtime < oldest->dtime) {
-                oldest = e;
-            }
-        }
+    oldest = apr_array_make(pool, (int)s.entries, sizeof(ENTRY *));
+    for (e = APR_RING_FIRST(&root.link);
+         e != APR_RING_SENTINEL(&root.link, _entry, link);
+         e = APR_RING_NEXT(e, link)) {
+        APR_ARRAY_PUSH(oldest, ENTRY *) = e;
+    }
+    qsort(oldest->elts, oldest->nelts, sizeof(ENTRY *), oldest_first);
+
+    for (i = 0; i < oldest->nelts
+            && !((!s.max || s.sum <= s.max) && (!s.inodes || s.nodes <= s.inodes))
+            && !interrupted; ++i) {
+        e = APR_ARRAY_IDX(oldest, i, ENTRY *);
 
-        delete_entry(path, oldest->basename, &s.nodes, pool);
-        s.sum -= round_up((apr_size_t)oldest->hsize, round);
-        s.sum -= round_up((apr_size_t)oldest->dsize, round);
+        delete_entry(path, e->basename, &s.nodes, pool);
+        s.sum -= round_up((apr_size_t)e->hsize, round);
+        s.sum -= round_up((apr_size_t)e->dsize, round);
         s.entries--;
         s.dfresh++;
-        APR_RING_REMOVE(oldest, link);
+        APR_RING_REMOVE(e, link);
     }
 
     if (!interrupted) {
         printstats(path, &s);
     }
+
+    return s.nodes;
+}
+
+#if APR_HAS_THREADS
+typedef struct {
+    apr_array_header_t *subdirs; /* the subdirectories of the root */
+    int next;                    /* the next one to walk */
+    int failed;
+    apr_off_t nodes;
+} SCAN;
+
+typedef struct {
+    SCAN *scan;
+    apr_pool_t *pool;            /* of the entries found by this thread */
+} SCANNER;
+
+static void * APR_THREAD_FUNC scan_thread(apr_thread_t *thd, void *data)
+{
+    SCANNER *scanner = data;
+    SCAN *scan = scanner->scan;
+    apr_off_t nodes = 0;
+    char *dir, *dirpath;
+
+    while (1) {
+        apr_thread_mutex_lock(scan_mutex);
+        if (scan->failed || interrupted
+            || scan->next >= scan->subdirs->nelts) {
+            apr_thread_mutex_unlock(scan_mutex);
+            break;
+        }
+        dir = APR_ARRAY_IDX(scan->subdirs, scan->next++, char *);
+        apr_thread_mutex_unlock(scan_mutex);
+
+        dirpath = apr_pstrdup(scanner->pool, dir);
+        if (process_dir(dir, scanner->pool, &nodes, NULL)) {
+            apr_thread_mutex_lock(scan_mutex);
+            scan->failed = 1;
+            apr_thread_mutex_unlock(scan_mutex);
+            break;
+        }
+        if (deldirs && !dryrun) {
+            apr_dir_remove(dirpath, scanner->pool);
+        }
+    }
+
+    apr_thread_mutex_lock(scan_mutex);
+    scan->nodes += nodes;
+    apr_thread_mutex_unlock(scan_mutex);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+#endif
+
+/*
+ * walk the whole cache, the subdirectories of the root being shared
+ * by the given number of threads
+ */
+static int scan_dir(char *path, apr_pool_t *pool, apr_off_t *nodes,
+                    int threads)
+{
+#if APR_HAS_THREADS
+    apr_thread_t **thds;
+    SCANNER *scanners;
+    SCAN scan;
+    apr_status_t status;
+    int i, started;
+
+    if (threads <= 1) {
+        return process_dir(path, pool, nodes, NULL);
+    }
+
+    memset(&scan, 0, sizeof(scan));
+    scan.subdirs = apr_array_make(pool, 256, sizeof(char *));
+    if (process_dir(path, pool, nodes, scan.subdirs)) {
+        return 1;
+    }
+
+    if (apr_thread_mutex_create(&scan_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                pool) != APR_SUCCESS) {
+        return 1;
+    }
+    thds = apr_pcalloc(pool, threads * sizeof(apr_thread_t *));
+    scanners = apr_pcalloc(pool, threads * sizeof(SCANNER));
+    for (i = 0, started = 0; i < threads; ++i) {
+        scanners[i].scan = &scan;
+        apr_pool_create(&scanners[i].pool, pool);
+        if (apr_thread_create(&thds[i], NULL, scan_thread, &scanners[i],
+                              pool) == APR_SUCCESS) {
+            started++;
+        }
+        else {
+            thds[i] = NULL;
+        }
+    }
+    if (!started) {
+        scan.failed = 1;
+    }
+    for (i = 0; i < threads; ++i) {
+        if (thds[i]) {
+            apr_thread_join(&status, thds[i]);
+        }
+    }
+    apr_thread_mutex_destroy(scan_mutex);
+    scan_mutex = NULL;
+
+    *nodes += scan.nodes;
+    return scan.failed || interrupted;
+#else
+    return process_dir(path, pool, nodes, NULL);
+#endif
+}
+
+/*
+ * read the index saved by the previous run
+ */
+static apr_status_t read_index(char *path, apr_pool_t *pool,
+                               apr_off_t *nodes, apr_hash_t *entries)
+{
+    apr_file_t *fd;
+    apr_status_t status;
+    INDEXHEADER header;
+    INDEXENTRY ie;
+    ENTRY *e;
+    apr_off_t i;
+
+    status = apr_file_open(&fd, apr_pstrcat(pool, path, "/", INDEX_FILE, NULL),
+                           APR_FOPEN_READ | APR_FOPEN_BINARY
+                           | APR_FOPEN_BUFFERED, APR_OS_DEFAULT, pool);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+
+    status = apr_file_read_full(fd, &header, sizeof(header), NULL);
+    if (status == APR_SUCCESS && (header.magic != INDEX_MAGIC
+                                  || header.version != INDEX_VERSION)) {
+        status = APR_EGENERAL;
+    }
+
+    for (i = 0; status == APR_SUCCESS && i < header.entries; ++i) {
+        status = apr_file_read_full(fd, &ie, sizeof(ie), NULL);
+        if (status != APR_SUCCESS) {
+            break;
+        }
+        if (!ie.name_len || ie.name_len > APR_PATH_MAX) {
+            status = APR_EGENERAL;
+            break;
+        }
+        e = apr_palloc(pool, sizeof(ENTRY));
+        e->expire = ie.expire;
+        e->response_time = ie.response_time;
+        e->htime = ie.htime;
+        e->dtime = ie.dtime;
+        e->hsize = ie.hsize;
+        e->dsize = ie.dsize;
+        e->basename = apr_palloc(pool, ie.name_len + 1);
+        status = apr_file_read_full(fd, e->basename, ie.name_len, NULL);
+        e->basename[ie.name_len] = '\0';
+        APR_RING_INSERT_TAIL(&root.link, e, _entry, link);
+        apr_hash_set(entries, e->basename, ie.name_len, e);
+    }
+
+    apr_file_close(fd);
+
+    if (status != APR_SUCCESS) {
+        APR_RING_INIT(&root.link, _entry, link);
+        apr_hash_clear(entries);
+        return status;
+    }
+
+    *nodes = header.nodes;
+    return APR_SUCCESS;
+}
+
+/*
+ * save the entries left after purging for the next run
+ */
+static apr_status_t write_index(char *path, apr_pool_t *pool,
+                                apr_off_t nodes)
+{
+    apr_file_t *fd;
+    apr_status_t status;
+    INDEXHEADER header;
+    INDEXENTRY ie;
+    ENTRY *e;
+    char *index, *temp;
+
+    index = apr_pstrcat(pool, path, "/", INDEX_FILE, NULL);
+    temp = apr_pstrcat(pool, index, ".tmp", NULL);
+
+    status = apr_file_open(&fd, temp, APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                           | APR_FOPEN_TRUNCATE | APR_FOPEN_BINARY
+                           | APR_FOPEN_BUFFERED, APR_OS_DEFAULT, pool);
+    if (status != APR_SUCCESS) {
+        apr_file_remove(index, pool);
+        return status;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.nodes = nodes;
+    for (e = APR_RING_FIRST(&root.link);
+         e != APR_RING_SENTINEL(&root.link, _entry, link);
+         e = APR_RING_NEXT(e, link)) {
+        header.entries++;
+    }
+    status = apr_file_write_full(fd, &header, sizeof(header), NULL);
+
+    for (e = APR_RING_FIRST(&root.link);
+         status == APR_SUCCESS
+         && e != APR_RING_SENTINEL(&root.link, _entry, link);
+         e = APR_RING_NEXT(e, link)) {
+        memset(&ie, 0, sizeof(ie));
+        ie.expire = e->expire;
+        ie.response_time = e->response_time;
+        ie.htime = e->htime;
+        ie.dtime = e->dtime;
+        ie.hsize = e->hsize;
+        ie.dsize = e->dsize;
+        ie.name_len = strlen(e->basename);
+        status = apr_file_write_full(fd, &ie, sizeof(ie), NULL);
+        if (status == APR_SUCCESS) {
+            status = apr_file_write_full(fd, e->basename, ie.name_len, NULL);
+        }
+    }
+
+    if (status == APR_SUCCESS) {
+        status = apr_file_close(fd);
+    }
+    else {
+        apr_file_close(fd);
+    }
+    if (status == APR_SUCCESS) {
+        status = apr_file_rename(temp, index, pool);
+    }
+    if (status != APR_SUCCESS) {
+        /* a stale index would miss changes, have the next run rebuild it */
+        apr_file_remove(temp, pool);
+        apr_file_remove(index, pool);
+    }
+
+    return status;
+}
+
+/*
+ * apply the changes recorded by mod_cache_disk to the entries
+ */
+static void replay_journal(const char *journal, apr_pool_t *pool,
+                           apr_off_t *nodes, apr_hash_t *entries)
+{
+    apr_file_t *fd;
+    disk_cache_journal_t rec;
+    ENTRY *e;
+    char *name;
+
+    if (apr_file_open(&fd, journal, APR_FOPEN_READ | APR_FOPEN_BINARY
+                      | APR_FOPEN_BUFFERED, APR_OS_DEFAULT,
+                      pool) != APR_SUCCESS) {
+        return;
+    }
+
+    /* stop at the first record which does not look right, a partial
+     * write being only possible at the end
+     */
+    while (!interrupted
+           && apr_file_read_full(fd, &rec, sizeof(rec), NULL) == APR_SUCCESS
+           && rec.format == JOURNAL_FORMAT_VERSION
+           && rec.name_len && rec.name_len <= APR_PATH_MAX) {
+        name = apr_palloc(pool, rec.name_len + 1);
+        if (apr_file_read_full(fd, name, rec.name_len, NULL) != APR_SUCCESS) {
+            break;
+        }
+        name[rec.name_len] = '\0';
+
+        e = apr_hash_get(entries, name, rec.name_len);
+        switch (rec.type) {
+        case JOURNAL_STORE:
+            if (!e) {
+                e = apr_palloc(pool, sizeof(ENTRY));
+                e->basename = name;
+                APR_RING_INSERT_TAIL(&root.link, e, _entry, link);
+                apr_hash_set(entries, e->basename, rec.name_len, e);
+                *nodes += rec.dsize ? 2 : 1;
+            }
+            e->expire = rec.expire;
+            e->response_time = rec.response_time;
+            e->htime = rec.time;
+            e->dtime = rec.time;
+            e->hsize = rec.hsize;
+            e->dsize = rec.dsize;
+            break;
+
+        case JOURNAL_REMOVE:
+            if (e) {
+                APR_RING_REMOVE(e, link);
+                apr_hash_set(entries, e->basename, rec.name_len, NULL);
+                *nodes -= e->dsize ? 2 : 1;
+            }
+            break;
+        }
+    }
+
+    apr_file_close(fd);
+}
+
+/*
+ * load the entries from the index and the journal, walking the cache
+ * only when there is no usable index
+ */
+static int load_entries(char *path, apr_pool_t *pool, apr_off_t *nodes,
+                        int threads)
+{
+    apr_hash_t *entries;
+    apr_finfo_t finfo;
+    char *journal, *old;
+
+    journal = apr_pstrcat(pool, path, "/", CACHE_JOURNAL_FILE, NULL);
+    old = apr_pstrcat(pool, journal, ".old", NULL);
+
+    /* take the journal away from the writers before reading the index,
+     * unless the previous run could not finish with it
+     */
+    if (apr_stat(&finfo, old, APR_FINFO_TYPE, pool) != APR_SUCCESS
+        && apr_file_rename(journal, old, pool) == APR_SUCCESS) {
+        apr_sleep(JOURNAL_DELAY);
+    }
+
+    entries = apr_hash_make(pool);
+    if (realclean || read_index(path, pool, nodes, entries) != APR_SUCCESS) {
+        /* the walk sees all that the journal recorded */
+        *nodes = 0;
+        if (scan_dir(path, pool, nodes, threads)) {
+            return 1;
+        }
+    }
+    else {
+        replay_journal(old, pool, nodes, entries);
+        if (interrupted) {
+            return 1;
+        }
+    }
+
+    apr_file_remove(old, pool);
+    return 0;
 }
 
 static apr_status_t remove_directory(apr_pool_t *pool, const char *dir)
@@ -1282,8 +1708,9 @@ static void usage(const char *error)
     }
     apr_file_printf(errfile,
     "%s -- program for cleaning the disk cache."                             NL
-    "Usage: %s [-Dvtrn] -pPATH [-lLIMIT] [-LLIMIT] [-PPIDFILE]"              NL
-    "       %s [-nti] -dINTERVAL -pPATH [-lLIMIT] [-LLIMIT] [-PPIDFILE]"     NL
+    "Usage: %s [-Dvtrnj] [-TTHREADS] -pPATH [-lLIMIT] [-LLIMIT] [-PPIDFILE]" NL
+    "       %s [-ntij] [-TTHREADS] -dINTERVAL -pPATH [-lLIMIT] [-LLIMIT]"    NL
+    "          [-PPIDFILE]"                                                  NL
     "       %s [-Dvt] -pPATH URL ..."                                        NL
                                                                              NL
     "Options:"                                                               NL
@@ -1328,6 +1755,14 @@ static void usage(const char *error)
     "       the disk cache. This option is only possible together with the"  NL
     "       -d option."                                                      NL
                                                                              NL
+    "  -j   Be incremental. The entries are kept in an index in PATH,"       NL
+    "       updated from the journal written by mod_cache_disk when"         NL
+    "       CacheJournal is on, and the cache is only walked when the index" NL
+    "       is missing or with the -r option."                               NL
+                                                                             NL
+    "  -T   Walk the cache with THREADS threads, each one taking the next"   NL
+    "       subdirectory of PATH."                                           NL
+                                                                             NL
     "  -a   List the URLs currently stored in the cache. Variants of the"    NL
     "       same URL will be listed once for each variant."                  NL
                                                                              NL
@@ -1393,6 +1828,7 @@ int main(int argc, const char * const argv[])
     apr_finfo_t info;
     apr_file_t *pidfile;
     int retries, isdaemon, limit_found, inodes_found, intelligent, dowork;
+    int incremental, threads;
     char opt;
     const char *arg;
     char *proxypath, *path, *pidfilename;
@@ -1411,6 +1847,8 @@ int main(int argc, const char * const argv[])
     benice = 0;
     deldirs = 0;
     intelligent = 0;
+    incremental = 0;
+    threads = 0;
     previous = 0; /* avoid compiler warning */
     proxypath = NULL;
     pidfilename = NULL;
@@ -1436,7 +1874,7 @@ int main(int argc, const char * const argv[])
     apr_getopt_init(&o, pool, argc, argv);
 
     while (1) {
-        status = apr_getopt(o, "iDnvrtd:l:L:p:P:R:aA", &opt, &arg);
+        status = apr_getopt(o, "iDnvrtjd:l:L:p:P:R:T:aA", &opt, &arg);
         if (status == APR_EOF) {
             break;
         }
@@ -1454,6 +1892,29 @@ int main(int argc, const char * const argv[])
                 intelligent = 1;
                 break;
 
+            case 'j':
+                if (incremental) {
+                    usage_repeated_arg(pool, opt);
+                }
+                incremental = 1;
+                break;
+
+            case 'T':
+                if (threads) {
+                    usage_repeated_arg(pool, opt);
+                }
+                threads = atoi(arg);
+                if (threads < 1) {
+                    usage(apr_psprintf(pool, "Invalid number of threads: %s"
+                                             APR_EOL_STR APR_EOL_STR, arg));
+                }
+#if !APR_HAS_THREADS
+                if (threads > 1) {
+                    usage("Option -T needs threads, which are not available");
+                }
+#endif
+                break;
+
             case 'D':
                 if (dryrun) {
                     usage_repeated_arg(pool, opt);
@@ -1635,6 +2096,9 @@ int main(int argc, const char * const argv[])
         if (intelligent) {
             usage("Option -i cannot be used with URL arguments, aborting");
         }
+        if (incremental) {
+            usage("Option -j cannot be used with URL arguments, aborting");
+        }
         if (limit_found) {
             usage("Option -l and -L cannot be used with URL arguments, aborting");
         }
@@ -1768,8 +2232,13 @@ int main(int argc, const char * const argv[])
 
         if (dowork && !interrupted) {
             apr_off_t nodes = 0;
-            if (!process_dir(path, instance, &nodes) && !interrupted) {
-                purge(path, instance, max, inodes, nodes, round);
+            if (!(incremental ? load_entries(path, instance, &nodes, threads)
+                              : scan_dir(path, instance, &nodes, threads))
+                && !interrupted) {
+                nodes = purge(path, instance, max, inodes, nodes, round);
+                if (incremental && !dryrun) {
+                    write_index(path, instance, nodes);
+                }
             }
             else if (!isdaemon && !interrupted) {
                 apr_file_printf(errfile, "An error occurred, cache cleaning "
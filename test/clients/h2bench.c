@@ -0,0 +1,1109 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* h2bench: a small HTTP/2 load generator for the mod_http2 test suite.
+ *
+ * Opens a number of cleartext (prior knowledge) HTTP/2 connections to
+ * a server and keeps a configurable number of streams in flight on each
+ * of them until the requested number of requests has been done. Reports
+ * stream throughput, per-stream latency percentiles and goodput, either
+ * as text or as a JSON object for consumption by the test scripts.
+ */
+
+#include <apr.h>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#ifdef APR_HAVE_UNISTD_H
+#  include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#ifdef APR_HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+#include <sys/types.h>
+#include <sys/time.h>
+#ifdef APR_HAVE_SYS_SOCKET_H
+#  include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+#ifdef APR_HAVE_NETDB_H
+#  include <netdb.h>
+#endif /* HAVE_NETDB_H */
+#ifdef APR_HAVE_NETINET_IN_H
+#  include <netinet/in.h>
+#endif /* HAVE_NETINET_IN_H */
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <nghttp2/nghttp2.h>
+
+#define MAKE_NV_CS(NAME, VALUE)                                                \
+  {                                                                            \
+    (uint8_t *)NAME, (uint8_t *)VALUE, sizeof(NAME) - 1, strlen(VALUE),        \
+        NGHTTP2_NV_FLAG_NONE                                                   \
+  }
+
+#define BENCH_MAX_WEIGHTS   16
+#define BENCH_MAX_CONNS     1024
+
+static int verbose;
+static const char *cmd;
+
+static void log_out(const char *level, const char *where, const char *msg)
+{
+    struct timespec tp;
+    struct tm tm;
+    char timebuf[128];
+
+    clock_gettime(CLOCK_REALTIME, &tp);
+    localtime_r(&tp.tv_sec, &tm);
+    strftime(timebuf, sizeof(timebuf)-1, "%H:%M:%S", &tm);
+    fprintf(stderr, "[%s.%09lu][%s][%s] %s\n", timebuf, tp.tv_nsec, level, where, msg);
+}
+
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+static void log_errf(const char *where, const char *msg, ...)
+{
+    char buffer[8*1024];
+    va_list ap;
+
+    va_start(ap, msg);
+    vsnprintf(buffer, sizeof(buffer), msg, ap);
+    va_end(ap);
+    log_out("ERROR", where, buffer);
+}
+
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+static void log_infof(const char *where, const char *msg, ...)
+{
+    if (verbose) {
+        char buffer[8*1024];
+        va_list ap;
+
+        va_start(ap, msg);
+        vsnprintf(buffer, sizeof(buffer), msg, ap);
+        va_end(ap);
+        log_out("INFO", where, buffer);
+    }
+}
+
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+static void log_debugf(const char *where, const char *msg, ...)
+{
+    if (verbose > 1) {
+        char buffer[8*1024];
+        va_list ap;
+
+        va_start(ap, msg);
+        vsnprintf(buffer, sizeof(buffer), msg, ap);
+        va_end(ap);
+        log_out("DEBUG", where, buffer);
+    }
+}
+
+static uint64_t now_usec(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000 + (uint64_t)(tp.tv_nsec / 1000);
+}
+
+static int parse_host_port(const char **phost, uint16_t *pport,
+                           int *pipv6, size_t *pconsumed,
+                           const char *s, size_t len, uint16_t def_port)
+{
+    size_t i, offset=0;
+    char *host = NULL;
+    int port = 0;
+    int rv = 1, ipv6 = 0;
+
+    if (!len)
+        goto leave;
+    if (s[offset] == '[') {
+        ipv6 = 1;
+        for (i = offset++; i < len; ++i) {
+            if (s[i] == ']')
+              break;
+        }
+        if (i >= len || i == offset)
+            goto leave;
+        host = strndup(s + offset, i - offset);
+        offset = i + 1;
+    }
+    else {
+        for (i = offset; i < len; ++i) {
+            if (strchr(":/?#", s[i]))
+              break;
+        }
+        if (i == offset) {
+            log_debugf("parse_uri", "empty host name in '%.*s", (int)len, s);
+            goto leave;
+        }
+        host = strndup(s + offset, i - offset);
+        offset = i;
+    }
+    if (offset < len && s[offset] == ':') {
+        port = 0;
+        ++offset;
+        for (i = offset; i < len; ++i) {
+            if (strchr("/?#", s[i]))
+                break;
+            if (s[i] < '0' || s[i] > '9') {
+                log_debugf("parse_uri", "invalid port char '%c'", s[i]);
+                goto leave;
+            }
+            port *= 10;
+            port += s[i] - '0';
+            if (port > 65535) {
+                log_debugf("parse_uri", "invalid port number '%d'", port);
+                goto leave;
+            }
+        }
+        offset = i;
+    }
+    rv = 0;
+
+leave:
+    *phost = rv? NULL : host;
+    *pport = rv? 0 : (port? (uint16_t)port : def_port);
+    if (pipv6)
+      *pipv6 = ipv6;
+    if (pconsumed)
+      *pconsumed = offset;
+    return rv;
+}
+
+struct uri {
+  const char *scheme;
+  const char *host;
+  const char *authority;
+  const char *path;
+  uint16_t port;
+  int ipv6;
+};
+
+static int parse_uri(struct uri *uri, const char *s, size_t len)
+{
+    char tmp[8192];
+    size_t n, offset = 0;
+    uint16_t def_port = 0;
+    int rv = 1;
+
+    /* NOT A REAL URI PARSER */
+    memset(uri, 0, sizeof(*uri));
+    if (len > 7 && !memcmp("http://", s, 7)) {
+        uri->scheme = "http";
+        def_port = 80;
+        offset = 7;
+    }
+    else {
+        /* not a scheme we process, TLS is not supported */
+        goto leave;
+    }
+
+    if (parse_host_port(&uri->host, &uri->port, &uri->ipv6, &n, s + offset,
+                        len - offset, def_port))
+        goto leave;
+    offset += n;
+
+    if (uri->port == def_port)
+      uri->authority = uri->host;
+    else if (uri->ipv6) {
+      snprintf(tmp, sizeof(tmp), "[%s]:%u", uri->host, uri->port);
+      uri->authority = strdup(tmp);
+    }
+    else {
+      snprintf(tmp, sizeof(tmp), "%s:%u", uri->host, uri->port);
+      uri->authority = strdup(tmp);
+    }
+
+    uri->path = (offset < len)? strndup(s + offset, len - offset) : "/";
+    rv = 0;
+
+leave:
+    return rv;
+}
+
+static int sock_nonblock_nodelay(int fd) {
+  int flags, rv;
+  int val = 1;
+
+  while ((flags = fcntl(fd, F_GETFL, 0)) == -1 && errno == EINTR)
+      ;
+  if (flags == -1) {
+      log_errf("sock_nonblock_nodelay", "fcntl get error %d (%s)",
+               errno, strerror(errno));
+      return -1;
+  }
+  while ((rv = fcntl(fd, F_SETFL, flags | O_NONBLOCK)) == -1 && errno == EINTR)
+    ;
+  if (rv == -1) {
+      log_errf("sock_nonblock_nodelay", "fcntl set error %d (%s)",
+               errno, strerror(errno));
+      return -1;
+  }
+  rv = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, (socklen_t)sizeof(val));
+  if (rv == -1) {
+      log_errf("sock_nonblock_nodelay", "set nodelay error %d (%s)",
+               errno, strerror(errno));
+      return -1;
+  }
+  return 0;
+}
+
+static int open_connection(const char *host, uint16_t port)
+{
+    char service[NI_MAXSERV];
+    struct addrinfo hints;
+    struct addrinfo *res = NULL, *rp;
+    int rv, fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    snprintf(service, sizeof(service), "%u", port);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    rv = getaddrinfo(host, service, &hints, &res);
+    if (rv) {
+      log_errf("getaddrinfo", "%s", gai_strerror(rv));
+      goto leave;
+    }
+
+    for (rp = res; rp; rp = rp->ai_next) {
+      fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+      if (fd == -1) {
+        continue;
+      }
+      while ((rv = connect(fd, rp->ai_addr, rp->ai_addrlen)) == -1 &&
+             errno == EINTR)
+        ;
+      if (!rv) /* connected */
+          break;
+      close(fd);
+      fd = -1;
+    }
+
+leave:
+    if (res)
+      freeaddrinfo(res);
+    return fd;
+}
+
+/* benchmark configuration, as given on the command line */
+struct bench_conf {
+    struct uri uri;
+    const char *connect_host;
+    uint16_t connect_port;
+    int connections;          /* number of connections to open */
+    int max_streams;          /* max concurrent streams per connection */
+    long requests;            /* total number of requests to do */
+    size_t header_size;       /* size of an additional request header */
+    size_t body_size;         /* size of request body, 0 for GET */
+    int weights[BENCH_MAX_WEIGHTS]; /* stream weights to cycle through */
+    int nweights;
+    int timeout_secs;         /* max duration of the run, 0 for none */
+    int json;                 /* output results as JSON */
+};
+
+/* results of the run */
+struct bench_stats {
+    uint64_t *latencies;      /* usec, in order of completion */
+    int *lat_class;           /* weight index of the completed stream */
+    long completed;
+    long submitted;
+    long succeeded;
+    long failed;
+    long lost;                /* in flight on a connection that failed */
+    long retried;
+    long connects;
+    long status[6];           /* counts by status class, 1xx-5xx */
+    uint64_t bytes_recv;      /* response body bytes */
+    uint64_t bytes_sent;      /* request body bytes */
+};
+
+static struct bench_conf conf;
+static struct bench_stats stats;
+static char *pad_value;
+static volatile sig_atomic_t interrupted;
+
+#define IO_WANT_NONE   0
+#define IO_WANT_READ   1
+#define IO_WANT_WRITE  2
+
+struct bench_conn {
+    int id;
+    int fd;
+    nghttp2_session *ngh2;
+    int active;               /* streams in flight */
+    int want_io;
+    unsigned closed : 1;
+};
+
+struct bench_stream {
+    struct bench_conn *conn;
+    int32_t id;
+    int weight_idx;
+    int http_status;
+    size_t body_remain;
+    uint64_t start_usec;
+};
+
+static void stream_done(struct bench_stream *stream, uint32_t error_code)
+{
+    uint64_t end = now_usec();
+
+    if (error_code == NGHTTP2_REFUSED_STREAM) {
+        /* server did not process the request, it is safe to do again
+         * and does not count towards the result */
+        log_debugf("stream done", "stream %d refused, retrying", stream->id);
+        --stats.submitted;
+        ++stats.retried;
+        return;
+    }
+    stats.latencies[stats.completed] = end - stream->start_usec;
+    stats.lat_class[stats.completed] = stream->weight_idx;
+    ++stats.completed;
+    if (error_code || stream->http_status < 100) {
+        log_debugf("stream done", "stream %d failed, error=%u",
+                   stream->id, error_code);
+        ++stats.failed;
+    }
+    else {
+        ++stats.succeeded;
+        ++stats.status[stream->http_status / 100];
+    }
+}
+
+static ssize_t conn_send(nghttp2_session *ngh2, const uint8_t *data,
+                         size_t length, int flags, void *user_data)
+{
+    struct bench_conn *conn = user_data;
+    ssize_t nwritten;
+    (void)ngh2;
+    (void)flags;
+
+    conn->want_io = IO_WANT_NONE;
+    nwritten = send(conn->fd, data, length, 0);
+    if (nwritten < 0) {
+      int err = errno;
+      if ((EWOULDBLOCK == err) || (EAGAIN == err) ||
+          (EINTR == err) || (EINPROGRESS == err)) {
+          conn->want_io = IO_WANT_WRITE;
+          return NGHTTP2_ERR_WOULDBLOCK;
+      }
+      log_errf("conn send", "error sending %ld bytes: %d (%s)",
+               (long)length, err, strerror(err));
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    return nwritten;
+}
+
+static ssize_t conn_recv(nghttp2_session *ngh2, uint8_t *buf,
+                         size_t length, int flags, void *user_data)
+{
+    struct bench_conn *conn = user_data;
+    ssize_t nread;
+    (void)ngh2;
+    (void)flags;
+
+    conn->want_io = IO_WANT_NONE;
+    nread = recv(conn->fd, buf, length, 0);
+    if (nread < 0) {
+      int err = errno;
+      if ((EWOULDBLOCK == err) || (EAGAIN == err) || (EINTR == err)) {
+          conn->want_io = IO_WANT_READ;
+          return NGHTTP2_ERR_WOULDBLOCK;
+      }
+      log_errf("conn recv", "error reading %ld bytes: %d (%s)",
+               (long)length, err, strerror(err));
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    else if (nread == 0) {
+      return NGHTTP2_ERR_EOF;
+    }
+    return nread;
+}
+
+static int conn_on_frame_send(nghttp2_session *ngh2,
+                              const nghttp2_frame *frame, void *user_data)
+{
+    struct bench_stream *stream;
+    (void)user_data;
+
+    if (frame->hd.type == NGHTTP2_HEADERS) {
+        stream = nghttp2_session_get_stream_user_data(ngh2,
+                                                      frame->hd.stream_id);
+        if (stream) {
+            /* latency is measured from the request leaving, not from the
+             * time it got queued in our session */
+            stream->start_usec = now_usec();
+        }
+    }
+    return 0;
+}
+
+static int conn_on_header(nghttp2_session *ngh2, const nghttp2_frame *frame,
+                          const uint8_t *name, size_t namelen,
+                          const uint8_t *value, size_t valuelen,
+                          uint8_t flags, void *user_data)
+{
+    struct bench_stream *stream;
+    (void)flags;
+    (void)user_data;
+
+    if (frame->hd.type != NGHTTP2_HEADERS)
+        return 0;
+    stream = nghttp2_session_get_stream_user_data(ngh2, frame->hd.stream_id);
+    if (stream && namelen == 7 && !strncmp(":status", (const char *)name, 7)) {
+        stream->http_status = 0;
+        if (valuelen == 3) {
+            stream->http_status = (value[0] - '0') * 100
+                                  + (value[1] - '0') * 10 + (value[2] - '0');
+        }
+        if (stream->http_status < 100 || stream->http_status >= 600) {
+            log_errf("on header recv", "stream=%d, invalid :status: %.*s",
+                     frame->hd.stream_id, (int)valuelen, value);
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+    }
+    return 0;
+}
+
+static int conn_on_data_chunk_recv(nghttp2_session *ngh2, uint8_t flags,
+                                   int32_t stream_id, const uint8_t *data,
+                                   size_t len, void *user_data)
+{
+    (void)ngh2;
+    (void)flags;
+    (void)stream_id;
+    (void)data;
+    (void)user_data;
+    stats.bytes_recv += len;
+    return 0;
+}
+
+static int conn_on_stream_close(nghttp2_session *ngh2, int32_t stream_id,
+                                uint32_t error_code, void *user_data)
+{
+    struct bench_conn *conn = user_data;
+    struct bench_stream *stream;
+
+    stream = nghttp2_session_get_stream_user_data(ngh2, stream_id);
+    if (stream) {
+        stream_done(stream, error_code);
+        nghttp2_session_set_stream_user_data(ngh2, stream_id, NULL);
+        --conn->active;
+        free(stream);
+    }
+    return 0;
+}
+
+static ssize_t stream_read_req_body(nghttp2_session *ngh2, int32_t stream_id,
+                                    uint8_t *buf, size_t buflen,
+                                    uint32_t *pflags,
+                                    nghttp2_data_source *source,
+                                    void *user_data)
+{
+    struct bench_stream *stream = source->ptr;
+    size_t len;
+    (void)ngh2;
+    (void)stream_id;
+    (void)user_data;
+
+    len = (stream->body_remain < buflen)? stream->body_remain : buflen;
+    memset(buf, 'x', len);
+    stream->body_remain -= len;
+    stats.bytes_sent += len;
+    if (!stream->body_remain)
+        *pflags |= NGHTTP2_DATA_FLAG_EOF;
+    return (ssize_t)len;
+}
+
+static void conn_close(struct bench_conn *conn)
+{
+    if (conn->ngh2) {
+        nghttp2_session_del(conn->ngh2);
+        conn->ngh2 = NULL;
+    }
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    conn->closed = 1;
+}
+
+static int conn_open(struct bench_conn *conn)
+{
+    nghttp2_session_callbacks *cbs = NULL;
+    nghttp2_settings_entry settings[3];
+    int rv = -1;
+
+    conn->fd = open_connection(conf.connect_host, conf.connect_port);
+    conn->ngh2 = NULL;
+    conn->active = 0;
+    conn->want_io = IO_WANT_NONE;
+    conn->closed = 0;
+    if (conn->fd < 0) {
+      log_errf(cmd, "could not connect to %s:%u",
+               conf.connect_host, conf.connect_port);
+      goto leave;
+    }
+    if (sock_nonblock_nodelay(conn->fd))
+        goto leave;
+    ++stats.connects;
+
+    rv = nghttp2_session_callbacks_new(&cbs);
+    if (rv) {
+        log_errf("setup callbacks", "error_code=%d, msg=%s", rv,
+                 nghttp2_strerror(rv));
+        rv = -1;
+        goto leave;
+    }
+    nghttp2_session_callbacks_set_send_callback(cbs, conn_send);
+    nghttp2_session_callbacks_set_recv_callback(cbs, conn_recv);
+    nghttp2_session_callbacks_set_on_frame_send_callback(
+        cbs, conn_on_frame_send);
+    nghttp2_session_callbacks_set_on_header_callback(cbs, conn_on_header);
+    nghttp2_session_callbacks_set_on_stream_close_callback(
+        cbs, conn_on_stream_close);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+        cbs, conn_on_data_chunk_recv);
+    rv = nghttp2_session_client_new(&conn->ngh2, cbs, conn);
+    if (rv) {
+        log_errf("client new", "error_code=%d, msg=%s", rv,
+                 nghttp2_strerror(rv));
+        rv = -1;
+        goto leave;
+    }
+
+    settings[0].settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    settings[0].value = 100;
+    settings[1].settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    settings[1].value = 10 * 1024 * 1024;
+    settings[2].settings_id = NGHTTP2_SETTINGS_ENABLE_PUSH;
+    settings[2].value = 0;
+    rv = nghttp2_submit_settings(conn->ngh2, NGHTTP2_FLAG_NONE, settings, 3);
+    if (rv) {
+        log_errf("submit settings", "error_code=%d, msg=%s", rv,
+                 nghttp2_strerror(rv));
+        rv = -1;
+        goto leave;
+    }
+    rv = nghttp2_session_set_local_window_size(conn->ngh2, NGHTTP2_FLAG_NONE,
+                                               0, 10 * 1024 * 1024);
+    if (rv) {
+        log_errf("set connection window size", "error_code=%d, msg=%s", rv,
+                 nghttp2_strerror(rv));
+        rv = -1;
+        goto leave;
+    }
+    log_infof(cmd, "conn %d connected to %s:%u", conn->id,
+              conf.connect_host, conf.connect_port);
+    rv = 0;
+
+leave:
+    if (cbs)
+        nghttp2_session_callbacks_del(cbs);
+    if (rv)
+        conn_close(conn);
+    return rv;
+}
+
+static int stream_submit(struct bench_conn *conn)
+{
+    struct bench_stream *stream;
+    nghttp2_priority_spec pri, *ppri = NULL;
+    nghttp2_data_provider provider, *req_body = NULL;
+    nghttp2_nv nva[8];
+    size_t nvlen = 0;
+    const char *method = conf.body_size? "POST" : "GET";
+    char clen[32];
+
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        log_errf("stream submit", "out of memory");
+        return -1;
+    }
+    stream->conn = conn;
+    stream->weight_idx = conf.nweights? (int)(stats.submitted % conf.nweights) : 0;
+    stream->body_remain = conf.body_size;
+
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS(":method", method);
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS(":scheme", conf.uri.scheme);
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS(":authority", conf.uri.authority);
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS(":path", conf.uri.path);
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS("user-agent", "mod_h2/h2bench-test");
+    nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS("accept", "*/*");
+    if (conf.body_size) {
+        snprintf(clen, sizeof(clen), "%lu", (unsigned long)conf.body_size);
+        nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS("content-length", clen);
+        provider.read_callback = stream_read_req_body;
+        provider.source.ptr = stream;
+        req_body = &provider;
+    }
+    if (pad_value) {
+        nva[nvlen++] = (nghttp2_nv)MAKE_NV_CS("x-h2bench-pad", pad_value);
+    }
+    if (conf.nweights) {
+        nghttp2_priority_spec_init(&pri, 0, conf.weights[stream->weight_idx], 0);
+        ppri = &pri;
+    }
+
+    stream->start_usec = now_usec();
+    stream->id = nghttp2_submit_request(conn->ngh2, ppri, nva, nvlen,
+                                        req_body, stream);
+    if (stream->id < 0) {
+        log_errf("stream submit", "nghttp2_submit_request: error %d (%s)",
+                 stream->id, nghttp2_strerror(stream->id));
+        free(stream);
+        return -1;
+    }
+    ++conn->active;
+    ++stats.submitted;
+    log_debugf("stream submit", "conn %d, stream %d opened",
+               conn->id, stream->id);
+    return 0;
+}
+
+/* Keep as many streams in flight on the connection as we and the
+ * server allow. */
+static int conn_fill(struct bench_conn *conn)
+{
+    uint32_t remote_max;
+    int max_streams = conf.max_streams;
+
+    remote_max = nghttp2_session_get_remote_settings(
+        conn->ngh2, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+    if (remote_max < (uint32_t)max_streams)
+        max_streams = (int)remote_max;
+    while (conn->active < max_streams && stats.submitted < conf.requests
+           && nghttp2_session_check_request_allowed(conn->ngh2)) {
+        if (stream_submit(conn))
+            return -1;
+    }
+    return 0;
+}
+
+static int conn_io(struct bench_conn *conn)
+{
+    int rv;
+
+    rv = nghttp2_session_recv(conn->ngh2);
+    if (rv) {
+        if (rv != NGHTTP2_ERR_EOF)
+            log_errf("conn recv", "conn %d, error_code=%d, msg=%s",
+                     conn->id, rv, nghttp2_strerror(rv));
+        return -1;
+    }
+    if (conn_fill(conn))
+        return -1;
+    rv = nghttp2_session_send(conn->ngh2);
+    if (rv) {
+        log_errf("conn send", "conn %d, error_code=%d, msg=%s",
+                 conn->id, rv, nghttp2_strerror(rv));
+        return -1;
+    }
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x < y)? -1 : ((x > y)? 1 : 0);
+}
+
+struct lat_summary {
+    long count;
+    uint64_t min, max, mean, p50, p90, p99;
+};
+
+static uint64_t percentile(const uint64_t *sorted, long n, int p)
+{
+    long idx = (long)(((double)p * (double)n + 99.0) / 100.0) - 1;
+    if (idx < 0)
+        idx = 0;
+    if (idx >= n)
+        idx = n - 1;
+    return sorted[idx];
+}
+
+/* summarize the latencies of all completed streams in weight class
+ * `wclass`, or of all streams when `wclass` is negative. */
+static void lat_summarize(struct lat_summary *sum, int wclass)
+{
+    uint64_t *lat, total = 0;
+    long i, n = 0;
+
+    memset(sum, 0, sizeof(*sum));
+    lat = calloc(stats.completed? stats.completed : 1, sizeof(*lat));
+    for (i = 0; i < stats.completed; ++i) {
+        if (wclass < 0 || stats.lat_class[i] == wclass) {
+            lat[n++] = stats.latencies[i];
+            total += stats.latencies[i];
+        }
+    }
+    if (n > 0) {
+        qsort(lat, n, sizeof(*lat), cmp_u64);
+        sum->count = n;
+        sum->min = lat[0];
+        sum->max = lat[n - 1];
+        sum->mean = total / n;
+        sum->p50 = percentile(lat, n, 50);
+        sum->p90 = percentile(lat, n, 90);
+        sum->p99 = percentile(lat, n, 99);
+    }
+    free(lat);
+}
+
+static void print_lat_json(const struct lat_summary *sum)
+{
+    fprintf(stdout, "{\"min\": %" PRIu64 ", \"mean\": %" PRIu64
+            ", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+            ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 "}",
+            sum->min, sum->mean, sum->p50, sum->p90, sum->p99, sum->max);
+}
+
+static void print_results(uint64_t duration_usec)
+{
+    struct lat_summary all, wsum;
+    double secs = (double)duration_usec / 1000000.0;
+    double rps = secs > 0? (double)stats.completed / secs : 0.0;
+    double goodput = secs > 0? (double)stats.bytes_recv / secs : 0.0;
+    int i;
+
+    lat_summarize(&all, -1);
+    if (conf.json) {
+        fprintf(stdout, "{\n");
+        fprintf(stdout, "  \"url\": \"%s://%s%s\",\n",
+                conf.uri.scheme, conf.uri.authority, conf.uri.path);
+        fprintf(stdout, "  \"connections\": %d,\n", conf.connections);
+        fprintf(stdout, "  \"max_concurrent_streams\": %d,\n", conf.max_streams);
+        fprintf(stdout, "  \"header_size\": %lu,\n", (unsigned long)conf.header_size);
+        fprintf(stdout, "  \"body_size\": %lu,\n", (unsigned long)conf.body_size);
+        fprintf(stdout, "  \"requests\": {\"total\": %ld, \"completed\": %ld, "
+                "\"succeeded\": %ld, \"failed\": %ld, \"retried\": %ld},\n",
+                conf.requests, stats.completed, stats.succeeded,
+                stats.failed, stats.retried);
+        fprintf(stdout, "  \"status\": {\"1xx\": %ld, \"2xx\": %ld, "
+                "\"3xx\": %ld, \"4xx\": %ld, \"5xx\": %ld},\n",
+                stats.status[1], stats.status[2], stats.status[3],
+                stats.status[4], stats.status[5]);
+        fprintf(stdout, "  \"connects\": %ld,\n", stats.connects);
+        fprintf(stdout, "  \"duration_secs\": %.6f,\n", secs);
+        fprintf(stdout, "  \"streams_per_sec\": %.2f,\n", rps);
+        fprintf(stdout, "  \"bytes_received\": %" PRIu64 ",\n", stats.bytes_recv);
+        fprintf(stdout, "  \"bytes_sent\": %" PRIu64 ",\n", stats.bytes_sent);
+        fprintf(stdout, "  \"goodput_bytes_per_sec\": %.2f,\n", goodput);
+        fprintf(stdout, "  \"latency_usec\": ");
+        print_lat_json(&all);
+        fprintf(stdout, ",\n  \"weights\": [");
+        for (i = 0; i < conf.nweights; ++i) {
+            lat_summarize(&wsum, i);
+            fprintf(stdout, "%s\n    {\"weight\": %d, \"completed\": %ld, "
+                    "\"latency_usec\": ", i? "," : "",
+                    conf.weights[i], wsum.count);
+            print_lat_json(&wsum);
+            fprintf(stdout, "}");
+        }
+        fprintf(stdout, "%s]\n}\n", conf.nweights? "\n  " : "");
+    }
+    else {
+        fprintf(stdout, "requests: %ld total, %ld completed, %ld succeeded, "
+                "%ld failed, %ld retried\n", conf.requests, stats.completed,
+                stats.succeeded, stats.failed, stats.retried);
+        fprintf(stdout, "status codes: %ld 2xx, %ld 3xx, %ld 4xx, %ld 5xx\n",
+                stats.status[2], stats.status[3], stats.status[4],
+                stats.status[5]);
+        fprintf(stdout, "finished in %.3fs, %.2f streams/s, %.2f KB/s goodput\n",
+                secs, rps, goodput / 1024);
+        fprintf(stdout, "latency (us): min %" PRIu64 ", mean %" PRIu64
+                ", p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64
+                ", max %" PRIu64 "\n", all.min, all.mean, all.p50,
+                all.p90, all.p99, all.max);
+        for (i = 0; i < conf.nweights; ++i) {
+            lat_summarize(&wsum, i);
+            fprintf(stdout, "  weight %3d: %ld streams, p50 %" PRIu64
+                    ", p99 %" PRIu64 "\n", conf.weights[i], wsum.count,
+                    wsum.p50, wsum.p99);
+        }
+    }
+}
+
+static int parse_weights(const char *s)
+{
+    char *end;
+    long w;
+
+    conf.nweights = 0;
+    while (*s) {
+        if (conf.nweights >= BENCH_MAX_WEIGHTS)
+            return -1;
+        w = strtol(s, &end, 10);
+        if (end == s || w < 1 || w > 256)
+            return -1;
+        conf.weights[conf.nweights++] = (int)w;
+        s = end;
+        if (*s == ',')
+            ++s;
+        else if (*s)
+            return -1;
+    }
+    return conf.nweights? 0 : -1;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static void usage(const char *msg)
+{
+    if(msg)
+        fprintf(stderr, "%s\n", msg);
+    fprintf(stderr,
+        "usage: [options] http-uri\n"
+        "  run HTTP/2 (h2c, prior knowledge) requests against http-uri, options:\n"
+        "  -c host:port connect to host:port\n"
+        "  -C num     number of connections (default 1)\n"
+        "  -m num     max concurrent streams per connection (default 10)\n"
+        "  -n num     total number of requests (default 100)\n"
+        "  -H bytes   add a request header with a value of this size\n"
+        "  -d bytes   POST a request body of this size\n"
+        "  -w list    comma separated stream weights (1-256) to cycle through\n"
+        "  -t secs    give up after this many seconds (default 60)\n"
+        "  -j         write results as JSON\n"
+        "  -v         increase verbosity\n"
+    );
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_conn *conns;
+    struct pollfd *pfds;
+    int *pidx;
+    uint64_t start, end, deadline = 0;
+    int i, n, ch, rv = 0;
+
+    cmd = argv[0];
+    memset(&conf, 0, sizeof(conf));
+    conf.connections = 1;
+    conf.max_streams = 10;
+    conf.requests = 100;
+    conf.timeout_secs = 60;
+
+    while((ch = getopt(argc, argv, "c:C:d:H:jm:n:t:vw:h")) != -1) {
+        switch(ch) {
+        case 'c':
+            if (parse_host_port(&conf.connect_host, &conf.connect_port,
+                                NULL, NULL, optarg, strlen(optarg), 80)) {
+                log_errf(cmd, "could not parse connect '%s'", optarg);
+                return 1;
+            }
+            break;
+        case 'C':
+            conf.connections = atoi(optarg);
+            if (conf.connections < 1 || conf.connections > BENCH_MAX_CONNS) {
+                usage("invalid number of connections");
+                return 1;
+            }
+            break;
+        case 'd':
+            conf.body_size = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'H':
+            conf.header_size = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            conf.json = 1;
+            break;
+        case 'm':
+            conf.max_streams = atoi(optarg);
+            if (conf.max_streams < 1) {
+                usage("invalid number of concurrent streams");
+                return 1;
+            }
+            break;
+        case 'n':
+            conf.requests = atol(optarg);
+            if (conf.requests < 1) {
+                usage("invalid number of requests");
+                return 1;
+            }
+            break;
+        case 't':
+            conf.timeout_secs = atoi(optarg);
+            break;
+        case 'w':
+            if (parse_weights(optarg)) {
+                usage("invalid weight list");
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(NULL);
+            return 2;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        default:
+           usage("invalid option");
+           return 1;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1) {
+        usage("need URL");
+        return 1;
+    }
+    if (parse_uri(&conf.uri, argv[0], strlen(argv[0]))) {
+        log_errf(cmd, "could not parse uri '%s'", argv[0]);
+        return 1;
+    }
+    if (!conf.connect_host) {
+        conf.connect_host = conf.uri.host;
+        conf.connect_port = conf.uri.port;
+    }
+    if (conf.header_size) {
+        pad_value = malloc(conf.header_size + 1);
+        memset(pad_value, 'a', conf.header_size);
+        pad_value[conf.header_size] = 0;
+    }
+
+    stats.latencies = calloc(conf.requests, sizeof(*stats.latencies));
+    stats.lat_class = calloc(conf.requests, sizeof(*stats.lat_class));
+    conns = calloc(conf.connections, sizeof(*conns));
+    pfds = calloc(conf.connections, sizeof(*pfds));
+    pidx = calloc(conf.connections, sizeof(*pidx));
+    if (!stats.latencies || !stats.lat_class || !conns || !pfds || !pidx) {
+        log_errf(cmd, "out of memory");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+
+    start = now_usec();
+    if (conf.timeout_secs > 0)
+        deadline = start + (uint64_t)conf.timeout_secs * 1000000;
+    for (i = 0; i < conf.connections; ++i) {
+        conns[i].id = i;
+        conns[i].fd = -1;
+        if (conn_open(&conns[i]) || conn_io(&conns[i])) {
+            rv = 1;
+            goto leave;
+        }
+    }
+
+    while (stats.completed + stats.lost < conf.requests && !interrupted) {
+        if (deadline && now_usec() > deadline) {
+            log_errf(cmd, "timeout after %d seconds", conf.timeout_secs);
+            rv = 1;
+            break;
+        }
+        for (i = 0, n = 0; i < conf.connections; ++i) {
+            struct bench_conn *conn = &conns[i];
+            int want_read, want_write;
+
+            if (!conn->closed) {
+                want_read = (nghttp2_session_want_read(conn->ngh2) ||
+                             conn->want_io == IO_WANT_READ);
+                want_write = (nghttp2_session_want_write(conn->ngh2) ||
+                              conn->want_io == IO_WANT_WRITE);
+                if (!want_read && !want_write) {
+                    /* session is done, e.g. server sent GOAWAY */
+                    conn_close(conn);
+                }
+            }
+            if (conn->closed) {
+                if (stats.submitted >= conf.requests)
+                    continue;
+                /* replace connections that went away while work remains */
+                if (conn_open(conn) || conn_io(conn)) {
+                    rv = 1;
+                    goto leave;
+                }
+                want_read = 1;
+                want_write = nghttp2_session_want_write(conn->ngh2);
+            }
+            pfds[n].fd = conn->fd;
+            pfds[n].events = pfds[n].revents = 0;
+            if (want_read)
+                pfds[n].events |= POLLIN;
+            if (want_write)
+                pfds[n].events |= POLLOUT;
+            pidx[n++] = i;
+        }
+        if (!n) {
+            log_errf(cmd, "no connections left with %ld requests pending",
+                     conf.requests - stats.completed - stats.lost);
+            rv = 1;
+            break;
+        }
+
+        if (poll(pfds, n, 100) == -1) {
+            if (errno == EINTR)
+                continue;
+            log_errf(cmd, "poll error %d (%s)", errno, strerror(errno));
+            rv = 1;
+            break;
+        }
+        for (i = 0; i < n; ++i) {
+            struct bench_conn *conn = &conns[pidx[i]];
+
+            if (!pfds[i].revents)
+                continue;
+            if ((pfds[i].revents & (POLLIN|POLLOUT|POLLHUP))
+                && !conn_io(conn))
+                continue;
+            /* the streams in flight are gone with the connection */
+            log_infof(cmd, "conn %d lost with %d streams in flight",
+                      conn->id, conn->active);
+            stats.lost += conn->active;
+            stats.failed += conn->active;
+            conn->active = 0;
+            conn_close(conn);
+        }
+    }
+
+leave:
+    end = now_usec();
+    for (i = 0; i < conf.connections; ++i) {
+        if (conns[i].ngh2) {
+            nghttp2_session_terminate_session(conns[i].ngh2, NGHTTP2_NO_ERROR);
+            nghttp2_session_send(conns[i].ngh2);
+        }
+        conn_close(&conns[i]);
+    }
+    print_results(end - start);
+    if (!rv && stats.failed)
+        rv = 1;
+    return rv;
+}
@@ -35,3 +35,28 @@ def _h2_package_scope(env):
         'AH10400',  # warning that 'enablereuse' has not effect in certain configs
         'AH00045',  # child did not exit in time, SIGTERM was sent
     ])
+
+
+@pytest.fixture(scope="package")
+def h2bench(env):
+    """Returns a function running the h2bench load client against the
+    local server via h2c. The ExecResult carries the client's results
+    as `json`."""
+    h2bench = os.path.join(env.clients_dir, 'h2bench')
+
+    def run(url, conns=1, streams=10, requests=100, header_size=0,
+            body_size=0, weights=None, timeout=60):
+        if not os.path.exists(h2bench):
+            pytest.fail(f'test client not build: {h2bench}')
+        args = [
+            h2bench, '-j', '-c', f'localhost:{env.http_port}',
+            '-C', f'{conns}', '-m', f'{streams}', '-n', f'{requests}',
+            '-H', f'{header_size}', '-d', f'{body_size}',
+            '-t', f'{timeout}',
+        ]
+        if weights:
+            args.extend(['-w', ','.join([f'{w}' for w in weights])])
+        args.append(url)
+        return env.run(args)
+
+    return run
@@ -17,6 +17,7 @@ class H2TestSetup(HttpdTestSetup):
         super().__init__(env=env)
         self.add_source_dir(os.path.dirname(inspect.getfile(H2TestSetup)))
         self.add_modules(["http2", "proxy_http2", "cgid", "autoindex", "ssl", "include"])
+        self.add_optional_modules(["early_hints"])
 
     def make(self):
         super().make()
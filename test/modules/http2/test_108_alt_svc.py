@@ -0,0 +1,53 @@
+import pytest
+
+from .env import H2Conf, H2TestEnv
+
+
+@pytest.mark.skipif(condition=H2TestEnv.is_unsupported, reason="mod_http2 not supported here")
+class TestAltSvc:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        conf = H2Conf(env, extras={
+            f'test1.{env.http_tld}': [
+                'H2AltSvc h3=:443',
+                'H2AltSvc h3-29=alt.example.org:8443',
+                'H2AltSvcMaxAge 3600',
+            ]
+        })
+        conf.add_vhost_test1()
+        conf.add_vhost_test2()
+        conf.install()
+        assert env.apache_restart() == 0
+
+    # alt-svc announced on h2 responses
+    def test_h2_108_01(self, env):
+        url = env.mkurl("https", "test1", "/alive.json")
+        r = env.curl_get(url, 5)
+        assert r.response["status"] == 200
+        assert r.response["protocol"] == "HTTP/2"
+        assert r.response["header"]["alt-svc"] == \
+               'h3=":443"; ma=3600, h3-29="alt.example.org:8443"; ma=3600'
+
+    # alt-svc announced on http/1.1 responses over TLS
+    def test_h2_108_02(self, env):
+        url = env.mkurl("https", "test1", "/alive.json")
+        r = env.curl_get(url, 5, options=["--http1.1"])
+        assert r.response["status"] == 200
+        assert "alt-svc" in r.response["header"]
+
+    # not announced when client already uses an alternative service
+    def test_h2_108_03(self, env):
+        url = env.mkurl("https", "test1", "/alive.json")
+        r = env.curl_get(url, 5, options=["-H", "Alt-Used: localhost:443"])
+        assert r.response["status"] == 200
+        assert "alt-svc" not in r.response["header"]
+
+    # not announced on hosts without configuration or without TLS
+    def test_h2_108_04(self, env):
+        r = env.curl_get(env.mkurl("https", "test2", "/alive.json"), 5)
+        assert r.response["status"] == 200
+        assert "alt-svc" not in r.response["header"]
+        r = env.curl_get(env.mkurl("http", "test1", "/alive.json"), 5)
+        assert r.response["status"] == 200
+        assert "alt-svc" not in r.response["header"]
@@ -0,0 +1,62 @@
+import pytest
+
+from .env import H2Conf, H2TestEnv
+
+
+@pytest.mark.skipif(condition=H2TestEnv.is_unsupported, reason="mod_http2 not supported here")
+@pytest.mark.skipif(condition=not H2TestEnv.has_shared_module("early_hints"),
+                    reason="no mod_early_hints available")
+class TestLearnedHints:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        H2Conf(env).start_vhost(domains=[f"hints.{env.http_tld}"],
+                                port=env.https_port, doc_root="htdocs/test1"
+        ).add("""
+        H2EarlyHints on
+        H2Push off
+        RewriteEngine on
+        RewriteRule ^/006-(.*)?\\.html$ /006.html
+        <Location /006-learn.html>
+            EarlyHintsLearning on
+            Header add Link "</006/006.css>;rel=preload;as=style"
+            Header add Link "</006/006.js>;rel=preload;as=script, </006/x.html>;rel=next"
+        </Location>
+        <Location /006-nolearn.html>
+            Header add Link "</006/006.css>;rel=preload;as=style"
+        </Location>
+        """).end_vhost(
+        ).install()
+        assert env.apache_restart() == 0
+
+    # first response is learned from, the next request gets the hints early
+    def test_h2_402_01(self, env):
+        url = env.mkurl("https", "hints", "/006-learn.html")
+        r = env.nghttp().get(url)
+        assert r.response["status"] == 200
+        assert "previous" not in r.response
+        r = env.nghttp().get(url)
+        assert r.response["status"] == 200
+        early = r.response["previous"]
+        assert early
+        assert 103 == int(early["header"][":status"])
+        assert early["header"]["link"] == \
+               '</006/006.css>;rel=preload;as=style, </006/006.js>;rel=preload;as=script'
+
+    # learned hints are sent on HTTP/1.1 as well
+    def test_h2_402_02(self, env):
+        url = env.mkurl("https", "hints", "/006-learn.html")
+        r = env.curl_get(url, 5, options=["--http1.1"])
+        assert r.response["status"] == 200
+        r = env.curl_get(url, 5, options=["--http1.1"])
+        assert r.response["status"] == 200
+        assert "previous" in r.response, f'{r.response}'
+        assert 103 == r.response["previous"]["status"]
+
+    # no learning where not enabled
+    def test_h2_402_03(self, env):
+        url = env.mkurl("https", "hints", "/006-nolearn.html")
+        for _ in range(2):
+            r = env.nghttp().get(url)
+            assert r.response["status"] == 200
+            assert "previous" not in r.response
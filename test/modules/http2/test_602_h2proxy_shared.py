@@ -0,0 +1,70 @@
+import json
+import os
+
+import pytest
+
+from .env import H2Conf, H2TestEnv
+
+
+@pytest.mark.skipif(condition=H2TestEnv.is_unsupported, reason="mod_http2 not supported here")
+class TestH2ProxyShared:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        conf = H2Conf(env, extras={
+            'base': [
+                "H2ProxySharedSessions on",
+            ],
+            f'cgi.{env.http_tld}': [
+                f"ProxyPass /h2c/ h2c://127.0.0.1:{env.http_port}/",
+            ]
+        })
+        conf.add_vhost_cgi(h2proxy_self=True)
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def run_parallel(self, env, urls, extra_args=None):
+        args = [env.curl, '--parallel', '--parallel-max', '20']
+        for i, url in enumerate(urls):
+            if i > 0:
+                args.append('--next')
+            args.extend(env.curl_resolve_args(url=url))
+            if extra_args:
+                args.extend(extra_args)
+            args.extend(['-o', '/dev/null', '-w', '%{json}\\n', url])
+        r = env.run(args)
+        assert r.exit_code == 0, f'{r}'
+        return [json.loads(line) for line in r.stdout.splitlines()]
+
+    # a single request on a shared session
+    @pytest.mark.parametrize("path", ["/h2proxy/hello.py", "/h2c/hello.py"])
+    def test_h2_602_01(self, env, path):
+        url = env.mkurl("https", "cgi", path)
+        r = env.curl_get(url, 5)
+        assert r.response["status"] == 200
+        assert r.response["json"]["protocol"] == "HTTP/2.0"
+
+    # many concurrent requests multiplexed on the shared sessions
+    @pytest.mark.parametrize("path", ["/h2proxy/hello.py", "/h2c/hello.py"])
+    def test_h2_602_02(self, env, path):
+        if not env.curl_is_at_least('8.0.0'):
+            pytest.skip(f'need at least curl v8.0.0 for this')
+        count = 100
+        urls = [env.mkurl("https", "cgi", f"{path}?id={i}") for i in range(count)]
+        stats = self.run_parallel(env, urls)
+        assert len(stats) == count
+        for st in stats:
+            assert st['http_code'] == 200, f'{st}'
+
+    # concurrent uploads on the shared sessions
+    def test_h2_602_03(self, env):
+        if not env.curl_is_at_least('8.0.0'):
+            pytest.skip(f'need at least curl v8.0.0 for this')
+        count = 20
+        fpath = os.path.join(env.gen_dir, "data-100k")
+        urls = [env.mkurl("https", "cgi", f"/h2c/echo.py?id={i}") for i in range(count)]
+        stats = self.run_parallel(env, urls, ['--data-binary', f'@{fpath}'])
+        assert len(stats) == count
+        for st in stats:
+            assert st['http_code'] == 200, f'{st}'
+            assert st['size_download'] == os.path.getsize(fpath), f'{st}'
@@ -61,3 +61,29 @@ class TestLoadGet:
                 args.append(env.mkurl("https", "cgi", ("/mnot164.py?count=%d&text=%s" % (start+(n*chunk)+i, text))))
             r = env.run(args)
             self.check_h2load_ok(env, r, chunk)
+
+    # test load with few workers, many streams per connection and
+    # adaptive MAX_CONCURRENT_STREAMS, all requests must succeed
+    @pytest.mark.parametrize("conns", [
+        2, 8
+    ])
+    def test_h2_700_20(self, env, conns):
+        conf = H2Conf(env)
+        conf.add([
+            "H2MinWorkers 2",
+            "H2MaxWorkers 4",
+            "H2AdaptiveStreams on",
+        ])
+        conf.add_vhost_cgi().add_vhost_test1().install()
+        assert env.apache_restart() == 0
+        text = "X"
+        start = 1400
+        chunk = 128
+        args = [env.h2load, "-n", "%d" % chunk, "-c", "%d" % conns, "-m", "100",
+                f"--connect-to=localhost:{env.https_port}",
+                f"--base-uri={env.mkurl('https', 'cgi', '/')}",
+        ]
+        for i in range(0, chunk):
+            args.append(env.mkurl("https", "cgi", ("/mnot164.py?count=%d&text=%s" % (start+i, text))))
+        r = env.run(args)
+        self.check_h2load_ok(env, r, chunk)
@@ -0,0 +1,62 @@
+import os
+
+import pytest
+
+from .env import H2Conf, H2TestEnv
+
+
+@pytest.mark.skipif(condition=H2TestEnv.is_unsupported, reason="mod_http2 not supported here")
+class TestUploadWindow:
+
+    def _setup(self, env, conf_lines):
+        conf = H2Conf(env)
+        conf.add(conf_lines)
+        conf.add_vhost_cgi().add_vhost_test1().install()
+        assert env.apache_restart() == 0
+
+    def check_bench_ok(self, r, n, body_size):
+        assert r.exit_code == 0, f'{r}'
+        assert r.json['requests']['succeeded'] == n, f'{r.json}'
+        assert r.json['bytes_sent'] == n * body_size, f'{r.json}'
+
+    # uploads with small windows and batched window updates do not stall
+    @pytest.mark.parametrize("threshold", [0, 1, 4096, 1000000])
+    def test_h2_713_01(self, env, h2bench, threshold):
+        self._setup(env, [
+            "H2WindowSize 16384",
+            f"H2WindowUpdateThreshold {threshold}",
+        ])
+        url = env.mkurl("http", "test1", "/index.html")
+        body_size = 1024 * 1024
+        r = h2bench(url, conns=2, streams=5, requests=20, body_size=body_size)
+        self.check_bench_ok(r, 20, body_size)
+
+    # uploads with windows tuned to the bandwidth-delay product
+    @pytest.mark.parametrize("win_max", [0, 65536, 8 * 1024 * 1024])
+    def test_h2_713_02(self, env, h2bench, win_max):
+        self._setup(env, [
+            "H2WindowSize 16384",
+            f"H2WindowSizeMax {win_max}",
+        ])
+        url = env.mkurl("http", "test1", "/index.html")
+        body_size = 4 * 1024 * 1024
+        r = h2bench(url, conns=1, streams=4, requests=8, body_size=body_size)
+        self.check_bench_ok(r, 8, body_size)
+
+    # request body arrives complete at a cgi with tuned windows
+    def test_h2_713_03(self, env):
+        self._setup(env, [
+            "H2WindowSize 16384",
+            "H2WindowUpdateThreshold 2048",
+            "H2WindowSizeMax 1048576",
+        ])
+        url = env.mkurl("https", "cgi", "/echo.py")
+        fpath = os.path.join(env.gen_dir, "data-100k")
+        r = env.curl_raw(url, timeout=10, options=[
+            '--data-binary', f'@{fpath}'
+        ])
+        assert r.exit_code == 0, f'{r}'
+        assert r.response["status"] == 200
+        with open(fpath, mode='rb') as file:
+            src = file.read()
+        assert src == r.response["body"]
@@ -0,0 +1,64 @@
+import pytest
+
+from .env import H2Conf, H2TestEnv
+
+
+@pytest.mark.skipif(condition=H2TestEnv.is_unsupported, reason="mod_http2 not supported here")
+class TestBench:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        H2Conf(env).add_vhost_test1().install()
+        assert env.apache_restart() == 0
+
+    def check_bench_ok(self, r, n):
+        assert r.exit_code == 0, f'{r}'
+        assert r.json, f'{r}'
+        assert r.json['requests']['completed'] == n, f'{r.json}'
+        assert r.json['requests']['succeeded'] == n, f'{r.json}'
+        assert r.json['requests']['failed'] == 0, f'{r.json}'
+        assert r.json['status']['2xx'] == n, f'{r.json}'
+        assert r.json['streams_per_sec'] > 0, f'{r.json}'
+        lat = r.json['latency_usec']
+        assert lat['min'] <= lat['p50'] <= lat['p90'] <= lat['p99'] <= lat['max']
+        return r.json
+
+    # GET with varying connections and concurrency
+    @pytest.mark.parametrize("conns, streams", [
+        (1, 1), (1, 50), (4, 20)
+    ])
+    def test_h2_720_01(self, env, h2bench, conns, streams):
+        url = env.mkurl("http", "test1", "/index.html")
+        n = 500
+        r = h2bench(url, conns=conns, streams=streams, requests=n)
+        res = self.check_bench_ok(r, n)
+        assert res['bytes_received'] > 0
+        assert res['goodput_bytes_per_sec'] > 0
+
+    # large request headers
+    @pytest.mark.parametrize("header_size", [1024, 7000])
+    def test_h2_720_02(self, env, h2bench, header_size):
+        url = env.mkurl("http", "test1", "/index.html")
+        r = h2bench(url, streams=10, requests=200, header_size=header_size)
+        self.check_bench_ok(r, 200)
+
+    # request bodies, the server may answer before it read all of one so
+    # only the requests' outcome is checked, not the bytes sent
+    @pytest.mark.parametrize("body_size", [1, 10*1024, 256*1024])
+    def test_h2_720_03(self, env, h2bench, body_size):
+        url = env.mkurl("http", "test1", "/index.html")
+        n = 100
+        r = h2bench(url, conns=2, streams=10, requests=n, body_size=body_size)
+        res = self.check_bench_ok(r, n)
+        assert res['requests']['succeeded'] == n, f'{res}'
+        assert res['requests']['failed'] == 0, f'{res}'
+
+    # mix of stream priorities, results are reported per weight
+    def test_h2_720_04(self, env, h2bench):
+        url = env.mkurl("http", "test1", "/index.html")
+        weights = [1, 32, 256]
+        n = 300
+        r = h2bench(url, streams=30, requests=n, weights=weights)
+        res = self.check_bench_ok(r, n)
+        assert [w['weight'] for w in res['weights']] == weights
+        assert sum([w['completed'] for w in res['weights']]) == n
@@ -0,0 +1,44 @@
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from threading import Lock, Thread
+
+
+class HttpBackend:
+    """A local HTTP server counting the GET requests it got, and letting
+       handle(request, count) answer them, count being the number of the
+       request."""
+
+    def __init__(self, handle):
+        backend = self
+        self.requests = 0
+        self._lock = Lock()
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                with backend._lock:
+                    backend.requests += 1
+                    count = backend.requests
+                handle(self, count)
+
+            def log_message(self, *args):
+                pass
+
+        self._server = ThreadingHTTPServer(('127.0.0.1', 0), Handler)
+        self.port = self._server.server_address[1]
+
+    @staticmethod
+    def respond(request, body, headers=None):
+        """Send a 200 text/plain response with body and the given headers."""
+        request.send_response(200)
+        request.send_header('Content-Type', 'text/plain')
+        request.send_header('Content-Length', str(len(body)))
+        for name, value in (headers or {}).items():
+            request.send_header(name, value)
+        request.end_headers()
+        request.wfile.write(body)
+
+    def start(self):
+        Thread(target=self._server.serve_forever, daemon=True).start()
+
+    def stop(self):
+        self._server.shutdown()
+        self._server.server_close()
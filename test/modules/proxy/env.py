@@ -17,6 +17,10 @@ class ProxyTestSetup(HttpdTestSetup):
         super().__init__(env=env)
         self.add_source_dir(os.path.dirname(inspect.getfile(ProxyTestSetup)))
         self.add_modules(["proxy", "proxy_http", "proxy_balancer", "lbmethod_byrequests"])
+        self.add_optional_modules(["proxy_broker", "lbmethod_bylatency", "lbmethod_byhash",
+                                    "lbmethod_bybusyness", "lbmethod_bytraffic",
+                                    "proxy_connect", "proxy_hcheck", "proxy_fcgi",
+                                    "cache_slab", "cache_tiered"])
 
 
 class ProxyTestEnv(HttpdTestEnv):
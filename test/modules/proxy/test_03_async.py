@@ -0,0 +1,120 @@
+import os
+import socket
+import time
+from threading import Thread
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+
+class SlowFaker:
+
+    def __init__(self, path, delay):
+        self._uds_path = path
+        self._delay = delay
+        self._done = False
+
+    def start(self):
+        def process(self):
+            self._socket.listen(10)
+            self._process()
+
+        try:
+            os.unlink(self._uds_path)
+        except OSError:
+            if os.path.exists(self._uds_path):
+                raise
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.bind(self._uds_path)
+        self._thread = Thread(target=process, daemon=True, args=[self])
+        self._thread.start()
+
+    def stop(self):
+        self._done = True
+        self._socket.close()
+
+    def _respond(self, c):
+        try:
+            c.recv(1024)
+            time.sleep(self._delay)
+            c.sendall("""HTTP/1.1 200 Ok
+Server: SlowFaker
+Content-Type: application/json
+Content-Length: 18
+
+{ "host": "slow" }""".encode())
+        except OSError:
+            pass
+        finally:
+            c.close()
+
+    def _process(self):
+        while self._done is False:
+            try:
+                c, client_address = self._socket.accept()
+                Thread(target=self._respond, daemon=True, args=[c]).start()
+            except (ConnectionAbortedError, OSError):
+                self._done = True
+
+
+class TestProxyAsync:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # reverse proxy to a unix: domain socket where a SlowFaker
+        # takes a second to answer, releasing the worker meanwhile.
+        UDS_PATH = f"{env.gen_dir}/proxy_03.sock"
+        faker = SlowFaker(path=UDS_PATH, delay=1)
+        faker.start()
+
+        conf = HttpdConf(env)
+        conf.add("ProxyPreserveHost on")
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "ProxyAsyncDelay 0",
+            "ProxyAsyncIdleTimeout 10",
+            f"ProxyPass /slow/ unix:{UDS_PATH}|http://127.0.0.1:{env.http_port}/",
+            f"ProxyPass / http://127.0.0.1:{env.http_port}/",
+        ])
+        conf.end_vhost()
+        conf.start_vhost(domains=[env.d_mixed], port=env.https_port)
+        conf.add([
+            "ProxyAsyncDelay 0",
+            "ProxyAsyncIdleTimeout 200ms",
+            f"ProxyPass / unix:{UDS_PATH}|http://127.0.0.1:{env.http_port}/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        faker.stop()
+
+    # responses of a fast backend are relayed as before
+    def test_proxy_03_001(self, env):
+        r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/alive.json", 5)
+        assert r.response["status"] == 200
+        assert r.json['host'] == "test1"
+
+    # responses of a slow backend are relayed once it answers
+    def test_proxy_03_002(self, env):
+        r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/slow/alive.json", 5)
+        assert r.response["status"] == 200
+        assert r.json['host'] == "slow"
+
+    # keep-alive works on the client connection after an async response
+    def test_proxy_03_003(self, env):
+        url1 = f"https://{env.d_reverse}:{env.https_port}/slow/alive.json"
+        url2 = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        r = env.curl_raw([url1, url2], timeout=10, options=['--http1.1'])
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.response["previous"]["status"] == 200
+
+    # a backend not answering within ProxyAsyncIdleTimeout is a 504
+    def test_proxy_03_004(self, env):
+        if env.mpm_module != 'mpm_event':
+            pytest.skip('needs an MPM that can poll')
+        r = env.curl_get(f"https://{env.d_mixed}:{env.https_port}/alive.json", 5)
+        assert r.response["status"] == 504
@@ -0,0 +1,77 @@
+import re
+import time
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("proxy_broker"),
+                    reason="no mod_proxy_broker available")
+class TestProxyBroker:
+
+    def _setup(self, env, broker):
+        conf = HttpdConf(env)
+        conf.add([
+            f"ProxyBroker {broker}",
+            "ProxyBrokerMaxIdle 4",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "ProxyStatus full",
+            "<Proxy balancer://backend>",
+            f"  BalancerMember http://127.0.0.1:{env.http_port} ttl=1",
+            "</Proxy>",
+            "<Location /status>",
+            "  SetHandler server-status",
+            "</Location>",
+            "ProxyPass /status !",
+            "ProxyPass / balancer://backend/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def get_worker_stats(self, env):
+        r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/status?auto", 5)
+        assert r.exit_code == 0, f'{r}'
+        stats = {}
+        for line in r.stdout.splitlines():
+            m = re.match(r'ProxyBalancer\[0]Worker\[0](\w+): (.*)', line)
+            if m:
+                stats[m.group(1)] = m.group(2)
+        return stats
+
+    def run_requests(self, env, count, pause=0):
+        for _ in range(count):
+            time.sleep(pause)
+            r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/alive.json", 5)
+            assert r.response["status"] == 200
+            assert r.json['host'] == "test1"
+
+    # connections expiring from the pool (ttl) are fetched back from the broker
+    def test_proxy_04_001(self, env):
+        self._setup(env, "on")
+        self.run_requests(env, 4, pause=1.5)
+        stats = self.get_worker_stats(env)
+        assert int(stats['Brokered']) > 0, f'{stats}'
+        assert int(stats['Reused']) >= int(stats['Brokered']), f'{stats}'
+        assert int(stats['Connects']) + int(stats['Reused']) == 4, f'{stats}'
+
+    # without the broker, nothing is brokered
+    def test_proxy_04_002(self, env):
+        self._setup(env, "off")
+        self.run_requests(env, 10)
+        stats = self.get_worker_stats(env)
+        assert int(stats['Brokered']) == 0, f'{stats}'
+        assert int(stats['Connects']) + int(stats['Reused']) == 10, f'{stats}'
+
+    # connections kept in the pool are reused locally, not brokered
+    def test_proxy_04_003(self, env):
+        self._setup(env, "on")
+        self.run_requests(env, 10)
+        stats = self.get_worker_stats(env)
+        assert int(stats['Brokered']) == 0, f'{stats}'
+        assert int(stats['Connects']) + int(stats['Reused']) == 10, f'{stats}'
@@ -0,0 +1,47 @@
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+from .test_03_async import SlowFaker
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("lbmethod_bylatency"),
+                    reason="no mod_lbmethod_bylatency available")
+class TestProxyByLatency:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # a balancer with a fast member and a slow one behind a
+        # unix: domain socket, taking 300ms to answer.
+        UDS_PATH = f"{env.gen_dir}/proxy_05.sock"
+        faker = SlowFaker(path=UDS_PATH, delay=0.3)
+        faker.start()
+
+        conf = HttpdConf(env)
+        conf.add("BalancerLatencyDecay 60")
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "<Proxy balancer://backend>",
+            f"  BalancerMember http://127.0.0.1:{env.http_port}",
+            f"  BalancerMember unix:{UDS_PATH}|http://127.0.0.1:{env.http_port}",
+            "  ProxySet lbmethod=bylatency",
+            "</Proxy>",
+            "ProxyPass / balancer://backend/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        faker.stop()
+
+    # once measured, the slow member gets (almost) no more requests
+    def test_proxy_05_001(self, env):
+        hosts = []
+        for _ in range(20):
+            r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/alive.json", 5)
+            assert r.response["status"] == 200
+            hosts.append(r.json['host'])
+        assert hosts.count("slow") <= 2, f'{hosts}'
+        assert hosts.count("test1") >= 18, f'{hosts}'
@@ -0,0 +1,53 @@
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+from .test_03_async import SlowFaker
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("lbmethod_byhash"),
+                    reason="no mod_lbmethod_byhash available")
+class TestProxyByHash:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # a balancer with two members answering differently, the
+        # second one behind a unix: domain socket.
+        UDS_PATH = f"{env.gen_dir}/proxy_06.sock"
+        faker = SlowFaker(path=UDS_PATH, delay=0)
+        faker.start()
+
+        conf = HttpdConf(env)
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "<Proxy balancer://backend>",
+            f"  BalancerMember http://127.0.0.1:{env.http_port}",
+            f"  BalancerMember unix:{UDS_PATH}|http://127.0.0.1:{env.http_port}",
+            "  ProxySet lbmethod=byhash",
+            "  BalancerHashKey %{HTTP:X-Key}",
+            "</Proxy>",
+            "ProxyPass / balancer://backend/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        faker.stop()
+
+    def get_host(self, env, key):
+        r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/alive.json", 5,
+                         options=['-H', f'X-Key: {key}'])
+        assert r.response["status"] == 200
+        return r.json['host']
+
+    # the same key always goes to the same member, keys spread over both
+    def test_proxy_06_001(self, env):
+        hosts = {}
+        for i in range(20):
+            hosts[f"key-{i}"] = self.get_host(env, f"key-{i}")
+        for key, host in hosts.items():
+            assert self.get_host(env, key) == host, f'{hosts}'
+        assert "test1" in hosts.values(), f'{hosts}'
+        assert "slow" in hosts.values(), f'{hosts}'
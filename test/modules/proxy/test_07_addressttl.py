@@ -0,0 +1,40 @@
+import time
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+
+class TestProxyAddressTTL:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # "localhost" may resolve to both ::1 and 127.0.0.1, the worker's
+        # address expires every second and is refreshed in the background.
+        conf = HttpdConf(env)
+        conf.add("ProxyPreserveHost on")
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            f"ProxyPass / http://localhost:{env.http_port}/ addressttl=1",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    # requests keep being served across address refreshes
+    def test_proxy_07_001(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        for i in range(3):
+            r = env.curl_get(url, 5)
+            assert r.response["status"] == 200
+            assert r.json['host'] == "test1"
+            time.sleep(1.5)
+
+    # consecutive requests on a client connection
+    def test_proxy_07_002(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        r = env.curl_raw([url, url, url], timeout=10, options=['--http1.1'])
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.response["previous"]["status"] == 200
@@ -0,0 +1,144 @@
+import logging
+import os
+import socket
+import time
+from threading import Thread
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+log = logging.getLogger(__name__)
+
+
+class SinkBackend:
+    """Reads a request body of Content-Length bytes and tells how many
+       bytes it received."""
+
+    def __init__(self, path):
+        self._uds_path = path
+        self._done = False
+
+    def start(self):
+        def process(self):
+            self._socket.listen(10)
+            self._process()
+
+        try:
+            os.unlink(self._uds_path)
+        except OSError:
+            if os.path.exists(self._uds_path):
+                raise
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.bind(self._uds_path)
+        self._thread = Thread(target=process, daemon=True, args=[self])
+        self._thread.start()
+
+    def stop(self):
+        self._done = True
+        self._socket.close()
+
+    def _respond(self, c):
+        try:
+            data = b''
+            while b'\r\n\r\n' not in data:
+                chunk = c.recv(4096)
+                if not chunk:
+                    return
+                data += chunk
+            head, body = data.split(b'\r\n\r\n', 1)
+            clen = 0
+            for line in head.split(b'\r\n')[1:]:
+                name, value = line.split(b':', 1)
+                if name.strip().lower() == b'content-length':
+                    clen = int(value.strip())
+            received = len(body)
+            while received < clen:
+                chunk = c.recv(min(clen - received, 1024 * 1024))
+                if not chunk:
+                    break
+                received += len(chunk)
+            resp = f'{{ "received": {received} }}'
+            c.sendall(f"""HTTP/1.1 200 Ok
+Server: SinkBackend
+Content-Type: application/json
+Content-Length: {len(resp)}
+Connection: close
+
+{resp}""".encode())
+        except OSError:
+            pass
+        finally:
+            c.close()
+
+    def _process(self):
+        while self._done is False:
+            try:
+                c, client_address = self._socket.accept()
+                Thread(target=self._respond, daemon=True, args=[c]).start()
+            except (ConnectionAbortedError, OSError):
+                self._done = True
+
+
+class TestProxyUpload:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # request bodies proxied from a plain http vhost (spliced on linux)
+        # and from a https one (always read and written by the server).
+        UDS_PATH = f"{env.gen_dir}/proxy_08.sock"
+        sink = SinkBackend(path=UDS_PATH)
+        sink.start()
+
+        conf = HttpdConf(env)
+        for port in [env.http_port, env.https_port]:
+            conf.start_vhost(domains=[env.d_reverse], port=port)
+            conf.add([
+                f"ProxyPass /sink/ unix:{UDS_PATH}|http://localhost/",
+            ])
+            conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        sink.stop()
+
+    def _mkfile(self, env, name, size):
+        fpath = os.path.join(env.gen_dir, name)
+        if not os.path.exists(fpath) or os.path.getsize(fpath) != size:
+            with open(fpath, 'wb') as fd:
+                fd.truncate(size)
+        return fpath
+
+    def _upload(self, env, url, fpath):
+        start = time.time()
+        r = env.curl_raw([url], timeout=120, options=[
+            '--http1.1', '-T', fpath, '-H', 'Expect:'
+        ])
+        duration = time.time() - start
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.json['received'] == os.path.getsize(fpath)
+        return duration
+
+    # a body large enough to be spliced, on both schemes
+    @pytest.mark.parametrize("scheme", ["http", "https"])
+    def test_proxy_08_001(self, env, scheme):
+        port = env.http_port if scheme == 'http' else env.https_port
+        url = f"{scheme}://{env.d_reverse}:{port}/sink/upload"
+        fpath = self._mkfile(env, "data-10m", 10 * 1024 * 1024)
+        self._upload(env, url, fpath)
+
+    # a small body, below the splice threshold
+    def test_proxy_08_002(self, env):
+        url = f"http://{env.d_reverse}:{env.http_port}/sink/upload"
+        fpath = self._mkfile(env, "data-10k", 10 * 1024)
+        self._upload(env, url, fpath)
+
+    # throughput of a 1GB upload, spliced or not
+    @pytest.mark.parametrize("scheme", ["http", "https"])
+    def test_proxy_08_003(self, env, scheme):
+        port = env.http_port if scheme == 'http' else env.https_port
+        url = f"{scheme}://{env.d_reverse}:{port}/sink/upload"
+        fpath = self._mkfile(env, "data-1g", 1024 * 1024 * 1024)
+        duration = self._upload(env, url, fpath)
+        log.info(f"upload 1GB via {scheme}: {1024 / duration:.1f} MB/s")
@@ -0,0 +1,54 @@
+import os
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("proxy_connect"),
+                    reason="no mod_proxy_connect available")
+class TestProxyTunnel:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # CONNECT tunnels through the plain http vhost to the https one,
+        # the TLS data are spliced between the sockets on linux.
+        docs = os.path.join(env.server_dir, 'htdocs/test1')
+        with open(os.path.join(docs, 'data-10m'), 'wb') as fd:
+            for i in range(10 * 1024):
+                fd.write(f"{i:09d}".encode() * 102 + b'0123\n')
+
+        conf = HttpdConf(env)
+        conf.start_vhost(domains=[env.d_forward], port=env.http_port)
+        conf.add([
+            "ProxyRequests on",
+            f"AllowCONNECT {env.https_port}",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse, "localhost"], port=env.https_port,
+                       doc_root="htdocs/test1")
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def _tunnel_get(self, env, path):
+        url = f"https://localhost:{env.https_port}{path}"
+        return env.curl_raw([url], timeout=10, insecure=True, options=[
+            '--http1.1', '-x', f"http://127.0.0.1:{env.http_port}", '-p',
+        ])
+
+    # a small resource through the tunnel
+    def test_proxy_09_001(self, env):
+        r = self._tunnel_get(env, "/alive.json")
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.json['host'] == "test1"
+
+    # a large resource through the tunnel arrives intact
+    def test_proxy_09_002(self, env):
+        r = self._tunnel_get(env, "/data-10m")
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        fpath = os.path.join(env.server_dir, 'htdocs/test1/data-10m')
+        with open(fpath, 'rb') as fd:
+            assert r.outraw == fd.read()
@@ -0,0 +1,93 @@
+import socket
+from threading import Thread
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+
+class FailingBackend:
+    """Answers every request with a 500."""
+
+    def __init__(self):
+        self._done = False
+
+    def start(self):
+        self._socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self._socket.bind(('127.0.0.1', 0))
+        self._socket.listen(10)
+        self.port = self._socket.getsockname()[1]
+        self._thread = Thread(target=self._process, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._done = True
+        self._socket.close()
+
+    def _respond(self, c):
+        try:
+            c.recv(4096)
+            c.sendall("""HTTP/1.1 500 Internal Server Error
+Server: FailingBackend
+Content-Length: 0
+Connection: close
+
+""".encode())
+        except OSError:
+            pass
+        finally:
+            c.close()
+
+    def _process(self):
+        while self._done is False:
+            try:
+                c, client_address = self._socket.accept()
+                Thread(target=self._respond, daemon=True, args=[c]).start()
+            except (ConnectionAbortedError, OSError):
+                self._done = True
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("proxy_hcheck"),
+                    reason="no mod_proxy_hcheck available")
+class TestProxyHcheck:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # a balancer with a healthy member and one failing all requests,
+        # which the TCP health check alone would not detect.
+        backend = FailingBackend()
+        backend.start()
+
+        conf = HttpdConf(env)
+        conf.add("ProxyPreserveHost on")
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "<Proxy balancer://hcheck>",
+            f"  BalancerMember http://127.0.0.1:{env.http_port}/ hcmethod=TCP hcinterval=60",
+            f"  BalancerMember http://127.0.0.1:{backend.port}/ hcmethod=TCP hcinterval=60 hcoutlier=3",
+            "  ProxySet lbmethod=byrequests",
+            "</Proxy>",
+            "ProxyPass / balancer://hcheck/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        backend.stop()
+
+    # the failing member is ejected after 3 consecutive failures
+    def test_proxy_10_001(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        failures = 0
+        for i in range(10):
+            r = env.curl_get(url, 5)
+            assert r.exit_code == 0, f"{r}"
+            if r.response["status"] == 500:
+                failures += 1
+        assert failures == 3
+        for i in range(5):
+            r = env.curl_get(url, 5)
+            assert r.response["status"] == 200
+            assert r.json['host'] == "test1"
@@ -0,0 +1,64 @@
+import os
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+
+class TestProxyResponseBuffer:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        docs = os.path.join(env.server_dir, 'htdocs/test1')
+        with open(os.path.join(docs, 'data-1m'), 'wb') as fd:
+            for i in range(1024):
+                fd.write(f"{i:09d}".encode() * 102 + b'0123\n')
+
+        conf = HttpdConf(env)
+        conf.add("ProxyPreserveHost on")
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            # in memory only
+            "<Location /mem/>",
+            f"  ProxyPass http://127.0.0.1:{env.http_port}/",
+            "  ProxyResponseBuffer 2097152 2097152",
+            "</Location>",
+            # spooled to a file
+            "<Location /file/>",
+            f"  ProxyPass http://127.0.0.1:{env.http_port}/",
+            "  ProxyResponseBuffer 2097152 16384",
+            "</Location>",
+            # too large to buffer, streamed after the limit
+            "<Location /limit/>",
+            f"  ProxyPass http://127.0.0.1:{env.http_port}/",
+            "  ProxyResponseBuffer 100000",
+            "</Location>",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    @pytest.mark.parametrize("prefix", ["mem", "file", "limit"])
+    def test_proxy_11_001(self, env, prefix):
+        url = f"https://{env.d_reverse}:{env.https_port}/{prefix}/alive.json"
+        r = env.curl_get(url, 5)
+        assert r.response["status"] == 200
+        assert r.json['host'] == "test1"
+
+    @pytest.mark.parametrize("prefix", ["mem", "file", "limit"])
+    def test_proxy_11_002(self, env, prefix):
+        url = f"https://{env.d_reverse}:{env.https_port}/{prefix}/data-1m"
+        r = env.curl_get(url, 5)
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        with open(os.path.join(env.server_dir, 'htdocs/test1/data-1m'), 'rb') as fd:
+            assert r.outraw == fd.read()
+
+    # consecutive requests on a client connection
+    def test_proxy_11_003(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/file/data-1m"
+        r = env.curl_raw([url, url, url], timeout=10, options=['--http1.1'])
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.response["previous"]["status"] == 200
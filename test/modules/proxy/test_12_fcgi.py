@@ -0,0 +1,204 @@
+import json
+import socket
+import struct
+import time
+from threading import Lock, Thread
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_ABORT_REQUEST = 2
+FCGI_END_REQUEST = 3
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_GET_VALUES = 9
+FCGI_GET_VALUES_RESULT = 10
+FCGI_KEEP_CONN = 1
+
+
+class FcgiBackend:
+    """A FastCGI responder telling on which connection and with which
+       request id it got a request, and how many body bytes. With mpxs,
+       it advertises FCGI_MPXS_CONNS and answers the requests of a
+       connection concurrently."""
+
+    def __init__(self, mpxs=False, delay=0.0):
+        self._mpxs = mpxs
+        self._delay = delay
+        self._done = False
+        self._lock = Lock()
+        self.connections = 0
+        self.max_concurrent = 0
+
+    def start(self):
+        self._socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self._socket.bind(('127.0.0.1', 0))
+        self._socket.listen(50)
+        self.port = self._socket.getsockname()[1]
+        self._thread = Thread(target=self._process, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._done = True
+        self._socket.close()
+
+    @staticmethod
+    def _record(rtype, rid, content=b''):
+        return struct.pack('>BBHHBB', 1, rtype, rid, len(content), 0, 0) + content
+
+    @staticmethod
+    def _recv_full(c, n):
+        data = b''
+        while len(data) < n:
+            chunk = c.recv(n - len(data))
+            if not chunk:
+                raise EOFError()
+            data += chunk
+        return data
+
+    @staticmethod
+    def _nv(name, value):
+        return bytes([len(name), len(value)]) + name + value
+
+    def _respond(self, c, wlock, conn_id, rid, req, state):
+        if self._delay:
+            time.sleep(self._delay)
+        body = json.dumps({
+            'conn': conn_id, 'rid': rid, 'received': req['received']
+        }).encode()
+        out = b'Content-Type: application/json\r\n\r\n' + body
+        with wlock:
+            c.sendall(self._record(FCGI_STDOUT, rid, out)
+                      + self._record(FCGI_STDOUT, rid)
+                      + self._record(FCGI_END_REQUEST, rid, bytes(8)))
+        with self._lock:
+            state['active'] -= 1
+        if not req['keep']:
+            c.close()
+
+    def _serve(self, c):
+        with self._lock:
+            self.connections += 1
+            conn_id = self.connections
+        wlock = Lock()
+        state = {'active': 0}
+        reqs = {}
+        try:
+            while True:
+                version, rtype, rid, clen, plen, _ = struct.unpack(
+                    '>BBHHBB', self._recv_full(c, 8))
+                content = self._recv_full(c, clen + plen)[:clen]
+                if rtype == FCGI_GET_VALUES:
+                    values = self._nv(b'FCGI_MPXS_CONNS', b'1' if self._mpxs else b'0') \
+                             + self._nv(b'FCGI_MAX_REQS', b'50')
+                    with wlock:
+                        c.sendall(self._record(FCGI_GET_VALUES_RESULT, 0, values))
+                elif rtype == FCGI_BEGIN_REQUEST:
+                    reqs[rid] = {'keep': content[2] & FCGI_KEEP_CONN, 'received': 0}
+                elif rtype == FCGI_STDIN and rid in reqs:
+                    if clen:
+                        reqs[rid]['received'] += clen
+                        continue
+                    req = reqs.pop(rid)
+                    with self._lock:
+                        state['active'] += 1
+                        self.max_concurrent = max(self.max_concurrent, state['active'])
+                    args = [c, wlock, conn_id, rid, req, state]
+                    if self._mpxs:
+                        Thread(target=self._respond, daemon=True, args=args).start()
+                    else:
+                        self._respond(*args)
+                        if not req['keep']:
+                            return
+                elif rtype == FCGI_ABORT_REQUEST:
+                    reqs.pop(rid, None)
+        except (EOFError, OSError):
+            pass
+        finally:
+            c.close()
+
+    def _process(self):
+        while self._done is False:
+            try:
+                c, client_address = self._socket.accept()
+                Thread(target=self._serve, daemon=True, args=[c]).start()
+            except (ConnectionAbortedError, OSError):
+                self._done = True
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("proxy_fcgi"),
+                    reason="no mod_proxy_fcgi available")
+class TestProxyFcgi:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        keep = FcgiBackend()
+        keep.start()
+        mux = FcgiBackend(mpxs=True, delay=0.5)
+        mux.start()
+        TestProxyFcgi.keep = keep
+        TestProxyFcgi.mux = mux
+
+        conf = HttpdConf(env)
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "<Location /keep/>",
+            f"  ProxyPass fcgi://127.0.0.1:{keep.port}/ enablereuse=on",
+            "</Location>",
+            "<Location /mux/>",
+            f"  ProxyPass fcgi://127.0.0.1:{mux.port}/ enablereuse=on",
+            "  ProxyFCGIMultiplex on",
+            "</Location>",
+        ])
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        keep.stop()
+        mux.stop()
+
+    def run_parallel(self, env, urls):
+        args = [env.curl, '--parallel', '--parallel-max', '20', '--http1.1']
+        for i, url in enumerate(urls):
+            if i > 0:
+                args.append('--next')
+            args.extend(env.curl_resolve_args(url=url))
+            args.extend(['-s', '-w', '%{http_code}\\n', url])
+        r = env.run(args)
+        assert r.exit_code == 0, f'{r}'
+        return r.stdout
+
+    # consecutive requests reuse the backend connection (FCGI_KEEP_CONN)
+    def test_proxy_12_001(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/keep/hello"
+        r = env.curl_raw([url, url, url], timeout=10, options=['--http1.1'])
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.response["previous"]["status"] == 200
+        assert self.keep.connections == 1
+
+    # with a request body
+    def test_proxy_12_002(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/keep/upload"
+        r = env.curl_raw([url], timeout=10,
+                         options=['--http1.1', '--data-binary', 'x' * 10000])
+        assert r.exit_code == 0, f"{r}"
+        assert r.response["status"] == 200
+        assert r.json['received'] == 10000
+
+    # concurrent requests are multiplexed on shared connections
+    def test_proxy_12_003(self, env):
+        count = 8
+        urls = [f"https://{env.d_reverse}:{env.https_port}/mux/r{i}"
+                for i in range(count)]
+        # the first requests of the children learn that the backend
+        # multiplexes, the next ones share connections
+        self.run_parallel(env, urls)
+        conns = self.mux.connections
+        out = self.run_parallel(env, urls)
+        assert out.split() == ['200'] * count, f'{out}'
+        assert self.mux.max_concurrent > 1
+        assert self.mux.connections - conns < count
@@ -0,0 +1,65 @@
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+LBMETHODS = ["byrequests", "bybusyness", "bytraffic"]
+
+
+class TestProxyBalancer:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        # a balancer per lbmethod, with two members answering differently
+        conf = HttpdConf(env)
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        for method in LBMETHODS:
+            if not HttpdTestEnv.has_shared_module(f"lbmethod_{method}"):
+                continue
+            conf.add([
+                f"<Proxy balancer://{method}>",
+                f"  BalancerMember http://127.0.0.1:{env.http_port}/test1",
+                f"  BalancerMember http://127.0.0.1:{env.http_port}/test2",
+                f"  ProxySet lbmethod={method}",
+                "</Proxy>",
+                f"ProxyPass /{method}/ balancer://{method}/",
+            ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def run_parallel(self, env, urls):
+        args = [env.curl, '--parallel', '--parallel-max', '20']
+        for i, url in enumerate(urls):
+            if i > 0:
+                args.append('--next')
+            args.extend(env.curl_resolve_args(url=url))
+            args.extend(['-s', '-o', '/dev/null', '-w', '%{http_code}\\n', url])
+        r = env.run(args)
+        assert r.exit_code == 0, f'{r}'
+        return r.stdout
+
+    # consecutive requests are spread evenly over the members
+    @pytest.mark.parametrize("method", LBMETHODS)
+    def test_proxy_13_001(self, env, method):
+        if not HttpdTestEnv.has_shared_module(f"lbmethod_{method}"):
+            pytest.skip(f'no mod_lbmethod_{method} available')
+        hosts = []
+        for _ in range(10):
+            r = env.curl_get(f"https://{env.d_reverse}:{env.https_port}/{method}/alive.json", 5)
+            assert r.response["status"] == 200
+            hosts.append(r.json['host'])
+        assert hosts.count("test1") >= 3, f'{hosts}'
+        assert hosts.count("test2") >= 3, f'{hosts}'
+
+    # concurrent elections, without the balancer lock
+    @pytest.mark.parametrize("method", LBMETHODS)
+    def test_proxy_13_002(self, env, method):
+        if not HttpdTestEnv.has_shared_module(f"lbmethod_{method}"):
+            pytest.skip(f'no mod_lbmethod_{method} available')
+        count = 50
+        urls = [f"https://{env.d_reverse}:{env.https_port}/{method}/alive.json?id={i}"
+                for i in range(count)]
+        out = self.run_parallel(env, urls)
+        assert out.split() == ['200'] * count, f'{out}'
@@ -0,0 +1,62 @@
+import os
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("cache_slab"),
+                    reason="no mod_cache_slab available")
+class TestProxyCacheSlab:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        docs = os.path.join(env.server_dir, 'htdocs/test1')
+        with open(os.path.join(docs, 'slab-large.txt'), 'w') as fd:
+            for i in range(10000):
+                fd.write(f"{i:09d}\n")
+        conf = HttpdConf(env)
+        conf.add([
+            f"CacheSlabRoot {os.path.join(env.gen_dir, 'cache-slab')}",
+            "CacheSlabSize 4194304",
+            "CacheSlabRegionSize 1048576",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable slab /",
+            "CacheHeader on",
+            f"ProxyPass / http://127.0.0.1:{env.http_port}/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def get_twice(self, env, path):
+        url = f"https://{env.d_reverse}:{env.https_port}{path}"
+        r1 = env.curl_get(url)
+        assert r1.response["status"] == 200
+        r2 = env.curl_get(url)
+        assert r2.response["status"] == 200
+        assert r2.response["header"]["x-cache"].startswith("HIT"), f"{r2}"
+        assert r2.response["body"] == r1.response["body"]
+        return r2
+
+    # a response is cached and served from the data file
+    def test_proxy_14_001(self, env):
+        r = self.get_twice(env, "/alive.json")
+        assert r.json['host'] == "test1"
+
+    # a body larger than a file read
+    def test_proxy_14_002(self, env):
+        r = self.get_twice(env, "/slab-large.txt")
+        assert len(r.response["body"]) == 100000
+
+    # the cache survives a restart
+    def test_proxy_14_003(self, env):
+        assert env.apache_restart() == 0
+        url = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        r = env.curl_get(url)
+        assert r.response["status"] == 200
+        assert r.response["header"]["x-cache"].startswith("HIT"), f"{r}"
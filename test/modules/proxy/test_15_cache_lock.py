@@ -0,0 +1,57 @@
+import time
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+from .backend import HttpBackend
+
+
+def slow_backend(delay=1.0):
+    """A backend answering with a cacheable response after a delay."""
+    def handle(request, count):
+        time.sleep(delay)
+        HttpBackend.respond(request, b'collapsed\n',
+                            {'Cache-Control': 'max-age=60'})
+    return HttpBackend(handle)
+
+
+class TestProxyCacheLock:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        backend = slow_backend()
+        backend.start()
+        TestProxyCacheLock.backend = backend
+
+        conf = HttpdConf(env)
+        conf.add([
+            "CacheLock on",
+            "CacheLockWait 5",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable disk /",
+            f"CacheRoot {env.gen_dir}/cache-lock",
+            f"ProxyPass / http://127.0.0.1:{backend.port}/",
+        ])
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        backend.stop()
+
+    # concurrent misses of a URL only send one request to the backend
+    def test_proxy_15_001(self, env):
+        count = 6
+        url = f"https://{env.d_reverse}:{env.https_port}/herd"
+        args = [env.curl, '--parallel', '--parallel-max', '20', '--http1.1']
+        for i in range(count):
+            if i > 0:
+                args.append('--next')
+            args.extend(env.curl_resolve_args(url=url))
+            args.extend(['-s', '-o', '/dev/null', '-w', '%{http_code}\\n', url])
+        r = env.run(args)
+        assert r.exit_code == 0, f'{r}'
+        assert r.stdout.split() == ['200'] * count, f'{r.stdout}'
+        assert self.backend.requests == 1
@@ -0,0 +1,62 @@
+import time
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+from .backend import HttpBackend
+
+
+def counting_backend(delay=1.0):
+    """A backend answering after a delay with the number of requests it
+       got, in a response stale after a second."""
+    def handle(request, count):
+        time.sleep(delay)
+        HttpBackend.respond(request, f'{count}\n'.encode(), {
+            'Cache-Control': 'max-age=1, stale-while-revalidate=30',
+        })
+    return HttpBackend(handle)
+
+
+class TestProxyCacheStaleWhileRevalidate:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        backend = counting_backend()
+        backend.start()
+        TestProxyCacheStaleWhileRevalidate.backend = backend
+
+        conf = HttpdConf(env)
+        conf.add([
+            "CacheLock on",
+            "CacheStaleWhileRevalidate on",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable disk /",
+            f"CacheRoot {env.gen_dir}/cache-swr",
+            f"ProxyPass / http://127.0.0.1:{backend.port}/",
+        ])
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        backend.stop()
+
+    # a stale entity is served at once, and refreshed in the background
+    def test_proxy_16_001(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/swr"
+        r = env.curl_get(url)
+        assert r.response["status"] == 200
+        assert r.response["body"] == b'1\n'
+        time.sleep(1.5)
+        start = time.time()
+        r = env.curl_get(url, options=['--http1.1'])
+        assert r.response["status"] == 200
+        assert r.response["body"] == b'1\n'
+        assert time.time() - start < 1.0
+        time.sleep(1.5)
+        r = env.curl_get(url)
+        assert r.response["status"] == 200
+        assert r.response["body"] == b'2\n'
+        assert self.backend.requests == 2
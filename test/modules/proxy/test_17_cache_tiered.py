@@ -0,0 +1,63 @@
+import re
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+from pyhttpd.env import HttpdTestEnv
+
+
+@pytest.mark.skipif(condition=not HttpdTestEnv.has_shared_module("cache_tiered"),
+                    reason="no mod_cache_tiered available")
+class TestProxyCacheTiered:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        conf = HttpdConf(env)
+        conf.add([
+            f"CacheSocache shmcb:{env.gen_dir}/cache-tiered-shmcb(1048576)",
+            "CacheTieredPromote 2",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable tiered /",
+            "CacheHeader on",
+            f"CacheRoot {env.gen_dir}/cache-tiered",
+            f"ProxyPass / http://127.0.0.1:{env.http_port}/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.add([
+            '<Location "/server-status">',
+            '  SetHandler server-status',
+            '</Location>',
+        ])
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def get_stats(self, env):
+        url = f"http://{env.d_reverse}:{env.http_port}/server-status?auto"
+        r = env.curl_get(url)
+        assert r.response["status"] == 200
+        stats = {}
+        for line in r.response["body"].decode().splitlines():
+            m = re.match(r'(CacheTiered\w+): (\d+)$', line)
+            if m:
+                stats[m.group(1)] = int(m.group(2))
+        return stats
+
+    # a response is stored on disk, then promoted to memory once hot
+    def test_proxy_17_001(self, env):
+        url = f"https://{env.d_reverse}:{env.https_port}/alive.json"
+        before = self.get_stats(env)
+        r1 = env.curl_get(url)
+        assert r1.response["status"] == 200
+        for i in range(2):
+            r = env.curl_get(url)
+            assert r.response["status"] == 200
+            assert r.response["header"]["x-cache"].startswith("HIT"), f"{r}"
+            assert r.response["body"] == r1.response["body"]
+        after = self.get_stats(env)
+        assert after["CacheTieredMisses"] - before["CacheTieredMisses"] == 1
+        assert after["CacheTieredDiskHits"] - before["CacheTieredDiskHits"] == 1
+        assert after["CacheTieredPromotions"] - before["CacheTieredPromotions"] == 1
+        assert after["CacheTieredMemoryHits"] - before["CacheTieredMemoryHits"] == 1
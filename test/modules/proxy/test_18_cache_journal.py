@@ -0,0 +1,51 @@
+import os
+import re
+
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+
+class TestProxyCacheJournal:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        TestProxyCacheJournal.root = os.path.join(env.gen_dir, 'cache-journal')
+        conf = HttpdConf(env)
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable disk /",
+            f"CacheRoot {self.root}",
+            "CacheJournal on",
+            f"ProxyPass / http://127.0.0.1:{env.http_port}/",
+        ])
+        conf.end_vhost()
+        conf.add_vhost(domains=[env.d_reverse], port=env.http_port, doc_root='htdocs/test1')
+        conf.install()
+        assert env.apache_restart() == 0
+
+    def get(self, env, path):
+        url = f"https://{env.d_reverse}:{env.https_port}{path}"
+        r = env.curl_get(url)
+        assert r.response["status"] == 200
+
+    def htcacheclean(self, env, limit):
+        r = env.run([os.path.join(env.bin_dir, 'htcacheclean'), '-j', '-v',
+                     f'-p{self.root}', f'-l{limit}'])
+        assert r.exit_code == 0, f'{r}'
+        m = re.search(r'total entries was (\d+), total entries now (\d+)', r.stderr)
+        assert m, f'{r}'
+        return int(m.group(1)), int(m.group(2))
+
+    # the index is built by a walk, then kept up to date from the journal
+    def test_proxy_18_001(self, env):
+        self.get(env, "/alive.json")
+        self.get(env, "/index.html")
+        assert os.path.exists(os.path.join(self.root, 'cache.journal'))
+        assert self.htcacheclean(env, '100M') == (2, 2)
+        assert os.path.exists(os.path.join(self.root, 'htcacheclean.index'))
+        assert not os.path.exists(os.path.join(self.root, 'cache.journal'))
+        self.get(env, "/001.html")
+        assert self.htcacheclean(env, '100M') == (3, 3)
+        assert self.htcacheclean(env, '1') == (3, 0)
+        assert self.htcacheclean(env, '100M') == (0, 0)
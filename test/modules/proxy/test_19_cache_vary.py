@@ -0,0 +1,74 @@
+import pytest
+
+from pyhttpd.conf import HttpdConf
+
+from .backend import HttpBackend
+
+
+def vary_backend():
+    """A backend answering with the Accept-Encoding it got, in a cacheable
+       response varying on it."""
+    def handle(request, count):
+        body = f"{request.headers.get('Accept-Encoding')}\n".encode()
+        HttpBackend.respond(request, body, {
+            'Cache-Control': 'max-age=60',
+            'Vary': 'Accept-Encoding',
+        })
+    return HttpBackend(handle)
+
+
+class TestProxyCacheVaryNormalize:
+
+    probe = "off"
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        backend = vary_backend()
+        backend.start()
+        type(self).backend = backend
+
+        conf = HttpdConf(env)
+        conf.add([
+            f"CacheSocache shmcb:{env.gen_dir}/cache-vary-{self.probe}-shmcb(1048576)",
+            "CacheVaryNormalize Accept-Encoding br gzip identity",
+            f"CacheVaryNormalizeProbe {self.probe}",
+        ])
+        conf.start_vhost(domains=[env.d_reverse], port=env.https_port)
+        conf.add([
+            "CacheEnable disk /disk/",
+            "CacheEnable socache /socache/",
+            f"CacheRoot {env.gen_dir}/cache-vary-{self.probe}",
+            f"ProxyPass / http://127.0.0.1:{backend.port}/",
+        ])
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        yield
+        backend.stop()
+
+    def get(self, env, path, accept_encoding=None):
+        url = f"https://{env.d_reverse}:{env.https_port}{path}"
+        options = ['-H', f'Accept-Encoding: {accept_encoding}'] \
+            if accept_encoding is not None else []
+        r = env.curl_get(url, options=options)
+        assert r.response["status"] == 200
+        return r.response["body"]
+
+    # the backend sees the buckets only, which key the variants
+    @pytest.mark.parametrize("provider", ["disk", "socache"])
+    def test_proxy_19_001(self, env, provider):
+        path = f"/{provider}/vary"
+        before = self.backend.requests
+        assert self.get(env, path, 'gzip, deflate, br') == b'br\n'
+        assert self.get(env, path, 'br;q=0.5, gzip') == b'br\n'
+        assert self.get(env, path, 'gzip, br;q=0') == b'gzip\n'
+        assert self.get(env, path, '*') == b'br\n'
+        assert self.get(env, path, 'deflate') == b'identity\n'
+        assert self.get(env, path) == b'identity\n'
+        assert self.backend.requests - before == 3
+
+
+# the same, the variants being looked up before the Vary
+class TestProxyCacheVaryNormalizeProbe(TestProxyCacheVaryNormalize):
+
+    probe = "on"